@@ -0,0 +1,263 @@
+#ifndef TINYTOML_SHM_H_
+#define TINYTOML_SHM_H_
+
+// SharedPublisher and SharedAttacher share a parsed document among the processes on a machine
+// through POSIX shared memory. It's available only on Linux.
+
+#include "toml.h"
+
+#if defined(__linux__)
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+TOML_NAMESPACE_BEGIN
+
+namespace internal {
+
+// The control object "/name". A document is published in "/name.<version>", and then |version|
+// is bumped. The version 0 means that nothing has been published.
+struct SharedControl {
+    char magic[8];
+    std::atomic<std::uint64_t> version;
+};
+
+const char kSharedMagic[8] = { 'T', 'O', 'M', 'L', 'S', 'H', 'M', '\0' };
+
+// An atomic shared between processes must not have a lock in the process.
+#if __cplusplus >= 201703L
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "std::atomic<uint64_t> must be lock-free");
+#else
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "std::atomic<uint64_t> must be lock-free");
+#endif
+
+inline std::string sharedControlName(const std::string& name)
+{
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+inline std::string sharedSegmentName(const std::string& name, std::uint64_t version)
+{
+    return sharedControlName(name) + "." + std::to_string(version);
+}
+
+// Maps the control object of |name|. Returns nullptr if it cannot be mapped.
+inline SharedControl* mapSharedControl(const std::string& name, bool writable)
+{
+    std::string controlName = sharedControlName(name);
+    int fd = writable ?
+        ::shm_open(controlName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644) :
+        ::shm_open(controlName.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 ||
+        (st.st_size == 0 && writable && ::ftruncate(fd, sizeof(SharedControl)) != 0) ||
+        (st.st_size != 0 && static_cast<size_t>(st.st_size) < sizeof(SharedControl)) ||
+        (st.st_size == 0 && !writable)) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    void* map = ::mmap(nullptr, sizeof(SharedControl), writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return nullptr;
+
+    SharedControl* control = static_cast<SharedControl*>(map);
+    if (writable && st.st_size == 0)
+        std::memcpy(control->magic, kSharedMagic, sizeof(kSharedMagic));
+    if (std::memcmp(control->magic, kSharedMagic, sizeof(kSharedMagic)) != 0) {
+        ::munmap(map, sizeof(SharedControl));
+        return nullptr;
+    }
+    return control;
+}
+
+} // namespace internal
+
+// SharedPublisher publishes documents under |name|. Each document is written once, with
+// serializeBinary(), into its own shared memory object, and then the version is bumped. The
+// previous object is unlinked, but it stays alive while a process maps it.
+//
+//   toml::SharedPublisher publisher("app-config");
+//   publisher.publish(toml::parseFile("/etc/app/config.toml").value);
+//
+// There must be one publisher of a name at a time. The objects remain after the publisher is
+// destroyed, until remove() is called.
+class SharedPublisher {
+public:
+    // Throws an exception if the control object cannot be created.
+    explicit SharedPublisher(std::string name);
+    ~SharedPublisher();
+
+    SharedPublisher(const SharedPublisher&) = delete;
+    SharedPublisher& operator=(const SharedPublisher&) = delete;
+
+    // Publishes |v|, and returns its version. Throws an exception on an error.
+    std::uint64_t publish(const Value& v);
+    // The version last published under the name, even by another publisher.
+    std::uint64_t version() const { return control_->version.load(std::memory_order_acquire); }
+
+    // Unlinks the shared memory objects of |name|. The processes mapping them are not affected.
+    static void remove(const std::string& name);
+
+private:
+    std::string name_;
+    internal::SharedControl* control_;
+};
+
+// SharedAttacher reads the documents published under |name| without copying them.
+// refresh() maps the latest version. load() returns the mapped document, which stays mapped while
+// the guard is alive, even after refresh() switches to a newer one.
+//
+//   toml::SharedAttacher attacher("app-config");
+//   attacher.refresh();
+//   if (auto doc = attacher.load())
+//       int port = doc->view().get<int>("server.port");
+//
+// load() may be called from any thread. refresh() must be called by one thread at a time.
+class SharedAttacher {
+public:
+    typedef BasicConfigHandle<BinaryFile>::Guard Guard;
+
+    // Does not fail even if nothing has been published yet.
+    explicit SharedAttacher(std::string name) : name_(std::move(name)), control_(nullptr), version_(0) {}
+    ~SharedAttacher();
+
+    SharedAttacher(const SharedAttacher&) = delete;
+    SharedAttacher& operator=(const SharedAttacher&) = delete;
+
+    // Maps the latest document if a newer one has been published. Returns true if it has switched.
+    bool refresh();
+    // Returns the mapped document. The guard is empty if nothing has been mapped.
+    Guard load() const { return handle_.load(); }
+    // The version of the mapped document, or 0.
+    std::uint64_t version() const { return version_.load(std::memory_order_acquire); }
+
+private:
+    std::string name_;
+    const internal::SharedControl* control_;
+    BasicConfigHandle<BinaryFile> handle_;
+    std::atomic<std::uint64_t> version_;
+};
+
+// ----------------------------------------------------------------------
+// Implementations
+
+inline SharedPublisher::SharedPublisher(std::string name) :
+    name_(std::move(name)),
+    control_(internal::mapSharedControl(name_, true))
+{
+    if (!control_)
+        failwith("could not create shared memory: ", internal::sharedControlName(name_), ": ", std::system_category().message(errno));
+}
+
+inline SharedPublisher::~SharedPublisher()
+{
+    ::munmap(control_, sizeof(internal::SharedControl));
+}
+
+inline std::uint64_t SharedPublisher::publish(const Value& v)
+{
+    const std::string bytes = serializeBinary(v);
+    const std::uint64_t previous = control_->version.load(std::memory_order_acquire);
+    const std::uint64_t version = previous + 1;
+    const std::string segmentName = internal::sharedSegmentName(name_, version);
+
+    // An object may be left by a publisher which crashed before bumping the version.
+    ::shm_unlink(segmentName.c_str());
+    int fd = ::shm_open(segmentName.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0)
+        failwith("could not create shared memory: ", segmentName, ": ", std::system_category().message(errno));
+
+    size_t written = 0;
+    while (written < bytes.size()) {
+        ssize_t n = ::write(fd, bytes.data() + written, bytes.size() - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            std::string reason = std::system_category().message(errno);
+            ::close(fd);
+            ::shm_unlink(segmentName.c_str());
+            failwith("could not write shared memory: ", segmentName, ": ", reason);
+        }
+        written += static_cast<size_t>(n);
+    }
+    ::close(fd);
+
+    control_->version.store(version, std::memory_order_release);
+    if (previous != 0)
+        ::shm_unlink(internal::sharedSegmentName(name_, previous).c_str());
+    return version;
+}
+
+inline void SharedPublisher::remove(const std::string& name)
+{
+    if (const internal::SharedControl* control = internal::mapSharedControl(name, false)) {
+        std::uint64_t version = control->version.load(std::memory_order_acquire);
+        ::munmap(const_cast<internal::SharedControl*>(control), sizeof(internal::SharedControl));
+        if (version != 0)
+            ::shm_unlink(internal::sharedSegmentName(name, version).c_str());
+    }
+    ::shm_unlink(internal::sharedControlName(name).c_str());
+}
+
+inline SharedAttacher::~SharedAttacher()
+{
+    if (control_)
+        ::munmap(const_cast<internal::SharedControl*>(control_), sizeof(internal::SharedControl));
+}
+
+inline bool SharedAttacher::refresh()
+{
+    if (!control_) {
+        control_ = internal::mapSharedControl(name_, false);
+        if (!control_)
+            return false;
+    }
+
+    while (true) {
+        std::uint64_t version = control_->version.load(std::memory_order_acquire);
+        if (version == 0 || version == version_.load(std::memory_order_relaxed))
+            return false;
+
+        std::string segmentName = internal::sharedSegmentName(name_, version);
+        int fd = ::shm_open(segmentName.c_str(), O_RDONLY | O_CLOEXEC, 0);
+        if (fd < 0) {
+            // The publisher has unlinked it after publishing a newer one.
+            if (errno == ENOENT && control_->version.load(std::memory_order_acquire) != version)
+                continue;
+            return false;
+        }
+
+        BinaryFile file;
+        try {
+            file = BinaryFile(fd, segmentName);
+        } catch (const std::exception&) {
+            ::close(fd);
+            return false;
+        }
+        ::close(fd);
+
+        handle_.publish(std::move(file));
+        version_.store(version, std::memory_order_release);
+        return true;
+    }
+}
+
+TOML_NAMESPACE_END // namespace toml
+
+#endif // defined(__linux__)
+
+#endif // TINYTOML_SHM_H_
@@ -2,541 +2,2787 @@
 #define TINYTOML_H_
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cctype>
+#include <cerrno>
 #include <chrono>
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <istream>
+#include <iterator>
+#include <limits>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <tuple>
+#include <type_traits>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
-namespace toml {
+#if defined(__linux__)
+#include <fcntl.h>
+#include <locale.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <xlocale.h>
+#elif defined(_MSC_VER)
+#include <locale.h>
+#endif
 
-// ----------------------------------------------------------------------
-// Declarations
+// The table policy, which is described at MapTablePolicy.
+#ifndef TOML_TABLE_POLICY
+#define TOML_TABLE_POLICY MapTablePolicy
+#endif
 
-class Value;
-typedef std::chrono::system_clock::time_point Time;
-typedef std::vector<Value> Array;
-typedef std::map<std::string, Value> Table;
+#define TOML_CONCAT_(a, b) a##b
+#define TOML_CONCAT(a, b) TOML_CONCAT_(a, b)
 
-namespace internal {
-template<typename T> struct call_traits_value {
-    typedef T return_type;
-};
-template<typename T> struct call_traits_ref {
-    typedef const T& return_type;
-};
-} // namespace internal
+// Everything is in an inline namespace named after the table policy, e.g. toml::FlatTablePolicy_,
+// so that translation units built with different policies fail to link with each other,
+// instead of silently breaking the one definition rule.
+#define TOML_NAMESPACE_BEGIN namespace toml { inline namespace TOML_CONCAT(TOML_TABLE_POLICY, _) {
+#define TOML_NAMESPACE_END } }
 
-template<typename T> struct call_traits;
-template<> struct call_traits<bool> : public internal::call_traits_value<bool> {};
-template<> struct call_traits<int> : public internal::call_traits_value<int> {};
-template<> struct call_traits<int64_t> : public internal::call_traits_value<int64_t> {};
-template<> struct call_traits<double> : public internal::call_traits_value<double> {};
-template<> struct call_traits<std::string> : public internal::call_traits_ref<std::string> {};
-template<> struct call_traits<Time> : public internal::call_traits_ref<Time> {};
-template<> struct call_traits<Array> : public internal::call_traits_ref<Array> {};
-template<> struct call_traits<Table> : public internal::call_traits_ref<Table> {};
+TOML_NAMESPACE_BEGIN
 
-// A value is returned for std::vector<T>. Not reference.
-// This is because a fresh vector is made.
-template<typename T> struct call_traits<std::vector<T>> : public internal::call_traits_value<std::vector<T>> {};
+// ----------------------------------------------------------------------
+// Declarations
 
-// Formatting flags
-enum FormatFlag {
-    FORMAT_NONE = 0,
-    FORMAT_INDENT = 1
+// Arena flags
+enum ArenaFlag {
+    ARENA_NONE = 0,
+    // Backs large blocks with transparent huge pages when the platform supports it.
+    ARENA_HUGE_PAGE = 1
 };
 
-class Value {
+// Arena is a monotonic allocator. Memory is carved from a few large blocks,
+// and it's released all at once when the arena is destroyed.
+//
+// When you parse with an arena, the nodes of the tables and arrays of the document, and their
+// storage, are allocated from it. Releasing the document still destroys each node, since a node
+// may be shared with a copy, but no node is freed one by one. String values, and the characters
+// of long keys, stay on the global heap.
+//
+// After parsing, the arena is sealed, and later insertions fall back to the global heap.
+// The allocator of each table and array refers to the arena, so it lives as long as any of them.
+//
+// Note: Arena itself is not thread-safe. Don't use an unsealed arena from multiple threads.
+class Arena {
 public:
-    enum Type {
-        NULL_TYPE,
-        BOOL_TYPE,
-        INT_TYPE,
-        DOUBLE_TYPE,
-        STRING_TYPE,
-        TIME_TYPE,
-        ARRAY_TYPE,
-        TABLE_TYPE,
-    };
+    explicit Arena(ArenaFlag flags = ARENA_NONE, size_t blockSize = 64 * 1024) :
+        flags_(flags), nextBlockSize_(blockSize), current_(nullptr), end_(nullptr), allocated_(0), sealed_(false) {}
+    ~Arena();
 
-    Value() : type_(NULL_TYPE), null_(nullptr) {}
-    Value(bool v) : type_(BOOL_TYPE), bool_(v) {}
-    Value(int v) : type_(INT_TYPE), int_(v) {}
-    Value(int64_t v) : type_(INT_TYPE), int_(v) {}
-    Value(double v) : type_(DOUBLE_TYPE), double_(v) {}
-    Value(const std::string& v) : type_(STRING_TYPE), string_(new std::string(v)) {}
-    Value(const char* v) : type_(STRING_TYPE), string_(new std::string(v)) {}
-    Value(const Time& v) : type_(TIME_TYPE), time_(new Time(v)) {}
-    Value(const Array& v) : type_(ARRAY_TYPE), array_(new Array(v)) {}
-    Value(const Table& v) : type_(TABLE_TYPE), table_(new Table(v)) {}
-    Value(std::string&& v) : type_(STRING_TYPE), string_(new std::string(std::move(v))) {}
-    Value(Array&& v) : type_(ARRAY_TYPE), array_(new Array(std::move(v))) {}
-    Value(Table&& v) : type_(TABLE_TYPE), table_(new Table(std::move(v))) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
 
-    Value(const Value& v);
-    Value(Value&& v) noexcept;
-    Value& operator=(const Value& v);
-    Value& operator=(Value&& v) noexcept;
+    void* allocate(size_t size, size_t alignment);
+    // Returns true if |p| points into a block of this arena.
+    bool owns(const void* p) const;
 
-    // Guards from unexpected Value construction.
-    // Someone might use a value like this:
-    //   toml::Value v = x->find("foo");
-    // But this is wrong. Without this constructor,
-    // value will be unexpectedly initialized with bool.
-    Value(const void* v) = delete;
-    ~Value();
+    // After sealed, ArenaAllocator doesn't allocate from this arena any more.
+    void seal() { sealed_ = true; }
+    bool sealed() const { return sealed_; }
 
-    // Retruns Value size.
-    // 0 for invalid value.
-    // The number of inner elements for array or table.
-    // 1 for other types.
-    size_t size() const;
-    bool empty() const;
-    Type type() const { return type_; }
+    // Returns the number of bytes handed out by allocate().
+    size_t allocatedBytes() const { return allocated_; }
+    size_t blockCount() const { return blocks_.size(); }
 
-    bool valid() const { return type_ != NULL_TYPE; }
-    template<typename T> bool is() const;
-    template<typename T> typename call_traits<T>::return_type as() const;
+private:
+    struct Block {
+        char* begin;
+        size_t size;
+        bool mapped;
+    };
 
-    friend bool operator==(const Value& lhs, const Value& rhs);
-    friend bool operator!=(const Value& lhs, const Value& rhs) { return !(lhs == rhs); }
+    void addBlock(size_t minSize);
 
-    // ----------------------------------------------------------------------
-    // For integer/floating value
+    ArenaFlag flags_;
+    size_t nextBlockSize_;
+    char* current_;
+    char* end_;
+    size_t allocated_;
+    bool sealed_;
+    // Sorted by address so that owns() can do binary search.
+    std::vector<Block> blocks_;
+};
 
-    // Returns true if the value is int or double.
-    bool isNumber() const;
-    // Returns number. Convert to double.
-    double asNumber() const;
+namespace internal {
 
-    // ----------------------------------------------------------------------
-    // For Time value
+// An allocator which allocates from an Arena if it has a (non-sealed) one,
+// and from the global heap otherwise. A default-constructed ArenaAllocator
+// just uses the global heap, so Table() and Array() behave as usual.
+template<typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
 
-    // Converts to time_t if the internal value is Time.
-    // We don't have as<std::time_t>(). Since time_t is basically signed long,
-    // it's something like a method to converting to (normal) integer.
-    std::time_t as_time_t() const;
+    ArenaAllocator() noexcept {}
+    explicit ArenaAllocator(std::shared_ptr<Arena> arena) noexcept : arena_(std::move(arena)) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena_(other.arena()) {}
 
-    // ----------------------------------------------------------------------
-    // For Table value
-    template<typename T> typename call_traits<T>::return_type get(const std::string&) const;
-    Value* set(const std::string& key, const Value& v);
-    // Finds a Value with |key|. |key| can contain '.'
-    // Note: if you would like to find a child value only, you need to use findChild.
-    const Value* find(const std::string& key) const;
-    Value* find(const std::string& key);
-    bool has(const std::string& key) const { return find(key) != nullptr; }
-    bool erase(const std::string& key);
+    T* allocate(size_t n)
+    {
+        if (arena_ && !arena_->sealed())
+            return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
 
-    Value& operator[](const std::string& key);
+    void deallocate(T* p, size_t)
+    {
+        // Memory in an arena is released when the arena is destroyed.
+        if (arena_ && arena_->owns(p))
+            return;
+        ::operator delete(p);
+    }
 
-    // Merge table. Returns true if succeeded. Otherwise, |this| might be corrupted.
-    // When the same key exists, it will be overwritten.
-    bool merge(const Value&);
+    // A copied container doesn't belong to the arena.
+    ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
 
-    // Finds a value with |key|. It searches only children.
-    Value* findChild(const std::string& key);
-    const Value* findChild(const std::string& key) const;
-    // Sets a value, and returns the pointer to the created value.
-    // When the value having the same key exists, it will be overwritten.
-    Value* setChild(const std::string& key, const Value& v);
-    Value* setChild(const std::string& key, Value&& v);
-    bool eraseChild(const std::string& key);
+    const std::shared_ptr<Arena>& arena() const { return arena_; }
 
-    // ----------------------------------------------------------------------
-    // For Array value
+private:
+    std::shared_ptr<Arena> arena_;
+};
 
-    template<typename T> typename call_traits<T>::return_type get(size_t index) const;
-    const Value* find(size_t index) const;
-    Value* find(size_t index);
-    Value* push(const Value& v);
-    Value* push(Value&& v);
+template<typename T, typename U>
+inline bool operator==(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) { return lhs.arena() == rhs.arena(); }
+template<typename T, typename U>
+inline bool operator!=(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) { return !(lhs == rhs); }
 
-    // ----------------------------------------------------------------------
-    // Others
+} // namespace internal
 
-    // Writer.
-    static std::string spaces(int num);
-    static std::string escapeKey(const std::string& key);
+// Key is an immutable table key used by InternedTablePolicy.
+// Keys interned into the same KeyPool share one string, and comparing them for equality is
+// usually a pointer comparison. A Key is a shared_ptr to the string, i.e. two pointers per table
+// entry, and copying it, e.g. when a table is cloned on write, increments an atomic count.
+// A Key constructed from a string is interned into KeyPool::current() if any.
+class Key {
+public:
+    Key(const std::string& s);
+    Key(const char* s) : Key(std::string(s)) {}
 
-    void write(std::ostream*, const std::string& keyPrefix = std::string(), int indent = -1) const;
-    void writeFormatted(std::ostream*, FormatFlag flags) const;
+    const std::string& str() const { return *str_; }
+    operator const std::string&() const { return *str_; }
 
-    friend std::ostream& operator<<(std::ostream&, const Value&);
+    friend bool operator==(const Key& lhs, const Key& rhs) { return lhs.str_ == rhs.str_ || *lhs.str_ == *rhs.str_; }
+    friend bool operator==(const Key& lhs, const std::string& rhs) { return *lhs.str_ == rhs; }
+    friend bool operator==(const std::string& lhs, const Key& rhs) { return lhs == *rhs.str_; }
+    friend bool operator!=(const Key& lhs, const Key& rhs) { return !(lhs == rhs); }
+    friend bool operator!=(const Key& lhs, const std::string& rhs) { return !(lhs == rhs); }
+    friend bool operator!=(const std::string& lhs, const Key& rhs) { return !(lhs == rhs); }
+    friend bool operator<(const Key& lhs, const Key& rhs) { return lhs.str_ != rhs.str_ && *lhs.str_ < *rhs.str_; }
+    friend bool operator<(const Key& lhs, const std::string& rhs) { return *lhs.str_ < rhs; }
+    friend bool operator<(const std::string& lhs, const Key& rhs) { return lhs < *rhs.str_; }
+
+    friend std::ostream& operator<<(std::ostream& os, const Key& key) { return os << *key.str_; }
 
 private:
-    static const char* typeToString(Type);
+    friend class KeyPool;
+    explicit Key(std::shared_ptr<const std::string> s) : str_(std::move(s)) {}
 
-    template<typename T> void assureType() const;
-    Value* ensureValue(const std::string& key);
+    std::shared_ptr<const std::string> str_;
+};
 
-    template<typename T> struct ValueConverter;
+// KeyPool interns table keys. It can be shared by many documents, and by many threads.
+// Keys keep their string alive, so documents may outlive the pool.
+//
+//   toml::KeyPool pool;
+//   toml::ParseOptions options;
+//   options.keyPool = &pool;
+//   toml::ParseResult pr = toml::parse(ifs, options);
+class KeyPool {
+public:
+    KeyPool() {}
+    KeyPool(const KeyPool&) = delete;
+    KeyPool& operator=(const KeyPool&) = delete;
 
-    Type type_;
-    union {
-        void* null_;
-        bool bool_;
-        int64_t int_;
-        double double_;
-        std::string* string_;
-        Time* time_;
-        Array* array_;
-        Table* table_;
-    };
+    Key intern(const std::string& s);
+    // The number of distinct keys.
+    size_t size() const;
 
-    template<typename T> friend struct ValueConverter;
-};
+    // While Scope is alive, Keys constructed in this thread are interned into |pool|.
+    class Scope {
+    public:
+        explicit Scope(KeyPool* pool) : previous_(current()) { current() = pool; }
+        ~Scope() { current() = previous_; }
 
-// parse() returns ParseResult.
-struct ParseResult {
-    ParseResult(toml::Value v, std::string er) :
-        value(std::move(v)),
-        errorReason(std::move(er)) {}
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
 
-    bool valid() const { return value.valid(); }
+    private:
+        KeyPool* previous_;
+    };
 
-    toml::Value value;
-    std::string errorReason;
-};
+    static KeyPool*& current()
+    {
+        static thread_local KeyPool* pool = nullptr;
+        return pool;
+    }
 
-// Parses from std::istream.
-ParseResult parse(std::istream&);
-// Parses a file.
-ParseResult parseFile(const std::string& filename);
+private:
+    struct Hash {
+        size_t operator()(const std::shared_ptr<const std::string>& s) const { return std::hash<std::string>()(*s); }
+    };
+    struct Equal {
+        bool operator()(const std::shared_ptr<const std::string>& lhs, const std::shared_ptr<const std::string>& rhs) const
+        {
+            return *lhs == *rhs;
+        }
+    };
 
-// ----------------------------------------------------------------------
-// Declarations for Implementations
-//   You don't need to understand the below to use this library.
+    mutable std::mutex mu_;
+    std::unordered_set<std::shared_ptr<const std::string>, Hash, Equal> keys_;
+};
 
-#if defined(_WIN32)
-// Windows does not have timegm but have _mkgmtime.
-inline time_t timegm(std::tm* timeptr)
+inline Key::Key(const std::string& s)
 {
-    return _mkgmtime(timeptr);
+    if (KeyPool* pool = KeyPool::current())
+        str_ = pool->intern(s).str_;
+    else
+        str_ = std::make_shared<const std::string>(s);
 }
 
-// On Windows, Visual Studio does not define gmtime_r. However, mingw might
-// do (or might not do). See https://github.com/mayah/tinytoml/issues/25,
-#ifndef gmtime_r
-inline struct tm* gmtime_r(const time_t* t, struct tm* r)
+inline Key KeyPool::intern(const std::string& s)
 {
-    // gmtime is threadsafe in windows because it uses TLS
-    struct tm *theTm = gmtime(t);
-    if (theTm) {
-        *r = *theTm;
-        return r;
-    } else {
-        return 0;
-    }
+    // Aliasing an empty shared_ptr, so that looking up doesn't allocate.
+    std::shared_ptr<const std::string> probe(std::shared_ptr<const std::string>(), &s);
+
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = keys_.find(probe);
+    if (it != keys_.end())
+        return Key(*it);
+
+    std::shared_ptr<const std::string> interned = std::make_shared<const std::string>(s);
+    keys_.insert(interned);
+    return Key(std::move(interned));
 }
-#endif  // gmtime_r
-#endif  // _WIN32
 
-namespace internal {
+inline size_t KeyPool::size() const
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    return keys_.size();
+}
 
-enum class TokenType {
-    ERROR_TOKEN,
-    END_OF_FILE,
-    END_OF_LINE,
-    IDENT,
-    STRING,
-    MULTILINE_STRING,
-    BOOL,
-    INT,
-    DOUBLE,
-    TIME,
-    COMMA,
-    DOT,
-    EQUAL,
-    LBRACKET,
-    RBRACKET,
-    LBRACE,
-    RBRACE,
-};
+namespace internal {
 
-class Token {
+// FlatMap is a map on a sorted vector. Lookup is a binary search over contiguous keys.
+// Inserting a key into the middle is O(n), so it's suitable for read-mostly tables.
+template<typename K, typename V, typename Alloc>
+class FlatMap {
 public:
-    explicit Token(TokenType tokenType) : type_(tokenType) {}
-    Token(TokenType tokenType, const std::string& v) : type_(tokenType), str_value_(v) {}
-    Token(TokenType tokenType, bool v) : type_(tokenType), int_value_(v) {}
-    Token(TokenType tokenType, std::int64_t v) : type_(tokenType), int_value_(v) {}
-    Token(TokenType tokenType, double v) : type_(tokenType), double_value_(v) {}
-    Token(TokenType tokenType, std::chrono::system_clock::time_point tp) : type_(tokenType), time_value_(tp) {}
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<K, V> value_type;
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<value_type> allocator_type;
+    typedef std::vector<value_type, allocator_type> container_type;
+    typedef typename container_type::iterator iterator;
+    typedef typename container_type::const_iterator const_iterator;
+    typedef typename container_type::size_type size_type;
+
+    FlatMap() {}
+    explicit FlatMap(const allocator_type& alloc) : items_(alloc) {}
+
+    iterator begin() { return items_.begin(); }
+    iterator end() { return items_.end(); }
+    const_iterator begin() const { return items_.begin(); }
+    const_iterator end() const { return items_.end(); }
+
+    size_type size() const { return items_.size(); }
+    bool empty() const { return items_.empty(); }
+    void clear() { items_.clear(); }
+    void reserve(size_type n) { items_.reserve(n); }
+    allocator_type get_allocator() const { return items_.get_allocator(); }
+
+    iterator lower_bound(const std::string& key)
+    {
+        return std::lower_bound(items_.begin(), items_.end(), key, KeyLess());
+    }
+    const_iterator lower_bound(const std::string& key) const
+    {
+        return std::lower_bound(items_.begin(), items_.end(), key, KeyLess());
+    }
 
-    TokenType type() const { return type_; }
-    const std::string& strValue() const { return str_value_; }
-    bool boolValue() const { return int_value_ != 0; }
-    std::int64_t intValue() const { return int_value_; }
-    double doubleValue() const { return double_value_; }
-    std::chrono::system_clock::time_point timeValue() const { return time_value_; }
+    iterator find(const std::string& key)
+    {
+        auto it = lower_bound(key);
+        return (it != items_.end() && it->first == key) ? it : items_.end();
+    }
+    const_iterator find(const std::string& key) const
+    {
+        auto it = lower_bound(key);
+        return (it != items_.end() && it->first == key) ? it : items_.end();
+    }
+    size_type count(const std::string& key) const { return find(key) != end() ? 1 : 0; }
 
-private:
-    TokenType type_;
-    std::string str_value_;
-    std::int64_t int_value_;
-    double double_value_;
-    std::chrono::system_clock::time_point time_value_;
-};
+    V& operator[](const std::string& key)
+    {
+        auto it = lower_bound(key);
+        if (it == items_.end() || it->first != key)
+            it = items_.emplace(it, key, V());
+        return it->second;
+    }
 
-class Lexer {
-public:
-    explicit Lexer(std::istream& is) : is_(is), lineNo_(1) {}
+    template<typename KK, typename M>
+    std::pair<iterator, bool> emplace(KK&& key, M&& value)
+    {
+        const std::string& k = key;
+        auto it = lower_bound(k);
+        if (it != items_.end() && it->first == k)
+            return std::make_pair(it, false);
+        return std::make_pair(items_.emplace(it, std::forward<KK>(key), std::forward<M>(value)), true);
+    }
 
-    Token nextKeyToken();
-    Token nextValueToken();
+    // When keys are inserted in sorted order with hint end(), each insertion is O(1).
+    template<typename KK, typename M>
+    iterator emplace_hint(const_iterator hint, KK&& key, M&& value)
+    {
+        const std::string& k = key;
+        iterator pos = items_.begin() + (hint - items_.begin());
+        if ((pos == items_.begin() || (pos - 1)->first < k) && (pos == items_.end() || k < pos->first))
+            return items_.emplace(pos, std::forward<KK>(key), std::forward<M>(value));
+        return emplace(std::forward<KK>(key), std::forward<M>(value)).first;
+    }
 
-    int lineNo() const { return lineNo_; }
+    // Constructs the value from |args| if |key| doesn't exist. Otherwise, does nothing.
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const std::string& key, Args&&... args)
+    {
+        auto it = lower_bound(key);
+        if (it != items_.end() && it->first == key)
+            return std::make_pair(it, false);
+        it = items_.emplace(it, std::piecewise_construct, std::forward_as_tuple(key),
+                            std::forward_as_tuple(std::forward<Args>(args)...));
+        return std::make_pair(it, true);
+    }
 
-    // Skips if UTF8BOM is found.
-    // Returns true if success. Returns false if intermediate state is left.
-    bool skipUTF8BOM();
+    std::pair<iterator, bool> insert(const value_type& v) { return emplace(v.first, v.second); }
+    std::pair<iterator, bool> insert(value_type&& v) { return emplace(std::move(v.first), std::move(v.second)); }
 
-private:
-    bool current(char* c);
-    void next();
-    bool consume(char c);
+    iterator erase(const_iterator it) { return items_.erase(items_.begin() + (it - items_.begin())); }
+    size_type erase(const std::string& key)
+    {
+        auto it = find(key);
+        if (it == items_.end())
+            return 0;
+        items_.erase(it);
+        return 1;
+    }
 
-    Token nextToken(bool isValueToken);
+    // Merges |src|, which is sorted by the keys, in one pass. merge(V&, item) is called for the
+    // keys in both, and make(item) returns the value for a key only in |src|. The result is built
+    // in a new vector, since inserting into the middle would shift the tail. O(n + m).
+    template<typename Src, typename Merge, typename Make>
+    void mergeSorted(Src& src, Merge merge, Make make)
+    {
+        container_type merged(items_.get_allocator());
+        merged.reserve(items_.size() + src.size());
+        auto it = items_.begin();
+        for (auto&& kv : src) {
+            const std::string& key = kv.first;
+            for (; it != items_.end() && static_cast<const std::string&>(it->first) < key; ++it)
+                merged.push_back(std::move(*it));
+
+            if (it != items_.end() && it->first == key) {
+                merge(it->second, kv);
+                merged.push_back(std::move(*it));
+                ++it;
+            } else {
+                merged.emplace_back(kv.first, make(kv));
+            }
+        }
+        std::move(it, items_.end(), std::back_inserter(merged));
+        items_.swap(merged);
+    }
 
-    void skipUntilNewLine();
+    friend bool operator==(const FlatMap& lhs, const FlatMap& rhs) { return lhs.items_ == rhs.items_; }
+    friend bool operator!=(const FlatMap& lhs, const FlatMap& rhs) { return !(lhs == rhs); }
 
-    Token nextStringDoubleQuote();
-    Token nextStringSingleQuote();
+private:
+    struct KeyLess {
+        bool operator()(const value_type& lhs, const std::string& rhs) const { return lhs.first < rhs; }
+    };
 
-    Token nextKey();
-    Token nextValue();
+    container_type items_;
+};
 
-    Token parseAsTime(const std::string&);
+// Merges the sorted table |src| into the sorted table |dst| as FlatMap::mergeSorted() does.
+// A tree takes the new keys with a hint, which is amortized O(1) as the merge-join moves forward.
+template<typename Table, typename Src, typename Merge, typename Make>
+inline void mergeSorted(Table& dst, Src& src, Merge merge, Make make)
+{
+    auto it = dst.begin();
+    for (auto&& kv : src) {
+        const std::string& key = kv.first;
+        while (it != dst.end() && static_cast<const std::string&>(it->first) < key)
+            ++it;
+
+        if (it != dst.end() && it->first == key)
+            merge(it->second, kv);
+        else
+            it = dst.emplace_hint(it, kv.first, make(kv));
+        ++it;
+    }
+}
 
-    std::istream& is_;
-    int lineNo_;
-};
+template<typename K, typename V, typename Alloc, typename Src, typename Merge, typename Make>
+inline void mergeSorted(FlatMap<K, V, Alloc>& dst, Src& src, Merge merge, Make make)
+{
+    dst.mergeSorted(src, merge, make);
+}
 
-class Parser {
+// OrderedMap keeps keys in insertion order. Small tables are searched linearly.
+// Larger ones have an open addressing index into the items.
+template<typename V, typename Alloc>
+class OrderedMap {
 public:
-    explicit Parser(std::istream& is) : lexer_(is), token_(TokenType::ERROR_TOKEN)
+    typedef std::string key_type;
+    typedef V mapped_type;
+    typedef std::pair<std::string, V> value_type;
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<value_type> allocator_type;
+    typedef std::vector<value_type, allocator_type> container_type;
+    typedef typename container_type::iterator iterator;
+    typedef typename container_type::const_iterator const_iterator;
+    typedef typename container_type::size_type size_type;
+
+    OrderedMap() {}
+    explicit OrderedMap(const allocator_type& alloc) : items_(alloc) {}
+
+    iterator begin() { return items_.begin(); }
+    iterator end() { return items_.end(); }
+    const_iterator begin() const { return items_.begin(); }
+    const_iterator end() const { return items_.end(); }
+
+    size_type size() const { return items_.size(); }
+    bool empty() const { return items_.empty(); }
+    void clear() { items_.clear(); index_.clear(); }
+    void reserve(size_type n) { items_.reserve(n); }
+    allocator_type get_allocator() const { return items_.get_allocator(); }
+
+    iterator find(const std::string& key) { return items_.begin() + findPosition(key); }
+    const_iterator find(const std::string& key) const { return items_.begin() + findPosition(key); }
+    size_type count(const std::string& key) const { return find(key) != end() ? 1 : 0; }
+
+    V& operator[](const std::string& key)
     {
-        if (!lexer_.skipUTF8BOM()) {
-            token_ = Token(TokenType::ERROR_TOKEN, std::string("Invalid UTF8 BOM"));
-        } else {
-            nextKey();
-        }
+        auto it = find(key);
+        if (it != items_.end())
+            return it->second;
+        return append(key, V())->second;
     }
 
-    // Parses. If failed, value should be invalid value.
-    // You can get the error by calling errorReason().
-    Value parse();
-    const std::string& errorReason();
-
-private:
-    const Token& token() const { return token_; }
-    void nextKey() { token_ = lexer_.nextKeyToken(); }
-    void nextValue() { token_ = lexer_.nextValueToken(); }
+    template<typename K, typename M>
+    std::pair<iterator, bool> emplace(K&& key, M&& value)
+    {
+        auto it = find(key);
+        if (it != items_.end())
+            return std::make_pair(it, false);
+        return std::make_pair(append(std::forward<K>(key), std::forward<M>(value)), true);
+    }
 
-    void skipForKey();
-    void skipForValue();
+    template<typename K, typename M>
+    iterator emplace_hint(const_iterator, K&& key, M&& value)
+    {
+        return emplace(std::forward<K>(key), std::forward<M>(value)).first;
+    }
 
-    bool consumeForKey(TokenType);
-    bool consumeForValue(TokenType);
-    bool consumeEOLorEOFForKey();
+    // Constructs the value from |args| if |key| doesn't exist. Otherwise, does nothing.
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const std::string& key, Args&&... args)
+    {
+        auto it = find(key);
+        if (it != items_.end())
+            return std::make_pair(it, false);
+        items_.emplace_back(std::piecewise_construct, std::forward_as_tuple(key),
+                            std::forward_as_tuple(std::forward<Args>(args)...));
+        return std::make_pair(indexBack(), true);
+    }
 
-    Value* parseGroupKey(Value* root);
+    std::pair<iterator, bool> insert(const value_type& v) { return emplace(v.first, v.second); }
+    std::pair<iterator, bool> insert(value_type&& v) { return emplace(std::move(v.first), std::move(v.second)); }
 
-    bool parseKeyValue(Value*);
-    bool parseKey(std::string*);
-    bool parseValue(Value*);
-    bool parseBool(Value*);
-    bool parseNumber(Value*);
-    bool parseArray(Value*);
-    bool parseInlineTable(Value*);
+    iterator erase(const_iterator it)
+    {
+        size_type pos = it - items_.begin();
+        items_.erase(items_.begin() + pos);
+        rebuildIndex();
+        return items_.begin() + pos;
+    }
+    size_type erase(const std::string& key)
+    {
+        auto it = find(key);
+        if (it == items_.end())
+            return 0;
+        erase(it);
+        return 1;
+    }
 
-    void addError(const std::string& reason);
+    // Two tables are equal when they have the same key-value pairs, regardless of the order.
+    friend bool operator==(const OrderedMap& lhs, const OrderedMap& rhs)
+    {
+        if (lhs.size() != rhs.size())
+            return false;
+        for (const auto& kv : lhs) {
+            auto it = rhs.find(kv.first);
+            if (it == rhs.end() || !(it->second == kv.second))
+                return false;
+        }
+        return true;
+    }
+    friend bool operator!=(const OrderedMap& lhs, const OrderedMap& rhs) { return !(lhs == rhs); }
 
-    Lexer lexer_;
-    Token token_;
-    std::string errorReason_;
-};
+private:
+    static const size_type LINEAR_SEARCH_LIMIT = 8;
 
-} // namespace internal
+    size_type findPosition(const std::string& key) const
+    {
+        if (index_.empty()) {
+            for (size_type i = 0; i < items_.size(); ++i) {
+                if (items_[i].first == key)
+                    return i;
+            }
+            return items_.size();
+        }
 
-// ----------------------------------------------------------------------
-// Implementations
+        size_type mask = index_.size() - 1;
+        for (size_type i = std::hash<std::string>()(key) & mask; index_[i] != 0; i = (i + 1) & mask) {
+            if (items_[index_[i] - 1].first == key)
+                return index_[i] - 1;
+        }
+        return items_.size();
+    }
 
-inline ParseResult parse(std::istream& is)
-{
-    if (!is) {
-        return ParseResult(toml::Value(), "stream is in bad state. file does not exist?");
+    template<typename K, typename M>
+    iterator append(K&& key, M&& value)
+    {
+        items_.emplace_back(std::forward<K>(key), std::forward<M>(value));
+        return indexBack();
     }
 
-    internal::Parser parser(is);
-    toml::Value v = parser.parse();
+    // Adds the last item to the index.
+    iterator indexBack()
+    {
+        if (items_.size() > LINEAR_SEARCH_LIMIT) {
+            if (index_.size() < items_.size() * 2)
+                rebuildIndex();
+            else
+                addIndex(items_.size() - 1);
+        }
+        return items_.end() - 1;
+    }
 
-    if (v.valid())
-        return ParseResult(std::move(v), std::string());
+    void addIndex(size_type pos)
+    {
+        size_type mask = index_.size() - 1;
+        size_type i = std::hash<std::string>()(items_[pos].first) & mask;
+        while (index_[i] != 0)
+            i = (i + 1) & mask;
+        index_[i] = static_cast<std::uint32_t>(pos + 1);
+    }
 
-    return ParseResult(std::move(v), std::move(parser.errorReason()));
-}
+    void rebuildIndex()
+    {
+        index_.clear();
+        if (items_.size() <= LINEAR_SEARCH_LIMIT)
+            return;
 
-inline ParseResult parseFile(const std::string& filename)
-{
-    std::ifstream ifs(filename);
-    if (!ifs) {
-        return ParseResult(toml::Value(),
-                           std::string("could not open file: ") + filename);
+        size_type n = 16;
+        while (n < items_.size() * 4)
+            n *= 2;
+        index_.assign(n, 0);
+        for (size_type i = 0; i < items_.size(); ++i)
+            addIndex(i);
     }
 
-    return parse(ifs);
-}
+    container_type items_;
+    // Position + 1 of items_. 0 is an empty slot.
+    std::vector<std::uint32_t> index_;
+};
 
-inline std::string format(std::stringstream& ss)
+// Constructs the value of |key| from |args| in |table| if |key| doesn't exist, with one lookup.
+// Returns the iterator to the value, and whether it has been constructed. |args| are not used
+// if |key| exists.
+//
+// A hash table is looked up twice, since its emplace() would construct the value before the lookup.
+template<typename Table, typename... Args>
+inline std::pair<typename Table::iterator, bool> tryEmplace(Table& table, const std::string& key, Args&&... args)
 {
-    return ss.str();
+    auto it = table.find(key);
+    if (it != table.end())
+        return std::make_pair(it, false);
+    return table.emplace(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
 }
 
-template<typename T, typename... Args>
-std::string format(std::stringstream& ss, T&& t, Args&&... args)
+template<typename V, typename Compare, typename Alloc, typename... Args>
+inline std::pair<typename std::map<std::string, V, Compare, Alloc>::iterator, bool>
+tryEmplace(std::map<std::string, V, Compare, Alloc>& table, const std::string& key, Args&&... args)
 {
-    ss << std::forward<T>(t);
-    return format(ss, std::forward<Args>(args)...);
+    auto it = table.lower_bound(key);
+    if (it != table.end() && it->first == key)
+        return std::make_pair(it, false);
+    it = table.emplace_hint(it, std::piecewise_construct, std::forward_as_tuple(key),
+                            std::forward_as_tuple(std::forward<Args>(args)...));
+    return std::make_pair(it, true);
 }
 
-// If you want to compile without exception,
-//   1. Define TOML_HAVE_FAILWITH_REPLACEMENT
-//   2. Define your own toml::failwith.
-// e.g. You can just abort here instead of exception.
-#ifndef TOML_HAVE_FAILWITH_REPLACEMENT
+template<typename K, typename V, typename Alloc, typename... Args>
+inline std::pair<typename FlatMap<K, V, Alloc>::iterator, bool> tryEmplace(FlatMap<K, V, Alloc>& table, const std::string& key, Args&&... args)
+{
+    return table.try_emplace(key, std::forward<Args>(args)...);
+}
 
-template<typename... Args>
-#if defined(_MSC_VER)
-__declspec(noreturn)
-#else
-[[noreturn]]
-#endif
-void failwith(Args&&... args)
+template<typename V, typename Alloc, typename... Args>
+inline std::pair<typename OrderedMap<V, Alloc>::iterator, bool> tryEmplace(OrderedMap<V, Alloc>& table, const std::string& key, Args&&... args)
 {
-    std::stringstream ss;
-    throw std::runtime_error(format(ss, std::forward<Args>(args)...));
+    return table.try_emplace(key, std::forward<Args>(args)...);
 }
 
-#endif
+} // namespace internal
 
-namespace internal {
+// Table policies decide the container of Table. The default is std::map.
+// If you want to use another one, define TOML_TABLE_POLICY to its name in namespace toml
+// before including this file, e.g.
+//   #define TOML_TABLE_POLICY FlatTablePolicy
+// All the translation units in a program must use the same policy. Otherwise they fail to link.
+struct MapTablePolicy {
+    // true if a table iterates its keys in sorted order.
+    static const bool sorted = true;
+    template<typename V>
+    using table = std::map<std::string, V, std::less<std::string>,
+                           internal::ArenaAllocator<std::pair<const std::string, V>>>;
+};
 
-inline std::string removeDelimiter(const std::string& s)
-{
-    std::string r;
-    for (char c : s) {
-        if (c == '_')
-            continue;
-        r += c;
-    }
-    return r;
-}
+// A sorted vector. Fast lookup and iteration, but slow insertion into the middle.
+struct FlatTablePolicy {
+    static const bool sorted = true;
+    template<typename V>
+    using table = internal::FlatMap<std::string, V, internal::ArenaAllocator<std::pair<std::string, V>>>;
+};
 
-inline std::string unescape(const std::string& codepoint)
-{
-    std::uint32_t x;
-    std::uint8_t buf[8];
-    std::stringstream ss(codepoint);
+// std::unordered_map. Keys are iterated in unspecified order.
+struct HashTablePolicy {
+    static const bool sorted = false;
+    template<typename V>
+    using table = std::unordered_map<std::string, V, std::hash<std::string>, std::equal_to<std::string>,
+                                     internal::ArenaAllocator<std::pair<const std::string, V>>>;
+};
 
-    ss >> std::hex >> x;
+// Keeps the insertion order. A written document has the keys in the order they were set.
+struct OrderedTablePolicy {
+    static const bool sorted = false;
+    template<typename V>
+    using table = internal::OrderedMap<V, internal::ArenaAllocator<std::pair<std::string, V>>>;
+};
 
-    if (x <= 0x7FUL) {
-        // 0xxxxxxx
-        buf[0] = 0x00 | ((x >> 0) & 0x7F);
-        buf[1] = '\0';
-    } else if (x <= 0x7FFUL) {
-        // 110yyyyx 10xxxxxx
-        buf[0] = 0xC0 | ((x >> 6) & 0xDF);
-        buf[1] = 0x80 | ((x >> 0) & 0xBF);
-        buf[2] = '\0';
-    } else if (x <= 0xFFFFUL) {
-        // 1110yyyy 10yxxxxx 10xxxxxx
-        buf[0] = 0xE0 | ((x >> 12) & 0xEF);
-        buf[1] = 0x80 | ((x >> 6) & 0xBF);
-        buf[2] = 0x80 | ((x >> 0) & 0xBF);
-        buf[3] = '\0';
-    } else if (x <= 0x10FFFFUL) {
-        // 11110yyy 10yyxxxx 10xxxxxx 10xxxxxx
-        buf[0] = 0xF0 | ((x >> 18) & 0xF7);
-        buf[1] = 0x80 | ((x >> 12) & 0xBF);
-        buf[2] = 0x80 | ((x >> 6) & 0xBF);
-        buf[3] = 0x80 | ((x >> 0) & 0xBF);
-        buf[4] = '\0';
-    } else {
-        buf[0] = '\0';
-    }
+// Keys are Key, which are interned into a KeyPool while parsing with ParseOptions::keyPool.
+// A table is a sorted vector of (Key, Value). It's suitable for a large number of tables
+// sharing the same set of keys, e.g. a long array of tables.
+struct InternedTablePolicy {
+    static const bool sorted = true;
+    template<typename V>
+    using table = internal::FlatMap<Key, V, internal::ArenaAllocator<std::pair<Key, V>>>;
+};
 
-    return reinterpret_cast<char*>(buf);
-}
+typedef TOML_TABLE_POLICY TablePolicy;
 
-// Returns true if |s| is integer.
-// [+-]?\d+(_\d+)*
-inline bool isInteger(const std::string& s)
-{
-    if (s.empty())
-        return false;
+class Value;
+class RecordView;
+struct Patch;
+class Path;
+class Slot;
+typedef std::chrono::system_clock::time_point Time;
+typedef std::vector<Value, internal::ArenaAllocator<Value>> Array;
+typedef TablePolicy::table<Value> Table;
 
-    std::string::size_type p = 0;
-    if (s[p] == '+' || s[p] == '-')
-        ++p;
+namespace internal {
 
-    while (p < s.size() && '0' <= s[p] && s[p] <= '9') {
-        ++p;
-        if (p < s.size() && s[p] == '_') {
-            ++p;
-            if (!(p < s.size() && '0' <= s[p] && s[p] <= '9'))
-                return false;
-        }
+class PackedArray;
+class Parser;
+
+// Node is a reference-counted payload of Value. Copying a Value shares the node,
+// and the node is cloned when it's modified while shared (copy-on-write).
+template<typename T>
+struct Node {
+    template<typename... Args>
+    explicit Node(Args&&... args) : refCount(1), shareable(true), inArena(false), hash(0), value(std::forward<Args>(args)...) {}
+
+    std::atomic<int> refCount;
+    // false after a non-const pointer into |value| has been handed out.
+    // Such a node is copied instead of shared, so that the pointer cannot modify the copies.
+    bool shareable;
+    // true if this is allocated from an arena by newNode().
+    bool inArena;
+    // The cached structural hash of |value|, or 0 if not computed yet.
+    // It's cached only while the node is shareable, and cleared when the node is modified.
+    std::atomic<std::uint64_t> hash;
+    T value;
+};
+
+// Allocates a node of the container |value| from the arena of its allocator if it's not sealed,
+// and from the global heap otherwise. The allocator of the container keeps the arena alive, so
+// the node doesn't have a reference of its own.
+template<typename T>
+inline Node<T>* newNode(T&& value)
+{
+    const typename T::allocator_type allocator = value.get_allocator();
+    const std::shared_ptr<Arena>& arena = allocator.arena();
+    if (!arena || arena->sealed())
+        return new Node<T>(std::move(value));
+
+    Node<T>* node = new (arena->allocate(sizeof(Node<T>), alignof(Node<T>))) Node<T>(std::move(value));
+    node->inArena = true;
+    return node;
+}
+
+template<typename T>
+inline void deleteNode(Node<T>* node)
+{
+    if (!node->inArena) {
+        delete node;
+        return;
     }
 
-    return p == s.size();
+    // The memory is released with the arena, which is kept alive by the allocator of |value|.
+    // It's moved out, so that the arena outlives the node.
+    T value(std::move(node->value));
+    node->~Node();
 }
 
-// Returns true if |s| is double.
-// [+-]? (\d+(_\d+)*)? (\.\d+(_\d+)*)? ([eE] [+-]? \d+(_\d+)*)?
-//       1-----------  2-------------  3----------------------
-// 2 or (1 and 3) should exist.
-inline bool isDouble(const std::string& s)
+template<typename T>
+inline Node<T>* retainNode(Node<T>* node)
 {
-    if (s.empty())
-        return false;
+    if (!node->shareable)
+        return new Node<T>(node->value);
 
-    std::string::size_type p = 0;
-    if (s[p] == '+' || s[p] == '-')
-        ++p;
+    node->refCount.fetch_add(1, std::memory_order_relaxed);
+    return node;
+}
 
-    bool ok = false;
-    while (p < s.size() && '0' <= s[p] && s[p] <= '9') {
-        ++p;
-        ok = true;
+template<typename T>
+inline void releaseNode(Node<T>* node)
+{
+    if (node->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        deleteNode(node);
+}
 
-        if (p < s.size() && s[p] == '_') {
-            ++p;
-            if (!(p < s.size() && '0' <= s[p] && s[p] <= '9'))
-                return false;
-        }
+// Makes |*node| owned only by the caller, cloning it if necessary.
+template<typename T>
+inline T& mutableNode(Node<T>** node, bool leaksPointer)
+{
+    if ((*node)->refCount.load(std::memory_order_acquire) != 1) {
+        Node<T>* cloned = new Node<T>((*node)->value);
+        releaseNode(*node);
+        *node = cloned;
     }
 
-    if (p < s.size() && s[p] == '.')
-        ++p;
+    if (leaksPointer)
+        (*node)->shareable = false;
+    (*node)->hash.store(0, std::memory_order_relaxed);
+    return (*node)->value;
+}
 
-    while (p < s.size() && '0' <= s[p] && s[p] <= '9') {
-        ++p;
-        ok = true;
+} // namespace internal
+
+namespace internal {
+template<typename T> struct call_traits_value {
+    typedef T return_type;
+};
+template<typename T> struct call_traits_ref {
+    typedef const T& return_type;
+};
+} // namespace internal
+
+template<typename T> struct call_traits;
+template<> struct call_traits<bool> : public internal::call_traits_value<bool> {};
+template<> struct call_traits<int> : public internal::call_traits_value<int> {};
+template<> struct call_traits<int64_t> : public internal::call_traits_value<int64_t> {};
+template<> struct call_traits<double> : public internal::call_traits_value<double> {};
+template<> struct call_traits<float> : public internal::call_traits_value<float> {};
+template<> struct call_traits<std::string> : public internal::call_traits_ref<std::string> {};
+template<> struct call_traits<Time> : public internal::call_traits_ref<Time> {};
+template<> struct call_traits<Array> : public internal::call_traits_ref<Array> {};
+template<> struct call_traits<Table> : public internal::call_traits_ref<Table> {};
+
+// A value is returned for std::vector<T>. Not reference.
+// This is because a fresh vector is made.
+template<typename T> struct call_traits<std::vector<T>> : public internal::call_traits_value<std::vector<T>> {};
+
+// Span is a read-only view of contiguous elements.
+// as<Span<const int64_t>>() and as<Span<const double>>() return a view of a packed array
+// without copying. See Value::pack().
+template<typename T>
+class Span {
+public:
+    typedef T element_type;
+    typedef T* iterator;
+
+    Span() : data_(nullptr), size_(0) {}
+    Span(T* data, size_t size) : data_(data), size_(size) {}
+
+    T* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    T& operator[](size_t index) const { return data_[index]; }
+    T* begin() const { return data_; }
+    T* end() const { return data_ + size_; }
+
+private:
+    T* data_;
+    size_t size_;
+};
+
+template<typename T> struct call_traits<Span<T>> : public internal::call_traits_value<Span<T>> {};
+
+// Formatting flags
+enum FormatFlag {
+    FORMAT_NONE = 0,
+    FORMAT_INDENT = 1
+};
+
+// What visitRecursive() gives a visitor for a packed array, if the visitor takes it, instead
+// of const Array&. |array| is the packed array value, e.g. for size(), elementType() or
+// as<Span<const int64_t>>(). Its elements are visited next.
+struct PackedArrayView {
+    const Value& array;
+};
+
+namespace internal {
+// The return type of toml::visit(). All the overloads of the visitor should return the same type.
+template<typename Visitor>
+struct VisitResult {
+    typedef decltype(std::declval<Visitor>()(std::declval<bool>())) type;
+};
+
+// True if Visitor has operator() which takes PackedArrayView, so that visitRecursive()
+// can hand over a packed array without building its Array.
+template<typename Visitor>
+struct AcceptsPackedArray {
+    template<typename V> static auto test(int) -> decltype(std::declval<V&>()(std::declval<const PackedArrayView&>()), std::true_type());
+    template<typename V> static std::false_type test(...);
+    static const bool value = decltype(test<Visitor>(0))::value;
+};
+} // namespace internal
+
+// How Value::merge() combines two arrays at the same key.
+enum class ArrayMergePolicy {
+    // The array of the merged value replaces the original one.
+    REPLACE,
+    // The elements of the merged value are appended.
+    APPEND,
+    // For arrays of tables, a table is merged into the original table which has the same
+    // value at MergeOptions::arrayKey. Otherwise, it's appended.
+    BY_KEY,
+};
+
+struct MergeOptions {
+    MergeOptions() : arrayPolicy(ArrayMergePolicy::REPLACE) {}
+
+    ArrayMergePolicy arrayPolicy;
+    // A child key (not a dotted path) used by ArrayMergePolicy::BY_KEY.
+    std::string arrayKey;
+};
+
+class Value {
+public:
+    enum Type {
+        NULL_TYPE,
+        BOOL_TYPE,
+        INT_TYPE,
+        DOUBLE_TYPE,
+        STRING_TYPE,
+        TIME_TYPE,
+        ARRAY_TYPE,
+        TABLE_TYPE,
+    };
+
+    Value() : type_(NULL_TYPE), null_(nullptr) {}
+    Value(bool v) : type_(BOOL_TYPE), bool_(v) {}
+    Value(int v) : type_(INT_TYPE), int_(v) {}
+    Value(int64_t v) : type_(INT_TYPE), int_(v) {}
+    Value(double v) : type_(DOUBLE_TYPE), double_(v) {}
+    Value(const std::string& v) : type_(STRING_TYPE), string_(new internal::Node<std::string>(v)) {}
+    Value(const char* v) : type_(STRING_TYPE), string_(new internal::Node<std::string>(v)) {}
+    Value(const Time& v) : type_(TIME_TYPE), time_(v) {}
+    Value(const Array& v) : type_(ARRAY_TYPE), array_(new internal::Node<Array>(v)) {}
+    Value(const Table& v) : type_(TABLE_TYPE), table_(new internal::Node<Table>(v)) {}
+    Value(std::string&& v) : type_(STRING_TYPE), string_(new internal::Node<std::string>(std::move(v))) {}
+    // The node is allocated from the arena of |v|, if it has one which is not sealed.
+    Value(Array&& v) : type_(ARRAY_TYPE), array_(internal::newNode(std::move(v))) {}
+    Value(Table&& v) : type_(TABLE_TYPE), table_(internal::newNode(std::move(v))) {}
+
+    // Copying a Value is O(1). Strings, arrays and tables are shared between copies,
+    // and a shared array or table is cloned when it's modified. Only the path from
+    // the modified value to the root is cloned; the other subtrees are kept shared.
+    // So you can pass a copy to another thread, or keep it as a snapshot.
+    //
+    // However, once you've got a non-const pointer into a subtree (e.g. by find(), setChild(),
+    // push() or operator[]), the subtree is deep-copied instead of shared, since the pointer
+    // might modify it later. See makeShareable().
+    Value(const Value& v);
+    Value(Value&& v) noexcept;
+    Value& operator=(const Value& v);
+    Value& operator=(Value&& v) noexcept;
+
+    // Guards from unexpected Value construction.
+    // Someone might use a value like this:
+    //   toml::Value v = x->find("foo");
+    // But this is wrong. Without this constructor,
+    // value will be unexpectedly initialized with bool.
+    Value(const void* v) = delete;
+    ~Value();
+
+    // Retruns Value size.
+    // 0 for invalid value.
+    // The number of inner elements for array or table.
+    // 1 for other types.
+    size_t size() const;
+    bool empty() const;
+    Type type() const { return type_; }
+
+    bool valid() const { return type_ != NULL_TYPE; }
+    template<typename T> bool is() const;
+    // An integer is stored as int64_t, and as<int>() truncates it without a range check,
+    // as it always has. Only the bulk conversions of arrays, i.e. as<std::vector<T>>(), copyTo()
+    // and into(), check the range of each element and throw an exception.
+    template<typename T> typename call_traits<T>::return_type as() const;
+
+    friend bool operator==(const Value& lhs, const Value& rhs);
+    friend bool operator!=(const Value& lhs, const Value& rhs) { return !(lhs == rhs); }
+
+    // Returns a structural hash. Equal values have the same hash, regardless of the table policy
+    // or whether arrays are packed. It's stable across runs and platforms.
+    // The hashes of arrays and tables are cached, so operator== can reject most unequal values quickly.
+    std::uint64_t hash() const;
+
+    // Makes identical subtrees in |root| share one node. Pointers into |root| are invalidated.
+    friend void deduplicate(Value& root);
+
+    // Calls |visitor| once with the payload of |v| (see visit() below).
+    template<typename Visitor>
+    friend typename internal::VisitResult<Visitor>::type visit(Visitor&& visitor, const Value& v);
+    // Calls |visitor| for |v| and all the values in it (see visitRecursive() below).
+    template<typename Visitor>
+    friend void visitRecursive(Visitor&& visitor, const Value& v);
+
+    // Returns the changes from |from| to |to|. See Patch.
+    friend Patch diff(const Value& from, const Value& to);
+    // Applies |patch| to |root|. Intermediate tables are created if necessary.
+    friend void apply(Value& root, const Patch& patch);
+
+    // ----------------------------------------------------------------------
+    // For integer/floating value
+
+    // Returns true if the value is int or double.
+    bool isNumber() const;
+    // Returns number. Convert to double.
+    double asNumber() const;
+
+    // ----------------------------------------------------------------------
+    // For Time value
+
+    // Converts to time_t if the internal value is Time.
+    // We don't have as<std::time_t>(). Since time_t is basically signed long,
+    // it's something like a method to converting to (normal) integer.
+    std::time_t as_time_t() const;
+
+    // ----------------------------------------------------------------------
+    // For Table value
+    template<typename T> typename call_traits<T>::return_type get(const std::string&) const;
+    Value* set(const std::string& key, const Value& v);
+    Value* set(const std::string& key, Value&& v);
+    // Finds a Value with |key|. |key| can contain '.'
+    // Note: if you would like to find a child value only, you need to use findChild.
+    const Value* find(const std::string& key) const;
+    Value* find(const std::string& key);
+    bool has(const std::string& key) const { return find(key) != nullptr; }
+    bool erase(const std::string& key);
+    // Same as find(), get() and has(), but with a key which has been split already, e.g. by TOML_PATH.
+    const Value* find(const Path& path) const;
+    template<typename T> typename call_traits<T>::return_type get(const Path& path) const;
+    bool has(const Path& path) const { return find(path) != nullptr; }
+    // Resolves all of |slots| in one depth-first pass, so that the paths sharing a prefix walk it once.
+    // A slot which is not found, or has a different type, gets an error and its output is not modified.
+    // Returns true if all of |slots| are resolved.
+    bool getMany(std::vector<Slot>* slots) const;
+
+    Value& operator[](const std::string& key);
+
+    // Merge table. When the same key exists, tables are merged recursively, arrays are combined
+    // as |options| says (replaced by default), and other values are overwritten.
+    // Returns false if |this| or |v| is not a table, or arrays of different types would be combined.
+    // Then |this| is not modified.
+    // Both the check and the merge walk the two tables once, so it's O(n + m) for sorted table
+    // policies. Arrays merged by key are matched with a hash index, which is linear as well.
+    bool merge(const Value& v);
+    bool merge(const Value& v, const MergeOptions& options);
+    // Same as above, but the subtrees are moved from |v| instead of copied.
+    bool merge(Value&& v);
+    bool merge(Value&& v, const MergeOptions& options);
+
+    // Finds a value with |key|. It searches only children.
+    Value* findChild(const std::string& key);
+    const Value* findChild(const std::string& key) const;
+    // Sets a value, and returns the pointer to the created value.
+    // When the value having the same key exists, it will be overwritten.
+    Value* setChild(const std::string& key, const Value& v);
+    Value* setChild(const std::string& key, Value&& v);
+    // Constructs a value from |args| in the table, and returns the pointer to it.
+    // When the value having the same key exists, it will be overwritten.
+    template<typename... Args> Value* emplaceChild(const std::string& key, Args&&... args);
+    // Sets children from a range of (key, value) pairs. Use std::make_move_iterator to move them.
+    // When the range is sorted by key, each insertion is amortized O(1) with sorted table policies.
+    template<typename InputIterator> void setChildren(InputIterator first, InputIterator last);
+    bool eraseChild(const std::string& key);
+
+    // ----------------------------------------------------------------------
+    // For Array value
+
+    template<typename T> typename call_traits<T>::return_type get(size_t index) const;
+    const Value* find(size_t index) const;
+    Value* find(size_t index);
+    Value* push(const Value& v);
+    Value* push(Value&& v);
+    // Constructs a value from |args| at the end of the array, and returns the pointer to it.
+    template<typename... Args> Value* emplaceBack(Args&&... args);
+    // Reserves the capacity of the array. If this is null value, this becomes an empty array.
+    void reserve(size_t n);
+
+    // Converts each element of the array to T, and writes it to |out|. Returns the end of the output.
+    // Any arithmetic T is allowed for integer and double elements, and an exception is thrown if
+    // an element is out of the range of T. T can be std::vector<U> for nested arrays.
+    template<typename T, typename OutputIt> OutputIt copyTo(OutputIt out) const;
+    // Replaces the contents of |out| with the elements. The capacity of |out| (and of the inner
+    // vectors for nested arrays) is reused, so nothing is allocated if it's large enough.
+    template<typename T> void into(std::vector<T>* out) const;
+    // Writes the elements to |buf|, which has room for |n| elements. Returns the number of the elements.
+    // If the array is longer than |n|, an exception is thrown and nothing is written.
+    template<typename T> size_t into(T* buf, size_t n) const;
+
+    // Packs arrays of integers, doubles, bools or strings in this value (recursively)
+    // into contiguous typed storage. A packed array is still an array, and you can
+    // get a view of the elements by as<Span<const int64_t>>() or as<Span<const double>>().
+    // It's unpacked when it's modified. Pointers into the packed arrays are invalidated.
+    void pack();
+    // Returns true if this is a packed array.
+    bool isPacked() const { return type_ == ARRAY_TYPE && packed_; }
+
+    // An array of tables which have the same keys is packed into columns: one shared list
+    // of keys and one array per key. Scanning a key over all the records touches only the column.
+    // Returns true if this is such an array.
+    bool isColumnar() const;
+    // Returns the column of |key| in a columnar array. It's an array, and is packed when possible.
+    // If this is not a columnar array or |key| is not found, nullptr is returned.
+    const Value* findColumn(const std::string& key) const;
+    // Returns a view of the |index|-th record in a columnar array.
+    // If this is not a columnar array or |index| is out of bound, an exception is thrown.
+    RecordView record(size_t index) const;
+
+    // ----------------------------------------------------------------------
+    // Others
+
+    // Makes the subtrees shareable between copies again.
+    // Call this when you no longer modify the value through the pointers you've got from
+    // the non-const methods. toml::parse() returns a shareable value.
+    void makeShareable();
+
+    // Writer.
+    static std::string spaces(int num);
+    static std::string escapeKey(const std::string& key);
+
+    void write(std::ostream*, const std::string& keyPrefix = std::string(), int indent = -1) const;
+    void writeFormatted(std::ostream*, FormatFlag flags) const;
+
+    friend std::ostream& operator<<(std::ostream&, const Value&);
+
+private:
+    static const char* typeToString(Type);
+
+    template<typename T> void assureType() const;
+    Value* ensureValue(const std::string& key);
+
+    // Returns the array or table to modify. It's cloned first if it's shared.
+    // |leaksPointer| should be true if a pointer into it is returned to the user.
+    // A packed array is unpacked.
+    Array& mutableArray(bool leaksPointer);
+    Table& mutableTable(bool leaksPointer) { return internal::mutableNode(&table_, leaksPointer); }
+
+    // Returns the elements of array. For a packed array, they're materialized on the first call.
+    const Array& arrayValue() const;
+    // Returns the |index|-th element of array as T. A packed array is read in place if T is
+    // returned by value, and materialized only for a reference into an element.
+    template<typename T> typename call_traits<T>::return_type elementAs(size_t index, std::true_type byValue) const;
+    template<typename T> typename call_traits<T>::return_type elementAs(size_t index, std::false_type byValue) const;
+    // Returns the cached hash of the array or table, or 0 if not cached.
+    std::uint64_t cachedHash() const;
+    void deduplicate(std::unordered_map<std::uint64_t, std::vector<Value>>* pool);
+    static void diffInto(const Value& from, const Value& to, std::vector<std::string>* path, Patch* patch);
+
+    // Helpers of merge(). canMerge() checks everything mergeTable() would fail on, so that
+    // merge() doesn't leave |this| half-updated.
+    static bool canMerge(const Value& dst, const Value& src, const MergeOptions& options);
+    static bool canMergeArray(const Value& dst, const Value& src, const MergeOptions& options);
+    // For each element of |src|, returns the index of the table in |dst| to merge it into, or -1.
+    static std::vector<size_t> matchByKey(const Value& dst, const Value& src, const std::string& key);
+    static const Table& sourceTable(const Value& v) { return v.table_->value; }
+    static Table& sourceTable(Value& v) { return v.mutableTable(false); }
+    static const Array& sourceArray(const Value& v) { return v.arrayValue(); }
+    static Array& sourceArray(Value& v) { return v.mutableArray(false); }
+    // Src is const Value& to copy, or Value to move.
+    template<typename Src> void mergeTable(Src&& src, const MergeOptions& options);
+    template<typename Src> void mergeChild(Src&& src, const MergeOptions& options);
+    template<typename Src> void mergeArray(Src&& src, const MergeOptions& options);
+    Type elementType() const;
+    bool isArrayOfTables() const;
+    void unpack();
+
+    template<typename T> struct ValueConverter;
+
+    Type type_;
+    // true if the array is stored in packedArray_ instead of array_. It's in the padding after
+    // |type_|, so that Value stays 16 bytes.
+    bool packed_ = false;
+    union {
+        void* null_;
+        bool bool_;
+        int64_t int_;
+        double double_;
+        internal::Node<std::string>* string_;
+        Time time_;
+        internal::Node<Array>* array_;
+        internal::Node<Table>* table_;
+        internal::Node<internal::PackedArray>* packedArray_;
+    };
+
+    template<typename T> friend struct ValueConverter;
+    friend class internal::PackedArray;
+    friend class Slot;
+    friend class FrozenValue;
+};
+
+// Every element of an array and every entry of a table is a Value, so it must not grow.
+static_assert(sizeof(Value) == 16, "Value must be 16 bytes");
+
+// LayeredView resolves lookups over a stack of tables (e.g. defaults, region, host and overrides)
+// without merging them. The result is the same as merging the layers from the bottom to the top
+// with Value::merge(): a key in an upper layer hides the one in the lower layers, but tables at
+// the same key are merged. Making a view costs O(layers).
+// The layers are not owned, so they must outlive the view.
+class LayeredView {
+public:
+    typedef std::pair<const std::string&, const Value&> value_type;
+    class const_iterator;
+
+    LayeredView() {}
+    // |layers| is from the bottom to the top.
+    explicit LayeredView(const std::vector<const Value*>& layers);
+
+    // Adds |layer| on the top. A layer which is not a table is ignored.
+    void push(const Value* layer);
+    // Returns the number of the layers in this view.
+    size_t layerCount() const { return layers_.size(); }
+    bool empty() const { return layers_.empty(); }
+
+    // Finds a value with |key|. |key| can contain '.'.
+    // If the value is a table, the one in the topmost layer is returned. Use view() to see the merged one.
+    const Value* find(const std::string& key) const;
+    bool has(const std::string& key) const { return find(key) != nullptr; }
+    template<typename T> typename call_traits<T>::return_type get(const std::string& key) const;
+
+    // Returns the view of the tables at |key|. If there is no table at |key|, the view is empty.
+    LayeredView view(const std::string& key) const;
+
+    // Iterates the keys of the merged table in sorted order. The keys from the layers are merged
+    // while iterating. The value is the one in the topmost layer that has the key.
+    const_iterator begin() const;
+    const_iterator end() const;
+
+private:
+    // Returns the view of the child tables with |key|.
+    LayeredView child(const std::string& key, const Value** found) const;
+
+    // From the top to the bottom.
+    std::vector<const Value*> layers_;
+};
+
+class LayeredView::const_iterator {
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef LayeredView::value_type value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const value_type* pointer;
+    typedef value_type reference;
+
+    const_iterator() {}
+
+    value_type operator*() const { return value_type(current_->first, current_->second); }
+    const_iterator& operator++();
+    const_iterator operator++(int) { const_iterator it = *this; ++*this; return it; }
+
+    friend bool operator==(const const_iterator& lhs, const const_iterator& rhs) { return lhs.current_ == rhs.current_; }
+    friend bool operator!=(const const_iterator& lhs, const const_iterator& rhs) { return !(lhs == rhs); }
+
+private:
+    typedef const Table::value_type* Entry;
+    friend class LayeredView;
+
+    void findCurrent();
+
+    // The sorted entries of each layer, from the top to the bottom.
+    std::shared_ptr<std::vector<std::vector<Entry>>> entries_;
+    std::vector<size_t> positions_;
+    Entry current_ = nullptr;
+};
+
+// Path is a dotted key split into its keys. Splitting it once saves lexing on every lookup.
+class Path {
+public:
+    Path() : valid_(false) {}
+    // An invalid |key| makes an invalid path, which never matches.
+    Path(const std::string& key);
+    explicit Path(std::vector<std::string> keys) : keys_(std::move(keys)), valid_(!keys_.empty()) {}
+
+    bool valid() const { return valid_; }
+    const std::vector<std::string>& keys() const { return keys_; }
+    size_t size() const { return keys_.size(); }
+    // Returns the canonical dotted key.
+    std::string toString() const;
+
+    friend bool operator==(const Path& lhs, const Path& rhs) { return lhs.keys_ == rhs.keys_; }
+    friend bool operator!=(const Path& lhs, const Path& rhs) { return !(lhs == rhs); }
+    friend bool operator<(const Path& lhs, const Path& rhs) { return lhs.keys_ < rhs.keys_; }
+
+private:
+    std::vector<std::string> keys_;
+    bool valid_;
+};
+
+namespace internal {
+
+constexpr bool isStaticKeyChar(char c)
+{
+    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9') || c == '_' || c == '-';
+}
+
+// Returns true if s[i, n) is the rest of a dotted bare key. |inKey| is true if s[i - 1] is in a key.
+constexpr bool isStaticKey(const char* s, size_t i, size_t n, bool inKey)
+{
+    return i == n ? inKey :
+        s[i] == '.' ? inKey && isStaticKey(s, i + 1, n, false) :
+        isStaticKeyChar(s[i]) && isStaticKey(s, i + 1, n, true);
+}
+
+constexpr bool isStaticKey(const char* s, size_t n)
+{
+    return isStaticKey(s, 0, n, false);
+}
+
+// Splits a key which isStaticKey() has accepted.
+inline std::vector<std::string> splitStaticKey(const char* s, size_t n)
+{
+    std::vector<std::string> keys;
+    const char* end = s + n;
+    while (true) {
+        const char* dot = std::find(s, end, '.');
+        keys.emplace_back(s, dot);
+        if (dot == end)
+            return keys;
+        s = dot + 1;
+    }
+}
+
+} // namespace internal
+
+// TOML_PATH("a.b.c") is a const Path& of a dotted key literal. The key is validated at compile time,
+// and split only once at the first evaluation, so the lookups with it don't tokenize the key.
+// Only bare keys are accepted; use Path for quoted keys.
+//
+//   int port = config.get<int>(TOML_PATH("server.http.port"));
+#define TOML_PATH(key)                                                                   \
+    ([]() -> const ::toml::Path& {                                                       \
+        static_assert(::toml::internal::isStaticKey(key, sizeof(key) - 1),               \
+                      "TOML_PATH: \"" key "\" is not a dotted key of bare keys");        \
+        static const ::toml::Path path(::toml::internal::splitStaticKey(key, sizeof(key) - 1)); \
+        return path;                                                                     \
+    }())
+
+// Slot is an output of Value::getMany(): a path, and the variable to store the found value to.
+// T is any type that Value::as<T>() supports.
+//
+//   int port = 80;
+//   std::string host;
+//   std::vector<toml::Slot> slots { { "server.port", &port }, { "server.host", &host } };
+//   if (!config.getMany(&slots)) { ... slots[i].error() ... }
+class Slot {
+public:
+    template<typename T> Slot(const std::string& key, T* out) : Slot(Path(key), out) {}
+    template<typename T> Slot(Path path, T* out) :
+        path_(std::move(path)), out_(out), assign_(&Slot::assign<T>) {}
+
+    const Path& path() const { return path_; }
+    bool ok() const { return error_.empty(); }
+    // Returns the reason of the failure, or an empty string.
+    const std::string& error() const { return error_; }
+
+private:
+    template<typename T> static bool assign(const Value& v, void* out, std::string* error);
+
+    Path path_;
+    void* out_;
+    bool (*assign_)(const Value&, void*, std::string*);
+    std::string error_;
+
+    friend class Value;
+};
+
+// Query finds values by a path expression. Compile it once, and evaluate it many times.
+//
+//   servers.*.port                    'port' of all the children of 'servers'
+//   **.port                           'port' at any depth
+//   hosts[*].checks[0].interval       array indices. [-1] is the last element
+//   hosts[1:3], hosts[:-1]            slices (the end is exclusive)
+//   hosts[?(enabled == true)].name    filters by a child of the elements (==, !=, <, <=, >, >=)
+//   hosts[?(tls)]                     filters by the existence of a child
+//   "a.b".c                           quoted keys
+//
+// An invalid expression throws an exception.
+class Query {
+public:
+    explicit Query(const std::string& expression);
+
+    const std::string& expression() const { return expression_; }
+
+    // Replaces |results| with the matched values, in document order.
+    // Nothing is allocated except for growing |results|, unless the query steps into a packed
+    // array: the results point to Values, so the Array of a packed array is built (once, and
+    // cached in it) as as<Array>() does.
+    void evaluate(const Value& root, std::vector<const Value*>* results) const;
+    // Returns the first matched value, or nullptr.
+    const Value* evaluateFirst(const Value& root) const;
+
+private:
+    struct Step {
+        enum Kind {
+            KEY,
+            ANY_KEY,
+            DESCENDANTS,
+            INDEX,
+            ANY_INDEX,
+            SLICE,
+            FILTER,
+        };
+        enum Op {
+            EXISTS,
+            EQ,
+            NE,
+            LT,
+            LE,
+            GT,
+            GE,
+        };
+
+        explicit Step(Kind kind) : kind(kind), index(0), hasBegin(false), hasEnd(false), begin(0), end(0), op(EXISTS) {}
+
+        Kind kind;
+        // For KEY, and the child key for FILTER.
+        std::string key;
+        // For INDEX.
+        std::int64_t index;
+        // For SLICE.
+        bool hasBegin;
+        bool hasEnd;
+        std::int64_t begin;
+        std::int64_t end;
+        // For FILTER.
+        Op op;
+        Value operand;
+    };
+
+    class Compiler;
+
+    // Appends the matches to |results|, or stores the first match to |first| and returns true.
+    bool match(const Value& v, size_t step, std::vector<const Value*>* results, const Value** first) const;
+    static bool test(const Step& step, const Value& element);
+
+    std::string expression_;
+    std::vector<Step> steps_;
+};
+
+// PathIndex maps the full paths (e.g. "a.b.c") of the values in a document to the values, so
+// that a lookup is a hash table probe instead of a descent per segment. The paths are also kept
+// sorted, so a subtree (e.g. everything under "features") can be scanned as a range.
+//
+// Tables are indexed recursively, and arrays are leaves. A path is in the canonical form: keys
+// joined with '.' without spaces, and quoted only when they are not bare keys (e.g. a."b.c").
+//
+// The index does not own the document. Editing the document invalidates the index: call update()
+// with the path of the edited table, or build() to index the whole document again.
+class PathIndex {
+public:
+    typedef std::map<std::string, const Value*> Map;
+    typedef Map::value_type Entry;
+    typedef Map::const_iterator const_iterator;
+
+    PathIndex() : slotCount_(0) {}
+    explicit PathIndex(const Value& root) : slotCount_(0) { build(root); }
+
+    void build(const Value& root);
+    // Indexes the subtree at |path| of |root| again. The other entries are kept. Use this after
+    // adding, removing or replacing the values in the table at |path|.
+    //
+    // The ancestors of |path| may have been copied on write, which moves their children. So the
+    // entries of the direct children of the ancestors are pointed to the new values, and a child
+    // table is descended into only if its own children have moved. The cost is proportional to
+    // the subtree and to the children of the ancestors, not to the whole document.
+    void update(const Value& root, const std::string& path);
+
+    // Finds a value with the canonical |path|. Returns nullptr if not found.
+    const Value* find(const std::string& path) const;
+    bool has(const std::string& path) const { return find(path) != nullptr; }
+
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+
+    // Iterates all the entries in the order of their paths.
+    const_iterator begin() const { return entries_.begin(); }
+    const_iterator end() const { return entries_.end(); }
+    // Returns the range of the entries under |path|, not including |path| itself.
+    // If |path| is empty, all the entries are returned.
+    std::pair<const_iterator, const_iterator> scan(const std::string& path) const;
+
+private:
+    // Adds the descendants of |table|. |path| is the path of |table|.
+    void collect(const Value& table, std::string* path);
+    // Points the entries of the children of |table| to them, and descends into the child tables
+    // whose children have moved. |skip| is a child not to descend into.
+    void relink(const Value& table, std::string* path, const std::string* skip);
+    bool moved(const Value& table, const std::string& path) const;
+
+    void insert(const std::string& path, const Value* v);
+    void erase(Map::iterator it);
+    Entry* lookup(const std::string& path) const;
+    void rehash(size_t capacity);
+
+    Map entries_;
+    // Open addressing table of the entries. nullptr is an empty slot.
+    std::vector<Entry*> slots_;
+    size_t slotCount_;
+};
+
+namespace internal {
+
+// The layout of FrozenDocument. Everything is addressed by the offset from the beginning of the
+// buffer (or of the string area for strings and keys), so the buffer can be relocated.
+//
+//   FrozenHeader | nodes, breadth-first | strings
+//
+// An array node points to its elements, FrozenNode[size]. A table node points to
+//   FrozenTable | FrozenKey[count] (sorted) | FrozenNode[count] | buckets | slots
+// where buckets and slots are a perfect hash of the keys if the table is large.
+//
+// The offsets are 64-bit, so a document can be larger than 4 GiB. A string, and the number of
+// the elements of an array or a table, are limited to 2^32 - 1. A time is microseconds since the
+// epoch, so that the bytes don't depend on the period of the system clock of the writer.
+struct FrozenNode {
+    std::uint8_t type;
+    std::uint8_t reserved[3];
+    // The length of a string, or the number of the elements of an array or a table.
+    std::uint32_t size;
+    // The value of bool/int/double/time, or the offset of the string or the children.
+    std::uint64_t payload;
+};
+
+struct FrozenKey {
+    std::uint64_t offset;
+    std::uint32_t size;
+    std::uint32_t reserved;
+};
+
+struct FrozenTable {
+    std::uint32_t count;
+    std::uint32_t bucketCount;
+    std::uint32_t slotCount;
+    std::uint32_t reserved;
+};
+
+struct FrozenHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t stringsOffset;
+    std::uint64_t size;
+    FrozenNode root;
+};
+
+class FrozenBuilder;
+
+} // namespace internal
+
+// FrozenValue is a read-only view of a value in a FrozenDocument or a BinaryView. It's a few
+// pointers, and is valid while the document or the bytes are alive. A value which is not found is an invalid FrozenValue.
+class FrozenValue {
+public:
+    typedef std::pair<std::string, FrozenValue> value_type;
+    class const_iterator;
+
+    FrozenValue() : base_(nullptr), strings_(nullptr), node_(nullptr) {}
+
+    bool valid() const { return node_ != nullptr; }
+    explicit operator bool() const { return valid(); }
+    Value::Type type() const { return valid() ? static_cast<Value::Type>(node_->type) : Value::NULL_TYPE; }
+
+    // T is bool, int, int64_t, double, std::string or Time.
+    template<typename T> bool is() const;
+    template<typename T> T as() const;
+    // Returns the number of the elements of an array or a table. Otherwise, returns 1.
+    size_t size() const;
+
+    // Finds a value with |key|. |key| can contain '.'.
+    FrozenValue find(const std::string& key) const;
+    FrozenValue find(const Path& path) const;
+    template<typename T> T get(const std::string& key) const;
+    template<typename T> T get(const Path& path) const;
+    bool has(const std::string& key) const { return find(key).valid(); }
+    // Finds a child value with |key|.
+    FrozenValue findChild(const std::string& key) const { return findChild(key.data(), key.size()); }
+    FrozenValue findChild(const char* key, size_t size) const;
+    // Returns the |index|-th element of an array.
+    FrozenValue at(size_t index) const;
+
+    // Iterates the keys and the values of a table, in sorted order.
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    // Makes a Value of this.
+    Value thaw() const;
+
+private:
+    FrozenValue(const char* base, const char* strings, const internal::FrozenNode* node) :
+        base_(base), strings_(strings), node_(node) {}
+
+    const internal::FrozenTable* table() const;
+    const internal::FrozenKey* keys() const;
+    const internal::FrozenNode* children() const;
+    std::string keyAt(size_t index) const;
+    template<typename T> void assureType(Value::Type type) const;
+
+    const char* base_;
+    const char* strings_;
+    const internal::FrozenNode* node_;
+
+    friend class FrozenDocument;
+    friend class BinaryView;
+};
+
+class FrozenValue::const_iterator {
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef FrozenValue::value_type value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const value_type* pointer;
+    typedef value_type reference;
+
+    const_iterator() : index_(0) {}
+
+    value_type operator*() const { return value_type(table_.keyAt(index_), FrozenValue(table_.base_, table_.strings_, table_.children() + index_)); }
+    const_iterator& operator++() { ++index_; return *this; }
+    const_iterator operator++(int) { const_iterator it = *this; ++index_; return it; }
+
+    friend bool operator==(const const_iterator& lhs, const const_iterator& rhs) { return lhs.index_ == rhs.index_; }
+    friend bool operator!=(const const_iterator& lhs, const const_iterator& rhs) { return !(lhs == rhs); }
+
+private:
+    const_iterator(const FrozenValue& table, size_t index) : table_(table), index_(index) {}
+
+    FrozenValue table_;
+    size_t index_;
+
+    friend class FrozenValue;
+};
+
+// FrozenDocument is an immutable document compacted into one allocation. The nodes are laid out
+// breadth-first, the keys of a table are sorted into a flat array, and a large table has a perfect
+// hash of its keys. Equal keys are stored once. Make it with freeze().
+class FrozenDocument {
+public:
+    FrozenDocument() : size_(0) {}
+
+    bool empty() const { return size_ == 0; }
+    FrozenValue root() const;
+
+    FrozenValue find(const std::string& key) const { return root().find(key); }
+    FrozenValue find(const Path& path) const { return root().find(path); }
+    template<typename T> T get(const std::string& key) const { return root().get<T>(key); }
+    template<typename T> T get(const Path& path) const { return root().get<T>(path); }
+    bool has(const std::string& key) const { return root().has(key); }
+
+    // The bytes of the document.
+    const char* data() const { return reinterpret_cast<const char*>(buffer_.get()); }
+    size_t byteSize() const { return size_; }
+
+    // Makes a document of the bytes made by data(), copying them. An empty document is returned
+    // if the header doesn't match this version, or an offset points out of the bytes. O(size).
+    static FrozenDocument fromBytes(const char* data, size_t size);
+
+private:
+    std::unique_ptr<std::uint64_t[]> buffer_;
+    size_t size_;
+
+    friend FrozenDocument freeze(const Value& v);
+};
+
+// Makes a FrozenDocument of |v|. The rvalue version releases |v|.
+FrozenDocument freeze(const Value& v);
+FrozenDocument freeze(Value&& v);
+
+// Serializes |v| into the relocatable binary form of FrozenDocument, which BinaryView reads in place.
+std::string serializeBinary(const Value& v);
+
+// BinaryView reads the bytes made by serializeBinary() in place, e.g. from a mapped file, without
+// copying nor deserializing them. Only the header is checked, so opening is O(1), and the rest
+// of the bytes are trusted. The bytes must be aligned to 8 bytes, and outlive the view.
+class BinaryView {
+public:
+    BinaryView() : data_(nullptr), size_(0) {}
+
+    // Returns an empty view if |data| is not a serialized document of this version, or not aligned.
+    static BinaryView fromBytes(const char* data, size_t size);
+
+    bool empty() const { return size_ == 0; }
+    FrozenValue root() const;
+
+    FrozenValue find(const std::string& key) const { return root().find(key); }
+    FrozenValue find(const Path& path) const { return root().find(path); }
+    template<typename T> T get(const std::string& key) const { return root().get<T>(key); }
+    template<typename T> T get(const Path& path) const { return root().get<T>(path); }
+    bool has(const std::string& key) const { return root().has(key); }
+
+    const char* data() const { return data_; }
+    size_t byteSize() const { return size_; }
+
+    // Checks that every offset points into the bytes, as FrozenDocument::fromBytes() does. O(size).
+    // Call this before reading the bytes which might be corrupted.
+    bool verify() const;
+
+private:
+    const char* data_;
+    size_t size_;
+};
+
+#if defined(__linux__)
+// BinaryFile maps a file written from serializeBinary() read-only. The pages are shared by the
+// processes which map the same file.
+//
+//   toml::BinaryFile file("/var/lib/app/config.bin");
+//   int port = file.view().get<int>("server.port");
+class BinaryFile {
+public:
+    BinaryFile() : map_(nullptr), size_(0) {}
+    // Throws an exception if the file cannot be mapped, or is not a serialized document.
+    explicit BinaryFile(const std::string& filename);
+    // Same as above, but maps an open file |fd|, e.g. a shared memory object. |fd| is not closed.
+    // |name| is used in the error messages.
+    BinaryFile(int fd, const std::string& name);
+    ~BinaryFile() { unmap(); }
+
+    BinaryFile(BinaryFile&& other) : map_(other.map_), size_(other.size_), view_(other.view_)
+    {
+        other.map_ = nullptr;
+        other.size_ = 0;
+        other.view_ = BinaryView();
+    }
+    BinaryFile& operator=(BinaryFile&& other)
+    {
+        if (this != &other) {
+            unmap();
+            std::swap(map_, other.map_);
+            std::swap(size_, other.size_);
+            std::swap(view_, other.view_);
+        }
+        return *this;
+    }
+    BinaryFile(const BinaryFile&) = delete;
+    BinaryFile& operator=(const BinaryFile&) = delete;
+
+    const BinaryView& view() const { return view_; }
+
+private:
+    void map(int fd, const std::string& name);
+    void unmap();
+
+    void* map_;
+    size_t size_;
+    BinaryView view_;
+};
+#endif
+
+// BasicConfigHandle shares a snapshot of T between threads, and replaces it atomically.
+// Readers don't take a lock nor touch a shared reference count: load() publishes the snapshot
+// in a hazard slot picked by the thread, so reading scales with cores. publish() swaps in a new
+// snapshot, and deletes the old ones that no reader holds. A snapshot which was held while it was
+// replaced is deleted by a later publish() or by the destructor.
+//
+//   toml::ConfigHandle config(std::move(pr.value));
+//   // Readers
+//   toml::ConfigHandle::Guard snapshot = config.load();
+//   int port = snapshot->get<int>("server.port");
+//   // Writer
+//   config.publish(std::move(newValue));
+//
+// A Guard must not outlive the handle. A thread can hold several guards, but the number of
+// guards alive at once is limited to kSlotCount; more readers spin until a slot is released.
+template<typename T>
+class BasicConfigHandle {
+    // Aligned to a cache line, so that readers in different slots don't contend.
+    struct alignas(64) Slot {
+        std::atomic<const T*> hazard;
+    };
+
+public:
+    static const size_t kSlotCount = 256;
+
+    class Guard {
+    public:
+        Guard() : slot_(nullptr), snapshot_(nullptr) {}
+        Guard(Guard&& other) : slot_(other.slot_), snapshot_(other.snapshot_) { other.slot_ = nullptr; other.snapshot_ = nullptr; }
+        Guard& operator=(Guard&& other)
+        {
+            if (this != &other) {
+                release();
+                std::swap(slot_, other.slot_);
+                std::swap(snapshot_, other.snapshot_);
+            }
+            return *this;
+        }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        ~Guard() { release(); }
+
+        // Returns nullptr if nothing has been published.
+        const T* get() const { return snapshot_; }
+        const T& operator*() const { return *snapshot_; }
+        const T* operator->() const { return snapshot_; }
+        explicit operator bool() const { return snapshot_ != nullptr; }
+
+    private:
+        Guard(Slot* slot, const T* snapshot) : slot_(slot), snapshot_(snapshot) {}
+        void release()
+        {
+            if (slot_)
+                slot_->hazard.store(nullptr, std::memory_order_release);
+            slot_ = nullptr;
+            snapshot_ = nullptr;
+        }
+
+        Slot* slot_;
+        const T* snapshot_;
+
+        friend class BasicConfigHandle;
+    };
+
+    BasicConfigHandle() : current_(nullptr) { clearSlots(); }
+    explicit BasicConfigHandle(T&& snapshot) : current_(new T(std::move(snapshot))) { clearSlots(); }
+    explicit BasicConfigHandle(const T& snapshot) : current_(new T(snapshot)) { clearSlots(); }
+    ~BasicConfigHandle();
+
+    BasicConfigHandle(const BasicConfigHandle&) = delete;
+    BasicConfigHandle& operator=(const BasicConfigHandle&) = delete;
+
+    // Returns the current snapshot. It stays alive while the guard is alive.
+    Guard load() const;
+    // Replaces the snapshot. Readers see either the old one or the new one.
+    void publish(T&& snapshot) { exchange(new T(std::move(snapshot))); }
+    void publish(const T& snapshot) { exchange(new T(snapshot)); }
+
+    // The number of the replaced snapshots which are not deleted yet.
+    size_t retiredCount() const;
+
+private:
+    void clearSlots();
+    void exchange(const T* snapshot);
+    // Deletes the retired snapshots which no reader holds. |mu_| must be held.
+    void reclaim();
+    static size_t threadHint();
+
+    // On a cache line of its own, so that publish() doesn't invalidate the line of a slot.
+    // (Before C++17, operator new doesn't honor the alignment of a heap-allocated handle.)
+    alignas(64) std::atomic<const T*> current_;
+    mutable Slot slots_[kSlotCount];
+
+    // For writers.
+    mutable std::mutex mu_;
+    std::vector<const T*> retired_;
+};
+
+typedef BasicConfigHandle<Value> ConfigHandle;
+
+// ChangeNotifier calls the subscribers of the subtrees which differ between two documents.
+// The subscriptions are kept in a tree of keys, and the documents are compared only at the
+// subscribed paths: an unchanged subtree is skipped with its descendant subscriptions. The
+// comparison is cheap for the subtrees shared by copies of a document, or with cached hashes.
+//
+//   toml::ChangeNotifier notifier;
+//   notifier.watch("db.pool", [](const toml::Value* before, const toml::Value* after) { ... });
+//   notifier.notify(oldConfig, newConfig);
+//
+// It's not thread-safe, and the callbacks must not call watch() nor unwatch().
+class ChangeNotifier {
+public:
+    // |before| or |after| is nullptr if the path doesn't exist in the document.
+    typedef std::function<void(const Value* before, const Value* after)> Callback;
+    typedef size_t SubscriptionId;
+
+    ChangeNotifier() : root_(new Node), nextId_(1) {}
+
+    // Calls |callback| when the value at |path| changes. An empty |path| watches the whole document.
+    // Throws an exception if |path| is not a valid key.
+    SubscriptionId watch(const std::string& path, Callback callback);
+    // Returns false if |id| is not found.
+    bool unwatch(SubscriptionId id);
+    size_t size() const { return paths_.size(); }
+
+    // Calls the subscribers of the paths whose values differ between |before| and |after|,
+    // parents before children. Returns the number of the called subscribers.
+    size_t notify(const Value& before, const Value& after) const;
+
+private:
+    struct Node {
+        std::vector<std::pair<SubscriptionId, Callback>> subscribers;
+        std::map<std::string, std::unique_ptr<Node>> children;
+    };
+
+    static size_t notify(const Node& node, const Value* before, const Value* after);
+
+    std::unique_ptr<Node> root_;
+    std::unordered_map<SubscriptionId, std::vector<std::string>> paths_;
+    SubscriptionId nextId_;
+};
+
+// Patch is a list of changes from one value to another, made by diff().
+// Tables are compared key by key. Other values (including arrays) are compared as a whole.
+struct Patch {
+    enum class Op {
+        ADD,
+        REMOVE,
+        CHANGE,
+    };
+
+    struct Change {
+        Change(Op op, std::vector<std::string> path, Value value) :
+            op(op), path(std::move(path)), value(std::move(value)) {}
+
+        // Returns the path as a dotted key, e.g. 'a."b.c"'.
+        std::string pathString() const;
+
+        Op op;
+        // The keys from the root. Empty if the root itself is changed.
+        std::vector<std::string> path;
+        // The new value. Null for REMOVE.
+        Value value;
+    };
+
+    bool empty() const { return changes.empty(); }
+    size_t size() const { return changes.size(); }
+
+    // Sorted by path.
+    std::vector<Change> changes;
+};
+
+// RecordView is a view of a record in a columnar array of tables (see Value::pack()).
+// It's valid while the array is alive and not modified.
+class RecordView {
+public:
+    RecordView(const internal::PackedArray* columns, size_t index) : columns_(columns), index_(index) {}
+
+    size_t index() const { return index_; }
+    // Returns the keys shared by all the records.
+    const std::vector<std::string>& keys() const;
+
+    bool has(const std::string& key) const;
+    // Returns the value of |key|. If not found, null value is returned.
+    Value find(const std::string& key) const;
+    // Returns the value of |key| as T. If not found or type mismatch, an exception is thrown.
+    template<typename T> T get(const std::string& key) const;
+
+    // Returns the record as a table.
+    Value toValue() const;
+
+private:
+    const internal::PackedArray* columns_;
+    size_t index_;
+};
+
+// parse() returns ParseResult.
+struct ParseResult {
+    ParseResult(toml::Value v, std::string er) :
+        value(std::move(v)),
+        errorReason(std::move(er)) {}
+
+    bool valid() const { return value.valid(); }
+
+    toml::Value value;
+    std::string errorReason;
+};
+
+// Options for parse().
+struct ParseOptions {
+    ParseOptions() : keyPool(nullptr), packArrays(false) {}
+
+    // If set, tables and arrays are allocated from |arena|. It's sealed after parsing. See Arena.
+    std::shared_ptr<Arena> arena;
+    // If set, table keys are interned into |keyPool|. This is effective only with InternedTablePolicy.
+    KeyPool* keyPool;
+    // If true, arrays of integers, doubles, bools or strings are packed. See Value::pack().
+    bool packArrays;
+    // If set, parseFile() caches the parsed documents in this existing directory, keyed by the hash
+    // of the file content. A cached document is loaded instead of parsing the file again. The cache
+    // files are written atomically, so processes can share the directory. Not used with |arena|,
+    // nor with a table policy which isn't sorted, since a cached document has its keys sorted.
+    std::string cacheDirectory;
+};
+
+// Parses from std::istream.
+ParseResult parse(std::istream&);
+ParseResult parse(std::istream&, const ParseOptions&);
+// Parses a file.
+ParseResult parseFile(const std::string& filename);
+ParseResult parseFile(const std::string& filename, const ParseOptions&);
+
+// Parses with allocating tables and arrays from |arena|.
+// |arena| is sealed after parsing. See Arena.
+ParseResult parse(std::istream&, const std::shared_ptr<Arena>& arena);
+ParseResult parseFile(const std::string& filename, const std::shared_ptr<Arena>& arena);
+
+// ----------------------------------------------------------------------
+// Declarations for Implementations
+//   You don't need to understand the below to use this library.
+
+#if defined(_WIN32)
+// Windows does not have timegm but have _mkgmtime.
+inline time_t timegm(std::tm* timeptr)
+{
+    return _mkgmtime(timeptr);
+}
+
+// On Windows, Visual Studio does not define gmtime_r. However, mingw might
+// do (or might not do). See https://github.com/mayah/tinytoml/issues/25,
+#ifndef gmtime_r
+inline struct tm* gmtime_r(const time_t* t, struct tm* r)
+{
+    // gmtime is threadsafe in windows because it uses TLS
+    struct tm *theTm = gmtime(t);
+    if (theTm) {
+        *r = *theTm;
+        return r;
+    } else {
+        return 0;
+    }
+}
+#endif  // gmtime_r
+#endif  // _WIN32
+
+namespace internal {
+
+// PackedArray is a homogeneous array in contiguous typed storage.
+// Integers and doubles are stored in plain vectors, bools are bit-packed, and
+// strings are concatenated into one blob. Tables which have the same keys are
+// stored in columns: the keys and one (packed if possible) array per key.
+class PackedArray {
+public:
+    explicit PackedArray(const Array& array);
+    PackedArray(const PackedArray& other);
+    PackedArray& operator=(const PackedArray&) = delete;
+
+    // Returns true if |array| is a non-empty array of integers, doubles, bools or strings,
+    // or a non-empty array of tables which have the same keys.
+    static bool packable(const Array& array);
+
+    Value::Type elementType() const { return elementType_; }
+    size_t size() const;
+    Value at(size_t index) const;
+
+    const std::vector<std::int64_t>& ints() const { return ints_; }
+    const std::vector<double>& doubles() const { return doubles_; }
+    bool boolAt(size_t index) const { return bools_[index]; }
+    // Assigns the index-th string to |out|, so that a buffer can be reused across the elements.
+    void stringAt(size_t index, std::string* out) const
+    {
+        out->assign(stringBlob_, stringOffsets_[index], stringOffsets_[index + 1] - stringOffsets_[index]);
+    }
+
+    // For tables. Returns the index of |key| in keys(), or keys().size() if not found.
+    const std::vector<std::string>& keys() const { return keys_; }
+    size_t keyIndex(const std::string& key) const;
+    const Value& column(size_t keyIndex) const { return columns_[keyIndex]; }
+    Value columnAt(size_t keyIndex, size_t index) const;
+
+    // Returns the same hash as at(index).hash() without making a value.
+    std::uint64_t hashAt(size_t index) const;
+    // Returns the same as at(index) == v without making a value.
+    bool equalAt(size_t index, const Value& v) const;
+
+    // Returns the elements as Array. It's built on the first call.
+    const Array& array() const;
+    // Returns the elements as Array. The cached one is moved if any.
+    Array unpack();
+
+    friend bool operator==(const PackedArray& lhs, const PackedArray& rhs);
+
+private:
+    // Compares the columns of arrays of tables by key.
+    static bool equalColumns(const PackedArray& lhs, const PackedArray& rhs);
+
+    Value::Type elementType_;
+    std::vector<std::int64_t> ints_;
+    std::vector<double> doubles_;
+    std::vector<bool> bools_;
+    std::string stringBlob_;
+    // stringOffsets_[i] is the beginning of the i-th string in stringBlob_. It has size() + 1 elements.
+    std::vector<size_t> stringOffsets_;
+    // For tables. keys_ is in the order of the first table, and sortedKeys_ is the indices
+    // of keys_ sorted by key for lookup.
+    std::vector<std::string> keys_;
+    std::vector<size_t> sortedKeys_;
+    std::vector<Value> columns_;
+    size_t tableCount_ = 0;
+
+    mutable std::once_flag arrayOnce_;
+    mutable std::unique_ptr<Array> array_;
+};
+
+enum class TokenType {
+    ERROR_TOKEN,
+    END_OF_FILE,
+    END_OF_LINE,
+    IDENT,
+    STRING,
+    MULTILINE_STRING,
+    BOOL,
+    INT,
+    DOUBLE,
+    TIME,
+    COMMA,
+    DOT,
+    EQUAL,
+    LBRACKET,
+    RBRACKET,
+    LBRACE,
+    RBRACE,
+};
+
+class Token {
+public:
+    explicit Token(TokenType tokenType) : type_(tokenType) {}
+    Token(TokenType tokenType, const std::string& v) : type_(tokenType), str_value_(v) {}
+    Token(TokenType tokenType, bool v) : type_(tokenType), int_value_(v) {}
+    Token(TokenType tokenType, std::int64_t v) : type_(tokenType), int_value_(v) {}
+    Token(TokenType tokenType, double v) : type_(tokenType), double_value_(v) {}
+    Token(TokenType tokenType, std::chrono::system_clock::time_point tp) : type_(tokenType), time_value_(tp) {}
+
+    TokenType type() const { return type_; }
+    const std::string& strValue() const { return str_value_; }
+    bool boolValue() const { return int_value_ != 0; }
+    std::int64_t intValue() const { return int_value_; }
+    double doubleValue() const { return double_value_; }
+    std::chrono::system_clock::time_point timeValue() const { return time_value_; }
+
+private:
+    TokenType type_;
+    std::string str_value_;
+    std::int64_t int_value_;
+    double double_value_;
+    std::chrono::system_clock::time_point time_value_;
+};
+
+// Where Lexer::scanNumbers() stopped.
+enum class NumberScanState {
+    // Just after an element. ',' or ']' (or something unusual) follows.
+    AFTER_ELEMENT,
+    // Just after ','. An element follows.
+    AFTER_COMMA,
+    // Just after an element which is not a number of the requested type. It's returned as a token.
+    TOKEN,
+};
+
+class Lexer {
+public:
+    explicit Lexer(std::istream& is) : is_(is), lineNo_(1) {}
+
+    Token nextKeyToken();
+    Token nextValueToken();
+
+    // Scans "ws* , ws* number" repeatedly just after a number element in an array,
+    // and appends the numbers to |ints| (for INT) or |doubles| (for DOUBLE).
+    // This doesn't make a token for each element, so it's much faster than nextValueToken()
+    // for a long numeric array. It stops before anything unusual (comments, strings, nested arrays, ...).
+    NumberScanState scanNumbers(TokenType type, std::vector<std::int64_t>* ints, std::vector<double>* doubles, Token* token);
+
+    int lineNo() const { return lineNo_; }
+
+    // Skips if UTF8BOM is found.
+    // Returns true if success. Returns false if intermediate state is left.
+    bool skipUTF8BOM();
+
+private:
+    bool current(char* c);
+    void next();
+    bool consume(char c);
+
+    Token nextToken(bool isValueToken);
+
+    void skipUntilNewLine();
+
+    Token nextStringDoubleQuote();
+    Token nextStringSingleQuote();
+
+    Token nextKey();
+    Token nextValue();
+
+    Token parseAsLiteral(const std::string&);
+    Token parseAsTime(const std::string&);
+
+    std::istream& is_;
+    int lineNo_;
+};
+
+class Parser {
+public:
+    explicit Parser(std::istream& is) : Parser(is, ParseOptions()) {}
+    Parser(std::istream& is, const ParseOptions& options) :
+        lexer_(is), token_(TokenType::ERROR_TOKEN), arena_(options.arena), keyPool_(options.keyPool),
+        packArrays_(options.packArrays)
+    {
+        if (!lexer_.skipUTF8BOM()) {
+            token_ = Token(TokenType::ERROR_TOKEN, std::string("Invalid UTF8 BOM"));
+        } else {
+            nextKey();
+        }
+    }
+
+    // Parses. If failed, value should be invalid value.
+    // You can get the error by calling errorReason().
+    Value parse();
+    const std::string& errorReason();
+
+private:
+    const Token& token() const { return token_; }
+    void nextKey() { token_ = lexer_.nextKeyToken(); }
+    void nextValue() { token_ = lexer_.nextValueToken(); }
+
+    void skipForKey();
+    void skipForValue();
+
+    bool consumeForKey(TokenType);
+    bool consumeForValue(TokenType);
+    bool consumeEOLorEOFForKey();
+
+    Value* parseGroupKey(Value* root);
+
+    bool parseKeyValue(Value*);
+    bool parseKey(std::string*);
+    bool parseValue(Value*);
+    bool parseBool(Value*);
+    bool parseNumber(Value*);
+    bool parseArray(Value*);
+    bool parseNumbers(Array*);
+    bool parseInlineTable(Value*);
+
+    void addError(const std::string& reason);
+
+    Table newTable() const { return Table(Table::allocator_type(arena_)); }
+    Array newArray() const { return Array(Array::allocator_type(arena_)); }
+
+    Lexer lexer_;
+    Token token_;
+    std::string errorReason_;
+    std::shared_ptr<Arena> arena_;
+    KeyPool* keyPool_;
+    bool packArrays_;
+};
+
+} // namespace internal
+
+// ----------------------------------------------------------------------
+// Implementations
+
+inline ParseResult parse(std::istream& is)
+{
+    return parse(is, ParseOptions());
+}
+
+inline ParseResult parseFile(const std::string& filename)
+{
+    return parseFile(filename, ParseOptions());
+}
+
+inline ParseResult parse(std::istream& is, const ParseOptions& options)
+{
+    if (!is) {
+        return ParseResult(toml::Value(), "stream is in bad state. file does not exist?");
+    }
+
+    internal::Parser parser(is, options);
+    toml::Value v = parser.parse();
+    if (options.arena)
+        options.arena->seal();
+
+    if (v.valid())
+        return ParseResult(std::move(v), std::string());
+
+    return ParseResult(std::move(v), std::move(parser.errorReason()));
+}
+
+namespace internal {
+ParseResult parseFileCached(const std::string& filename, const ParseOptions& options);
+} // namespace internal
+
+inline ParseResult parseFile(const std::string& filename, const ParseOptions& options)
+{
+    if (!options.cacheDirectory.empty() && !options.arena && TablePolicy::sorted)
+        return internal::parseFileCached(filename, options);
+
+    std::ifstream ifs(filename);
+    if (!ifs) {
+        return ParseResult(toml::Value(),
+                           std::string("could not open file: ") + filename);
+    }
+
+    return parse(ifs, options);
+}
+
+inline ParseResult parse(std::istream& is, const std::shared_ptr<Arena>& arena)
+{
+    ParseOptions options;
+    options.arena = arena;
+    return parse(is, options);
+}
+
+inline ParseResult parseFile(const std::string& filename, const std::shared_ptr<Arena>& arena)
+{
+    ParseOptions options;
+    options.arena = arena;
+    return parseFile(filename, options);
+}
+
+// ----------------------------------------------------------------------
+// Arena
+
+inline Arena::~Arena()
+{
+    for (const Block& block : blocks_) {
+#if defined(__linux__)
+        if (block.mapped) {
+            munmap(block.begin, block.size);
+            continue;
+        }
+#endif
+        ::operator delete(block.begin);
+    }
+}
+
+inline void* Arena::allocate(size_t size, size_t alignment)
+{
+    if (size == 0)
+        size = 1;
+
+    uintptr_t p = (reinterpret_cast<uintptr_t>(current_) + alignment - 1) & ~(alignment - 1);
+    if (!current_ || p + size > reinterpret_cast<uintptr_t>(end_)) {
+        addBlock(size + alignment);
+        p = (reinterpret_cast<uintptr_t>(current_) + alignment - 1) & ~(alignment - 1);
+    }
+
+    current_ = reinterpret_cast<char*>(p + size);
+    allocated_ += size;
+    return reinterpret_cast<void*>(p);
+}
+
+inline bool Arena::owns(const void* p) const
+{
+    const char* c = static_cast<const char*>(p);
+    auto it = std::upper_bound(blocks_.begin(), blocks_.end(), c, [](const char* x, const Block& block) {
+        return x < block.begin;
+    });
+    if (it == blocks_.begin())
+        return false;
+    --it;
+    return c < it->begin + it->size;
+}
+
+inline void Arena::addBlock(size_t minSize)
+{
+    size_t size = std::max(nextBlockSize_, minSize);
+    // Blocks grow geometrically, so a large document lives in a few blocks.
+    if (nextBlockSize_ < 64 * 1024 * 1024)
+        nextBlockSize_ *= 2;
+
+    Block block;
+    block.mapped = false;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    const size_t hugePageSize = 2 * 1024 * 1024;
+    if ((flags_ & ARENA_HUGE_PAGE) && size >= hugePageSize) {
+        size = (size + hugePageSize - 1) & ~(hugePageSize - 1);
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+            // It's just an advice. We don't care the result.
+            madvise(p, size, MADV_HUGEPAGE);
+            block.begin = static_cast<char*>(p);
+            block.mapped = true;
+        }
+    }
+#endif
+    if (!block.mapped)
+        block.begin = static_cast<char*>(::operator new(size));
+    block.size = size;
+
+    auto it = std::upper_bound(blocks_.begin(), blocks_.end(), block.begin, [](const char* x, const Block& b) {
+        return x < b.begin;
+    });
+    blocks_.insert(it, block);
+
+    current_ = block.begin;
+    end_ = block.begin + size;
+}
+
+inline std::string format(std::stringstream& ss)
+{
+    return ss.str();
+}
+
+template<typename T, typename... Args>
+std::string format(std::stringstream& ss, T&& t, Args&&... args)
+{
+    ss << std::forward<T>(t);
+    return format(ss, std::forward<Args>(args)...);
+}
+
+// If you want to compile without exception,
+//   1. Define TOML_HAVE_FAILWITH_REPLACEMENT
+//   2. Define your own toml::failwith.
+// e.g. You can just abort here instead of exception.
+#ifndef TOML_HAVE_FAILWITH_REPLACEMENT
+
+template<typename... Args>
+#if defined(_MSC_VER)
+__declspec(noreturn)
+#else
+[[noreturn]]
+#endif
+void failwith(Args&&... args)
+{
+    std::stringstream ss;
+    throw std::runtime_error(format(ss, std::forward<Args>(args)...));
+}
+
+#endif
+
+namespace internal {
+
+// Returns the entries of |table| sorted by key.
+template<typename TableType>
+std::vector<const typename TableType::value_type*> sortedEntries(const TableType& table, bool sorted)
+{
+    typedef const typename TableType::value_type* Entry;
+    std::vector<Entry> entries;
+    entries.reserve(table.size());
+    for (const auto& kv : table)
+        entries.push_back(&kv);
+    if (!sorted) {
+        std::sort(entries.begin(), entries.end(), [](Entry lhs, Entry rhs) {
+            return static_cast<const std::string&>(lhs->first) < static_cast<const std::string&>(rhs->first);
+        });
+    }
+    return entries;
+}
+
+// Helpers of Value::hash(). They use FNV-1a and a 64-bit finalizer, so the hash doesn't depend
+// on std::hash.
+inline std::uint64_t mixHash(std::uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+inline std::uint64_t combineHash(std::uint64_t seed, std::uint64_t h)
+{
+    return mixHash(seed * 31 + h);
+}
+
+inline std::uint64_t hashBytes(const char* s, size_t n)
+{
+    std::uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < n; ++i) {
+        h ^= static_cast<unsigned char>(s[i]);
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+inline std::uint64_t hashInt(std::int64_t x) { return mixHash(1 + static_cast<std::uint64_t>(x)); }
+inline std::uint64_t hashBool(bool b) { return mixHash(b ? 3 : 2); }
+inline std::uint64_t hashString(const char* s, size_t n) { return mixHash(hashBytes(s, n) + 4); }
+inline std::uint64_t hashString(const std::string& s) { return hashString(s.data(), s.size()); }
+
+inline std::uint64_t hashDouble(double d)
+{
+    // 0.0 == -0.0
+    if (d == 0)
+        d = 0;
+    std::uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    return mixHash(bits + 5);
+}
+
+// NumericCast converts an integer or double element to an arithmetic T with a range check.
+template<typename T, typename Enable = void>
+struct NumericCast {
+    static const bool numeric = false;
+};
+
+template<typename T>
+struct NumericCast<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> {
+    static const bool numeric = true;
+    static const Value::Type elementType = Value::INT_TYPE;
+    typedef std::int64_t source_type;
+
+    static bool inRange(std::int64_t x) { return inRange(x, std::is_signed<T>()); }
+    static bool inRange(std::int64_t x, std::true_type /* signed */)
+    {
+        return static_cast<std::int64_t>(std::numeric_limits<T>::min()) <= x &&
+            x <= static_cast<std::int64_t>(std::numeric_limits<T>::max());
+    }
+    static bool inRange(std::int64_t x, std::false_type /* signed */)
+    {
+        return 0 <= x && static_cast<std::uint64_t>(x) <= static_cast<std::uint64_t>(std::numeric_limits<T>::max());
+    }
+
+    static T cast(std::int64_t x)
+    {
+        if (!inRange(x))
+            failwith("range error: ", x, " is out of the range of the requested type");
+        return static_cast<T>(x);
+    }
+};
+
+template<typename T>
+struct NumericCast<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+    static const bool numeric = true;
+    static const Value::Type elementType = Value::DOUBLE_TYPE;
+    typedef double source_type;
+
+    // Infinity and NaN are in any range.
+    static bool inRange(double d) { return !(std::fabs(d) > std::numeric_limits<T>::max()) || std::isinf(d); }
+
+    static T cast(double d)
+    {
+        if (!inRange(d))
+            failwith("range error: ", d, " is out of the range of the requested type");
+        return static_cast<T>(d);
+    }
+};
+
+// BulkConverter converts all the elements of an array. See Value::copyTo() and Value::into().
+template<typename T, bool numeric = NumericCast<T>::numeric>
+struct BulkConverter {
+    static void convert(const Value& v, T* out) { *out = v.as<T>(); }
+
+    template<typename OutputIt>
+    static OutputIt copy(const Value& array, OutputIt out)
+    {
+        for (const Value& v : array.as<Array>()) {
+            T x;
+            convert(v, &x);
+            *out++ = std::move(x);
+        }
+        return out;
+    }
+
+    static void into(const Value& array, std::vector<T>* out)
+    {
+        out->clear();
+        out->reserve(array.size());
+        copy(array, std::back_inserter(*out));
+    }
+};
+
+template<typename T>
+struct BulkConverter<T, true> {
+    typedef NumericCast<T> Cast;
+    typedef typename Cast::source_type source_type;
+
+    // Throws an exception if an element of |span| is out of the range of T.
+    static void checkRange(Span<const source_type> span)
+    {
+        bool ok = true;
+        for (source_type x : span)
+            ok &= Cast::inRange(x);
+        if (!ok) {
+            for (source_type x : span)
+                Cast::cast(x);
+        }
+    }
+
+    static void convert(const Value& v, T* out)
+    {
+        *out = Cast::cast(v.as<source_type>());
+    }
+
+    template<typename OutputIt>
+    static OutputIt copy(const Value& array, OutputIt out)
+    {
+        if (!array.is<Span<const source_type>>()) {
+            for (const Value& v : array.as<Array>()) {
+                T x;
+                convert(v, &x);
+                *out++ = x;
+            }
+            return out;
+        }
+
+        // A packed array. Both loops are simple enough to be vectorized by the compiler.
+        Span<const source_type> span = array.as<Span<const source_type>>();
+        checkRange(span);
+        for (source_type x : span)
+            *out++ = static_cast<T>(x);
+        return out;
+    }
+
+    static void into(const Value& array, std::vector<T>* out)
+    {
+        if (array.is<Span<const source_type>>()) {
+            // The range is checked first, so that |out| is not modified on an error.
+            Span<const source_type> span = array.as<Span<const source_type>>();
+            checkRange(span);
+            out->resize(span.size());
+            T* p = out->data();
+            for (source_type x : span)
+                *p++ = static_cast<T>(x);
+            return;
+        }
+
+        out->clear();
+        out->reserve(array.size());
+        copy(array, std::back_inserter(*out));
+    }
+};
+
+template<typename T>
+struct BulkConverter<std::vector<T>, false> {
+    static void convert(const Value& v, std::vector<T>* out) { v.into(out); }
+
+    template<typename OutputIt>
+    static OutputIt copy(const Value& array, OutputIt out)
+    {
+        for (const Value& v : array.as<Array>()) {
+            std::vector<T> x;
+            v.into(&x);
+            *out++ = std::move(x);
+        }
+        return out;
+    }
+
+    // Reuses the inner vectors too.
+    static void into(const Value& array, std::vector<std::vector<T>>* out)
+    {
+        const Array& elements = array.as<Array>();
+        out->resize(elements.size());
+        for (size_t i = 0; i < elements.size(); ++i)
+            elements[i].into(&(*out)[i]);
+    }
+};
+
+inline std::string removeDelimiter(const std::string& s)
+{
+    std::string r;
+    for (char c : s) {
+        if (c == '_')
+            continue;
+        r += c;
+    }
+    return r;
+}
+
+inline std::string unescape(const std::string& codepoint)
+{
+    std::uint32_t x;
+    std::uint8_t buf[8];
+    std::stringstream ss(codepoint);
+
+    ss >> std::hex >> x;
+
+    if (x <= 0x7FUL) {
+        // 0xxxxxxx
+        buf[0] = 0x00 | ((x >> 0) & 0x7F);
+        buf[1] = '\0';
+    } else if (x <= 0x7FFUL) {
+        // 110yyyyx 10xxxxxx
+        buf[0] = 0xC0 | ((x >> 6) & 0xDF);
+        buf[1] = 0x80 | ((x >> 0) & 0xBF);
+        buf[2] = '\0';
+    } else if (x <= 0xFFFFUL) {
+        // 1110yyyy 10yxxxxx 10xxxxxx
+        buf[0] = 0xE0 | ((x >> 12) & 0xEF);
+        buf[1] = 0x80 | ((x >> 6) & 0xBF);
+        buf[2] = 0x80 | ((x >> 0) & 0xBF);
+        buf[3] = '\0';
+    } else if (x <= 0x10FFFFUL) {
+        // 11110yyy 10yyxxxx 10xxxxxx 10xxxxxx
+        buf[0] = 0xF0 | ((x >> 18) & 0xF7);
+        buf[1] = 0x80 | ((x >> 12) & 0xBF);
+        buf[2] = 0x80 | ((x >> 6) & 0xBF);
+        buf[3] = 0x80 | ((x >> 0) & 0xBF);
+        buf[4] = '\0';
+    } else {
+        buf[0] = '\0';
+    }
+
+    return reinterpret_cast<char*>(buf);
+}
+
+// Returns true if |s| is integer.
+// [+-]?\d+(_\d+)*
+inline bool isInteger(const std::string& s)
+{
+    if (s.empty())
+        return false;
+
+    std::string::size_type p = 0;
+    if (s[p] == '+' || s[p] == '-')
+        ++p;
+
+    while (p < s.size() && '0' <= s[p] && s[p] <= '9') {
+        ++p;
+        if (p < s.size() && s[p] == '_') {
+            ++p;
+            if (!(p < s.size() && '0' <= s[p] && s[p] <= '9'))
+                return false;
+        }
+    }
+
+    return p == s.size();
+}
+
+// Returns true if |c| can be a part of number or time literal.
+inline bool isLiteralChar(char c)
+{
+    return ('0' <= c && c <= '9') || c == '.' || c == 'e' || c == 'E' ||
+        c == 'T' || c == 'Z' || c == '_' || c == ':' || c == '-' || c == '+';
+}
+
+// Converts |s| to integer. |s| should be integer (see isInteger).
+// Returns false if it has no digit or it overflows.
+inline bool parseInteger(const std::string& s, std::int64_t* x)
+{
+    std::string::size_type p = 0;
+    bool negative = false;
+    if (s[p] == '+' || s[p] == '-') {
+        negative = s[p] == '-';
+        ++p;
+    }
+    if (p == s.size())
+        return false;
+
+    // Accumulates as negative, since |INT64_MIN| > INT64_MAX.
+    const std::int64_t minValue = std::numeric_limits<std::int64_t>::min();
+    std::int64_t r = 0;
+    for (; p < s.size(); ++p) {
+        if (s[p] == '_')
+            continue;
+        int d = s[p] - '0';
+        if (r < (minValue + d) / 10)
+            return false;
+        r = r * 10 - d;
+    }
+
+    if (!negative) {
+        if (r == minValue)
+            return false;
+        r = -r;
+    }
+    *x = r;
+    return true;
+}
+
+// Converts |s| to double. |s| should be double (see isDouble).
+// Returns false if it's out of range.
+// Parses |s| in the "C" locale, whatever the locale of the process is.
+// Returns false if not all of |s| is a double, or if it's out of range.
+inline bool parseDouble(const std::string& s, double* d)
+{
+    std::string r = s.find('_') == std::string::npos ? s : removeDelimiter(s);
+#if defined(__linux__) || defined(__APPLE__)
+    static const locale_t cLocale = ::newlocale(LC_NUMERIC_MASK, "C", nullptr);
+    char* end = nullptr;
+    errno = 0;
+    *d = ::strtod_l(r.c_str(), &end, cLocale);
+    return end == r.c_str() + r.size() && errno != ERANGE;
+#elif defined(_MSC_VER)
+    static const _locale_t cLocale = ::_create_locale(LC_NUMERIC, "C");
+    char* end = nullptr;
+    errno = 0;
+    *d = ::_strtod_l(r.c_str(), &end, cLocale);
+    return end == r.c_str() + r.size() && errno != ERANGE;
+#else
+    std::istringstream ss(r);
+    ss.imbue(std::locale::classic());
+    ss >> *d;
+    return !ss.fail() && ss.peek() == std::char_traits<char>::eof();
+#endif
+}
+
+// Returns true if |s| is double.
+// [+-]? (\d+(_\d+)*)? (\.\d+(_\d+)*)? ([eE] [+-]? \d+(_\d+)*)?
+//       1-----------  2-------------  3----------------------
+// 2 or (1 and 3) should exist.
+inline bool isDouble(const std::string& s)
+{
+    if (s.empty())
+        return false;
+
+    std::string::size_type p = 0;
+    if (s[p] == '+' || s[p] == '-')
+        ++p;
+
+    bool ok = false;
+    while (p < s.size() && '0' <= s[p] && s[p] <= '9') {
+        ++p;
+        ok = true;
+
+        if (p < s.size() && s[p] == '_') {
+            ++p;
+            if (!(p < s.size() && '0' <= s[p] && s[p] <= '9'))
+                return false;
+        }
+    }
+
+    if (p < s.size() && s[p] == '.')
+        ++p;
+
+    while (p < s.size() && '0' <= s[p] && s[p] <= '9') {
+        ++p;
+        ok = true;
 
         if (p < s.size() && s[p] == '_') {
             ++p;
@@ -545,1166 +2791,4170 @@ inline bool isDouble(const std::string& s)
         }
     }
 
-    if (!ok)
-        return false;
+    if (!ok)
+        return false;
+
+    ok = false;
+    if (p < s.size() && (s[p] == 'e' || s[p] == 'E')) {
+        ++p;
+        if (p < s.size() && (s[p] == '+' || s[p] == '-'))
+            ++p;
+        while (p < s.size() && '0' <= s[p] && s[p] <= '9') {
+            ++p;
+            ok = true;
+
+            if (p < s.size() && s[p] == '_') {
+                ++p;
+                if (!(p < s.size() && '0' <= s[p] && s[p] <= '9'))
+                    return false;
+            }
+        }
+        if (!ok)
+            return false;
+    }
+
+    return p == s.size();
+}
+
+// static
+inline std::string escapeString(const std::string& s)
+{
+    std::stringstream ss;
+    for (size_t i = 0; i < s.size(); ++i) {
+        switch (s[i]) {
+        case '\n': ss << "\\n"; break;
+        case '\r': ss << "\\r"; break;
+        case '\t': ss << "\\t"; break;
+        case '\"': ss << "\\\""; break;
+        case '\'': ss << "\\\'"; break;
+        case '\\': ss << "\\\\"; break;
+        default: ss << s[i]; break;
+        }
+    }
+
+    return ss.str();
+}
+
+} // namespace internal
+
+// ----------------------------------------------------------------------
+// Lexer
+
+namespace internal {
+
+inline bool Lexer::skipUTF8BOM()
+{
+    // Check [EF, BB, BF]
+
+    int x1 = is_.peek();
+    if (x1 != 0xEF) {
+        // When the first byte is not 0xEF, it's not UTF8 BOM.
+        // Just return true.
+        return true;
+    }
+
+    is_.get();
+    int x2 = is_.get();
+    if (x2 != 0xBB) {
+        return false;
+    }
+
+    int x3 = is_.get();
+    if (x3 != 0xBF) {
+        return false;
+    }
+
+    return true;
+}
+
+inline bool Lexer::current(char* c)
+{
+    int x = is_.peek();
+    if (x == EOF)
+        return false;
+    *c = static_cast<char>(x);
+    return true;
+}
+
+inline void Lexer::next()
+{
+    int x = is_.get();
+    if (x == '\n')
+        ++lineNo_;
+}
+
+inline bool Lexer::consume(char c)
+{
+    char x;
+    if (!current(&x))
+        return false;
+    if (x != c)
+        return false;
+    next();
+    return true;
+}
+
+inline void Lexer::skipUntilNewLine()
+{
+    char c;
+    while (current(&c)) {
+        if (c == '\n')
+            return;
+        next();
+    }
+}
+
+inline Token Lexer::nextStringDoubleQuote()
+{
+    if (!consume('"'))
+        return Token(TokenType::ERROR_TOKEN, std::string("string didn't start with '\"'"));
+
+    std::string s;
+    char c;
+    bool multiline = false;
+
+    if (current(&c) && c == '"') {
+        next();
+        if (!current(&c) || c != '"') {
+            // OK. It's empty string.
+            return Token(TokenType::STRING, std::string());
+        }
+
+        next();
+        // raw string literal started.
+        // Newline just after """ should be ignored.
+        while (current(&c) && (c == ' ' || c == '\t'))
+            next();
+        if (current(&c) && c == '\n')
+            next();
+        multiline = true;
+    }
+
+    while (current(&c)) {
+        next();
+        if (c == '\\') {
+            if (!current(&c))
+                return Token(TokenType::ERROR_TOKEN, std::string("string has unknown escape sequence"));
+            next();
+            switch (c) {
+            case 't': c = '\t'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 'u':
+            case 'U': {
+                int size = c == 'u' ? 4 : 8;
+                std::string codepoint;
+                for (int i = 0; i < size; ++i) {
+                  if (current(&c) && (('0' <= c && c <= '9') || ('A' <= c && c <= 'F') || ('a' <= c && c <= 'f'))) {
+                    codepoint += c;
+                    next();
+                  } else {
+                    return Token(TokenType::ERROR_TOKEN, std::string("string has unknown escape sequence"));
+                  }
+                }
+                s += unescape(codepoint);
+                continue;
+            }
+            case '"': c = '"'; break;
+            case '\'': c = '\''; break;
+            case '\\': c = '\\'; break;
+            case '\n':
+                while (current(&c) && (c == ' ' || c == '\t' || c == '\r' || c == '\n')) {
+                    next();
+                }
+                continue;
+            default:
+                return Token(TokenType::ERROR_TOKEN, std::string("string has unknown escape sequence"));
+            }
+        } else if (c == '"') {
+            if (multiline) {
+                if (current(&c) && c == '"') {
+                    next();
+                    if (current(&c) && c == '"') {
+                        next();
+                        return Token(TokenType::MULTILINE_STRING, s);
+                    } else {
+                        s += '"';
+                        s += '"';
+                        continue;
+                    }
+                } else {
+                    s += '"';
+                    continue;
+                }
+            } else {
+                return Token(TokenType::STRING, s);
+            }
+        }
+
+        s += c;
+    }
+
+    return Token(TokenType::ERROR_TOKEN, std::string("string didn't end"));
+}
+
+inline Token Lexer::nextStringSingleQuote()
+{
+    if (!consume('\''))
+        return Token(TokenType::ERROR_TOKEN, std::string("string didn't start with '\''?"));
+
+    std::string s;
+    char c;
+
+    if (current(&c) && c == '\'') {
+        next();
+        if (!current(&c) || c != '\'') {
+            // OK. It's empty string.
+            return Token(TokenType::STRING, std::string());
+        }
+        next();
+        // raw string literal started.
+        // Newline just after """ should be ignored.
+        if (current(&c) && c == '\n')
+            next();
+
+        while (current(&c)) {
+            if (c == '\'') {
+                next();
+                if (current(&c) && c == '\'') {
+                    next();
+                    if (current(&c) && c == '\'') {
+                        next();
+                        return Token(TokenType::MULTILINE_STRING, s);
+                    } else {
+                        s += '\'';
+                        s += '\'';
+                        continue;
+                    }
+                } else {
+                    s += '\'';
+                    continue;
+                }
+            }
+
+            next();
+            s += c;
+        }
+
+        return Token(TokenType::ERROR_TOKEN, std::string("string didn't end with '\'\'\'' ?"));
+    }
+
+    while (current(&c)) {
+        next();
+        if (c == '\'') {
+            return Token(TokenType::STRING, s);
+        }
+
+        s += c;
+    }
+
+    return Token(TokenType::ERROR_TOKEN, std::string("string didn't end with '\''?"));
+}
+
+inline Token Lexer::nextKey()
+{
+    std::string s;
+    char c;
+    while (current(&c) && (isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-')) {
+        s += c;
+        next();
+    }
+
+    if (s.empty())
+        return Token(TokenType::ERROR_TOKEN, std::string("Unknown key format"));
+
+    return Token(TokenType::IDENT, s);
+}
+
+inline Token Lexer::nextValue()
+{
+    std::string s;
+    char c;
+
+    if (current(&c) && isalpha(static_cast<unsigned char>(c))) {
+        s += c;
+        next();
+        while (current(&c) && isalpha(static_cast<unsigned char>(c))) {
+            s += c;
+            next();
+        }
+
+        if (s == "true")
+            return Token(TokenType::BOOL, true);
+        if (s == "false")
+            return Token(TokenType::BOOL, false);
+        return Token(TokenType::ERROR_TOKEN, std::string("Unknown ident: ") + s);
+    }
+
+    while (current(&c) && isLiteralChar(c)) {
+        next();
+        s += c;
+    }
+
+    return parseAsLiteral(s);
+}
+
+inline Token Lexer::parseAsLiteral(const std::string& s)
+{
+    if (isInteger(s)) {
+        std::int64_t x;
+        if (parseInteger(s, &x))
+            return Token(TokenType::INT, x);
+
+        std::stringstream ss(removeDelimiter(s));
+        ss >> x;
+        return Token(TokenType::INT, x);
+    }
+
+    if (isDouble(s)) {
+        double d;
+        if (parseDouble(s, &d))
+            return Token(TokenType::DOUBLE, d);
+
+        std::stringstream ss(removeDelimiter(s));
+        ss >> d;
+        return Token(TokenType::DOUBLE, d);
+    }
+
+    return parseAsTime(s);
+}
+
+inline Token Lexer::parseAsTime(const std::string& str)
+{
+    const char* s = str.c_str();
+
+    int n;
+    int YYYY, MM, DD;
+#if defined(_MSC_VER)
+    if (sscanf_s(s, "%d-%d-%d%n", &YYYY, &MM, &DD, &n) != 3)
+        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
+#else
+    if (sscanf(s, "%d-%d-%d%n", &YYYY, &MM, &DD, &n) != 3)
+        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
+#endif
+
+    if (!(1 <= MM && MM <= 12)) {
+        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
+    }
+    if (YYYY < 1900) {
+        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
+    }
+
+    if (s[n] == '\0') {
+        std::tm t;
+        t.tm_sec = 0;
+        t.tm_min = 0;
+        t.tm_hour = 0;
+        t.tm_mday = DD;
+        t.tm_mon = MM - 1;
+        t.tm_year = YYYY - 1900;
+        auto tp = std::chrono::system_clock::from_time_t(timegm(&t));
+        return Token(TokenType::TIME, tp);
+    }
+
+    if (s[n] != 'T')
+        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
+
+    s = s + n + 1;
+
+    int hh, mm;
+    double ss; // double for fraction
+#if defined(_MSC_VER)
+    if (sscanf_s(s, "%d:%d:%lf%n", &hh, &mm, &ss, &n) != 3)
+        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
+#else
+    if (sscanf(s, "%d:%d:%lf%n", &hh, &mm, &ss, &n) != 3)
+        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
+#endif
+
+    std::tm t;
+    t.tm_sec = static_cast<int>(ss);
+    t.tm_min = mm;
+    t.tm_hour = hh;
+    t.tm_mday = DD;
+    t.tm_mon = MM - 1;
+    t.tm_year = YYYY - 1900;
+    auto tp = std::chrono::system_clock::from_time_t(timegm(&t));
+    ss -= static_cast<int>(ss);
+    // TODO(mayah): workaround GCC 4.9.3 on cygwin does not have std::round, but round().
+    tp += std::chrono::microseconds(static_cast<std::int64_t>(round(ss * 1000000)));
+
+    if (s[n] == '\0')
+        return Token(TokenType::TIME, tp);
+
+    if (s[n] == 'Z' && s[n + 1] == '\0')
+        return Token(TokenType::TIME, tp);
+
+    s = s + n;
+    // offset
+    // [+/-]%d:%d
+    char pn;
+    int oh, om;
+#if defined(_MSC_VER)
+    if (sscanf_s(s, "%c%d:%d", &pn, static_cast<unsigned>(sizeof(pn)), &oh, &om) != 3)
+        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
+#else
+    if (sscanf(s, "%c%d:%d", &pn, &oh, &om) != 3)
+        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
+#endif
+
+    if (pn != '+' && pn != '-')
+        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
+
+    if (pn == '+') {
+        tp -= std::chrono::hours(oh);
+        tp -= std::chrono::minutes(om);
+    } else {
+        tp += std::chrono::hours(oh);
+        tp += std::chrono::minutes(om);
+    }
+
+    return Token(TokenType::TIME, tp);
+}
+
+// Splits a dotted |key| into |parts|. Returns false if |key| is not a valid key.
+inline bool splitKey(const std::string& key, std::vector<std::string>* parts)
+{
+    std::istringstream ss(key);
+    Lexer lexer(ss);
+
+    while (true) {
+        Token t = lexer.nextKeyToken();
+        if (!(t.type() == TokenType::IDENT || t.type() == TokenType::STRING))
+            return false;
+        parts->push_back(t.strValue());
+
+        t = lexer.nextKeyToken();
+        if (t.type() == TokenType::END_OF_FILE)
+            return true;
+        if (t.type() != TokenType::DOT)
+            return false;
+    }
+}
+
+inline Token Lexer::nextKeyToken()
+{
+    return nextToken(false);
+}
+
+inline Token Lexer::nextValueToken()
+{
+    return nextToken(true);
+}
+
+inline NumberScanState Lexer::scanNumbers(TokenType type, std::vector<std::int64_t>* ints, std::vector<double>* doubles, Token* token)
+{
+    // Reads the stream buffer directly. The sentry of istream::peek() and get() is too heavy here.
+    std::streambuf* buf = is_.rdbuf();
+    const int eof = std::char_traits<char>::eof();
+    std::string s;
+
+    auto skipWhitespaces = [&]() {
+        int c;
+        while ((c = buf->sgetc()) != eof && (c == ' ' || c == '\t' || c == '\r' || c == '\n')) {
+            if (c == '\n')
+                ++lineNo_;
+            buf->sbumpc();
+        }
+        return c;
+    };
+
+    while (true) {
+        if (skipWhitespaces() != ',')
+            return NumberScanState::AFTER_ELEMENT;
+        buf->sbumpc();
+
+        int c = skipWhitespaces();
+        if (!(('0' <= c && c <= '9') || c == '+' || c == '-'))
+            return NumberScanState::AFTER_COMMA;
+
+        s.clear();
+        while ((c = buf->sgetc()) != eof && isLiteralChar(static_cast<char>(c))) {
+            s += static_cast<char>(c);
+            buf->sbumpc();
+        }
+
+        if (type == TokenType::INT) {
+            std::int64_t x;
+            if (isInteger(s) && parseInteger(s, &x)) {
+                ints->push_back(x);
+                continue;
+            }
+        } else {
+            double d;
+            if (!isInteger(s) && isDouble(s) && parseDouble(s, &d)) {
+                doubles->push_back(d);
+                continue;
+            }
+        }
+
+        *token = parseAsLiteral(s);
+        return NumberScanState::TOKEN;
+    }
+}
+
+inline Token Lexer::nextToken(bool isValueToken)
+{
+    char c;
+    while (current(&c)) {
+        if (c == ' ' || c == '\t' || c == '\r') {
+            next();
+            continue;
+        }
+
+        if (c == '#') {
+            skipUntilNewLine();
+            continue;
+        }
+
+        switch (c) {
+        case '\n':
+            next();
+            return Token(TokenType::END_OF_LINE);
+        case '=':
+            next();
+            return Token(TokenType::EQUAL);
+        case '{':
+            next();
+            return Token(TokenType::LBRACE);
+        case '}':
+            next();
+            return Token(TokenType::RBRACE);
+        case '[':
+            next();
+            return Token(TokenType::LBRACKET);
+        case ']':
+            next();
+            return Token(TokenType::RBRACKET);
+        case ',':
+            next();
+            return Token(TokenType::COMMA);
+        case '.':
+            next();
+            return Token(TokenType::DOT);
+        case '\"':
+            return nextStringDoubleQuote();
+        case '\'':
+            return nextStringSingleQuote();
+        default:
+            if (isValueToken) {
+                return nextValue();
+            } else {
+                return nextKey();
+            }
+        }
+    }
+
+    return Token(TokenType::END_OF_FILE);
+}
+
+} // namespace internal
+
+// ----------------------------------------------------------------------
+
+// static
+inline const char* Value::typeToString(Value::Type type)
+{
+    switch (type) {
+    case NULL_TYPE:   return "null";
+    case BOOL_TYPE:   return "bool";
+    case INT_TYPE:    return "int";
+    case DOUBLE_TYPE: return "double";
+    case STRING_TYPE: return "string";
+    case TIME_TYPE:   return "time";
+    case ARRAY_TYPE:  return "array";
+    case TABLE_TYPE:  return "table";
+    default:          return "unknown";
+    }
+}
+
+inline Value::Value(const Value& v) :
+    type_(v.type_),
+    packed_(v.packed_)
+{
+    switch (v.type_) {
+    case NULL_TYPE: null_ = v.null_; break;
+    case BOOL_TYPE: bool_ = v.bool_; break;
+    case INT_TYPE: int_ = v.int_; break;
+    case DOUBLE_TYPE: double_ = v.double_; break;
+    case STRING_TYPE: string_ = internal::retainNode(v.string_); break;
+    case TIME_TYPE: time_ = v.time_; break;
+    case ARRAY_TYPE:
+        if (v.packed_)
+            packedArray_ = internal::retainNode(v.packedArray_);
+        else
+            array_ = internal::retainNode(v.array_);
+        break;
+    case TABLE_TYPE: table_ = internal::retainNode(v.table_); break;
+    default:
+        assert(false);
+        type_ = NULL_TYPE;
+        null_ = nullptr;
+    }
+}
+
+inline Value::Value(Value&& v) noexcept :
+    type_(v.type_),
+    packed_(v.packed_)
+{
+    switch (v.type_) {
+    case NULL_TYPE: null_ = v.null_; break;
+    case BOOL_TYPE: bool_ = v.bool_; break;
+    case INT_TYPE: int_ = v.int_; break;
+    case DOUBLE_TYPE: double_ = v.double_; break;
+    case STRING_TYPE: string_ = v.string_; break;
+    case TIME_TYPE: time_ = v.time_; break;
+    case ARRAY_TYPE:
+        if (v.packed_)
+            packedArray_ = v.packedArray_;
+        else
+            array_ = v.array_;
+        break;
+    case TABLE_TYPE: table_ = v.table_; break;
+    default:
+        assert(false);
+        type_ = NULL_TYPE;
+        null_ = nullptr;
+    }
+
+    v.type_ = NULL_TYPE;
+    v.null_ = nullptr;
+    v.packed_ = false;
+}
+
+inline Value& Value::operator=(const Value& v)
+{
+    if (this == &v)
+        return *this;
+
+    this->~Value();
+
+    type_ = v.type_;
+    packed_ = v.packed_;
+    switch (v.type_) {
+    case NULL_TYPE: null_ = v.null_; break;
+    case BOOL_TYPE: bool_ = v.bool_; break;
+    case INT_TYPE: int_ = v.int_; break;
+    case DOUBLE_TYPE: double_ = v.double_; break;
+    case STRING_TYPE: string_ = internal::retainNode(v.string_); break;
+    case TIME_TYPE: time_ = v.time_; break;
+    case ARRAY_TYPE:
+        if (v.packed_)
+            packedArray_ = internal::retainNode(v.packedArray_);
+        else
+            array_ = internal::retainNode(v.array_);
+        break;
+    case TABLE_TYPE: table_ = internal::retainNode(v.table_); break;
+    default:
+        assert(false);
+        type_ = NULL_TYPE;
+        null_ = nullptr;
+    }
+
+    return *this;
+}
+
+inline Value& Value::operator=(Value&& v) noexcept
+{
+    if (this == &v)
+        return *this;
+
+    this->~Value();
+
+    type_ = v.type_;
+    packed_ = v.packed_;
+    switch (v.type_) {
+    case NULL_TYPE: null_ = v.null_; break;
+    case BOOL_TYPE: bool_ = v.bool_; break;
+    case INT_TYPE: int_ = v.int_; break;
+    case DOUBLE_TYPE: double_ = v.double_; break;
+    case STRING_TYPE: string_ = v.string_; break;
+    case TIME_TYPE: time_ = v.time_; break;
+    case ARRAY_TYPE:
+        if (v.packed_)
+            packedArray_ = v.packedArray_;
+        else
+            array_ = v.array_;
+        break;
+    case TABLE_TYPE: table_ = v.table_; break;
+    default:
+        assert(false);
+        type_ = NULL_TYPE;
+        null_ = nullptr;
+    }
+
+    v.type_ = NULL_TYPE;
+    v.null_ = nullptr;
+    v.packed_ = false;
+    return *this;
+}
+
+inline Value::~Value()
+{
+    switch (type_) {
+    case STRING_TYPE:
+        internal::releaseNode(string_);
+        break;
+    case ARRAY_TYPE:
+        if (packed_)
+            internal::releaseNode(packedArray_);
+        else
+            internal::releaseNode(array_);
+        break;
+    case TABLE_TYPE:
+        internal::releaseNode(table_);
+        break;
+    default:
+        break;
+    }
+}
+
+inline size_t Value::size() const
+{
+    switch (type_) {
+    case NULL_TYPE:
+        return 0;
+    case ARRAY_TYPE:
+        return packed_ ? packedArray_->value.size() : array_->value.size();
+    case TABLE_TYPE:
+        return table_->value.size();
+    default:
+        return 1;
+    }
+}
+
+inline bool Value::empty() const
+{
+    return size() == 0;
+}
+
+template<> struct Value::ValueConverter<bool>
+{
+    bool is(const Value& v) { return v.type() == Value::BOOL_TYPE; }
+    bool to(const Value& v) { v.assureType<bool>(); return v.bool_; }
+
+};
+template<> struct Value::ValueConverter<int64_t>
+{
+    bool is(const Value& v) { return v.type() == Value::INT_TYPE; }
+    int64_t to(const Value& v) { v.assureType<int64_t>(); return v.int_; }
+};
+template<> struct Value::ValueConverter<int>
+{
+    bool is(const Value& v) { return v.type() == Value::INT_TYPE; }
+    int to(const Value& v) { v.assureType<int>(); return static_cast<int>(v.int_); }
+};
+template<> struct Value::ValueConverter<double>
+{
+    bool is(const Value& v) { return v.type() == Value::DOUBLE_TYPE; }
+    double to(const Value& v) { v.assureType<double>(); return v.double_; }
+};
+template<> struct Value::ValueConverter<float>
+{
+    bool is(const Value& v) { return v.type() == Value::DOUBLE_TYPE; }
+    float to(const Value& v) { v.assureType<float>(); return internal::NumericCast<float>::cast(v.double_); }
+};
+template<> struct Value::ValueConverter<std::string>
+{
+    bool is(const Value& v) { return v.type() == Value::STRING_TYPE; }
+    const std::string& to(const Value& v) { v.assureType<std::string>(); return v.string_->value; }
+};
+template<> struct Value::ValueConverter<Time>
+{
+    bool is(const Value& v) { return v.type() == Value::TIME_TYPE; }
+    const Time& to(const Value& v) { v.assureType<Time>(); return v.time_; }
+};
+template<> struct Value::ValueConverter<Array>
+{
+    bool is(const Value& v) { return v.type() == Value::ARRAY_TYPE; }
+    const Array& to(const Value& v) { v.assureType<Array>(); return v.arrayValue(); }
+};
+template<> struct Value::ValueConverter<Table>
+{
+    bool is(const Value& v) { return v.type() == Value::TABLE_TYPE; }
+    const Table& to(const Value& v) { v.assureType<Table>(); return v.table_->value; }
+};
+
+template<typename T>
+struct Value::ValueConverter<std::vector<T>>
+{
+    bool is(const Value& v)
+    {
+        if (v.type() != Value::ARRAY_TYPE)
+            return false;
+        if (v.packed_)
+            return v.packedArray_->value.at(0).is<T>();
+        const Array& array = v.as<Array>();
+        if (array.empty())
+            return true;
+        return array.front().is<T>();
+    }
+
+    std::vector<T> to(const Value& v)
+    {
+        std::vector<T> result;
+        v.into(&result);
+        return result;
+    }
+};
+
+template<> struct Value::ValueConverter<Span<const std::int64_t>>
+{
+    bool is(const Value& v)
+    {
+        if (v.isPacked())
+            return v.packedArray_->value.elementType() == Value::INT_TYPE;
+        return v.is<Array>() && v.empty();
+    }
+    Span<const std::int64_t> to(const Value& v)
+    {
+        v.assureType<Span<const std::int64_t>>();
+        if (!v.isPacked())
+            return Span<const std::int64_t>();
+        const std::vector<std::int64_t>& ints = v.packedArray_->value.ints();
+        return Span<const std::int64_t>(ints.data(), ints.size());
+    }
+};
+
+template<> struct Value::ValueConverter<Span<const double>>
+{
+    bool is(const Value& v)
+    {
+        if (v.isPacked())
+            return v.packedArray_->value.elementType() == Value::DOUBLE_TYPE;
+        return v.is<Array>() && v.empty();
+    }
+    Span<const double> to(const Value& v)
+    {
+        v.assureType<Span<const double>>();
+        if (!v.isPacked())
+            return Span<const double>();
+        const std::vector<double>& doubles = v.packedArray_->value.doubles();
+        return Span<const double>(doubles.data(), doubles.size());
+    }
+};
+
+namespace internal {
+template<typename T> inline const char* type_name();
+template<> inline const char* type_name<bool>() { return "bool"; }
+template<> inline const char* type_name<int>() { return "int"; }
+template<> inline const char* type_name<int64_t>() { return "int64_t"; }
+template<> inline const char* type_name<double>() { return "double"; }
+template<> inline const char* type_name<float>() { return "float"; }
+template<> inline const char* type_name<std::string>() { return "string"; }
+template<> inline const char* type_name<toml::Time>() { return "time"; }
+template<> inline const char* type_name<toml::Array>() { return "array"; }
+template<> inline const char* type_name<toml::Table>() { return "table"; }
+template<> inline const char* type_name<toml::Span<const std::int64_t>>() { return "packed int array"; }
+template<> inline const char* type_name<toml::Span<const double>>() { return "packed double array"; }
+} // namespace internal
+
+template<typename T>
+inline void Value::assureType() const
+{
+    if (!is<T>())
+        failwith("type error: this value is ", typeToString(type_), " but ", internal::type_name<T>(), " was requested");
+}
+
+template<typename T>
+inline bool Value::is() const
+{
+    return ValueConverter<T>().is(*this);
+}
+
+template<typename T>
+inline typename call_traits<T>::return_type Value::as() const
+{
+    return ValueConverter<T>().to(*this);
+}
+
+inline bool Value::isNumber() const
+{
+    return is<int>() || is<double>();
+}
+
+inline double Value::asNumber() const
+{
+    if (is<int>())
+        return as<int>();
+    if (is<double>())
+        return as<double>();
+
+    failwith("type error: this value is ", typeToString(type_), " but number is requested");
+}
+
+inline std::time_t Value::as_time_t() const
+{
+    return std::chrono::system_clock::to_time_t(as<Time>());
+}
+
+inline std::string Value::spaces(int num)
+{
+    if (num <= 0)
+        return std::string();
+
+    return std::string(num, ' ');
+}
+
+inline std::string Value::escapeKey(const std::string& key)
+{
+    auto position = std::find_if(key.begin(), key.end(), [](char c) -> bool {
+        if (std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-')
+            return false;
+        return true;
+    });
+
+    if (position != key.end()) {
+        std::string escaped = "\"";
+        for (const char& c : key) {
+            if (c == '\\' || c  == '"')
+                escaped += '\\';
+            escaped += c;
+        }
+        escaped += "\"";
+
+        return escaped;
+    }
+
+    return key;
+}
+
+inline void Value::write(std::ostream* os, const std::string& keyPrefix, int indent) const
+{
+    switch (type_) {
+    case NULL_TYPE:
+        failwith("null type value is not a valid value");
+        break;
+    case BOOL_TYPE:
+        (*os) << (bool_ ? "true" : "false");
+        break;
+    case INT_TYPE:
+        (*os) << int_;
+        break;
+    case DOUBLE_TYPE: {
+        (*os) << std::fixed << std::showpoint << double_;
+        break;
+    }
+    case STRING_TYPE:
+        (*os) << '"' << internal::escapeString(string_->value) << '"';
+        break;
+    case TIME_TYPE: {
+        time_t tt = std::chrono::system_clock::to_time_t(time_);
+        std::tm t;
+        gmtime_r(&tt, &t);
+        char buf[256];
+        snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02dZ", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+        (*os) << buf;
+        break;
+    }
+    case ARRAY_TYPE:
+        (*os) << '[';
+        for (size_t i = 0; i < size(); ++i) {
+            if (i)
+                (*os) << ", ";
+            if (packed_)
+                packedArray_->value.at(i).write(os, keyPrefix, -1);
+            else
+                array_->value[i].write(os, keyPrefix, -1);
+        }
+        (*os) << ']';
+        break;
+    case TABLE_TYPE:
+        for (const auto& kv : table_->value) {
+            if (kv.second.is<Table>())
+                continue;
+            if (kv.second.isArrayOfTables())
+                continue;
+            (*os) << spaces(indent) << escapeKey(kv.first) << " = ";
+            kv.second.write(os, keyPrefix, indent >= 0 ? indent + 1 : indent);
+            (*os) << '\n';
+        }
+        for (const auto& kv : table_->value) {
+            if (kv.second.is<Table>()) {
+                std::string key(keyPrefix);
+                if (!keyPrefix.empty())
+                    key += ".";
+                key += escapeKey(kv.first);
+                (*os) << "\n" << spaces(indent) << "[" << key << "]\n";
+                kv.second.write(os, key, indent >= 0 ? indent + 1 : indent);
+            }
+            if (kv.second.isArrayOfTables()) {
+                std::string key(keyPrefix);
+                if (!keyPrefix.empty())
+                    key += ".";
+                key += escapeKey(kv.first);
+                for (size_t i = 0; i < kv.second.size(); ++i) {
+                    (*os) << "\n" << spaces(indent) << "[[" << key << "]]\n";
+                    if (kv.second.packed_)
+                        kv.second.packedArray_->value.at(i).write(os, key, indent >= 0 ? indent + 1 : indent);
+                    else
+                        kv.second.array_->value[i].write(os, key, indent >= 0 ? indent + 1 : indent);
+                }
+            }
+        }
+        break;
+    default:
+        failwith("writing unknown type");
+        break;
+    }
+}
+
+inline void Value::writeFormatted(std::ostream* os, FormatFlag flags) const
+{
+    int indent = flags & FORMAT_INDENT ? 0 : -1;
+
+    write(os, std::string(), indent);
+}
+
+// static
+inline FormatFlag operator|(FormatFlag lhs, FormatFlag rhs)
+{
+    return static_cast<FormatFlag>(static_cast<int>(lhs) | static_cast<int>(rhs));
+}
+
+// static
+inline std::ostream& operator<<(std::ostream& os, const toml::Value& v)
+{
+    v.write(&os);
+    return os;
+}
+
+// static
+inline bool operator==(const Value& lhs, const Value& rhs)
+{
+    if (lhs.type() != rhs.type())
+        return false;
+
+    switch (lhs.type()) {
+    case Value::Type::NULL_TYPE:
+        return true;
+    case Value::Type::BOOL_TYPE:
+        return lhs.bool_ == rhs.bool_;
+    case Value::Type::INT_TYPE:
+        return lhs.int_ == rhs.int_;
+    case Value::Type::DOUBLE_TYPE:
+        return lhs.double_ == rhs.double_;
+    case Value::Type::STRING_TYPE:
+        return lhs.string_ == rhs.string_ || lhs.string_->value == rhs.string_->value;
+    case Value::Type::TIME_TYPE:
+        return lhs.time_ == rhs.time_;
+    case Value::Type::ARRAY_TYPE:
+        if (lhs.cachedHash() && rhs.cachedHash() && lhs.cachedHash() != rhs.cachedHash())
+            return false;
+        if (lhs.packed_ && rhs.packed_)
+            return lhs.packedArray_ == rhs.packedArray_ || lhs.packedArray_->value == rhs.packedArray_->value;
+        if (lhs.packed_ != rhs.packed_) {
+            // Compared element by element, so that the packed one is not materialized.
+            const internal::PackedArray& packed = (lhs.packed_ ? lhs : rhs).packedArray_->value;
+            const Array& array = (lhs.packed_ ? rhs : lhs).array_->value;
+            if (packed.size() != array.size())
+                return false;
+            for (size_t i = 0; i < array.size(); ++i) {
+                if (!packed.equalAt(i, array[i]))
+                    return false;
+            }
+            return true;
+        }
+        return lhs.array_ == rhs.array_ || lhs.array_->value == rhs.array_->value;
+    case Value::Type::TABLE_TYPE:
+        if (lhs.table_ == rhs.table_)
+            return true;
+        if (lhs.cachedHash() && rhs.cachedHash() && lhs.cachedHash() != rhs.cachedHash())
+            return false;
+        return lhs.table_->value == rhs.table_->value;
+    default:
+        failwith("unknown type");
+    }
+}
+
+template<typename T>
+inline typename call_traits<T>::return_type Value::get(const std::string& key) const
+{
+    if (!is<Table>())
+        failwith("type must be table to do get(key).");
+
+    const Value* obj = find(key);
+    if (!obj)
+        failwith("key ", key, " was not found.");
+
+    return obj->as<T>();
+}
+
+inline const Value* Value::find(const std::string& key) const
+{
+    if (!is<Table>())
+        return nullptr;
+
+    std::istringstream ss(key);
+    internal::Lexer lexer(ss);
+
+    const Value* current = this;
+    while (true) {
+        internal::Token t = lexer.nextKeyToken();
+        if (!(t.type() == internal::TokenType::IDENT || t.type() == internal::TokenType::STRING))
+            return nullptr;
+
+        std::string part = t.strValue();
+        t = lexer.nextKeyToken();
+        if (t.type() == internal::TokenType::DOT) {
+            current = current->findChild(part);
+            if (!current || !current->is<Table>())
+                return nullptr;
+        } else if (t.type() == internal::TokenType::END_OF_FILE) {
+            return current->findChild(part);
+        } else {
+            return nullptr;
+        }
+    }
+}
+
+inline Value* Value::find(const std::string& key)
+{
+    if (!is<Table>())
+        return nullptr;
+
+    std::istringstream ss(key);
+    internal::Lexer lexer(ss);
+
+    Value* current = this;
+    while (true) {
+        internal::Token t = lexer.nextKeyToken();
+        if (!(t.type() == internal::TokenType::IDENT || t.type() == internal::TokenType::STRING))
+            return nullptr;
+
+        std::string part = t.strValue();
+        t = lexer.nextKeyToken();
+        if (t.type() == internal::TokenType::DOT) {
+            current = current->findChild(part);
+            if (!current || !current->is<Table>())
+                return nullptr;
+        } else if (t.type() == internal::TokenType::END_OF_FILE) {
+            return current->findChild(part);
+        } else {
+            return nullptr;
+        }
+    }
+}
+
+inline bool Value::merge(const Value& v)
+{
+    return merge(v, MergeOptions());
+}
+
+inline bool Value::merge(const Value& v, const MergeOptions& options)
+{
+    if (this == &v)
+        return true;
+    if (!canMerge(*this, v, options))
+        return false;
+
+    mergeTable(v, options);
+    return true;
+}
+
+inline bool Value::merge(Value&& v)
+{
+    return merge(std::move(v), MergeOptions());
+}
+
+inline bool Value::merge(Value&& v, const MergeOptions& options)
+{
+    if (this == &v)
+        return true;
+    if (!canMerge(*this, v, options))
+        return false;
+
+    mergeTable(std::move(v), options);
+    return true;
+}
+
+// static
+inline bool Value::canMerge(const Value& dst, const Value& src, const MergeOptions& options)
+{
+    if (!dst.is<Table>() || !src.is<Table>())
+        return false;
+    // Only combining arrays can fail, so there is nothing to check when they are replaced.
+    if (options.arrayPolicy == ArrayMergePolicy::REPLACE)
+        return true;
+
+    // Sorted tables are checked with the same merge-join as mergeTable(), not with a lookup per key.
+    const Table& dstTable = dst.table_->value;
+    auto it = dstTable.begin();
+    for (const auto& kv : src.table_->value) {
+        const std::string& key = kv.first;
+        const Value* child = nullptr;
+        if (TablePolicy::sorted) {
+            while (it != dstTable.end() && static_cast<const std::string&>(it->first) < key)
+                ++it;
+            if (it != dstTable.end() && it->first == key)
+                child = &it->second;
+        } else {
+            child = dst.findChild(key);
+        }
+        if (!child)
+            continue;
+        if (child->is<Table>() && kv.second.is<Table>()) {
+            if (!canMerge(*child, kv.second, options))
+                return false;
+        } else if (child->is<Array>() && kv.second.is<Array>() && options.arrayPolicy != ArrayMergePolicy::REPLACE) {
+            if (!canMergeArray(*child, kv.second, options))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+// static
+inline bool Value::canMergeArray(const Value& dst, const Value& src, const MergeOptions& options)
+{
+    if (dst.empty() || src.empty())
+        return true;
+    if (dst.elementType() != src.elementType())
+        return false;
+    if (options.arrayPolicy != ArrayMergePolicy::BY_KEY || dst.elementType() != TABLE_TYPE)
+        return true;
+
+    std::vector<size_t> matches = matchByKey(dst, src, options.arrayKey);
+    const Array& dstArray = dst.arrayValue();
+    const Array& srcArray = src.arrayValue();
+    for (size_t i = 0; i < matches.size(); ++i) {
+        if (matches[i] != static_cast<size_t>(-1) && !canMerge(dstArray[matches[i]], srcArray[i], options))
+            return false;
+    }
+    return true;
+}
+
+// static
+inline std::vector<size_t> Value::matchByKey(const Value& dst, const Value& src, const std::string& key)
+{
+    const Array& dstArray = dst.arrayValue();
+    const Array& srcArray = src.arrayValue();
+
+    std::unordered_multimap<std::uint64_t, size_t> index;
+    for (size_t i = 0; i < dstArray.size(); ++i) {
+        if (const Value* v = dstArray[i].findChild(key))
+            index.emplace(v->hash(), i);
+    }
+
+    std::vector<size_t> matches(srcArray.size(), static_cast<size_t>(-1));
+    for (size_t i = 0; i < srcArray.size(); ++i) {
+        const Value* v = srcArray[i].findChild(key);
+        if (!v)
+            continue;
+        auto range = index.equal_range(v->hash());
+        for (auto it = range.first; it != range.second; ++it) {
+            if (*dstArray[it->second].findChild(key) == *v) {
+                matches[i] = it->second;
+                break;
+            }
+        }
+    }
+    return matches;
+}
+
+template<typename Src>
+inline void Value::mergeTable(Src&& src, const MergeOptions& options)
+{
+    // Value&& for Src = Value, const Value& for Src = const Value&.
+    typedef typename std::conditional<std::is_lvalue_reference<Src>::value, const Value&, Value&&>::type Child;
+
+    auto&& srcTable = sourceTable(src);
+    Table& dst = mutableTable(false);
+
+    if (!TablePolicy::sorted) {
+        for (auto& kv : srcTable) {
+            auto it = dst.find(kv.first);
+            if (it != dst.end())
+                it->second.mergeChild(static_cast<Child>(kv.second), options);
+            else
+                dst.emplace(kv.first, static_cast<Child>(kv.second));
+        }
+        return;
+    }
+
+    typedef decltype(*srcTable.begin()) Item;
+    internal::mergeSorted(dst, srcTable,
+                          [&options](Value& child, Item kv) { child.mergeChild(static_cast<Child>(kv.second), options); },
+                          [](Item kv) { return Value(static_cast<Child>(kv.second)); });
+}
+
+template<typename Src>
+inline void Value::mergeChild(Src&& src, const MergeOptions& options)
+{
+    if (is<Table>() && src.template is<Table>())
+        mergeTable(std::forward<Src>(src), options);
+    else if (is<Array>() && src.template is<Array>() && options.arrayPolicy != ArrayMergePolicy::REPLACE)
+        mergeArray(std::forward<Src>(src), options);
+    else
+        *this = std::forward<Src>(src);
+}
+
+template<typename Src>
+inline void Value::mergeArray(Src&& src, const MergeOptions& options)
+{
+    typedef typename std::conditional<std::is_lvalue_reference<Src>::value, const Value&, Value&&>::type Child;
+
+    std::vector<size_t> matches;
+    if (options.arrayPolicy == ArrayMergePolicy::BY_KEY && !empty() && elementType() == TABLE_TYPE)
+        matches = matchByKey(*this, src, options.arrayKey);
+
+    auto&& srcArray = sourceArray(src);
+    Array& dst = mutableArray(false);
+    dst.reserve(dst.size() + srcArray.size());
+    for (size_t i = 0; i < srcArray.size(); ++i) {
+        if (i < matches.size() && matches[i] != static_cast<size_t>(-1))
+            dst[matches[i]].mergeTable(static_cast<Child>(srcArray[i]), options);
+        else
+            dst.push_back(static_cast<Child>(srcArray[i]));
+    }
+}
+
+inline Value::Type Value::elementType() const
+{
+    assert(is<Array>() && !empty());
+    if (packed_)
+        return packedArray_->value.elementType();
+    return array_->value.front().type();
+}
+
+inline Value* Value::set(const std::string& key, const Value& v)
+{
+    Value* result = ensureValue(key);
+    *result = v;
+    return result;
+}
+
+inline Value* Value::set(const std::string& key, Value&& v)
+{
+    Value* result = ensureValue(key);
+    *result = std::move(v);
+    return result;
+}
+
+inline Value* Value::setChild(const std::string& key, const Value& v)
+{
+    if (!valid())
+        *this = Value((Table()));
+
+    if (!is<Table>())
+        failwith("type must be table to do set(key, v).");
+
+    Value& child = mutableTable(true)[key];
+    child = v;
+    return &child;
+}
+
+inline Value* Value::setChild(const std::string& key, Value&& v)
+{
+    if (!valid())
+        *this = Value((Table()));
+
+    if (!is<Table>())
+        failwith("type must be table to do set(key, v).");
+
+    Value& child = mutableTable(true)[key];
+    child = std::move(v);
+    return &child;
+}
+
+template<typename... Args>
+inline Value* Value::emplaceChild(const std::string& key, Args&&... args)
+{
+    if (!valid())
+        *this = Value((Table()));
+
+    if (!is<Table>())
+        failwith("type must be table to do set(key, v).");
+
+    Table& table = mutableTable(true);
+    auto result = internal::tryEmplace(table, key, std::forward<Args>(args)...);
+    if (!result.second)
+        result.first->second = Value(std::forward<Args>(args)...);
+    return &result.first->second;
+}
+
+template<typename InputIterator>
+inline void Value::setChildren(InputIterator first, InputIterator last)
+{
+    if (!valid())
+        *this = Value((Table()));
+
+    if (!is<Table>())
+        failwith("type must be table to do set(key, v).");
+
+    Table& table = mutableTable(false);
+    for (; first != last; ++first) {
+        Value v((*first).second);
+        // Inserting just before end() is O(1) when keys come in order.
+        auto it = table.emplace_hint(table.end(), (*first).first, Value());
+        it->second = std::move(v);
+    }
+}
+
+inline bool Value::erase(const std::string& key)
+{
+    if (!is<Table>())
+        return false;
+
+    std::istringstream ss(key);
+    internal::Lexer lexer(ss);
+
+    Value* current = this;
+    while (true) {
+        internal::Token t = lexer.nextKeyToken();
+        if (!(t.type() == internal::TokenType::IDENT || t.type() == internal::TokenType::STRING))
+            return false;
+
+        std::string part = t.strValue();
+        t = lexer.nextKeyToken();
+        if (t.type() == internal::TokenType::DOT) {
+            current = current->findChild(part);
+            if (!current || !current->is<Table>())
+                return false;
+        } else if (t.type() == internal::TokenType::END_OF_FILE) {
+            return current->eraseChild(part);
+        } else {
+            return false;
+        }
+    }
+}
+
+inline bool Value::eraseChild(const std::string& key)
+{
+    if (!is<Table>())
+        failwith("type must be table to do erase(key).");
+
+    if (!static_cast<const Value*>(this)->findChild(key))
+        return false;
+
+    return mutableTable(false).erase(key) > 0;
+}
+
+inline Value& Value::operator[](const std::string& key)
+{
+    if (!valid())
+        *this = Value((Table()));
+
+    if (Value* v = findChild(key))
+        return *v;
+
+    return *setChild(key, Value());
+}
+
+template<typename T>
+inline typename call_traits<T>::return_type Value::get(size_t index) const
+{
+    if (!is<Array>())
+        failwith("type must be array to do get(index).");
+
+    if (size() <= index)
+        failwith("index out of bound");
+
+    typedef typename call_traits<T>::return_type ReturnType;
+    return elementAs<T>(index, std::integral_constant<bool, !std::is_reference<ReturnType>::value>());
+}
+
+template<typename T>
+inline typename call_traits<T>::return_type Value::elementAs(size_t index, std::true_type) const
+{
+    return packed_ ? packedArray_->value.at(index).as<T>() : array_->value[index].as<T>();
+}
+
+template<typename T>
+inline typename call_traits<T>::return_type Value::elementAs(size_t index, std::false_type) const
+{
+    return arrayValue()[index].as<T>();
+}
+
+inline const Value* Value::find(size_t index) const
+{
+    if (!is<Array>())
+        return nullptr;
+    if (index < size())
+        return &arrayValue()[index];
+    return nullptr;
+}
+
+inline Value* Value::find(size_t index)
+{
+    if (!is<Array>())
+        return nullptr;
+    if (index < size())
+        return &mutableArray(true)[index];
+    return nullptr;
+}
+
+inline Value* Value::push(const Value& v)
+{
+    if (!valid())
+        *this = Value((Array()));
+    else if (!is<Array>())
+        failwith("type must be array to do push(Value).");
+
+    Array& array = mutableArray(true);
+    array.push_back(v);
+    return &array.back();
+}
+
+inline Value* Value::push(Value&& v)
+{
+    if (!valid())
+        *this = Value((Array()));
+    else if (!is<Array>())
+        failwith("type must be array to do push(Value).");
+
+    Array& array = mutableArray(true);
+    array.push_back(std::move(v));
+    return &array.back();
+}
+
+template<typename... Args>
+inline Value* Value::emplaceBack(Args&&... args)
+{
+    if (!valid())
+        *this = Value((Array()));
+    else if (!is<Array>())
+        failwith("type must be array to do push(Value).");
+
+    Array& array = mutableArray(true);
+    array.emplace_back(std::forward<Args>(args)...);
+    return &array.back();
+}
+
+inline void Value::reserve(size_t n)
+{
+    if (!valid())
+        *this = Value((Array()));
+    else if (!is<Array>())
+        failwith("type must be array to do reserve(n).");
+
+    mutableArray(false).reserve(n);
+}
+
+template<typename T, typename OutputIt>
+inline OutputIt Value::copyTo(OutputIt out) const
+{
+    assureType<Array>();
+    return internal::BulkConverter<T>::copy(*this, out);
+}
+
+template<typename T>
+inline void Value::into(std::vector<T>* out) const
+{
+    assureType<Array>();
+    internal::BulkConverter<T>::into(*this, out);
+}
+
+template<typename T>
+inline size_t Value::into(T* buf, size_t n) const
+{
+    assureType<Array>();
+    if (n < size())
+        failwith("buffer is too small: the array has ", size(), " elements but the buffer has ", n);
+
+    internal::BulkConverter<T>::copy(*this, buf);
+    return size();
+}
+
+inline Value* Value::ensureValue(const std::string& key)
+{
+    if (!valid())
+        *this = Value((Table()));
+    if (!is<Table>()) {
+        failwith("encountered non table value");
+    }
+
+    std::istringstream ss(key);
+    internal::Lexer lexer(ss);
+
+    Value* current = this;
+    while (true) {
+        internal::Token t = lexer.nextKeyToken();
+        if (!(t.type() == internal::TokenType::IDENT || t.type() == internal::TokenType::STRING)) {
+            failwith("invalid key");
+        }
+
+        std::string part = t.strValue();
+        t = lexer.nextKeyToken();
+        if (t.type() == internal::TokenType::DOT) {
+            if (Value* candidate = current->findChild(part)) {
+                if (!candidate->is<Table>())
+                    failwith("encountered non table value");
+
+                current = candidate;
+            } else {
+                current = current->setChild(part, Table());
+            }
+        } else if (t.type() == internal::TokenType::END_OF_FILE) {
+            if (Value* v = current->findChild(part))
+                return v;
+            return current->setChild(part, Value());
+        } else {
+            failwith("invalid key");
+        }
+    }
+}
+
+inline Value* Value::findChild(const std::string& key)
+{
+    assert(is<Table>());
+
+    // Don't clone the table when the key doesn't exist.
+    if (!static_cast<const Value*>(this)->findChild(key))
+        return nullptr;
+
+    Table& table = mutableTable(true);
+    return &table.find(key)->second;
+}
+
+inline const Value* Value::findChild(const std::string& key) const
+{
+    assert(is<Table>());
+
+    auto it = table_->value.find(key);
+    if (it == table_->value.end())
+        return nullptr;
+
+    return &it->second;
+}
+
+inline void Value::makeShareable()
+{
+    switch (type_) {
+    case ARRAY_TYPE:
+        // A shareable node never has a non-shareable descendant, since a pointer
+        // into a descendant can be obtained only through its ancestors.
+        if (packed_ || array_->shareable)
+            return;
+        array_->shareable = true;
+        for (Value& v : array_->value)
+            v.makeShareable();
+        break;
+    case TABLE_TYPE:
+        if (table_->shareable)
+            return;
+        table_->shareable = true;
+        for (auto& kv : table_->value)
+            kv.second.makeShareable();
+        break;
+    default:
+        break;
+    }
+}
+
+inline void Value::pack()
+{
+    switch (type_) {
+    case ARRAY_TYPE:
+        if (packed_)
+            return;
+        if (internal::PackedArray::packable(array_->value)) {
+            internal::Node<internal::PackedArray>* packed = new internal::Node<internal::PackedArray>(array_->value);
+            internal::releaseNode(array_);
+            packedArray_ = packed;
+            packed_ = true;
+            return;
+        }
+        if (isArrayOfTables() || (size() > 0 && array_->value.front().is<Array>())) {
+            // Tables which don't have the same keys, or nested arrays.
+            for (Value& v : mutableArray(false))
+                v.pack();
+        }
+        break;
+    case TABLE_TYPE:
+        for (auto& kv : mutableTable(false))
+            kv.second.pack();
+        break;
+    default:
+        break;
+    }
+}
+
+inline std::uint64_t Value::hash() const
+{
+    switch (type_) {
+    case NULL_TYPE:
+        return internal::mixHash(0);
+    case BOOL_TYPE:
+        return internal::hashBool(bool_);
+    case INT_TYPE:
+        return internal::hashInt(int_);
+    case DOUBLE_TYPE:
+        return internal::hashDouble(double_);
+    case STRING_TYPE:
+        return internal::hashString(string_->value);
+    case TIME_TYPE: {
+        std::int64_t count = std::chrono::duration_cast<std::chrono::microseconds>(time_.time_since_epoch()).count();
+        return internal::mixHash(internal::hashInt(count) + 6);
+    }
+    default:
+        break;
+    }
+
+    std::uint64_t h = cachedHash();
+    if (h)
+        return h;
+
+    if (type_ == ARRAY_TYPE) {
+        h = internal::mixHash(7);
+        for (size_t i = 0; i < size(); ++i)
+            h = internal::combineHash(h, packed_ ? packedArray_->value.hashAt(i) : array_->value[i].hash());
+    } else {
+        // Order-independent, since the order of keys depends on the table policy.
+        h = internal::mixHash(8);
+        for (const auto& kv : table_->value) {
+            const std::string& key = kv.first;
+            h += internal::combineHash(internal::hashString(key), kv.second.hash());
+        }
+        h = internal::mixHash(h);
+    }
+
+    // 0 means "not cached".
+    if (!h)
+        h = 1;
+    if (packed_)
+        packedArray_->hash.store(h, std::memory_order_relaxed);
+    else if (type_ == ARRAY_TYPE && array_->shareable)
+        array_->hash.store(h, std::memory_order_relaxed);
+    else if (type_ == TABLE_TYPE && table_->shareable)
+        table_->hash.store(h, std::memory_order_relaxed);
+    return h;
+}
+
+inline std::uint64_t Value::cachedHash() const
+{
+    if (type_ == ARRAY_TYPE) {
+        if (packed_)
+            return packedArray_->hash.load(std::memory_order_relaxed);
+        return array_->shareable ? array_->hash.load(std::memory_order_relaxed) : 0;
+    }
+    if (type_ == TABLE_TYPE)
+        return table_->shareable ? table_->hash.load(std::memory_order_relaxed) : 0;
+    return 0;
+}
+
+inline void deduplicate(Value& root)
+{
+    root.makeShareable();
+
+    std::unordered_map<std::uint64_t, std::vector<Value>> pool;
+    root.deduplicate(&pool);
+}
+
+inline Patch diff(const Value& from, const Value& to)
+{
+    Patch patch;
+    std::vector<std::string> path;
+    Value::diffInto(from, to, &path, &patch);
+    return patch;
+}
+
+// static
+inline void Value::diffInto(const Value& from, const Value& to, std::vector<std::string>* path, Patch* patch)
+{
+    if (!from.is<Table>() || !to.is<Table>()) {
+        if (!from.valid() && to.valid())
+            patch->changes.emplace_back(Patch::Op::ADD, *path, to);
+        else if (from.valid() && !to.valid())
+            patch->changes.emplace_back(Patch::Op::REMOVE, *path, Value());
+        else if (from != to)
+            patch->changes.emplace_back(Patch::Op::CHANGE, *path, to);
+        return;
+    }
+
+    // Prunes a shared subtree, or a subtree whose cached hash says it's likely unchanged.
+    if (from.table_ == to.table_)
+        return;
+    if (from.cachedHash() && from.cachedHash() == to.cachedHash() && from == to)
+        return;
+
+    // Merge-walks the keys in sorted order.
+    typedef const Table::value_type* Entry;
+    std::vector<Entry> lhs = internal::sortedEntries(from.table_->value, TablePolicy::sorted);
+    std::vector<Entry> rhs = internal::sortedEntries(to.table_->value, TablePolicy::sorted);
+
+    size_t i = 0, j = 0;
+    while (i < lhs.size() || j < rhs.size()) {
+        int cmp;
+        if (i == lhs.size())
+            cmp = 1;
+        else if (j == rhs.size())
+            cmp = -1;
+        else
+            cmp = static_cast<const std::string&>(lhs[i]->first).compare(rhs[j]->first);
+
+        if (cmp < 0) {
+            path->push_back(lhs[i]->first);
+            patch->changes.emplace_back(Patch::Op::REMOVE, *path, Value());
+            path->pop_back();
+            ++i;
+        } else if (cmp > 0) {
+            path->push_back(rhs[j]->first);
+            patch->changes.emplace_back(Patch::Op::ADD, *path, rhs[j]->second);
+            path->pop_back();
+            ++j;
+        } else {
+            path->push_back(lhs[i]->first);
+            diffInto(lhs[i]->second, rhs[j]->second, path, patch);
+            path->pop_back();
+            ++i;
+            ++j;
+        }
+    }
+}
+
+inline void apply(Value& root, const Patch& patch)
+{
+    for (const Patch::Change& change : patch.changes) {
+        if (change.path.empty()) {
+            root = change.value;
+            continue;
+        }
+
+        // Finds the parent table without leaking pointers, so that the nodes stay shareable.
+        Value* parent = &root;
+        bool found = true;
+        for (size_t i = 0; i + 1 < change.path.size(); ++i) {
+            if (!parent->valid()) {
+                if (change.op == Patch::Op::REMOVE) {
+                    found = false;
+                    break;
+                }
+                *parent = Value((Table()));
+            }
+            if (!parent->is<Table>())
+                failwith("type error: ", change.pathString(), " cannot be applied since its parent is not a table");
+
+            Table& table = parent->mutableTable(false);
+            auto it = table.find(change.path[i]);
+            if (it == table.end()) {
+                if (change.op == Patch::Op::REMOVE) {
+                    found = false;
+                    break;
+                }
+                it = table.emplace(change.path[i], Value()).first;
+            }
+            parent = &it->second;
+        }
+        if (!found)
+            continue;
+
+        if (change.op == Patch::Op::REMOVE) {
+            if (parent->is<Table>() && static_cast<const Value*>(parent)->findChild(change.path.back()))
+                parent->mutableTable(false).erase(change.path.back());
+            continue;
+        }
+
+        if (!parent->valid())
+            *parent = Value((Table()));
+        if (!parent->is<Table>())
+            failwith("type error: ", change.pathString(), " cannot be applied since its parent is not a table");
+        parent->mutableTable(false)[change.path.back()] = change.value;
+    }
+}
+
+inline std::string Patch::Change::pathString() const
+{
+    std::string s;
+    for (const std::string& key : path) {
+        if (!s.empty())
+            s += '.';
+        s += Value::escapeKey(key);
+    }
+    return s;
+}
+
+// ----------------------------------------------------------------------
+// Visitor
+
+// Calls |visitor| with the payload of |v|, and returns what it returns.
+// The type is checked only once, and |visitor| gets one of:
+//   std::nullptr_t, bool, std::int64_t, double, const std::string&, const Time&, const Array& or const Table&.
+// So |visitor| is usually a struct which has operator() for all of them.
+template<typename Visitor>
+inline typename internal::VisitResult<Visitor>::type visit(Visitor&& visitor, const Value& v)
+{
+    switch (v.type_) {
+    case Value::NULL_TYPE:
+        return visitor(nullptr);
+    case Value::BOOL_TYPE:
+        return visitor(v.bool_);
+    case Value::INT_TYPE:
+        return visitor(v.int_);
+    case Value::DOUBLE_TYPE:
+        return visitor(v.double_);
+    case Value::STRING_TYPE:
+        return visitor(static_cast<const std::string&>(v.string_->value));
+    case Value::TIME_TYPE:
+        return visitor(static_cast<const Time&>(v.time_));
+    case Value::ARRAY_TYPE:
+        return visitor(v.arrayValue());
+    case Value::TABLE_TYPE:
+        return visitor(static_cast<const Table&>(v.table_->value));
+    default:
+        failwith("unknown type");
+    }
+}
+
+namespace internal {
+
+template<typename Visitor>
+inline void visitPackedArray(Visitor& visitor, const Value& array, std::true_type)
+{
+    visitor(static_cast<const PackedArrayView&>(PackedArrayView{array}));
+}
+
+template<typename Visitor>
+inline void visitPackedArray(Visitor& visitor, const Value& array, std::false_type)
+{
+    visitor(array.as<Array>());
+}
+
+} // namespace internal
+
+// Calls |visitor| for |v| and all the values in it, in pre-order (an array or a table is
+// visited before its elements). The return value of |visitor| is ignored.
+// The elements of a packed array are read from its typed storage. The array itself is given
+// as PackedArrayView if |visitor| takes it; otherwise its Array is built as visit() does.
+template<typename Visitor>
+inline void visitRecursive(Visitor&& visitor, const Value& v)
+{
+    switch (v.type_) {
+    case Value::ARRAY_TYPE:
+        if (v.packed_) {
+            const internal::PackedArray& packed = v.packedArray_->value;
+            internal::visitPackedArray(visitor, v, std::integral_constant<bool, internal::AcceptsPackedArray<Visitor>::value>());
+            switch (packed.elementType()) {
+            case Value::BOOL_TYPE:
+                for (size_t i = 0; i < packed.size(); ++i)
+                    visitor(packed.boolAt(i));
+                break;
+            case Value::INT_TYPE:
+                for (std::int64_t x : packed.ints())
+                    visitor(x);
+                break;
+            case Value::DOUBLE_TYPE:
+                for (double x : packed.doubles())
+                    visitor(x);
+                break;
+            case Value::STRING_TYPE: {
+                std::string s;
+                for (size_t i = 0; i < packed.size(); ++i) {
+                    packed.stringAt(i, &s);
+                    visitor(static_cast<const std::string&>(s));
+                }
+                break;
+            }
+            default:
+                // A table is stored in columns, so it's made for the visit.
+                for (size_t i = 0; i < packed.size(); ++i)
+                    visitRecursive(visitor, packed.at(i));
+                break;
+            }
+            return;
+        }
+        visitor(static_cast<const Array&>(v.array_->value));
+        for (const Value& element : v.array_->value)
+            visitRecursive(visitor, element);
+        return;
+    case Value::TABLE_TYPE:
+        visitor(static_cast<const Table&>(v.table_->value));
+        for (const auto& kv : v.table_->value)
+            visitRecursive(visitor, kv.second);
+        return;
+    default:
+        visit(visitor, v);
+        return;
+    }
+}
+
+// ----------------------------------------------------------------------
+// Query
+
+class Query::Compiler {
+public:
+    Compiler(const std::string& expression, std::vector<Step>* steps) : s_(expression), p_(0), steps_(steps) {}
+
+    void compile()
+    {
+        if (s_.empty())
+            error("empty");
+
+        bool first = true;
+        while (p_ < s_.size()) {
+            if (s_[p_] == '[') {
+                ++p_;
+                compileBracket();
+            } else {
+                if (!first) {
+                    if (s_[p_] != '.')
+                        error("'.' or '[' is expected");
+                    ++p_;
+                }
+                compileSegment();
+            }
+            first = false;
+        }
+    }
+
+private:
+    [[noreturn]] void error(const char* reason)
+    {
+        failwith("invalid query: ", s_, ": ", reason, " at ", p_);
+    }
+
+    void skipSpaces()
+    {
+        while (p_ < s_.size() && (s_[p_] == ' ' || s_[p_] == '\t'))
+            ++p_;
+    }
+
+    static bool isBareKeyChar(char c)
+    {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-';
+    }
+
+    std::string parseKey()
+    {
+        std::string key;
+        if (p_ < s_.size() && s_[p_] == '"') {
+            ++p_;
+            while (p_ < s_.size() && s_[p_] != '"') {
+                if (s_[p_] == '\\' && p_ + 1 < s_.size())
+                    ++p_;
+                key += s_[p_++];
+            }
+            if (p_ == s_.size())
+                error("unterminated string");
+            ++p_;
+            return key;
+        }
+
+        while (p_ < s_.size() && isBareKeyChar(s_[p_]))
+            key += s_[p_++];
+        if (key.empty())
+            error("key is expected");
+        return key;
+    }
+
+    bool parseInt(std::int64_t* x)
+    {
+        size_t start = p_;
+        if (p_ < s_.size() && (s_[p_] == '-' || s_[p_] == '+'))
+            ++p_;
+        while (p_ < s_.size() && '0' <= s_[p_] && s_[p_] <= '9')
+            ++p_;
+        std::string digits = s_.substr(start, p_ - start);
+        if (!internal::isInteger(digits) || !internal::parseInteger(digits, x)) {
+            p_ = start;
+            return false;
+        }
+        return true;
+    }
+
+    void compileSegment()
+    {
+        if (s_.compare(p_, 2, "**") == 0) {
+            p_ += 2;
+            steps_->push_back(Step(Step::DESCENDANTS));
+            return;
+        }
+        if (p_ < s_.size() && s_[p_] == '*') {
+            ++p_;
+            steps_->push_back(Step(Step::ANY_KEY));
+            return;
+        }
+
+        Step step(Step::KEY);
+        step.key = parseKey();
+        steps_->push_back(std::move(step));
+    }
+
+    void compileBracket()
+    {
+        skipSpaces();
+        if (p_ < s_.size() && s_[p_] == '*') {
+            ++p_;
+            steps_->push_back(Step(Step::ANY_INDEX));
+        } else if (p_ < s_.size() && s_[p_] == '?') {
+            ++p_;
+            compileFilter();
+        } else {
+            Step step(Step::INDEX);
+            step.hasBegin = parseInt(&step.begin);
+            skipSpaces();
+            if (p_ < s_.size() && s_[p_] == ':') {
+                ++p_;
+                skipSpaces();
+                step.kind = Step::SLICE;
+                step.hasEnd = parseInt(&step.end);
+            } else if (step.hasBegin) {
+                step.index = step.begin;
+            } else {
+                error("index is expected");
+            }
+            steps_->push_back(std::move(step));
+        }
+
+        skipSpaces();
+        if (p_ == s_.size() || s_[p_] != ']')
+            error("']' is expected");
+        ++p_;
+    }
+
+    void compileFilter()
+    {
+        skipSpaces();
+        if (p_ == s_.size() || s_[p_] != '(')
+            error("'(' is expected");
+        ++p_;
+        skipSpaces();
+
+        Step step(Step::FILTER);
+        step.key = parseKey();
+        skipSpaces();
+
+        static const struct { const char* text; Step::Op op; } ops[] = {
+            { "==", Step::EQ }, { "!=", Step::NE }, { "<=", Step::LE },
+            { ">=", Step::GE }, { "<", Step::LT }, { ">", Step::GT },
+        };
+        for (const auto& op : ops) {
+            if (s_.compare(p_, std::strlen(op.text), op.text) == 0) {
+                p_ += std::strlen(op.text);
+                step.op = op.op;
+                break;
+            }
+        }
+
+        if (step.op != Step::EXISTS) {
+            skipSpaces();
+            step.operand = parseLiteral();
+            skipSpaces();
+        }
+
+        if (p_ == s_.size() || s_[p_] != ')')
+            error("')' is expected");
+        ++p_;
+        steps_->push_back(std::move(step));
+    }
+
+    Value parseLiteral()
+    {
+        if (p_ < s_.size() && s_[p_] == '"')
+            return Value(parseKey());
+        if (s_.compare(p_, 4, "true") == 0) {
+            p_ += 4;
+            return Value(true);
+        }
+        if (s_.compare(p_, 5, "false") == 0) {
+            p_ += 5;
+            return Value(false);
+        }
 
-    ok = false;
-    if (p < s.size() && (s[p] == 'e' || s[p] == 'E')) {
-        ++p;
-        if (p < s.size() && (s[p] == '+' || s[p] == '-'))
-            ++p;
-        while (p < s.size() && '0' <= s[p] && s[p] <= '9') {
-            ++p;
-            ok = true;
+        size_t start = p_;
+        while (p_ < s_.size() && internal::isLiteralChar(s_[p_]))
+            ++p_;
+        std::string literal = s_.substr(start, p_ - start);
+        std::int64_t x;
+        if (internal::isInteger(literal) && internal::parseInteger(literal, &x))
+            return Value(x);
+        double d;
+        if (internal::isDouble(literal) && internal::parseDouble(literal, &d))
+            return Value(d);
 
-            if (p < s.size() && s[p] == '_') {
-                ++p;
-                if (!(p < s.size() && '0' <= s[p] && s[p] <= '9'))
-                    return false;
-            }
+        p_ = start;
+        error("literal is expected");
+    }
+
+    const std::string& s_;
+    size_t p_;
+    std::vector<Step>* steps_;
+};
+
+inline Query::Query(const std::string& expression) :
+    expression_(expression)
+{
+    Compiler(expression_, &steps_).compile();
+}
+
+inline void Query::evaluate(const Value& root, std::vector<const Value*>* results) const
+{
+    results->clear();
+    match(root, 0, results, nullptr);
+}
+
+inline const Value* Query::evaluateFirst(const Value& root) const
+{
+    const Value* result = nullptr;
+    match(root, 0, nullptr, &result);
+    return result;
+}
+
+inline bool Query::match(const Value& v, size_t index, std::vector<const Value*>* results, const Value** first) const
+{
+    if (index == steps_.size()) {
+        if (first) {
+            *first = &v;
+            return true;
         }
-        if (!ok)
+        results->push_back(&v);
+        return false;
+    }
+
+    const Step& step = steps_[index];
+    switch (step.kind) {
+    case Step::KEY:
+        if (!v.is<Table>())
             return false;
+        if (const Value* child = v.findChild(step.key))
+            return match(*child, index + 1, results, first);
+        return false;
+    case Step::ANY_KEY:
+        if (v.is<Table>()) {
+            for (const auto& kv : v.as<Table>()) {
+                if (match(kv.second, index + 1, results, first))
+                    return true;
+            }
+        }
+        return false;
+    case Step::DESCENDANTS:
+        if (match(v, index + 1, results, first))
+            return true;
+        if (v.is<Table>()) {
+            for (const auto& kv : v.as<Table>()) {
+                if (match(kv.second, index, results, first))
+                    return true;
+            }
+        } else if (v.is<Array>()) {
+            for (const Value& element : v.as<Array>()) {
+                if (match(element, index, results, first))
+                    return true;
+            }
+        }
+        return false;
+    default:
+        break;
     }
 
-    return p == s.size();
+    // Array steps.
+    if (!v.is<Array>())
+        return false;
+    const Array& array = v.as<Array>();
+    const std::int64_t size = static_cast<std::int64_t>(array.size());
+
+    switch (step.kind) {
+    case Step::INDEX: {
+        std::int64_t i = step.index < 0 ? size + step.index : step.index;
+        if (0 <= i && i < size)
+            return match(array[i], index + 1, results, first);
+        return false;
+    }
+    case Step::ANY_INDEX:
+    case Step::SLICE:
+    case Step::FILTER: {
+        std::int64_t begin = 0, end = size;
+        if (step.kind == Step::SLICE) {
+            if (step.hasBegin)
+                begin = step.begin < 0 ? std::max<std::int64_t>(size + step.begin, 0) : std::min(step.begin, size);
+            if (step.hasEnd)
+                end = step.end < 0 ? std::max<std::int64_t>(size + step.end, 0) : std::min(step.end, size);
+        }
+        for (std::int64_t i = begin; i < end; ++i) {
+            if (step.kind == Step::FILTER && !test(step, array[i]))
+                continue;
+            if (match(array[i], index + 1, results, first))
+                return true;
+        }
+        return false;
+    }
+    default:
+        return false;
+    }
 }
 
 // static
-inline std::string escapeString(const std::string& s)
+inline bool Query::test(const Step& step, const Value& element)
 {
-    std::stringstream ss;
-    for (size_t i = 0; i < s.size(); ++i) {
-        switch (s[i]) {
-        case '\n': ss << "\\n"; break;
-        case '\r': ss << "\\r"; break;
-        case '\t': ss << "\\t"; break;
-        case '\"': ss << "\\\""; break;
-        case '\'': ss << "\\\'"; break;
-        case '\\': ss << "\\\\"; break;
-        default: ss << s[i]; break;
+    if (!element.is<Table>())
+        return false;
+    const Value* child = element.findChild(step.key);
+    if (!child)
+        return false;
+
+    int cmp;
+    if (child->isNumber() && step.operand.isNumber()) {
+        if (child->is<std::int64_t>() && step.operand.is<std::int64_t>()) {
+            std::int64_t lhs = child->as<std::int64_t>(), rhs = step.operand.as<std::int64_t>();
+            cmp = lhs < rhs ? -1 : (rhs < lhs ? 1 : 0);
+        } else {
+            double lhs = child->asNumber(), rhs = step.operand.asNumber();
+            if (lhs != lhs || rhs != rhs)
+                return step.op == Step::NE;
+            cmp = lhs < rhs ? -1 : (rhs < lhs ? 1 : 0);
         }
+    } else if (child->is<std::string>() && step.operand.is<std::string>()) {
+        cmp = child->as<std::string>().compare(step.operand.as<std::string>());
+    } else if (step.op == Step::EXISTS) {
+        return true;
+    } else if (step.op == Step::EQ) {
+        return *child == step.operand;
+    } else if (step.op == Step::NE) {
+        return *child != step.operand;
+    } else {
+        // Not ordered.
+        return false;
     }
 
-    return ss.str();
+    switch (step.op) {
+    case Step::EXISTS: return true;
+    case Step::EQ: return cmp == 0;
+    case Step::NE: return cmp != 0;
+    case Step::LT: return cmp < 0;
+    case Step::LE: return cmp <= 0;
+    case Step::GT: return cmp > 0;
+    case Step::GE: return cmp >= 0;
+    }
+    return false;
 }
 
-} // namespace internal
-
 // ----------------------------------------------------------------------
-// Lexer
-
-namespace internal {
+// Path and Slot
 
-inline bool Lexer::skipUTF8BOM()
+inline Path::Path(const std::string& key) :
+    valid_(internal::splitKey(key, &keys_))
 {
-    // Check [EF, BB, BF]
+    if (!valid_)
+        keys_.clear();
+}
 
-    int x1 = is_.peek();
-    if (x1 != 0xEF) {
-        // When the first byte is not 0xEF, it's not UTF8 BOM.
-        // Just return true.
-        return true;
+inline std::string Path::toString() const
+{
+    std::string s;
+    for (const std::string& key : keys_) {
+        if (!s.empty())
+            s += '.';
+        s += Value::escapeKey(key);
     }
+    return s;
+}
 
-    is_.get();
-    int x2 = is_.get();
-    if (x2 != 0xBB) {
+// static
+template<typename T>
+inline bool Slot::assign(const Value& v, void* out, std::string* error)
+{
+    if (!v.is<T>()) {
+        *error = std::string("type error: this value is ") + Value::typeToString(v.type()) +
+            ", which is not convertible to the slot";
         return false;
     }
 
-    int x3 = is_.get();
-    if (x3 != 0xBF) {
+    try {
+        *static_cast<T*>(out) = v.as<T>();
+    } catch (const std::runtime_error& e) {
+        *error = e.what();
         return false;
     }
-
     return true;
 }
 
-inline bool Lexer::current(char* c)
+inline const Value* Value::find(const Path& path) const
 {
-    int x = is_.peek();
-    if (x == EOF)
-        return false;
-    *c = static_cast<char>(x);
-    return true;
+    if (!path.valid())
+        return nullptr;
+
+    const Value* current = this;
+    for (const std::string& key : path.keys()) {
+        if (!current->is<Table>())
+            return nullptr;
+        current = current->findChild(key);
+        if (!current)
+            return nullptr;
+    }
+    return current;
 }
 
-inline void Lexer::next()
+template<typename T>
+inline typename call_traits<T>::return_type Value::get(const Path& path) const
 {
-    int x = is_.get();
-    if (x == '\n')
-        ++lineNo_;
+    if (!is<Table>())
+        failwith("type must be table to do get(key).");
+
+    const Value* obj = find(path);
+    if (!obj)
+        failwith("key ", path.toString(), " was not found.");
+
+    return obj->as<T>();
 }
 
-inline bool Lexer::consume(char c)
+inline bool Value::getMany(std::vector<Slot>* slots) const
 {
-    char x;
-    if (!current(&x))
-        return false;
-    if (x != c)
-        return false;
-    next();
-    return true;
+    std::vector<Slot*> sorted;
+    sorted.reserve(slots->size());
+    for (Slot& slot : *slots) {
+        slot.error_.clear();
+        if (slot.path_.valid())
+            sorted.push_back(&slot);
+        else
+            slot.error_ = "invalid key";
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Slot* lhs, const Slot* rhs) { return lhs->path_ < rhs->path_; });
+
+    // stack[i] is the value at the first i keys of the previous path.
+    std::vector<const Value*> stack(1, this);
+    const Path* previous = nullptr;
+    bool allResolved = slots->size() == sorted.size();
+    for (Slot* slot : sorted) {
+        const std::vector<std::string>& keys = slot->path_.keys();
+        size_t depth = 0;
+        if (previous) {
+            const std::vector<std::string>& prev = previous->keys();
+            while (depth < keys.size() && depth < prev.size() && keys[depth] == prev[depth])
+                ++depth;
+        }
+        if (stack.size() > depth + 1)
+            stack.resize(depth + 1);
+        previous = &slot->path_;
+
+        // Walks the rest of the path from the deepest shared value.
+        while (stack.size() <= keys.size()) {
+            const Value* parent = stack.back();
+            const Value* child = parent->is<Table>() ? parent->findChild(keys[stack.size() - 1]) : nullptr;
+            if (!child)
+                break;
+            stack.push_back(child);
+        }
+
+        if (stack.size() <= keys.size()) {
+            slot->error_ = "key " + slot->path_.toString() + " was not found";
+            allResolved = false;
+        } else if (!slot->assign_(*stack.back(), slot->out_, &slot->error_)) {
+            allResolved = false;
+        }
+    }
+    return allResolved;
 }
 
-inline void Lexer::skipUntilNewLine()
+// ----------------------------------------------------------------------
+// PathIndex
+
+inline void PathIndex::build(const Value& root)
 {
-    char c;
-    while (current(&c)) {
-        if (c == '\n')
-            return;
-        next();
+    entries_.clear();
+    slots_.clear();
+    slotCount_ = 0;
+    if (root.is<Table>()) {
+        std::string path;
+        collect(root, &path);
     }
 }
 
-inline Token Lexer::nextStringDoubleQuote()
+inline void PathIndex::update(const Value& root, const std::string& path)
 {
-    if (!consume('"'))
-        return Token(TokenType::ERROR_TOKEN, std::string("string didn't start with '\"'"));
-
-    std::string s;
-    char c;
-    bool multiline = false;
+    const Path keys(path);
+    if (path.empty() || !keys.valid()) {
+        build(root);
+        return;
+    }
 
-    if (current(&c) && c == '"') {
-        next();
-        if (!current(&c) || c != '"') {
-            // OK. It's empty string.
-            return Token(TokenType::STRING, std::string());
+    // The entries are keyed by the canonical form, e.g. 'a . "b"' is "a.b".
+    const std::string canonical = keys.toString();
+
+    // Removes |path| and the entries under it.
+    auto it = entries_.find(canonical);
+    if (it != entries_.end())
+        erase(it);
+    const std::string prefix = canonical + '.';
+    it = entries_.lower_bound(prefix);
+    while (it != entries_.end() && it->first.compare(0, prefix.size(), prefix) == 0)
+        erase(it++);
+
+    if (const Value* v = root.find(keys)) {
+        insert(canonical, v);
+        if (v->is<Table>()) {
+            std::string subtree = canonical;
+            collect(*v, &subtree);
         }
+    }
 
-        next();
-        // raw string literal started.
-        // Newline just after """ should be ignored.
-        while (current(&c) && (c == ' ' || c == '\t'))
-            next();
-        if (current(&c) && c == '\n')
-            next();
-        multiline = true;
+    // Follows the ancestors from the root.
+    const Value* table = &root;
+    std::string ancestor;
+    for (const std::string& key : keys.keys()) {
+        if (!table->is<Table>())
+            break;
+        relink(*table, &ancestor, &key);
+        table = table->findChild(key);
+        if (!table)
+            break;
+        if (!ancestor.empty())
+            ancestor += '.';
+        ancestor += Value::escapeKey(key);
     }
+}
 
-    while (current(&c)) {
-        next();
-        if (c == '\\') {
-            if (!current(&c))
-                return Token(TokenType::ERROR_TOKEN, std::string("string has unknown escape sequence"));
-            next();
-            switch (c) {
-            case 't': c = '\t'; break;
-            case 'n': c = '\n'; break;
-            case 'r': c = '\r'; break;
-            case 'u':
-            case 'U': {
-                int size = c == 'u' ? 4 : 8;
-                std::string codepoint;
-                for (int i = 0; i < size; ++i) {
-                  if (current(&c) && (('0' <= c && c <= '9') || ('A' <= c && c <= 'F') || ('a' <= c && c <= 'f'))) {
-                    codepoint += c;
-                    next();
-                  } else {
-                    return Token(TokenType::ERROR_TOKEN, std::string("string has unknown escape sequence"));
-                  }
-                }
-                s += unescape(codepoint);
-                continue;
-            }
-            case '"': c = '"'; break;
-            case '\'': c = '\''; break;
-            case '\\': c = '\\'; break;
-            case '\n':
-                while (current(&c) && (c == ' ' || c == '\t' || c == '\r' || c == '\n')) {
-                    next();
-                }
-                continue;
-            default:
-                return Token(TokenType::ERROR_TOKEN, std::string("string has unknown escape sequence"));
-            }
-        } else if (c == '"') {
-            if (multiline) {
-                if (current(&c) && c == '"') {
-                    next();
-                    if (current(&c) && c == '"') {
-                        next();
-                        return Token(TokenType::MULTILINE_STRING, s);
-                    } else {
-                        s += '"';
-                        s += '"';
-                        continue;
-                    }
-                } else {
-                    s += '"';
-                    continue;
-                }
-            } else {
-                return Token(TokenType::STRING, s);
-            }
+inline const Value* PathIndex::find(const std::string& path) const
+{
+    const Entry* e = lookup(path);
+    return e ? e->second : nullptr;
+}
+
+inline std::pair<PathIndex::const_iterator, PathIndex::const_iterator> PathIndex::scan(const std::string& path) const
+{
+    if (path.empty())
+        return std::make_pair(entries_.begin(), entries_.end());
+
+    // The entries under |path| are not contiguous with |path|, since e.g. "a-b" is between
+    // "a" and "a.b".
+    const std::string prefix = path + '.';
+    auto first = entries_.lower_bound(prefix);
+    auto last = first;
+    while (last != entries_.end() && last->first.compare(0, prefix.size(), prefix) == 0)
+        ++last;
+    return std::make_pair(first, last);
+}
+
+inline void PathIndex::collect(const Value& table, std::string* path)
+{
+    const size_t length = path->size();
+    for (const auto& kv : table.as<Table>()) {
+        if (length > 0)
+            *path += '.';
+        *path += Value::escapeKey(kv.first);
+        insert(*path, &kv.second);
+        if (kv.second.is<Table>())
+            collect(kv.second, path);
+        path->resize(length);
+    }
+}
+
+inline void PathIndex::relink(const Value& table, std::string* path, const std::string* skip)
+{
+    const size_t length = path->size();
+    for (const auto& kv : table.as<Table>()) {
+        if (length > 0)
+            *path += '.';
+        *path += Value::escapeKey(kv.first);
+        if (Entry* e = lookup(*path)) {
+            e->second = &kv.second;
+            if (kv.second.is<Table>() && !(skip && kv.first == *skip) && moved(kv.second, *path))
+                relink(kv.second, path, nullptr);
+        }
+        path->resize(length);
+    }
+}
+
+inline bool PathIndex::moved(const Value& table, const std::string& path) const
+{
+    // The children of a table are stored together, so they move together.
+    const Table& children = table.as<Table>();
+    if (children.empty())
+        return false;
+    auto first = children.begin();
+    const Entry* e = lookup(path + '.' + Value::escapeKey(first->first));
+    return e && e->second != &first->second;
+}
+
+inline void PathIndex::insert(const std::string& path, const Value* v)
+{
+    auto result = entries_.emplace(path, v);
+    if (!result.second) {
+        result.first->second = v;
+        return;
+    }
+
+    // Keeps the load factor at most 1/2. rehash() adds the new entry too.
+    if (++slotCount_ * 2 > slots_.size()) {
+        rehash(std::max<size_t>(16, slots_.size() * 2));
+        return;
+    }
+
+    const size_t mask = slots_.size() - 1;
+    size_t i = std::hash<std::string>()(path) & mask;
+    while (slots_[i])
+        i = (i + 1) & mask;
+    slots_[i] = &*result.first;
+}
+
+inline void PathIndex::erase(Map::iterator it)
+{
+    const size_t mask = slots_.size() - 1;
+    size_t i = std::hash<std::string>()(it->first) & mask;
+    while (slots_[i] != &*it)
+        i = (i + 1) & mask;
+
+    // Moves the following entries of the cluster back, so that no probe stops at the hole.
+    for (size_t j = (i + 1) & mask; slots_[j]; j = (j + 1) & mask) {
+        size_t home = std::hash<std::string>()(slots_[j]->first) & mask;
+        // Moves the entry at j unless its home is cyclically in (i, j].
+        bool stays = i < j ? (i < home && home <= j) : (i < home || home <= j);
+        if (!stays) {
+            slots_[i] = slots_[j];
+            i = j;
         }
+    }
+    slots_[i] = nullptr;
+    --slotCount_;
+    entries_.erase(it);
+}
 
-        s += c;
+inline PathIndex::Entry* PathIndex::lookup(const std::string& path) const
+{
+    if (slots_.empty())
+        return nullptr;
+
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = std::hash<std::string>()(path) & mask; slots_[i]; i = (i + 1) & mask) {
+        if (slots_[i]->first == path)
+            return slots_[i];
     }
+    return nullptr;
+}
 
-    return Token(TokenType::ERROR_TOKEN, std::string("string didn't end"));
+inline void PathIndex::rehash(size_t capacity)
+{
+    slots_.assign(capacity, nullptr);
+    const size_t mask = capacity - 1;
+    for (Entry& e : entries_) {
+        size_t i = std::hash<std::string>()(e.first) & mask;
+        while (slots_[i])
+            i = (i + 1) & mask;
+        slots_[i] = &e;
+    }
 }
 
-inline Token Lexer::nextStringSingleQuote()
+// ----------------------------------------------------------------------
+// FrozenDocument
+
+namespace internal {
+
+const char kFrozenMagic[8] = { 'T', 'O', 'M', 'L', 'F', 'R', 'Z', '\0' };
+const std::uint32_t kFrozenVersion = 3;
+// A table which has more keys than this has a perfect hash.
+const size_t kFrozenHashThreshold = 8;
+
+// FNV-1a alone doesn't spread the keys differing only in the last characters over the high bits.
+inline std::uint64_t frozenHash(const char* key, size_t size)
 {
-    if (!consume('\''))
-        return Token(TokenType::ERROR_TOKEN, std::string("string didn't start with '\''?"));
+    return mixHash(hashBytes(key, size));
+}
 
-    std::string s;
-    char c;
+// These are on the lookup path, so they avoid a division and another mixHash().
+inline std::uint32_t frozenBucket(std::uint64_t h, std::uint32_t bucketCount)
+{
+    return static_cast<std::uint32_t>(((h >> 32) * bucketCount) >> 32);
+}
 
-    if (current(&c) && c == '\'') {
-        next();
-        if (!current(&c) || c != '\'') {
-            // OK. It's empty string.
-            return Token(TokenType::STRING, std::string());
-        }
-        next();
-        // raw string literal started.
-        // Newline just after """ should be ignored.
-        if (current(&c) && c == '\n')
-            next();
+inline std::uint32_t frozenSlot(std::uint64_t h, std::uint32_t displacement, std::uint32_t slotCount)
+{
+    std::uint64_t x = (h ^ (displacement * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL;
+    return static_cast<std::uint32_t>(((x >> 32) * slotCount) >> 32);
+}
 
-        while (current(&c)) {
-            if (c == '\'') {
-                next();
-                if (current(&c) && c == '\'') {
-                    next();
-                    if (current(&c) && c == '\'') {
-                        next();
-                        return Token(TokenType::MULTILINE_STRING, s);
-                    } else {
-                        s += '\'';
-                        s += '\'';
-                        continue;
-                    }
-                } else {
-                    s += '\'';
-                    continue;
-                }
-            }
+class FrozenBuilder {
+public:
+    std::vector<char> build(const Value& root);
 
-            next();
-            s += c;
-        }
+private:
+    size_t allocate(size_t bytes);
+    std::uint64_t addString(const std::string& s);
+    std::uint64_t addKey(const std::string& key);
+    // Checks that |size| fits in FrozenNode::size.
+    static std::uint32_t checkSize(size_t size);
+    void fill(size_t offset, const Value& v);
+    void fillTable(FrozenNode* node, const Table& table);
+    static bool buildPerfectHash(const std::vector<std::uint64_t>& hashes,
+                                 std::vector<std::uint32_t>* buckets, std::vector<std::uint32_t>* slots);
+
+    template<typename T> T* at(size_t offset) { return reinterpret_cast<T*>(&nodes_[offset]); }
+
+    std::vector<char> nodes_;
+    std::string strings_;
+    std::unordered_map<std::string, std::uint64_t> keys_;
+    // The values to fill, and the offsets of their nodes.
+    std::vector<std::pair<const Value*, size_t>> queue_;
+};
 
-        return Token(TokenType::ERROR_TOKEN, std::string("string didn't end with '\'\'\'' ?"));
+inline std::vector<char> FrozenBuilder::build(const Value& root)
+{
+    nodes_.clear();
+    strings_.clear();
+    keys_.clear();
+    queue_.clear();
+
+    allocate(sizeof(FrozenHeader));
+    queue_.emplace_back(&root, offsetof(FrozenHeader, root));
+    // Breadth-first. fill() appends the children to |queue_|.
+    for (size_t i = 0; i < queue_.size(); ++i)
+        fill(queue_[i].second, *queue_[i].first);
+
+    size_t stringsOffset = nodes_.size();
+    FrozenHeader* header = at<FrozenHeader>(0);
+    std::memcpy(header->magic, kFrozenMagic, sizeof(header->magic));
+    header->version = kFrozenVersion;
+    header->stringsOffset = stringsOffset;
+    header->size = stringsOffset + strings_.size();
+
+    nodes_.insert(nodes_.end(), strings_.begin(), strings_.end());
+    return std::move(nodes_);
+}
+
+inline size_t FrozenBuilder::allocate(size_t bytes)
+{
+    size_t offset = nodes_.size();
+    nodes_.resize(offset + ((bytes + 7) & ~static_cast<size_t>(7)));
+    return offset;
+}
+
+inline std::uint64_t FrozenBuilder::addString(const std::string& s)
+{
+    std::uint64_t offset = strings_.size();
+    strings_ += s;
+    return offset;
+}
+
+inline std::uint64_t FrozenBuilder::addKey(const std::string& key)
+{
+    auto it = keys_.find(key);
+    if (it != keys_.end())
+        return it->second;
+    std::uint64_t offset = addString(key);
+    keys_.emplace(key, offset);
+    return offset;
+}
+
+// static
+inline std::uint32_t FrozenBuilder::checkSize(size_t size)
+{
+    if (size > std::numeric_limits<std::uint32_t>::max())
+        failwith("too large to freeze: a string or a container of ", size, " bytes or elements");
+    return static_cast<std::uint32_t>(size);
+}
+
+inline void FrozenBuilder::fill(size_t offset, const Value& v)
+{
+    FrozenNode node = FrozenNode();
+    node.type = static_cast<std::uint8_t>(v.type());
+
+    switch (v.type()) {
+    case Value::NULL_TYPE:
+        break;
+    case Value::BOOL_TYPE:
+        node.payload = v.as<bool>();
+        break;
+    case Value::INT_TYPE:
+        node.payload = static_cast<std::uint64_t>(v.as<std::int64_t>());
+        break;
+    case Value::DOUBLE_TYPE: {
+        double d = v.as<double>();
+        std::memcpy(&node.payload, &d, sizeof(d));
+        break;
+    }
+    case Value::STRING_TYPE: {
+        const std::string& str = v.as<std::string>();
+        node.size = checkSize(str.size());
+        node.payload = addString(str);
+        break;
+    }
+    case Value::TIME_TYPE:
+        node.payload = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(v.as<Time>().time_since_epoch()).count());
+        break;
+    case Value::ARRAY_TYPE: {
+        const Array& array = v.as<Array>();
+        node.size = checkSize(array.size());
+        size_t children = allocate(sizeof(FrozenNode) * array.size());
+        node.payload = children;
+        for (size_t i = 0; i < array.size(); ++i)
+            queue_.emplace_back(&array[i], children + sizeof(FrozenNode) * i);
+        break;
+    }
+    case Value::TABLE_TYPE:
+        fillTable(&node, v.as<Table>());
+        break;
     }
 
-    while (current(&c)) {
-        next();
-        if (c == '\'') {
-            return Token(TokenType::STRING, s);
+    // |nodes_| may have been reallocated above.
+    *at<FrozenNode>(offset) = node;
+}
+
+inline void FrozenBuilder::fillTable(FrozenNode* node, const Table& table)
+{
+    auto entries = sortedEntries(table, TablePolicy::sorted);
+    const size_t count = checkSize(entries.size());
+
+    std::vector<std::uint32_t> buckets, slots;
+    if (count > kFrozenHashThreshold) {
+        std::vector<std::uint64_t> hashes;
+        hashes.reserve(count);
+        for (const auto* entry : entries) {
+            const std::string& key = entry->first;
+            hashes.push_back(frozenHash(key.data(), key.size()));
+        }
+        if (!buildPerfectHash(hashes, &buckets, &slots)) {
+            buckets.clear();
+            slots.clear();
         }
+    }
 
-        s += c;
+    size_t offset = allocate(sizeof(FrozenTable) + (sizeof(FrozenKey) + sizeof(FrozenNode)) * count +
+                             sizeof(std::uint32_t) * (buckets.size() + slots.size()));
+    FrozenTable* header = at<FrozenTable>(offset);
+    header->count = static_cast<std::uint32_t>(count);
+    header->bucketCount = static_cast<std::uint32_t>(buckets.size());
+    header->slotCount = static_cast<std::uint32_t>(slots.size());
+
+    size_t keys = offset + sizeof(FrozenTable);
+    size_t children = keys + sizeof(FrozenKey) * count;
+    size_t hash = children + sizeof(FrozenNode) * count;
+    for (size_t i = 0; i < count; ++i) {
+        const std::string& key = entries[i]->first;
+        std::uint64_t keyOffset = addKey(key);
+        FrozenKey* k = at<FrozenKey>(keys + sizeof(FrozenKey) * i);
+        k->offset = keyOffset;
+        k->size = checkSize(key.size());
+        queue_.emplace_back(&entries[i]->second, children + sizeof(FrozenNode) * i);
     }
+    if (!buckets.empty())
+        std::memcpy(&nodes_[hash], buckets.data(), sizeof(std::uint32_t) * buckets.size());
+    if (!slots.empty())
+        std::memcpy(&nodes_[hash + sizeof(std::uint32_t) * buckets.size()], slots.data(), sizeof(std::uint32_t) * slots.size());
 
-    return Token(TokenType::ERROR_TOKEN, std::string("string didn't end with '\''?"));
+    node->size = static_cast<std::uint32_t>(count);
+    node->payload = offset;
 }
 
-inline Token Lexer::nextKey()
+// Hash and displace: the keys are grouped into buckets, and for each bucket from the largest,
+// a displacement which maps all of its keys to free slots is searched.
+// static
+inline bool FrozenBuilder::buildPerfectHash(const std::vector<std::uint64_t>& hashes,
+                                            std::vector<std::uint32_t>* buckets, std::vector<std::uint32_t>* slots)
 {
-    std::string s;
-    char c;
-    while (current(&c) && (isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-')) {
-        s += c;
-        next();
+    const size_t count = hashes.size();
+    const std::uint32_t slotCount = static_cast<std::uint32_t>(count + count / 4);
+    const std::uint32_t bucketCount = static_cast<std::uint32_t>((count + 3) / 4);
+
+    std::vector<std::vector<std::uint32_t>> members(bucketCount);
+    for (size_t i = 0; i < count; ++i)
+        members[frozenBucket(hashes[i], bucketCount)].push_back(static_cast<std::uint32_t>(i));
+    std::vector<std::uint32_t> order(bucketCount);
+    for (std::uint32_t b = 0; b < bucketCount; ++b)
+        order[b] = b;
+    std::stable_sort(order.begin(), order.end(), [&members](std::uint32_t lhs, std::uint32_t rhs) {
+        return members[lhs].size() > members[rhs].size();
+    });
+
+    buckets->assign(bucketCount, 0);
+    slots->assign(slotCount, 0);
+    std::vector<std::uint32_t> taken;
+    for (std::uint32_t b : order) {
+        if (members[b].empty())
+            break;
+
+        bool placed = false;
+        for (std::uint32_t d = 0; d < (1U << 16) && !placed; ++d) {
+            taken.clear();
+            placed = true;
+            for (std::uint32_t i : members[b]) {
+                std::uint32_t slot = frozenSlot(hashes[i], d, slotCount);
+                if ((*slots)[slot] != 0 || std::find(taken.begin(), taken.end(), slot) != taken.end()) {
+                    placed = false;
+                    break;
+                }
+                taken.push_back(slot);
+            }
+            if (placed) {
+                (*buckets)[b] = d;
+                for (size_t k = 0; k < taken.size(); ++k)
+                    (*slots)[taken[k]] = members[b][k] + 1;
+            }
+        }
+        if (!placed)
+            return false;
     }
+    return true;
+}
 
-    if (s.empty())
-        return Token(TokenType::ERROR_TOKEN, std::string("Unknown key format"));
+// Returns true if |data| starts with a header of this version, which says the size is |size|.
+inline bool isFrozenHeader(const char* data, size_t size)
+{
+    if (size < sizeof(FrozenHeader))
+        return false;
 
-    return Token(TokenType::IDENT, s);
+    FrozenHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    return std::memcmp(header.magic, kFrozenMagic, sizeof(header.magic)) == 0 &&
+        header.version == kFrozenVersion && header.size == size && header.stringsOffset <= size;
 }
 
-inline Token Lexer::nextValue()
+// Returns true if every node, key and string of |data|, which has a valid header, is within |size|
+// bytes. |data| must be aligned to 8 bytes. The arrays and tables are laid out in the breadth-first
+// order, so each one must start after the previous one. It makes the walk O(size) even for crafted
+// bytes, which might point back to a node.
+inline bool isFrozenBodyValid(const char* data, size_t size)
 {
-    std::string s;
-    char c;
+    const FrozenHeader* header = reinterpret_cast<const FrozenHeader*>(data);
+    const std::uint64_t nodesEnd = header->stringsOffset;
+    if (nodesEnd < sizeof(FrozenHeader) || nodesEnd % 8 != 0)
+        return false;
+    const std::uint64_t stringsSize = size - nodesEnd;
+    auto inStrings = [stringsSize](std::uint64_t offset, std::uint32_t length) {
+        return offset <= stringsSize && length <= stringsSize - offset;
+    };
 
-    if (current(&c) && isalpha(static_cast<unsigned char>(c))) {
-        s += c;
-        next();
-        while (current(&c) && isalpha(static_cast<unsigned char>(c))) {
-            s += c;
-            next();
+    std::vector<const FrozenNode*> queue(1, &header->root);
+    std::uint64_t next = sizeof(FrozenHeader);
+    for (size_t i = 0; i < queue.size(); ++i) {
+        const FrozenNode& node = *queue[i];
+        switch (node.type) {
+        case Value::NULL_TYPE:
+        case Value::BOOL_TYPE:
+        case Value::INT_TYPE:
+        case Value::DOUBLE_TYPE:
+        case Value::TIME_TYPE:
+            continue;
+        case Value::STRING_TYPE:
+            if (!inStrings(node.payload, node.size))
+                return false;
+            continue;
+        case Value::ARRAY_TYPE:
+        case Value::TABLE_TYPE:
+            break;
+        default:
+            return false;
         }
 
-        if (s == "true")
-            return Token(TokenType::BOOL, true);
-        if (s == "false")
-            return Token(TokenType::BOOL, false);
-        return Token(TokenType::ERROR_TOKEN, std::string("Unknown ident: ") + s);
-    }
+        if (node.payload < next || node.payload % 8 != 0 || node.payload > nodesEnd)
+            return false;
+        const std::uint64_t room = nodesEnd - node.payload;
+        const char* p = data + node.payload;
+        const FrozenNode* children;
+        std::uint64_t bytes;
+        if (node.type == Value::ARRAY_TYPE) {
+            bytes = sizeof(FrozenNode) * static_cast<std::uint64_t>(node.size);
+            if (bytes > room)
+                return false;
+            children = reinterpret_cast<const FrozenNode*>(p);
+        } else {
+            if (room < sizeof(FrozenTable))
+                return false;
+            const FrozenTable* table = reinterpret_cast<const FrozenTable*>(p);
+            if (table->count != node.size || (table->bucketCount == 0) != (table->slotCount == 0))
+                return false;
+            bytes = sizeof(FrozenTable) + (sizeof(FrozenKey) + sizeof(FrozenNode)) * static_cast<std::uint64_t>(table->count) +
+                sizeof(std::uint32_t) * (static_cast<std::uint64_t>(table->bucketCount) + table->slotCount);
+            if (bytes > room)
+                return false;
 
-    while (current(&c) && (('0' <= c && c <= '9') || c == '.' || c == 'e' || c == 'E' ||
-                           c == 'T' || c == 'Z' || c == '_' || c == ':' || c == '-' || c == '+')) {
-        next();
-        s += c;
-    }
+            const FrozenKey* keys = reinterpret_cast<const FrozenKey*>(table + 1);
+            for (std::uint32_t k = 0; k < table->count; ++k) {
+                if (!inStrings(keys[k].offset, keys[k].size))
+                    return false;
+            }
+            children = reinterpret_cast<const FrozenNode*>(keys + table->count);
+            const std::uint32_t* slots = reinterpret_cast<const std::uint32_t*>(children + table->count) + table->bucketCount;
+            for (std::uint32_t k = 0; k < table->slotCount; ++k) {
+                if (slots[k] > table->count)
+                    return false;
+            }
+        }
 
-    if (isInteger(s)) {
-        std::stringstream ss(removeDelimiter(s));
-        std::int64_t x;
-        ss >> x;
-        return Token(TokenType::INT, x);
+        next = node.payload + bytes;
+        for (std::uint32_t k = 0; k < node.size; ++k)
+            queue.push_back(children + k);
     }
+    return true;
+}
 
-    if (isDouble(s)) {
-        std::stringstream ss(removeDelimiter(s));
-        double d;
-        ss >> d;
-        return Token(TokenType::DOUBLE, d);
-    }
+inline int compareKey(const char* lhs, size_t lhsSize, const char* rhs, size_t rhsSize)
+{
+    int cmp = std::memcmp(lhs, rhs, std::min(lhsSize, rhsSize));
+    if (cmp != 0)
+        return cmp;
+    return lhsSize < rhsSize ? -1 : (rhsSize < lhsSize ? 1 : 0);
+}
 
-    return parseAsTime(s);
+} // namespace internal
+
+inline FrozenDocument freeze(const Value& v)
+{
+    std::vector<char> bytes = internal::FrozenBuilder().build(v);
+
+    FrozenDocument doc;
+    doc.buffer_.reset(new std::uint64_t[(bytes.size() + 7) / 8]);
+    std::memcpy(doc.buffer_.get(), bytes.data(), bytes.size());
+    doc.size_ = bytes.size();
+    return doc;
 }
 
-inline Token Lexer::parseAsTime(const std::string& str)
+inline FrozenDocument freeze(Value&& v)
 {
-    const char* s = str.c_str();
+    FrozenDocument doc = freeze(static_cast<const Value&>(v));
+    v = Value();
+    return doc;
+}
 
-    int n;
-    int YYYY, MM, DD;
-#if defined(_MSC_VER)
-    if (sscanf_s(s, "%d-%d-%d%n", &YYYY, &MM, &DD, &n) != 3)
-        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
-#else
-    if (sscanf(s, "%d-%d-%d%n", &YYYY, &MM, &DD, &n) != 3)
-        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
-#endif
+// static
+inline FrozenDocument FrozenDocument::fromBytes(const char* data, size_t size)
+{
+    FrozenDocument doc;
 
-    if (!(1 <= MM && MM <= 12)) {
-        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
-    }
-    if (YYYY < 1900) {
-        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
-    }
+    if (!internal::isFrozenHeader(data, size))
+        return doc;
 
-    if (s[n] == '\0') {
-        std::tm t;
-        t.tm_sec = 0;
-        t.tm_min = 0;
-        t.tm_hour = 0;
-        t.tm_mday = DD;
-        t.tm_mon = MM - 1;
-        t.tm_year = YYYY - 1900;
-        auto tp = std::chrono::system_clock::from_time_t(timegm(&t));
-        return Token(TokenType::TIME, tp);
+    doc.buffer_.reset(new std::uint64_t[(size + 7) / 8]);
+    std::memcpy(doc.buffer_.get(), data, size);
+    if (!internal::isFrozenBodyValid(doc.data(), size)) {
+        doc.buffer_.reset();
+        return doc;
     }
+    doc.size_ = size;
+    return doc;
+}
 
-    if (s[n] != 'T')
-        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
+inline FrozenValue FrozenDocument::root() const
+{
+    if (empty())
+        return FrozenValue();
+    const internal::FrozenHeader* header = reinterpret_cast<const internal::FrozenHeader*>(data());
+    return FrozenValue(data(), data() + header->stringsOffset, &header->root);
+}
 
-    s = s + n + 1;
+inline std::string serializeBinary(const Value& v)
+{
+    std::vector<char> bytes = internal::FrozenBuilder().build(v);
+    return std::string(bytes.begin(), bytes.end());
+}
 
-    int hh, mm;
-    double ss; // double for fraction
-#if defined(_MSC_VER)
-    if (sscanf_s(s, "%d:%d:%lf%n", &hh, &mm, &ss, &n) != 3)
-        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
-#else
-    if (sscanf(s, "%d:%d:%lf%n", &hh, &mm, &ss, &n) != 3)
-        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
-#endif
+// static
+inline BinaryView BinaryView::fromBytes(const char* data, size_t size)
+{
+    BinaryView view;
+    if (reinterpret_cast<std::uintptr_t>(data) % alignof(std::uint64_t) != 0 || !internal::isFrozenHeader(data, size))
+        return view;
 
-    std::tm t;
-    t.tm_sec = static_cast<int>(ss);
-    t.tm_min = mm;
-    t.tm_hour = hh;
-    t.tm_mday = DD;
-    t.tm_mon = MM - 1;
-    t.tm_year = YYYY - 1900;
-    auto tp = std::chrono::system_clock::from_time_t(timegm(&t));
-    ss -= static_cast<int>(ss);
-    // TODO(mayah): workaround GCC 4.9.3 on cygwin does not have std::round, but round().
-    tp += std::chrono::microseconds(static_cast<std::int64_t>(round(ss * 1000000)));
+    view.data_ = data;
+    view.size_ = size;
+    return view;
+}
+
+inline bool BinaryView::verify() const
+{
+    return !empty() && internal::isFrozenBodyValid(data_, size_);
+}
 
-    if (s[n] == '\0')
-        return Token(TokenType::TIME, tp);
+inline FrozenValue BinaryView::root() const
+{
+    if (empty())
+        return FrozenValue();
+    const internal::FrozenHeader* header = reinterpret_cast<const internal::FrozenHeader*>(data_);
+    return FrozenValue(data_, data_ + header->stringsOffset, &header->root);
+}
 
-    if (s[n] == 'Z' && s[n + 1] == '\0')
-        return Token(TokenType::TIME, tp);
+#if defined(__linux__)
+inline BinaryFile::BinaryFile(const std::string& filename) :
+    map_(nullptr),
+    size_(0)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        failwith("could not open file: ", filename);
+
+    try {
+        map(fd, filename);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+}
 
-    s = s + n;
-    // offset
-    // [+/-]%d:%d
-    char pn;
-    int oh, om;
-#if defined(_MSC_VER)
-    if (sscanf_s(s, "%c%d:%d", &pn, static_cast<unsigned>(sizeof(pn)), &oh, &om) != 3)
-        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
-#else
-    if (sscanf(s, "%c%d:%d", &pn, &oh, &om) != 3)
-        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
+inline BinaryFile::BinaryFile(int fd, const std::string& name) :
+    map_(nullptr),
+    size_(0)
+{
+    map(fd, name);
+}
+
+inline void BinaryFile::map(int fd, const std::string& name)
+{
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0)
+        failwith("not a serialized document: ", name);
+
+    void* map = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+        failwith("could not map file: ", name);
+    map_ = map;
+    size_ = static_cast<size_t>(st.st_size);
+
+    view_ = BinaryView::fromBytes(static_cast<const char*>(map_), size_);
+    if (view_.empty()) {
+        unmap();
+        failwith("not a serialized document: ", name);
+    }
+}
+
+inline void BinaryFile::unmap()
+{
+    if (map_)
+        ::munmap(map_, size_);
+    map_ = nullptr;
+    size_ = 0;
+    view_ = BinaryView();
+}
 #endif
 
-    if (pn != '+' && pn != '-')
-        return Token(TokenType::ERROR_TOKEN, std::string("Invalid token"));
+template<typename T>
+inline void FrozenValue::assureType(Value::Type type) const
+{
+    if (this->type() != type)
+        failwith("type error: this value is ", Value::typeToString(this->type()), " but ", internal::type_name<T>(), " was requested");
+}
 
-    if (pn == '+') {
-        tp -= std::chrono::hours(oh);
-        tp -= std::chrono::minutes(om);
-    } else {
-        tp += std::chrono::hours(oh);
-        tp += std::chrono::minutes(om);
-    }
+template<> inline bool FrozenValue::is<bool>() const { return type() == Value::BOOL_TYPE; }
+template<> inline bool FrozenValue::is<int>() const { return type() == Value::INT_TYPE; }
+template<> inline bool FrozenValue::is<std::int64_t>() const { return type() == Value::INT_TYPE; }
+template<> inline bool FrozenValue::is<double>() const { return type() == Value::DOUBLE_TYPE; }
+template<> inline bool FrozenValue::is<std::string>() const { return type() == Value::STRING_TYPE; }
+template<> inline bool FrozenValue::is<Time>() const { return type() == Value::TIME_TYPE; }
+template<> inline bool FrozenValue::is<Array>() const { return type() == Value::ARRAY_TYPE; }
+template<> inline bool FrozenValue::is<Table>() const { return type() == Value::TABLE_TYPE; }
 
-    return Token(TokenType::TIME, tp);
+template<> inline bool FrozenValue::as<bool>() const
+{
+    assureType<bool>(Value::BOOL_TYPE);
+    return node_->payload != 0;
 }
 
-inline Token Lexer::nextKeyToken()
+template<> inline std::int64_t FrozenValue::as<std::int64_t>() const
 {
-    return nextToken(false);
+    assureType<std::int64_t>(Value::INT_TYPE);
+    return static_cast<std::int64_t>(node_->payload);
 }
 
-inline Token Lexer::nextValueToken()
+template<> inline int FrozenValue::as<int>() const
 {
-    return nextToken(true);
+    assureType<int>(Value::INT_TYPE);
+    return static_cast<int>(static_cast<std::int64_t>(node_->payload));
 }
 
-inline Token Lexer::nextToken(bool isValueToken)
+template<> inline double FrozenValue::as<double>() const
 {
-    char c;
-    while (current(&c)) {
-        if (c == ' ' || c == '\t' || c == '\r') {
-            next();
-            continue;
-        }
+    assureType<double>(Value::DOUBLE_TYPE);
+    double d;
+    std::memcpy(&d, &node_->payload, sizeof(d));
+    return d;
+}
 
-        if (c == '#') {
-            skipUntilNewLine();
-            continue;
-        }
+template<> inline std::string FrozenValue::as<std::string>() const
+{
+    assureType<std::string>(Value::STRING_TYPE);
+    return std::string(strings_ + node_->payload, node_->size);
+}
 
-        switch (c) {
-        case '\n':
-            next();
-            return Token(TokenType::END_OF_LINE);
-        case '=':
-            next();
-            return Token(TokenType::EQUAL);
-        case '{':
-            next();
-            return Token(TokenType::LBRACE);
-        case '}':
-            next();
-            return Token(TokenType::RBRACE);
-        case '[':
-            next();
-            return Token(TokenType::LBRACKET);
-        case ']':
-            next();
-            return Token(TokenType::RBRACKET);
-        case ',':
-            next();
-            return Token(TokenType::COMMA);
-        case '.':
-            next();
-            return Token(TokenType::DOT);
-        case '\"':
-            return nextStringDoubleQuote();
-        case '\'':
-            return nextStringSingleQuote();
-        default:
-            if (isValueToken) {
-                return nextValue();
-            } else {
-                return nextKey();
-            }
-        }
+template<> inline Time FrozenValue::as<Time>() const
+{
+    assureType<Time>(Value::TIME_TYPE);
+    // A time written with a coarser clock may not fit in this one. It's clamped.
+    typedef std::chrono::microseconds Micros;
+    const Micros us(static_cast<std::int64_t>(node_->payload));
+    if (us >= std::chrono::duration_cast<Micros>(Time::duration::max()))
+        return Time::max();
+    if (us <= std::chrono::duration_cast<Micros>(Time::duration::min()))
+        return Time::min();
+    return Time(std::chrono::duration_cast<Time::duration>(us));
+}
+
+inline size_t FrozenValue::size() const
+{
+    switch (type()) {
+    case Value::NULL_TYPE:
+        return 0;
+    case Value::ARRAY_TYPE:
+    case Value::TABLE_TYPE:
+        return node_->size;
+    default:
+        return 1;
     }
+}
 
-    return Token(TokenType::END_OF_FILE);
+inline const internal::FrozenTable* FrozenValue::table() const
+{
+    return reinterpret_cast<const internal::FrozenTable*>(base_ + node_->payload);
 }
 
-} // namespace internal
+inline const internal::FrozenKey* FrozenValue::keys() const
+{
+    return reinterpret_cast<const internal::FrozenKey*>(table() + 1);
+}
 
-// ----------------------------------------------------------------------
+inline const internal::FrozenNode* FrozenValue::children() const
+{
+    if (type() == Value::ARRAY_TYPE)
+        return reinterpret_cast<const internal::FrozenNode*>(base_ + node_->payload);
+    return reinterpret_cast<const internal::FrozenNode*>(keys() + table()->count);
+}
 
-// static
-inline const char* Value::typeToString(Value::Type type)
+inline std::string FrozenValue::keyAt(size_t index) const
 {
-    switch (type) {
-    case NULL_TYPE:   return "null";
-    case BOOL_TYPE:   return "bool";
-    case INT_TYPE:    return "int";
-    case DOUBLE_TYPE: return "double";
-    case STRING_TYPE: return "string";
-    case TIME_TYPE:   return "time";
-    case ARRAY_TYPE:  return "array";
-    case TABLE_TYPE:  return "table";
-    default:          return "unknown";
+    const internal::FrozenKey& key = keys()[index];
+    return std::string(strings_ + key.offset, key.size);
+}
+
+inline FrozenValue FrozenValue::findChild(const char* key, size_t size) const
+{
+    if (type() != Value::TABLE_TYPE)
+        return FrozenValue();
+
+    const internal::FrozenTable* t = table();
+    const internal::FrozenKey* k = keys();
+    if (t->slotCount > 0) {
+        const std::uint32_t* buckets = reinterpret_cast<const std::uint32_t*>(children() + t->count);
+        const std::uint32_t* slots = buckets + t->bucketCount;
+        std::uint64_t h = internal::frozenHash(key, size);
+        std::uint32_t slot = slots[internal::frozenSlot(h, buckets[internal::frozenBucket(h, t->bucketCount)], t->slotCount)];
+        if (slot == 0)
+            return FrozenValue();
+        const internal::FrozenKey& found = k[slot - 1];
+        if (found.size != size || std::memcmp(strings_ + found.offset, key, size) != 0)
+            return FrozenValue();
+        return FrozenValue(base_, strings_, children() + (slot - 1));
+    }
+
+    size_t lo = 0, hi = t->count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int cmp = internal::compareKey(strings_ + k[mid].offset, k[mid].size, key, size);
+        if (cmp == 0)
+            return FrozenValue(base_, strings_, children() + mid);
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
+    return FrozenValue();
 }
 
-inline Value::Value(const Value& v) :
-    type_(v.type_)
+inline FrozenValue FrozenValue::find(const std::string& key) const
 {
-    switch (v.type_) {
-    case NULL_TYPE: null_ = v.null_; break;
-    case BOOL_TYPE: bool_ = v.bool_; break;
-    case INT_TYPE: int_ = v.int_; break;
-    case DOUBLE_TYPE: double_ = v.double_; break;
-    case STRING_TYPE: string_ = new std::string(*v.string_); break;
-    case TIME_TYPE: time_ = new Time(*v.time_); break;
-    case ARRAY_TYPE: array_ = new Array(*v.array_); break;
-    case TABLE_TYPE: table_ = new Table(*v.table_); break;
-    default:
-        assert(false);
-        type_ = NULL_TYPE;
-        null_ = nullptr;
+    // A dotted key of bare keys is split in place. Otherwise, it's tokenized by Path.
+    if (!std::all_of(key.begin(), key.end(), [](char c) { return c == '.' || internal::isStaticKeyChar(c); }))
+        return find(Path(key));
+    if (key.empty() || key.front() == '.' || key.back() == '.' || key.find("..") != std::string::npos)
+        return FrozenValue();
+
+    FrozenValue current = *this;
+    const char* p = key.data();
+    const char* end = p + key.size();
+    while (current.valid()) {
+        const char* dot = std::find(p, end, '.');
+        current = current.findChild(p, dot - p);
+        if (dot == end)
+            break;
+        p = dot + 1;
     }
+    return current;
 }
 
-inline Value::Value(Value&& v) noexcept :
-    type_(v.type_)
+inline FrozenValue FrozenValue::find(const Path& path) const
 {
-    switch (v.type_) {
-    case NULL_TYPE: null_ = v.null_; break;
-    case BOOL_TYPE: bool_ = v.bool_; break;
-    case INT_TYPE: int_ = v.int_; break;
-    case DOUBLE_TYPE: double_ = v.double_; break;
-    case STRING_TYPE: string_ = v.string_; break;
-    case TIME_TYPE: time_ = v.time_; break;
-    case ARRAY_TYPE: array_ = v.array_; break;
-    case TABLE_TYPE: table_ = v.table_; break;
-    default:
-        assert(false);
-        type_ = NULL_TYPE;
-        null_ = nullptr;
+    if (!path.valid())
+        return FrozenValue();
+
+    FrozenValue current = *this;
+    for (const std::string& key : path.keys()) {
+        current = current.findChild(key);
+        if (!current.valid())
+            break;
     }
+    return current;
+}
 
-    v.type_ = NULL_TYPE;
-    v.null_ = nullptr;
+template<typename T>
+inline T FrozenValue::get(const std::string& key) const
+{
+    if (type() != Value::TABLE_TYPE)
+        failwith("type must be table to do get(key).");
+
+    FrozenValue v = find(key);
+    if (!v.valid())
+        failwith("key ", key, " was not found.");
+    return v.as<T>();
 }
 
-inline Value& Value::operator=(const Value& v)
+template<typename T>
+inline T FrozenValue::get(const Path& path) const
 {
-    if (this == &v)
-        return *this;
+    if (type() != Value::TABLE_TYPE)
+        failwith("type must be table to do get(key).");
 
-    this->~Value();
+    FrozenValue v = find(path);
+    if (!v.valid())
+        failwith("key ", path.toString(), " was not found.");
+    return v.as<T>();
+}
 
-    type_ = v.type_;
-    switch (v.type_) {
-    case NULL_TYPE: null_ = v.null_; break;
-    case BOOL_TYPE: bool_ = v.bool_; break;
-    case INT_TYPE: int_ = v.int_; break;
-    case DOUBLE_TYPE: double_ = v.double_; break;
-    case STRING_TYPE: string_ = new std::string(*v.string_); break;
-    case TIME_TYPE: time_ = new Time(*v.time_); break;
-    case ARRAY_TYPE: array_ = new Array(*v.array_); break;
-    case TABLE_TYPE: table_ = new Table(*v.table_); break;
-    default:
-        assert(false);
-        type_ = NULL_TYPE;
-        null_ = nullptr;
+inline FrozenValue FrozenValue::at(size_t index) const
+{
+    if (type() != Value::ARRAY_TYPE || index >= node_->size)
+        return FrozenValue();
+    return FrozenValue(base_, strings_, children() + index);
+}
+
+inline FrozenValue::const_iterator FrozenValue::begin() const
+{
+    return const_iterator(*this, 0);
+}
+
+inline FrozenValue::const_iterator FrozenValue::end() const
+{
+    return const_iterator(*this, type() == Value::TABLE_TYPE ? node_->size : 0);
+}
+
+inline Value FrozenValue::thaw() const
+{
+    switch (type()) {
+    case Value::NULL_TYPE:
+        return Value();
+    case Value::BOOL_TYPE:
+        return Value(as<bool>());
+    case Value::INT_TYPE:
+        return Value(as<std::int64_t>());
+    case Value::DOUBLE_TYPE:
+        return Value(as<double>());
+    case Value::STRING_TYPE:
+        return Value(as<std::string>());
+    case Value::TIME_TYPE:
+        return Value(as<Time>());
+    // The containers are built before they're wrapped, so that the result is shareable
+    // like a parsed document.
+    case Value::ARRAY_TYPE: {
+        Array array;
+        array.reserve(node_->size);
+        for (size_t i = 0; i < node_->size; ++i)
+            array.push_back(at(i).thaw());
+        return Value(std::move(array));
     }
+    case Value::TABLE_TYPE: {
+        Table table;
+        for (size_t i = 0; i < node_->size; ++i)
+            table.emplace_hint(table.end(), keyAt(i), FrozenValue(base_, strings_, children() + i).thaw());
+        return Value(std::move(table));
+    }
+    }
+    return Value();
+}
 
-    return *this;
+// ----------------------------------------------------------------------
+// Parse cache
+
+namespace internal {
+
+const char kParseCacheMagic[8] = { 'T', 'O', 'M', 'L', 'C', 'A', 'C', 'H' };
+const std::uint32_t kParseCacheVersion = 2;
+
+// A cache file is ParseCacheHeader, the content of the parsed file, and the bytes of a
+// FrozenDocument. The content is compared on a hit, since two files can have the same 64-bit hash.
+struct ParseCacheHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t frozenVersion;
+    std::uint64_t contentSize;
+    std::uint64_t contentHash;
+};
+
+// Reads the rest of |ifs|.
+inline std::string readAll(std::ifstream& ifs)
+{
+    std::streampos position = ifs.tellg();
+    ifs.seekg(0, std::ios::end);
+    std::streamoff size = ifs.tellg() - position;
+    ifs.seekg(position);
+
+    std::string bytes(static_cast<size_t>(std::max<std::streamoff>(size, 0)), '\0');
+    if (!ifs.read(&bytes[0], bytes.size()))
+        return std::string();
+    return bytes;
 }
 
-inline Value& Value::operator=(Value&& v) noexcept
+inline std::string parseCachePath(const std::string& directory, std::uint64_t hash)
 {
-    if (this == &v)
-        return *this;
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.tomlc", static_cast<unsigned long long>(hash));
+    return directory + "/" + name;
+}
 
-    this->~Value();
+// Returns an empty document if the cache file doesn't exist or doesn't match.
+inline FrozenDocument readParseCache(const std::string& path, const std::string& content, std::uint64_t hash)
+{
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs)
+        return FrozenDocument();
+
+    ParseCacheHeader header;
+    if (!ifs.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, kParseCacheMagic, sizeof(header.magic)) != 0 ||
+        header.version != kParseCacheVersion || header.frozenVersion != kFrozenVersion ||
+        header.contentSize != content.size() || header.contentHash != hash)
+        return FrozenDocument();
+
+    std::string cachedContent(content.size(), '\0');
+    if (!ifs.read(&cachedContent[0], cachedContent.size()) || cachedContent != content)
+        return FrozenDocument();
+
+    std::string bytes = readAll(ifs);
+    return FrozenDocument::fromBytes(bytes.data(), bytes.size());
+}
 
-    type_ = v.type_;
-    switch (v.type_) {
-    case NULL_TYPE: null_ = v.null_; break;
-    case BOOL_TYPE: bool_ = v.bool_; break;
-    case INT_TYPE: int_ = v.int_; break;
-    case DOUBLE_TYPE: double_ = v.double_; break;
-    case STRING_TYPE: string_ = v.string_; break;
-    case TIME_TYPE: time_ = v.time_; break;
-    case ARRAY_TYPE: array_ = v.array_; break;
-    case TABLE_TYPE: table_ = v.table_; break;
-    default:
-        assert(false);
-        type_ = NULL_TYPE;
-        null_ = nullptr;
+// Writes to a temporary file, and renames it, so that readers never see a partial file.
+// Errors are ignored, since the cache is only an optimization.
+inline void writeParseCache(const std::string& path, const std::string& content, std::uint64_t hash, const FrozenDocument& doc)
+{
+    ParseCacheHeader header;
+    std::memcpy(header.magic, kParseCacheMagic, sizeof(header.magic));
+    header.version = kParseCacheVersion;
+    header.frozenVersion = kFrozenVersion;
+    header.contentSize = content.size();
+    header.contentHash = hash;
+
+    int local;
+    std::uint64_t unique = mixHash(static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()) ^
+                                   reinterpret_cast<std::uintptr_t>(&local));
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), ".%016llx.tmp", static_cast<unsigned long long>(unique));
+    const std::string temporary = path + suffix;
+
+    {
+        std::ofstream ofs(temporary, std::ios::binary | std::ios::trunc);
+        ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        ofs.write(content.data(), content.size());
+        ofs.write(doc.data(), doc.byteSize());
+        if (!ofs) {
+            ofs.close();
+            std::remove(temporary.c_str());
+            return;
+        }
     }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0)
+        std::remove(temporary.c_str());
+}
 
-    v.type_ = NULL_TYPE;
-    v.null_ = nullptr;
-    return *this;
+inline ParseResult parseFileCached(const std::string& filename, const ParseOptions& options)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs) {
+        return ParseResult(toml::Value(),
+                           std::string("could not open file: ") + filename);
+    }
+    const std::string content = readAll(ifs);
+
+    // The options which change the parsed document are a part of the key.
+    const std::uint64_t hash = combineHash(hashBytes(content.data(), content.size()), options.packArrays ? 1 : 0);
+    const std::string path = parseCachePath(options.cacheDirectory, hash);
+
+    FrozenDocument cached = readParseCache(path, content, hash);
+    if (!cached.empty()) {
+        KeyPool::Scope keyPoolScope(options.keyPool ? options.keyPool : KeyPool::current());
+        Value v = cached.root().thaw();
+        if (options.packArrays)
+            v.pack();
+        v.makeShareable();
+        return ParseResult(std::move(v), std::string());
+    }
+
+    std::istringstream ss(content);
+    ParseOptions uncached = options;
+    uncached.cacheDirectory.clear();
+    ParseResult pr = parse(ss, uncached);
+    if (pr.valid())
+        writeParseCache(path, content, hash, freeze(pr.value));
+    return pr;
+}
+
+} // namespace internal
+
+// ----------------------------------------------------------------------
+// ConfigHandle
+
+template<typename T>
+const size_t BasicConfigHandle<T>::kSlotCount;
+
+template<typename T>
+BasicConfigHandle<T>::~BasicConfigHandle()
+{
+    delete current_.load();
+    for (const T* snapshot : retired_)
+        delete snapshot;
+}
+
+template<typename T>
+void BasicConfigHandle<T>::clearSlots()
+{
+    for (Slot& slot : slots_)
+        slot.hazard.store(nullptr, std::memory_order_relaxed);
 }
 
-inline Value::~Value()
+// static
+template<typename T>
+size_t BasicConfigHandle<T>::threadHint()
 {
-    switch (type_) {
-    case STRING_TYPE:
-        delete string_;
-        break;
-    case TIME_TYPE:
-        delete time_;
-        break;
-    case ARRAY_TYPE:
-        delete array_;
-        break;
-    case TABLE_TYPE:
-        delete table_;
-        break;
-    default:
-        break;
-    }
+    // Threads start from different slots, so that they don't share a cache line.
+    static thread_local char tag;
+    static thread_local size_t hint = static_cast<size_t>(internal::mixHash(reinterpret_cast<std::uintptr_t>(&tag)));
+    return hint;
 }
 
-inline size_t Value::size() const
+template<typename T>
+typename BasicConfigHandle<T>::Guard BasicConfigHandle<T>::load() const
 {
-    switch (type_) {
-    case NULL_TYPE:
-        return 0;
-    case ARRAY_TYPE:
-        return array_->size();
-    case TABLE_TYPE:
-        return table_->size();
-    default:
-        return 1;
+    size_t index = threadHint();
+    while (true) {
+        const T* snapshot = current_.load(std::memory_order_acquire);
+        if (!snapshot)
+            return Guard();
+
+        // Publishes |snapshot| in a free slot.
+        Slot* slot;
+        while (true) {
+            slot = &slots_[index++ % kSlotCount];
+            const T* expected = nullptr;
+            if (slot->hazard.load(std::memory_order_relaxed) == nullptr &&
+                slot->hazard.compare_exchange_strong(expected, snapshot, std::memory_order_seq_cst))
+                break;
+        }
+
+        // If |snapshot| is still current, a writer retiring it later sees the slot.
+        if (current_.load(std::memory_order_seq_cst) == snapshot)
+            return Guard(slot, snapshot);
+        slot->hazard.store(nullptr, std::memory_order_release);
+        --index;
     }
 }
 
-inline bool Value::empty() const
+template<typename T>
+void BasicConfigHandle<T>::exchange(const T* snapshot)
 {
-    return size() == 0;
+    std::lock_guard<std::mutex> lock(mu_);
+    const T* old = current_.exchange(snapshot, std::memory_order_seq_cst);
+    if (old)
+        retired_.push_back(old);
+    reclaim();
 }
 
-template<> struct Value::ValueConverter<bool>
+template<typename T>
+void BasicConfigHandle<T>::reclaim()
 {
-    bool is(const Value& v) { return v.type() == Value::BOOL_TYPE; }
-    bool to(const Value& v) { v.assureType<bool>(); return v.bool_; }
+    if (retired_.empty())
+        return;
 
-};
-template<> struct Value::ValueConverter<int64_t>
-{
-    bool is(const Value& v) { return v.type() == Value::INT_TYPE; }
-    int64_t to(const Value& v) { v.assureType<int64_t>(); return v.int_; }
-};
-template<> struct Value::ValueConverter<int>
-{
-    bool is(const Value& v) { return v.type() == Value::INT_TYPE; }
-    int to(const Value& v) { v.assureType<int>(); return static_cast<int>(v.int_); }
-};
-template<> struct Value::ValueConverter<double>
-{
-    bool is(const Value& v) { return v.type() == Value::DOUBLE_TYPE; }
-    double to(const Value& v) { v.assureType<double>(); return v.double_; }
-};
-template<> struct Value::ValueConverter<std::string>
-{
-    bool is(const Value& v) { return v.type() == Value::STRING_TYPE; }
-    const std::string& to(const Value& v) { v.assureType<std::string>(); return *v.string_; }
-};
-template<> struct Value::ValueConverter<Time>
-{
-    bool is(const Value& v) { return v.type() == Value::TIME_TYPE; }
-    const Time& to(const Value& v) { v.assureType<Time>(); return *v.time_; }
-};
-template<> struct Value::ValueConverter<Array>
-{
-    bool is(const Value& v) { return v.type() == Value::ARRAY_TYPE; }
-    const Array& to(const Value& v) { v.assureType<Array>(); return *v.array_; }
-};
-template<> struct Value::ValueConverter<Table>
-{
-    bool is(const Value& v) { return v.type() == Value::TABLE_TYPE; }
-    const Table& to(const Value& v) { v.assureType<Table>(); return *v.table_; }
-};
+    std::vector<const T*> held;
+    for (const Slot& slot : slots_) {
+        if (const T* hazard = slot.hazard.load(std::memory_order_seq_cst))
+            held.push_back(hazard);
+    }
+    std::sort(held.begin(), held.end());
+
+    auto alive = std::partition(retired_.begin(), retired_.end(), [&held](const T* snapshot) {
+        return std::binary_search(held.begin(), held.end(), snapshot);
+    });
+    for (auto it = alive; it != retired_.end(); ++it)
+        delete *it;
+    retired_.erase(alive, retired_.end());
+}
 
 template<typename T>
-struct Value::ValueConverter<std::vector<T>>
+size_t BasicConfigHandle<T>::retiredCount() const
 {
-    bool is(const Value& v)
-    {
-        if (v.type() != Value::ARRAY_TYPE)
-            return false;
-        const Array& array = v.as<Array>();
-        if (array.empty())
-            return true;
-        return array.front().is<T>();
-    }
+    std::lock_guard<std::mutex> lock(mu_);
+    return retired_.size();
+}
 
-    std::vector<T> to(const Value& v)
-    {
-        const Array& array = v.as<Array>();
-        if (array.empty())
-            return std::vector<T>();
-        array.front().assureType<T>();
+// ----------------------------------------------------------------------
+// ChangeNotifier
 
-        std::vector<T> result;
-        for (const auto& element : array) {
-            result.push_back(element.as<T>());
-        }
+inline ChangeNotifier::SubscriptionId ChangeNotifier::watch(const std::string& path, Callback callback)
+{
+    std::vector<std::string> keys;
+    if (!path.empty()) {
+        Path p(path);
+        if (!p.valid())
+            failwith("invalid key: ", path);
+        keys = p.keys();
+    }
 
-        return result;
+    Node* node = root_.get();
+    for (const std::string& key : keys) {
+        std::unique_ptr<Node>& child = node->children[key];
+        if (!child)
+            child.reset(new Node);
+        node = child.get();
     }
-};
 
-namespace internal {
-template<typename T> inline const char* type_name();
-template<> inline const char* type_name<bool>() { return "bool"; }
-template<> inline const char* type_name<int>() { return "int"; }
-template<> inline const char* type_name<int64_t>() { return "int64_t"; }
-template<> inline const char* type_name<double>() { return "double"; }
-template<> inline const char* type_name<std::string>() { return "string"; }
-template<> inline const char* type_name<toml::Time>() { return "time"; }
-template<> inline const char* type_name<toml::Array>() { return "array"; }
-template<> inline const char* type_name<toml::Table>() { return "table"; }
-} // namespace internal
+    SubscriptionId id = nextId_++;
+    node->subscribers.emplace_back(id, std::move(callback));
+    paths_.emplace(id, std::move(keys));
+    return id;
+}
 
-template<typename T>
-inline void Value::assureType() const
+inline bool ChangeNotifier::unwatch(SubscriptionId id)
 {
-    if (!is<T>())
-        failwith("type error: this value is ", typeToString(type_), " but ", internal::type_name<T>(), " was requested");
+    auto it = paths_.find(id);
+    if (it == paths_.end())
+        return false;
+
+    // The nodes on the path, to remove the empty ones from the bottom.
+    std::vector<Node*> nodes(1, root_.get());
+    for (const std::string& key : it->second)
+        nodes.push_back(nodes.back()->children[key].get());
+
+    auto& subscribers = nodes.back()->subscribers;
+    subscribers.erase(std::find_if(subscribers.begin(), subscribers.end(),
+                                   [id](const std::pair<SubscriptionId, Callback>& s) { return s.first == id; }));
+    for (size_t i = it->second.size(); i > 0; --i) {
+        if (!nodes[i]->subscribers.empty() || !nodes[i]->children.empty())
+            break;
+        nodes[i - 1]->children.erase(it->second[i - 1]);
+    }
+
+    paths_.erase(it);
+    return true;
 }
 
-template<typename T>
-inline bool Value::is() const
+inline size_t ChangeNotifier::notify(const Value& before, const Value& after) const
 {
-    return ValueConverter<T>().is(*this);
+    return notify(*root_, &before, &after);
 }
 
-template<typename T>
-inline typename call_traits<T>::return_type Value::as() const
+// static
+inline size_t ChangeNotifier::notify(const Node& node, const Value* before, const Value* after)
 {
-    return ValueConverter<T>().to(*this);
+    if (before == after)
+        return 0;
+
+    size_t count = 0;
+    if (!node.subscribers.empty()) {
+        if (before && after && *before == *after)
+            return 0;
+        for (const auto& subscriber : node.subscribers)
+            subscriber.second(before, after);
+        count += node.subscribers.size();
+    }
+
+    for (const auto& child : node.children) {
+        const Value* childBefore = before && before->is<Table>() ? before->findChild(child.first) : nullptr;
+        const Value* childAfter = after && after->is<Table>() ? after->findChild(child.first) : nullptr;
+        count += notify(*child.second, childBefore, childAfter);
+    }
+    return count;
 }
 
-inline bool Value::isNumber() const
+// ----------------------------------------------------------------------
+// LayeredView
+
+inline LayeredView::LayeredView(const std::vector<const Value*>& layers)
 {
-    return is<int>() || is<double>();
+    for (const Value* layer : layers)
+        push(layer);
 }
 
-inline double Value::asNumber() const
+inline void LayeredView::push(const Value* layer)
 {
-    if (is<int>())
-        return as<int>();
-    if (is<double>())
-        return as<double>();
+    if (layer && layer->is<Table>())
+        layers_.insert(layers_.begin(), layer);
+}
 
-    failwith("type error: this value is ", typeToString(type_), " but number is requested");
+inline LayeredView LayeredView::child(const std::string& key, const Value** found) const
+{
+    // Collects the tables from the topmost one until a non-table value, which hides
+    // everything below it.
+    LayeredView result;
+    *found = nullptr;
+    for (const Value* layer : layers_) {
+        const Value* v = layer->findChild(key);
+        if (!v)
+            continue;
+        if (!*found)
+            *found = v;
+        if (!v->is<Table>())
+            break;
+        result.layers_.push_back(v);
+    }
+    return result;
 }
 
-inline std::time_t Value::as_time_t() const
+inline const Value* LayeredView::find(const std::string& key) const
 {
-    return std::chrono::system_clock::to_time_t(as<Time>());
+    std::vector<std::string> parts;
+    if (!internal::splitKey(key, &parts))
+        return nullptr;
+
+    LayeredView current = *this;
+    const Value* found = nullptr;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        current = current.child(parts[i], &found);
+        if (!found)
+            return nullptr;
+        if (i + 1 < parts.size() && current.empty())
+            return nullptr;
+    }
+    return found;
 }
 
-inline std::string Value::spaces(int num)
+template<typename T>
+inline typename call_traits<T>::return_type LayeredView::get(const std::string& key) const
 {
-    if (num <= 0)
-        return std::string();
+    const Value* obj = find(key);
+    if (!obj)
+        failwith("key ", key, " was not found.");
 
-    return std::string(num, ' ');
+    return obj->as<T>();
 }
 
-inline std::string Value::escapeKey(const std::string& key)
+inline LayeredView LayeredView::view(const std::string& key) const
 {
-    auto position = std::find_if(key.begin(), key.end(), [](char c) -> bool {
-        if (std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-')
-            return false;
-        return true;
-    });
+    std::vector<std::string> parts;
+    if (!internal::splitKey(key, &parts))
+        return LayeredView();
+
+    LayeredView current = *this;
+    const Value* found = nullptr;
+    for (const std::string& part : parts) {
+        current = current.child(part, &found);
+        if (current.empty())
+            break;
+    }
+    return current;
+}
 
-    if (position != key.end()) {
-        std::string escaped = "\"";
-        for (const char& c : key) {
-            if (c == '\\' || c  == '"')
-                escaped += '\\';
-            escaped += c;
-        }
-        escaped += "\"";
+inline LayeredView::const_iterator LayeredView::begin() const
+{
+    const_iterator it;
+    it.entries_ = std::make_shared<std::vector<std::vector<const_iterator::Entry>>>();
+    for (const Value* layer : layers_)
+        it.entries_->push_back(internal::sortedEntries(layer->as<Table>(), TablePolicy::sorted));
+    it.positions_.assign(layers_.size(), 0);
+    it.findCurrent();
+    return it;
+}
 
-        return escaped;
+inline LayeredView::const_iterator LayeredView::end() const
+{
+    return const_iterator();
+}
+
+inline void LayeredView::const_iterator::findCurrent()
+{
+    // The smallest key among the layers. The upper layer wins a tie.
+    current_ = nullptr;
+    for (size_t i = 0; i < entries_->size(); ++i) {
+        const std::vector<Entry>& entries = (*entries_)[i];
+        if (positions_[i] == entries.size())
+            continue;
+        Entry entry = entries[positions_[i]];
+        if (!current_ || static_cast<const std::string&>(entry->first) < static_cast<const std::string&>(current_->first))
+            current_ = entry;
     }
+}
 
-    return key;
+inline LayeredView::const_iterator& LayeredView::const_iterator::operator++()
+{
+    const std::string& key = current_->first;
+    for (size_t i = 0; i < entries_->size(); ++i) {
+        const std::vector<Entry>& entries = (*entries_)[i];
+        if (positions_[i] < entries.size() && entries[positions_[i]]->first == key)
+            ++positions_[i];
+    }
+    findCurrent();
+    return *this;
 }
 
-inline void Value::write(std::ostream* os, const std::string& keyPrefix, int indent) const
+inline void Value::deduplicate(std::unordered_map<std::uint64_t, std::vector<Value>>* pool)
 {
     switch (type_) {
-    case NULL_TYPE:
-        failwith("null type value is not a valid value");
-        break;
-    case BOOL_TYPE:
-        (*os) << (bool_ ? "true" : "false");
-        break;
-    case INT_TYPE:
-        (*os) << int_;
-        break;
-    case DOUBLE_TYPE: {
-        (*os) << std::fixed << std::showpoint << double_;
-        break;
-    }
     case STRING_TYPE:
-        (*os) << '"' << internal::escapeString(*string_) << '"';
-        break;
-    case TIME_TYPE: {
-        time_t tt = std::chrono::system_clock::to_time_t(*time_);
-        std::tm t;
-        gmtime_r(&tt, &t);
-        char buf[256];
-        snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02dZ", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
-        (*os) << buf;
         break;
-    }
     case ARRAY_TYPE:
-        (*os) << '[';
-        for (size_t i = 0; i < array_->size(); ++i) {
-            if (i)
-                (*os) << ", ";
-            (*array_)[i].write(os, keyPrefix, -1);
+        // A packed array is deduplicated as a whole.
+        if (!packed_) {
+            for (Value& v : mutableArray(false))
+                v.deduplicate(pool);
         }
-        (*os) << ']';
         break;
     case TABLE_TYPE:
-        for (const auto& kv : *table_) {
-            if (kv.second.is<Table>())
-                continue;
-            if (kv.second.is<Array>() && kv.second.size() > 0 && kv.second.find(0)->is<Table>())
-                continue;
-            (*os) << spaces(indent) << escapeKey(kv.first) << " = ";
-            kv.second.write(os, keyPrefix, indent >= 0 ? indent + 1 : indent);
-            (*os) << '\n';
-        }
-        for (const auto& kv : *table_) {
-            if (kv.second.is<Table>()) {
-                std::string key(keyPrefix);
-                if (!keyPrefix.empty())
-                    key += ".";
-                key += escapeKey(kv.first);
-                (*os) << "\n" << spaces(indent) << "[" << key << "]\n";
-                kv.second.write(os, key, indent >= 0 ? indent + 1 : indent);
-            }
-            if (kv.second.is<Array>() && kv.second.size() > 0 && kv.second.find(0)->is<Table>()) {
-                std::string key(keyPrefix);
-                if (!keyPrefix.empty())
-                    key += ".";
-                key += escapeKey(kv.first);
-                for (const auto& v : kv.second.as<Array>()) {
-                    (*os) << "\n" << spaces(indent) << "[[" << key << "]]\n";
-                    v.write(os, key, indent >= 0 ? indent + 1 : indent);
-                }
-            }
-        }
+        for (auto& kv : mutableTable(false))
+            kv.second.deduplicate(pool);
         break;
     default:
-        failwith("writing unknown type");
-        break;
+        // Scalars are not shared.
+        return;
     }
-}
-
-inline void Value::writeFormatted(std::ostream* os, FormatFlag flags) const
-{
-    int indent = flags & FORMAT_INDENT ? 0 : -1;
 
-    write(os, std::string(), indent);
+    std::vector<Value>& candidates = (*pool)[hash()];
+    for (const Value& candidate : candidates) {
+        if (candidate == *this) {
+            *this = candidate;
+            return;
+        }
+    }
+    candidates.push_back(*this);
 }
 
-// static
-inline FormatFlag operator|(FormatFlag lhs, FormatFlag rhs)
+inline Array& Value::mutableArray(bool leaksPointer)
 {
-    return static_cast<FormatFlag>(static_cast<int>(lhs) | static_cast<int>(rhs));
+    if (packed_)
+        unpack();
+    return internal::mutableNode(&array_, leaksPointer);
 }
-
-// static
-inline std::ostream& operator<<(std::ostream& os, const toml::Value& v)
+
+inline const Array& Value::arrayValue() const
 {
-    v.write(&os);
-    return os;
+    return packed_ ? packedArray_->value.array() : array_->value;
 }
 
-// static
-inline bool operator==(const Value& lhs, const Value& rhs)
+inline bool Value::isArrayOfTables() const
 {
-    if (lhs.type() != rhs.type())
+    if (!is<Array>())
         return false;
+    if (packed_)
+        return packedArray_->value.elementType() == TABLE_TYPE;
+    return !array_->value.empty() && array_->value.front().is<Table>();
+}
 
-    switch (lhs.type()) {
-    case Value::Type::NULL_TYPE:
-        return true;
-    case Value::Type::BOOL_TYPE:
-        return lhs.bool_ == rhs.bool_;
-    case Value::Type::INT_TYPE:
-        return lhs.int_ == rhs.int_;
-    case Value::Type::DOUBLE_TYPE:
-        return lhs.double_ == rhs.double_;
-    case Value::Type::STRING_TYPE:
-        return *lhs.string_ == *rhs.string_;
-    case Value::Type::TIME_TYPE:
-        return *lhs.time_ == *rhs.time_;
-    case Value::Type::ARRAY_TYPE:
-        return *lhs.array_ == *rhs.array_;
-    case Value::Type::TABLE_TYPE:
-        return *lhs.table_ == *rhs.table_;
-    default:
-        failwith("unknown type");
-    }
+inline bool Value::isColumnar() const
+{
+    return isPacked() && packedArray_->value.elementType() == TABLE_TYPE;
 }
 
-template<typename T>
-inline typename call_traits<T>::return_type Value::get(const std::string& key) const
+inline const Value* Value::findColumn(const std::string& key) const
 {
-    if (!is<Table>())
-        failwith("type must be table to do get(key).");
+    if (!isColumnar())
+        return nullptr;
 
-    const Value* obj = find(key);
-    if (!obj)
-        failwith("key ", key, " was not found.");
+    const internal::PackedArray& columns = packedArray_->value;
+    size_t k = columns.keyIndex(key);
+    if (k == columns.keys().size())
+        return nullptr;
+    return &columns.column(k);
+}
 
-    return obj->as<T>();
+inline RecordView Value::record(size_t index) const
+{
+    if (!isColumnar())
+        failwith("type error: this value is not a columnar array");
+    if (size() <= index)
+        failwith("index out of bound");
+    return RecordView(&packedArray_->value, index);
 }
 
-inline const Value* Value::find(const std::string& key) const
+inline void Value::unpack()
 {
-    if (!is<Table>())
-        return nullptr;
+    assert(packed_);
+
+    internal::Node<Array>* node;
+    if (packedArray_->refCount.load(std::memory_order_acquire) == 1)
+        node = new internal::Node<Array>(packedArray_->value.unpack());
+    else
+        node = new internal::Node<Array>(packedArray_->value.array());
+    internal::releaseNode(packedArray_);
+    array_ = node;
+    packed_ = false;
+}
 
-    std::istringstream ss(key);
-    internal::Lexer lexer(ss);
+// ----------------------------------------------------------------------
+// PackedArray
 
-    const Value* current = this;
-    while (true) {
-        internal::Token t = lexer.nextKeyToken();
-        if (!(t.type() == internal::TokenType::IDENT || t.type() == internal::TokenType::STRING))
-            return nullptr;
+namespace internal {
 
-        std::string part = t.strValue();
-        t = lexer.nextKeyToken();
-        if (t.type() == internal::TokenType::DOT) {
-            current = current->findChild(part);
-            if (!current || !current->is<Table>())
-                return nullptr;
-        } else if (t.type() == internal::TokenType::END_OF_FILE) {
-            return current->findChild(part);
-        } else {
-            return nullptr;
+inline PackedArray::PackedArray(const Array& array) :
+    elementType_(array.front().type())
+{
+    switch (elementType_) {
+    case Value::BOOL_TYPE:
+        bools_.reserve(array.size());
+        for (const Value& v : array)
+            bools_.push_back(v.as<bool>());
+        break;
+    case Value::INT_TYPE:
+        ints_.reserve(array.size());
+        for (const Value& v : array)
+            ints_.push_back(v.as<std::int64_t>());
+        break;
+    case Value::DOUBLE_TYPE:
+        doubles_.reserve(array.size());
+        for (const Value& v : array)
+            doubles_.push_back(v.as<double>());
+        break;
+    case Value::STRING_TYPE:
+        stringOffsets_.reserve(array.size() + 1);
+        for (const Value& v : array) {
+            stringOffsets_.push_back(stringBlob_.size());
+            stringBlob_ += v.as<std::string>();
+        }
+        stringOffsets_.push_back(stringBlob_.size());
+        break;
+    case Value::TABLE_TYPE:
+        tableCount_ = array.size();
+        for (const auto& kv : array.front().as<Table>())
+            keys_.push_back(kv.first);
+        sortedKeys_.resize(keys_.size());
+        for (size_t k = 0; k < keys_.size(); ++k)
+            sortedKeys_[k] = k;
+        std::sort(sortedKeys_.begin(), sortedKeys_.end(), [this](size_t lhs, size_t rhs) {
+            return keys_[lhs] < keys_[rhs];
+        });
+
+        columns_.reserve(keys_.size());
+        for (const std::string& key : keys_) {
+            Value column((Array()));
+            Array& elements = column.mutableArray(false);
+            elements.reserve(array.size());
+            for (const Value& v : array)
+                elements.push_back(*v.findChild(key));
+            column.pack();
+            columns_.push_back(std::move(column));
         }
+        break;
+    default:
+        assert(false);
+        break;
     }
 }
 
-inline Value* Value::find(const std::string& key)
+inline PackedArray::PackedArray(const PackedArray& other) :
+    elementType_(other.elementType_),
+    ints_(other.ints_),
+    doubles_(other.doubles_),
+    bools_(other.bools_),
+    stringBlob_(other.stringBlob_),
+    stringOffsets_(other.stringOffsets_),
+    keys_(other.keys_),
+    sortedKeys_(other.sortedKeys_),
+    columns_(other.columns_),
+    tableCount_(other.tableCount_)
 {
-    return const_cast<Value*>(const_cast<const Value*>(this)->find(key));
 }
 
-inline bool Value::merge(const toml::Value& v)
+// static
+inline bool PackedArray::packable(const Array& array)
 {
-    if (this == &v)
-        return true;
-    if (!is<Table>() || !v.is<Table>())
+    if (array.empty())
         return false;
 
-    for (const auto& kv : *v.table_) {
-        if (Value* tmp = find(kv.first)) {
-            // If both are table, we merge them.
-            if (tmp->is<Table>() && kv.second.is<Table>()) {
-                if (!tmp->merge(kv.second))
+    Value::Type type = array.front().type();
+    if (type == Value::TABLE_TYPE) {
+        const Value& front = array.front();
+        for (const Value& v : array) {
+            if (!v.is<Table>() || v.size() != front.size())
+                return false;
+            for (const auto& kv : v.as<Table>()) {
+                if (!front.findChild(kv.first))
                     return false;
-            } else {
-                setChild(kv.first, kv.second);
             }
-        } else {
-            setChild(kv.first, kv.second);
         }
+        return true;
     }
 
+    if (type != Value::BOOL_TYPE && type != Value::INT_TYPE && type != Value::DOUBLE_TYPE && type != Value::STRING_TYPE)
+        return false;
+
+    for (const Value& v : array) {
+        if (v.type() != type)
+            return false;
+    }
     return true;
 }
 
-inline Value* Value::set(const std::string& key, const Value& v)
+inline size_t PackedArray::size() const
 {
-    Value* result = ensureValue(key);
-    *result = v;
-    return result;
+    switch (elementType_) {
+    case Value::BOOL_TYPE: return bools_.size();
+    case Value::INT_TYPE: return ints_.size();
+    case Value::DOUBLE_TYPE: return doubles_.size();
+    case Value::STRING_TYPE: return stringOffsets_.size() - 1;
+    case Value::TABLE_TYPE: return tableCount_;
+    default: return 0;
+    }
 }
 
-inline Value* Value::setChild(const std::string& key, const Value& v)
+inline Value PackedArray::at(size_t index) const
 {
-    if (!valid())
-        *this = Value((Table()));
-
-    if (!is<Table>())
-        failwith("type must be table to do set(key, v).");
-
-    (*table_)[key] = v;
-    return &(*table_)[key];
+    switch (elementType_) {
+    case Value::BOOL_TYPE: return Value(static_cast<bool>(bools_[index]));
+    case Value::INT_TYPE: return Value(ints_[index]);
+    case Value::DOUBLE_TYPE: return Value(doubles_[index]);
+    case Value::STRING_TYPE:
+        return Value(stringBlob_.substr(stringOffsets_[index], stringOffsets_[index + 1] - stringOffsets_[index]));
+    case Value::TABLE_TYPE: {
+        Value table((Table()));
+        for (size_t k = 0; k < keys_.size(); ++k)
+            table.setChild(keys_[k], columnAt(k, index));
+        return table;
+    }
+    default:
+        return Value();
+    }
 }
 
-inline Value* Value::setChild(const std::string& key, Value&& v)
+inline size_t PackedArray::keyIndex(const std::string& key) const
 {
-    if (!valid())
-        *this = Value((Table()));
+    auto it = std::lower_bound(sortedKeys_.begin(), sortedKeys_.end(), key, [this](size_t k, const std::string& key) {
+        return keys_[k] < key;
+    });
+    if (it == sortedKeys_.end() || keys_[*it] != key)
+        return keys_.size();
+    return *it;
+}
 
-    if (!is<Table>())
-        failwith("type must be table to do set(key, v).");
+inline Value PackedArray::columnAt(size_t keyIndex, size_t index) const
+{
+    const Value& column = columns_[keyIndex];
+    if (column.packed_)
+        return column.packedArray_->value.at(index);
+    return column.array_->value[index];
+}
 
-    (*table_)[key] = std::move(v);
-    return &(*table_)[key];
+inline std::uint64_t PackedArray::hashAt(size_t index) const
+{
+    switch (elementType_) {
+    case Value::BOOL_TYPE: return hashBool(bools_[index]);
+    case Value::INT_TYPE: return hashInt(ints_[index]);
+    case Value::DOUBLE_TYPE: return hashDouble(doubles_[index]);
+    case Value::STRING_TYPE:
+        return hashString(stringBlob_.data() + stringOffsets_[index], stringOffsets_[index + 1] - stringOffsets_[index]);
+    case Value::TABLE_TYPE: {
+        // Same as Value::hash() for the table.
+        std::uint64_t h = mixHash(8);
+        for (size_t k = 0; k < keys_.size(); ++k) {
+            const Value& column = columns_[k];
+            std::uint64_t elementHash = column.packed_ ? column.packedArray_->value.hashAt(index) : column.array_->value[index].hash();
+            h += combineHash(hashString(keys_[k]), elementHash);
+        }
+        h = mixHash(h);
+        return h ? h : 1;
+    }
+    default:
+        return 0;
+    }
 }
 
-inline bool Value::erase(const std::string& key)
+inline bool PackedArray::equalAt(size_t index, const Value& v) const
 {
-    if (!is<Table>())
+    if (v.type() != elementType_)
         return false;
 
-    std::istringstream ss(key);
-    internal::Lexer lexer(ss);
-
-    Value* current = this;
-    while (true) {
-        internal::Token t = lexer.nextKeyToken();
-        if (!(t.type() == internal::TokenType::IDENT || t.type() == internal::TokenType::STRING))
+    switch (elementType_) {
+    case Value::BOOL_TYPE: return v.bool_ == bools_[index];
+    case Value::INT_TYPE: return v.int_ == ints_[index];
+    case Value::DOUBLE_TYPE: return v.double_ == doubles_[index];
+    case Value::STRING_TYPE: {
+        size_t begin = stringOffsets_[index];
+        return v.string_->value.compare(0, std::string::npos, stringBlob_, begin, stringOffsets_[index + 1] - begin) == 0;
+    }
+    case Value::TABLE_TYPE: {
+        if (v.size() != keys_.size())
             return false;
-
-        std::string part = t.strValue();
-        t = lexer.nextKeyToken();
-        if (t.type() == internal::TokenType::DOT) {
-            current = current->findChild(part);
-            if (!current || !current->is<Table>())
+        for (size_t k = 0; k < keys_.size(); ++k) {
+            const Value* child = v.findChild(keys_[k]);
+            if (!child)
+                return false;
+            const Value& column = columns_[k];
+            if (column.packed_ ? !column.packedArray_->value.equalAt(index, *child) : !(column.array_->value[index] == *child))
                 return false;
-        } else if (t.type() == internal::TokenType::END_OF_FILE) {
-            return current->eraseChild(part);
-        } else {
-            return false;
         }
+        return true;
+    }
+    default:
+        return false;
     }
 }
 
-inline bool Value::eraseChild(const std::string& key)
+inline const Array& PackedArray::array() const
 {
-    if (!is<Table>())
-        failwith("type must be table to do erase(key).");
-
-    return table_->erase(key) > 0;
+    std::call_once(arrayOnce_, [this]() {
+        std::unique_ptr<Array> array(new Array);
+        array->reserve(size());
+        for (size_t i = 0; i < size(); ++i)
+            array->push_back(at(i));
+        array_ = std::move(array);
+    });
+    return *array_;
 }
 
-inline Value& Value::operator[](const std::string& key)
+inline Array PackedArray::unpack()
 {
-    if (!valid())
-        *this = Value((Table()));
-
-    if (Value* v = findChild(key))
-        return *v;
-
-    return *setChild(key, Value());
+    if (array_)
+        return std::move(*array_);
+
+    Array array;
+    array.reserve(size());
+    for (size_t i = 0; i < size(); ++i)
+        array.push_back(at(i));
+    return array;
 }
 
-template<typename T>
-inline typename call_traits<T>::return_type Value::get(size_t index) const
+inline bool operator==(const PackedArray& lhs, const PackedArray& rhs)
 {
-    if (!is<Array>())
-        failwith("type must be array to do get(index).");
-
-    if (array_->size() <= index)
-        failwith("index out of bound");
-
-    return (*array_)[index].as<T>();
+    return lhs.elementType_ == rhs.elementType_ &&
+        lhs.ints_ == rhs.ints_ &&
+        lhs.doubles_ == rhs.doubles_ &&
+        lhs.bools_ == rhs.bools_ &&
+        lhs.stringBlob_ == rhs.stringBlob_ &&
+        lhs.stringOffsets_ == rhs.stringOffsets_ &&
+        lhs.tableCount_ == rhs.tableCount_ &&
+        PackedArray::equalColumns(lhs, rhs);
 }
 
-inline const Value* Value::find(size_t index) const
+inline bool PackedArray::equalColumns(const PackedArray& lhs, const PackedArray& rhs)
 {
-    if (!is<Array>())
-        return nullptr;
-    if (index < array_->size())
-        return &(*array_)[index];
-    return nullptr;
-}
+    if (lhs.keys_.size() != rhs.keys_.size())
+        return false;
 
-inline Value* Value::find(size_t index)
-{
-    return const_cast<Value*>(const_cast<const Value*>(this)->find(index));
+    // keys_ is in the order of the first table, which may differ with an unsorted table policy.
+    for (size_t i = 0; i < lhs.sortedKeys_.size(); ++i) {
+        size_t l = lhs.sortedKeys_[i];
+        size_t r = rhs.sortedKeys_[i];
+        if (lhs.keys_[l] != rhs.keys_[r] || !(lhs.columns_[l] == rhs.columns_[r]))
+            return false;
+    }
+    return true;
 }
 
-inline Value* Value::push(const Value& v)
-{
-    if (!valid())
-        *this = Value((Array()));
-    else if (!is<Array>())
-        failwith("type must be array to do push(Value).");
+} // namespace internal
 
-    array_->push_back(v);
-    return &array_->back();
-}
+// ----------------------------------------------------------------------
+// RecordView
 
-inline Value* Value::push(Value&& v)
+inline const std::vector<std::string>& RecordView::keys() const
 {
-    if (!valid())
-        *this = Value((Array()));
-    else if (!is<Array>())
-        failwith("type must be array to do push(Value).");
-
-    array_->push_back(std::move(v));
-    return &array_->back();
+    return columns_->keys();
 }
 
-inline Value* Value::ensureValue(const std::string& key)
+inline bool RecordView::has(const std::string& key) const
 {
-    if (!valid())
-        *this = Value((Table()));
-    if (!is<Table>()) {
-        failwith("encountered non table value");
-    }
-
-    std::istringstream ss(key);
-    internal::Lexer lexer(ss);
-
-    Value* current = this;
-    while (true) {
-        internal::Token t = lexer.nextKeyToken();
-        if (!(t.type() == internal::TokenType::IDENT || t.type() == internal::TokenType::STRING)) {
-            failwith("invalid key");
-        }
-
-        std::string part = t.strValue();
-        t = lexer.nextKeyToken();
-        if (t.type() == internal::TokenType::DOT) {
-            if (Value* candidate = current->findChild(part)) {
-                if (!candidate->is<Table>())
-                    failwith("encountered non table value");
-
-                current = candidate;
-            } else {
-                current = current->setChild(part, Table());
-            }
-        } else if (t.type() == internal::TokenType::END_OF_FILE) {
-            if (Value* v = current->findChild(part))
-                return v;
-            return current->setChild(part, Value());
-        } else {
-            failwith("invalid key");
-        }
-    }
+    return columns_->keyIndex(key) != columns_->keys().size();
 }
 
-inline Value* Value::findChild(const std::string& key)
+inline Value RecordView::find(const std::string& key) const
 {
-    assert(is<Table>());
-
-    auto it = table_->find(key);
-    if (it == table_->end())
-        return nullptr;
-
-    return &it->second;
+    size_t k = columns_->keyIndex(key);
+    if (k == columns_->keys().size())
+        return Value();
+    return columns_->columnAt(k, index_);
 }
 
-inline const Value* Value::findChild(const std::string& key) const
+template<typename T>
+inline T RecordView::get(const std::string& key) const
 {
-    assert(is<Table>());
-
-    auto it = table_->find(key);
-    if (it == table_->end())
-        return nullptr;
+    size_t k = columns_->keyIndex(key);
+    if (k == columns_->keys().size())
+        failwith("key ", key, " was not found.");
+    return columns_->columnAt(k, index_).as<T>();
+}
 
-    return &it->second;
+inline Value RecordView::toValue() const
+{
+    return columns_->at(index_);
 }
 
 // ----------------------------------------------------------------------
@@ -1770,7 +7020,8 @@ inline const std::string& Parser::errorReason()
 
 inline Value Parser::parse()
 {
-    Value root((Table()));
+    KeyPool::Scope keyPoolScope(keyPool_ ? keyPool_ : KeyPool::current());
+    Value root(newTable());
     Value* currentValue = &root;
 
     while (true) {
@@ -1791,6 +7042,10 @@ inline Value Parser::parse()
             return Value();
         }
     }
+
+    if (packArrays_)
+        root.pack();
+    root.makeShareable();
     return root;
 }
 
@@ -1822,7 +7077,7 @@ inline Value* Parser::parseGroupKey(Value* root)
                     return nullptr;
                 currentValue = candidate;
             } else {
-                currentValue = currentValue->setChild(key, Table());
+                currentValue = currentValue->setChild(key, newTable());
             }
             continue;
         }
@@ -1833,7 +7088,7 @@ inline Value* Parser::parseGroupKey(Value* root)
                 if (isArray) {
                     if (!candidate->is<Array>())
                         return nullptr;
-                    currentValue = candidate->push(Table());
+                    currentValue = candidate->push(newTable());
                 } else {
                     if (candidate->is<Array>() && candidate->size() > 0)
                         candidate = candidate->find(candidate->size() - 1);
@@ -1843,10 +7098,10 @@ inline Value* Parser::parseGroupKey(Value* root)
                 }
             } else {
                 if (isArray) {
-                    currentValue = currentValue->setChild(key, Array());
-                    currentValue = currentValue->push(Table());
+                    currentValue = currentValue->setChild(key, newArray());
+                    currentValue = currentValue->push(newTable());
                 } else {
-                    currentValue = currentValue->setChild(key, Table());
+                    currentValue = currentValue->setChild(key, newTable());
                 }
             }
             break;
@@ -1911,7 +7166,7 @@ inline bool Parser::parseValue(Value* v)
     switch (token().type()) {
     case TokenType::STRING:
     case TokenType::MULTILINE_STRING:
-        *v = token().strValue();
+        *v = Value(std::string(token().strValue()));
         nextValue();
         return true;
     case TokenType::LBRACKET:
@@ -1965,7 +7220,7 @@ inline bool Parser::parseArray(Value* v)
     if (!consumeForValue(TokenType::LBRACKET))
         return false;
 
-    Array a;
+    Array a = newArray();
     while (true) {
         skipForValue();
 
@@ -1973,18 +7228,24 @@ inline bool Parser::parseArray(Value* v)
             break;
 
         skipForValue();
-        Value x;
-        if (!parseValue(&x))
-            return false;
-
-        if (!a.empty()) {
-            if (a.front().type() != x.type()) {
-                addError("type check failed");
+        if ((token().type() == TokenType::INT && (a.empty() || a.front().is<std::int64_t>())) ||
+            (token().type() == TokenType::DOUBLE && (a.empty() || a.front().is<double>()))) {
+            if (parseNumbers(&a))
+                continue;
+        } else {
+            Value x;
+            if (!parseValue(&x))
                 return false;
+
+            if (!a.empty()) {
+                if (a.front().type() != x.type()) {
+                    addError("type check failed");
+                    return false;
+                }
             }
-        }
 
-        a.push_back(std::move(x));
+            a.push_back(std::move(x));
+        }
         skipForValue();
         if (token().type() == TokenType::RBRACKET)
             break;
@@ -1995,16 +7256,54 @@ inline bool Parser::parseArray(Value* v)
     if (!consumeForValue(TokenType::RBRACKET))
         return false;
     *v = std::move(a);
+    if (packArrays_)
+        v->pack();
     return true;
 }
 
+// Parses the current number token and the following numbers of the same type.
+// Returns true if the current token is at the next element, false if it's just after an element.
+inline bool Parser::parseNumbers(Array* a)
+{
+    std::vector<std::int64_t> ints;
+    std::vector<double> doubles;
+    if (token().type() == TokenType::INT)
+        ints.push_back(token().intValue());
+    else
+        doubles.push_back(token().doubleValue());
+
+    Token next(TokenType::ERROR_TOKEN);
+    NumberScanState state = lexer_.scanNumbers(token().type(), &ints, &doubles, &next);
+
+    if (a->empty())
+        a->reserve(ints.size() + doubles.size());
+    for (std::int64_t x : ints)
+        a->emplace_back(x);
+    for (double d : doubles)
+        a->emplace_back(d);
+
+    switch (state) {
+    case NumberScanState::AFTER_ELEMENT:
+        nextValue();
+        return false;
+    case NumberScanState::AFTER_COMMA:
+        nextValue();
+        return true;
+    case NumberScanState::TOKEN:
+        token_ = std::move(next);
+        return true;
+    }
+
+    return false;
+}
+
 inline bool Parser::parseInlineTable(Value* value)
 {
     // For inline table, next is KEY, so use consumeForKey here.
     if (!consumeForKey(TokenType::LBRACE))
         return false;
 
-    Value t((Table()));
+    Value t(newTable());
     bool first = true;
     while (true) {
         if (token().type() == TokenType::RBRACE) {
@@ -2034,7 +7333,7 @@ inline bool Parser::parseInlineTable(Value* value)
             return false;
         }
 
-        t.set(key, v);
+        t.setChild(key, std::move(v));
     }
 
     if (!consumeForValue(TokenType::RBRACE))
@@ -2044,6 +7343,6 @@ inline bool Parser::parseInlineTable(Value* value)
 }
 
 } // namespace internal
-} // namespace toml
+TOML_NAMESPACE_END // namespace toml
 
 #endif // TINYTOML_H_
@@ -0,0 +1,470 @@
+#ifndef TINYTOML_WATCHER_H_
+#define TINYTOML_WATCHER_H_
+
+// Watcher reloads a config file, or a directory of config fragments, when it changes.
+// It uses inotify, so it's available only on Linux.
+
+#include "toml.h"
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+TOML_NAMESPACE_BEGIN
+
+namespace internal {
+
+const std::uint32_t kWatchMask = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+
+// Appends the directories and the names which |path| is resolved through: each symbolic link on
+// the way, and the file which it finally refers to. A change of any of them may change what
+// |path| reads, e.g. when a Kubernetes ConfigMap swaps its "..data" link.
+inline void resolveWatchTargets(const std::string& path, std::vector<std::pair<std::string, std::string>>* targets)
+{
+    // The components left to resolve, in the reverse order.
+    std::vector<std::string> rest;
+    auto push = [&rest](const std::string& p) {
+        std::vector<std::string> components;
+        std::string::size_type begin = 0;
+        while (begin <= p.size()) {
+            std::string::size_type end = std::min(p.find('/', begin), p.size());
+            if (end > begin)
+                components.push_back(p.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        rest.insert(rest.end(), components.rbegin(), components.rend());
+    };
+
+    // The resolved directory, without the trailing slash. It's empty for the root.
+    std::string resolved;
+    if (!path.empty() && path[0] == '/') {
+        push(path);
+    } else {
+        char cwd[PATH_MAX];
+        if (!::getcwd(cwd, sizeof(cwd)))
+            return;
+        push(std::string(cwd) + "/" + path);
+    }
+
+    for (int links = 0; !rest.empty(); ) {
+        std::string name = std::move(rest.back());
+        rest.pop_back();
+        if (name == ".")
+            continue;
+        if (name == "..") {
+            resolved.erase(std::min(resolved.rfind('/'), resolved.size()));
+            continue;
+        }
+
+        std::string current = resolved + "/" + name;
+        struct stat st;
+        bool isLink = ::lstat(current.c_str(), &st) == 0 && S_ISLNK(st.st_mode);
+        if (isLink || rest.empty())
+            targets->emplace_back(resolved.empty() ? "/" : resolved, name);
+        if (!isLink) {
+            resolved = std::move(current);
+            continue;
+        }
+
+        char target[PATH_MAX];
+        ssize_t size = ::readlink(current.c_str(), target, sizeof(target));
+        if (size <= 0 || static_cast<size_t>(size) >= sizeof(target) || ++links > 40)
+            return;
+        if (target[0] == '/')
+            resolved.clear();
+        push(std::string(target, size));
+    }
+}
+
+} // namespace internal
+
+// Options for Watcher.
+struct WatchOptions {
+    WatchOptions() : debounce(std::chrono::milliseconds(100)), maxDelay(std::chrono::seconds(1)), diff(false) {}
+
+    // Reloads after no change has been seen for this duration, so that a storm of writes by
+    // an editor causes one reload.
+    std::chrono::milliseconds debounce;
+    // Reloads at the latest this long after the first change, even if the files keep changing,
+    // so that a file written continuously (e.g. by a log-like producer) is still reloaded.
+    std::chrono::milliseconds maxDelay;
+    // If true, WatchEvent::patch has the changes from the previous document.
+    bool diff;
+    // |arena| is ignored, since an arena is sealed after a parse.
+    ParseOptions parseOptions;
+};
+
+// A reloaded document.
+struct WatchEvent {
+    bool valid() const { return value.valid(); }
+
+    // The new document. It's invalid if the files could not be read or parsed.
+    Value value;
+    std::string errorReason;
+    // The changes from the previous valid document, if WatchOptions::diff is set.
+    // The first document is compared with an empty table.
+    Patch patch;
+};
+
+// Watcher watches a file, or a directory whose *.toml files are merged in the order of their
+// names with Value::merge(). It calls |callback| on its thread with the first document, and with
+// a new one whenever the content changes. Events which don't change the content, e.g. `touch`,
+// don't reparse: the content is hashed, and compared with the previous one.
+//
+// A watched file may be a symbolic link. The links it's resolved through, and the directory of
+// the file it refers to, are watched too, so that replacing a link, e.g. the "..data" link of a
+// Kubernetes ConfigMap volume, reloads the document.
+//
+//   toml::ConfigHandle config;
+//   toml::Watcher watcher("/etc/app/config.toml", [&](const toml::WatchEvent& e) {
+//       if (e.valid())
+//           config.publish(e.value);
+//   });
+//   watcher.start();
+//
+// |callback| must not throw.
+class Watcher {
+public:
+    typedef std::function<void(const WatchEvent&)> Callback;
+
+    Watcher(std::string path, Callback callback, WatchOptions options = WatchOptions());
+    ~Watcher() { stop(); }
+
+    Watcher(const Watcher&) = delete;
+    Watcher& operator=(const Watcher&) = delete;
+
+    // Starts watching on a background thread. Throws an exception if it cannot watch |path|.
+    void start();
+    // Stops watching. The callback is not called after this returns (or, when called from the
+    // callback, after the callback returns). Called from the callback, it doesn't wait for the
+    // thread, which would wait for itself: the thread is joined by the next stop() or by the
+    // destructor. So the Watcher must not be destroyed from its own callback.
+    void stop();
+
+    // The number of the times the files have been parsed.
+    size_t parseCount() const { return parseCount_.load(); }
+
+private:
+    void run();
+    bool isWatched(const char* name) const;
+    bool isWatched(const struct inotify_event* event) const;
+    // Lists the files to read into |names|. Returns false on an error.
+    bool list(std::vector<std::string>* names, std::string* error) const;
+    // Watches the links which the files are resolved through.
+    void watchLinks();
+    // Reads the files into |contents|, and returns their hash. Returns false on an error.
+    bool read(std::vector<std::pair<std::string, std::string>>* contents, std::uint64_t* hash, std::string* error) const;
+    void reload();
+
+    std::string path_;
+    Callback callback_;
+    WatchOptions options_;
+    bool isDirectory_;
+    // The directory watched by inotify, and the file name in it if |path_| is a file.
+    std::string directory_;
+    std::string fileName_;
+
+    int inotifyFd_;
+    int stopFd_;
+    int directoryWatch_;
+    // The names watched in each watched directory other than |directory_|, by the watch descriptor.
+    std::map<int, std::set<std::string>> links_;
+    std::thread thread_;
+
+    // Used only by the thread.
+    bool loaded_;
+    std::uint64_t hash_;
+    Value previous_;
+
+    std::atomic<size_t> parseCount_;
+};
+
+// ----------------------------------------------------------------------
+// Implementations
+
+inline Watcher::Watcher(std::string path, Callback callback, WatchOptions options) :
+    path_(std::move(path)),
+    callback_(std::move(callback)),
+    options_(std::move(options)),
+    isDirectory_(false),
+    inotifyFd_(-1),
+    stopFd_(-1),
+    directoryWatch_(-1),
+    loaded_(false),
+    hash_(0),
+    parseCount_(0)
+{
+    options_.parseOptions.arena.reset();
+}
+
+inline void Watcher::start()
+{
+    if (thread_.joinable())
+        return;
+
+    struct stat st;
+    if (::stat(path_.c_str(), &st) != 0)
+        failwith("could not watch ", path_, ": ", std::system_category().message(errno));
+    isDirectory_ = S_ISDIR(st.st_mode);
+
+    // A file is replaced by a rename when an editor saves it, so its directory is watched.
+    if (isDirectory_) {
+        directory_ = path_;
+        fileName_.clear();
+    } else {
+        std::string::size_type slash = path_.rfind('/');
+        directory_ = slash == std::string::npos ? "." : (slash == 0 ? "/" : path_.substr(0, slash));
+        fileName_ = slash == std::string::npos ? path_ : path_.substr(slash + 1);
+    }
+
+    inotifyFd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd_ < 0)
+        failwith("inotify_init1 failed: ", std::system_category().message(errno));
+    directoryWatch_ = ::inotify_add_watch(inotifyFd_, directory_.c_str(), internal::kWatchMask);
+    if (directoryWatch_ < 0) {
+        std::string reason = std::system_category().message(errno);
+        ::close(inotifyFd_);
+        inotifyFd_ = -1;
+        failwith("could not watch ", directory_, ": ", reason);
+    }
+
+    stopFd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (stopFd_ < 0) {
+        std::string reason = std::system_category().message(errno);
+        ::close(inotifyFd_);
+        inotifyFd_ = -1;
+        failwith("eventfd failed: ", reason);
+    }
+
+    thread_ = std::thread([this]() { run(); });
+}
+
+inline void Watcher::stop()
+{
+    if (!thread_.joinable())
+        return;
+
+    std::uint64_t one = 1;
+    if (::write(stopFd_, &one, sizeof(one)) < 0) {
+        // The eventfd cannot be full, since it's written at most twice.
+    }
+    // From the callback. run() sees |stopFd_| when the callback returns.
+    if (std::this_thread::get_id() == thread_.get_id())
+        return;
+    thread_.join();
+
+    ::close(inotifyFd_);
+    ::close(stopFd_);
+    inotifyFd_ = -1;
+    stopFd_ = -1;
+    directoryWatch_ = -1;
+    links_.clear();
+}
+
+inline bool Watcher::isWatched(const char* name) const
+{
+    if (!isDirectory_)
+        return fileName_ == name;
+
+    size_t n = std::strlen(name);
+    return n > 5 && name[0] != '.' && std::strcmp(name + n - 5, ".toml") == 0;
+}
+
+inline bool Watcher::isWatched(const struct inotify_event* event) const
+{
+    if (event->mask & IN_Q_OVERFLOW)
+        return true;
+    if (event->len == 0)
+        return false;
+    if (event->wd == directoryWatch_ && isWatched(event->name))
+        return true;
+
+    auto it = links_.find(event->wd);
+    return it != links_.end() && it->second.count(event->name) > 0;
+}
+
+inline void Watcher::watchLinks()
+{
+    std::vector<std::string> names;
+    std::string error;
+    if (!list(&names, &error))
+        return;
+
+    std::vector<std::pair<std::string, std::string>> targets;
+    for (const std::string& name : names)
+        internal::resolveWatchTargets(name, &targets);
+
+    // Watching a directory twice returns the same descriptor.
+    std::map<int, std::set<std::string>> links;
+    for (const auto& target : targets) {
+        int wd = ::inotify_add_watch(inotifyFd_, target.first.c_str(), internal::kWatchMask);
+        if (wd >= 0)
+            links[wd].insert(target.second);
+    }
+    for (const auto& link : links_) {
+        if (link.first != directoryWatch_ && !links.count(link.first))
+            ::inotify_rm_watch(inotifyFd_, link.first);
+    }
+    links_ = std::move(links);
+}
+
+inline void Watcher::run()
+{
+    reload();
+
+    typedef std::chrono::steady_clock Clock;
+    bool pending = false;
+    Clock::time_point deadline;
+    // The deadline which the debounce cannot push back, set by the first change.
+    Clock::time_point latest;
+    alignas(struct inotify_event) char buffer[4096];
+
+    while (true) {
+        int timeout = -1;
+        if (pending) {
+            auto rest = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            timeout = static_cast<int>(std::max<decltype(rest)>(rest, 0));
+        }
+
+        struct pollfd fds[2] = { { stopFd_, POLLIN, 0 }, { inotifyFd_, POLLIN, 0 } };
+        int n = ::poll(fds, 2, timeout);
+        if (n < 0 && errno != EINTR)
+            return;
+        if (fds[0].revents & POLLIN)
+            return;
+
+        if (fds[1].revents & POLLIN) {
+            ssize_t size;
+            while ((size = ::read(inotifyFd_, buffer, sizeof(buffer))) > 0) {
+                for (char* p = buffer; p < buffer + size; ) {
+                    const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+                    if (isWatched(event)) {
+                        const Clock::time_point now = Clock::now();
+                        if (!pending)
+                            latest = now + options_.maxDelay;
+                        pending = true;
+                        deadline = std::min(now + options_.debounce, latest);
+                    }
+                    p += sizeof(struct inotify_event) + event->len;
+                }
+            }
+        }
+
+        if (pending && Clock::now() >= deadline) {
+            pending = false;
+            reload();
+        }
+    }
+}
+
+inline bool Watcher::list(std::vector<std::string>* names, std::string* error) const
+{
+    if (isDirectory_) {
+        DIR* dir = ::opendir(directory_.c_str());
+        if (!dir) {
+            *error = "could not open directory: " + directory_;
+            return false;
+        }
+        while (struct dirent* entry = ::readdir(dir)) {
+            if (isWatched(entry->d_name))
+                names->push_back(directory_ + "/" + entry->d_name);
+        }
+        ::closedir(dir);
+        std::sort(names->begin(), names->end());
+    } else {
+        names->push_back(path_);
+    }
+    return true;
+}
+
+inline bool Watcher::read(std::vector<std::pair<std::string, std::string>>* contents, std::uint64_t* hash, std::string* error) const
+{
+    std::vector<std::string> names;
+    if (!list(&names, error))
+        return false;
+
+    *hash = internal::mixHash(names.size());
+    for (const std::string& name : names) {
+        std::ifstream ifs(name, std::ios::binary);
+        if (!ifs) {
+            *error = "could not open file: " + name;
+            return false;
+        }
+        std::string content((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        *hash = internal::combineHash(*hash, internal::hashBytes(name.data(), name.size()));
+        *hash = internal::combineHash(*hash, internal::hashBytes(content.data(), content.size()));
+        contents->emplace_back(name, std::move(content));
+    }
+    return true;
+}
+
+inline void Watcher::reload()
+{
+    // The links are watched before reading, so that a link replaced after this is not missed.
+    watchLinks();
+
+    WatchEvent event;
+    std::vector<std::pair<std::string, std::string>> contents;
+    std::uint64_t hash;
+    if (!read(&contents, &hash, &event.errorReason)) {
+        // The next content is delivered even if it's the same as the last one.
+        loaded_ = false;
+        callback_(event);
+        return;
+    }
+    if (loaded_ && hash == hash_)
+        return;
+    loaded_ = true;
+    hash_ = hash;
+
+    ++parseCount_;
+    Value value((Table()));
+    for (const auto& file : contents) {
+        std::istringstream ss(file.second);
+        ParseResult pr = parse(ss, options_.parseOptions);
+        if (!pr.valid()) {
+            event.errorReason = file.first + ": " + pr.errorReason;
+            callback_(event);
+            return;
+        }
+        if (!value.merge(std::move(pr.value))) {
+            event.errorReason = file.first + ": could not be merged with the previous files";
+            callback_(event);
+            return;
+        }
+    }
+
+    if (options_.diff) {
+        event.patch = diff(previous_.valid() ? previous_ : Value(Table()), value);
+        previous_ = value;
+    }
+    event.value = std::move(value);
+    callback_(event);
+}
+
+TOML_NAMESPACE_END // namespace toml
+
+#endif // defined(__linux__)
+
+#endif // TINYTOML_WATCHER_H_
@@ -0,0 +1,119 @@
+#include "toml/toml.h"
+
+#include <sstream>
+#include <string>
+#include <gtest/gtest.h>
+
+using namespace std;
+
+TEST(ArenaTest, allocate)
+{
+    toml::Arena arena(toml::ARENA_NONE, 1024);
+
+    void* p1 = arena.allocate(10, 1);
+    void* p2 = arena.allocate(16, 16);
+    EXPECT_TRUE(arena.owns(p1));
+    EXPECT_TRUE(arena.owns(p2));
+    EXPECT_EQ(0U, reinterpret_cast<uintptr_t>(p2) % 16);
+    EXPECT_EQ(1U, arena.blockCount());
+
+    // Larger than the block size.
+    void* p3 = arena.allocate(4096, 8);
+    EXPECT_TRUE(arena.owns(p3));
+    EXPECT_EQ(2U, arena.blockCount());
+
+    int x;
+    EXPECT_FALSE(arena.owns(&x));
+}
+
+TEST(ArenaTest, hugePage)
+{
+    toml::Arena arena(toml::ARENA_HUGE_PAGE, 4 * 1024 * 1024);
+
+    char* p = static_cast<char*>(arena.allocate(1024, 8));
+    p[0] = 'a';
+    p[1023] = 'z';
+    EXPECT_TRUE(arena.owns(p + 1023));
+}
+
+TEST(ArenaTest, parse)
+{
+    const string s =
+        "x = 1\n"
+        "y = [1, 2, 3]\n"
+        "z = { a = \"foo\", b = [[1], [2.0]] }\n"
+        "[table]\n"
+        "key = \"value\"\n"
+        "[[array]]\n"
+        "a = 1\n"
+        "[[array]]\n"
+        "a = 2\n";
+
+    shared_ptr<toml::Arena> arena = make_shared<toml::Arena>();
+    istringstream ss1(s);
+    toml::ParseResult pr1 = toml::parse(ss1, arena);
+    ASSERT_TRUE(pr1.valid()) << pr1.errorReason;
+    EXPECT_TRUE(arena->sealed());
+    EXPECT_LT(0U, arena->allocatedBytes());
+
+    istringstream ss2(s);
+    toml::ParseResult pr2 = toml::parse(ss2);
+    ASSERT_TRUE(pr2.valid()) << pr2.errorReason;
+
+    EXPECT_EQ(pr2.value, pr1.value);
+    EXPECT_EQ(arena, pr1.value.as<toml::Table>().get_allocator().arena());
+    EXPECT_EQ(arena, pr1.value.find("y")->as<toml::Array>().get_allocator().arena());
+}
+
+TEST(ArenaTest, documentOutlivesArenaHandle)
+{
+    toml::Value v;
+    {
+        istringstream ss("a = [1, 2]\n[b]\nc = 3\n");
+        toml::ParseResult pr = toml::parse(ss, make_shared<toml::Arena>());
+        ASSERT_TRUE(pr.valid()) << pr.errorReason;
+        v = std::move(pr.value);
+    }
+
+    // The arena is sealed, so these go to the global heap.
+    v.set("b.d", 4);
+    v.find("a")->push(3);
+    for (int i = 0; i < 100; ++i)
+        v.set("b.e" + to_string(i), i);
+
+    EXPECT_EQ(3, v.get<int>("b.c"));
+    EXPECT_EQ(4, v.get<int>("b.d"));
+    EXPECT_EQ(3U, v.find("a")->size());
+
+    // A copy doesn't belong to the arena.
+    toml::Value copied = v;
+    EXPECT_EQ(nullptr, copied.as<toml::Table>().get_allocator().arena());
+    EXPECT_EQ(v, copied);
+}
+
+TEST(ArenaTest, nodes)
+{
+    shared_ptr<toml::Arena> arena = make_shared<toml::Arena>();
+    istringstream ss("s = \"a string longer than the small string buffer\"\nxs = [1, 2]\n[t]\nk = \"v\"\n");
+    toml::ParseResult pr = toml::parse(ss, arena);
+    ASSERT_TRUE(pr.valid()) << pr.errorReason;
+
+    // The nodes themselves are in the arena, not only the storage of the containers.
+    const toml::Value& v = pr.value;
+    EXPECT_TRUE(arena->owns(&v.as<toml::Table>()));
+    EXPECT_TRUE(arena->owns(&v.find("t")->as<toml::Table>()));
+    EXPECT_TRUE(arena->owns(&v.find("xs")->as<toml::Array>()));
+    EXPECT_FALSE(arena->owns(&v.find("s")->as<string>()));
+
+    // A table keeps the arena alive after the document and the handle are gone.
+    toml::Value s = *v.find("s");
+    toml::Value t = *v.find("t");
+    pr.value = toml::Value();
+    arena.reset();
+    EXPECT_EQ("a string longer than the small string buffer", s.as<string>());
+    EXPECT_EQ("v", t.get<string>("k"));
+
+    // Modifying them after the arena has been released allocates from the heap.
+    t.set("k2", 1);
+    EXPECT_EQ(1, t.get<int>("k2"));
+}
@@ -0,0 +1,108 @@
+#include "toml/toml.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "test_helper.h"
+
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// Copies |bytes| into an 8-byte aligned buffer.
+vector<uint64_t> aligned(const string& bytes)
+{
+    vector<uint64_t> buffer((bytes.size() + 7) / 8);
+    memcpy(buffer.data(), bytes.data(), bytes.size());
+    return buffer;
+}
+
+} // namespace anonymous
+
+TEST(BinaryTest, view)
+{
+    toml::Value v = parse(kAppDocument);
+    string bytes = toml::serializeBinary(v);
+    vector<uint64_t> buffer = aligned(bytes);
+    const char* data = reinterpret_cast<const char*>(buffer.data());
+
+    toml::BinaryView view = toml::BinaryView::fromBytes(data, bytes.size());
+    ASSERT_FALSE(view.empty());
+    EXPECT_EQ(data, view.data());
+    EXPECT_EQ("app", view.get<string>("name"));
+    EXPECT_EQ("localhost", view.get<string>("server.host"));
+    EXPECT_EQ(443, view.find("server.ports").at(1).as<int>());
+    EXPECT_EQ("b", view.find("hosts").at(1).get<string>("name"));
+    EXPECT_FALSE(view.has("nothing"));
+    EXPECT_EQ(v, view.root().thaw());
+
+    // The same bytes as a frozen document.
+    toml::FrozenDocument doc = toml::freeze(v);
+    EXPECT_EQ(bytes, string(doc.data(), doc.byteSize()));
+}
+
+TEST(BinaryTest, invalidBytes)
+{
+    string bytes = toml::serializeBinary(parse(kAppDocument));
+    vector<uint64_t> buffer = aligned(bytes + "x");
+    const char* data = reinterpret_cast<const char*>(buffer.data());
+
+    EXPECT_TRUE(toml::BinaryView::fromBytes(data, bytes.size() - 1).empty());
+    EXPECT_TRUE(toml::BinaryView::fromBytes(data, bytes.size() + 1).empty());
+    // Not aligned.
+    EXPECT_TRUE(toml::BinaryView::fromBytes(data + 1, bytes.size()).empty());
+
+    string broken = bytes;
+    broken[0] = 'X';
+    vector<uint64_t> brokenBuffer = aligned(broken);
+    EXPECT_TRUE(toml::BinaryView::fromBytes(reinterpret_cast<const char*>(brokenBuffer.data()), broken.size()).empty());
+
+    toml::BinaryView empty;
+    EXPECT_TRUE(empty.empty());
+    EXPECT_FALSE(empty.root().valid());
+}
+
+TEST(BinaryTest, file)
+{
+    char path[] = "/tmp/toml_binary_test_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+
+    toml::Value v = parse(kAppDocument);
+    {
+        ofstream ofs(path, ios::binary);
+        ofs << toml::serializeBinary(v);
+    }
+
+    toml::BinaryFile file(path);
+    EXPECT_EQ("localhost", file.view().get<string>("server.host"));
+    EXPECT_EQ(v, file.view().root().thaw());
+
+    toml::BinaryFile moved(std::move(file));
+    EXPECT_TRUE(file.view().empty());
+    EXPECT_EQ("app", moved.view().get<string>("name"));
+
+    {
+        ofstream ofs(path, ios::binary | ios::trunc);
+        ofs << "not a document";
+    }
+    EXPECT_THROW(toml::BinaryFile(string(path)), std::runtime_error);
+    EXPECT_THROW(toml::BinaryFile("/nonexistent/file"), std::runtime_error);
+
+    unlink(path);
+}
+
+TEST(BinaryTest, largeOffsets)
+{
+    // Every offset is 64-bit, so that a document larger than 4 GiB can be addressed.
+    EXPECT_EQ(8U, sizeof(toml::internal::FrozenHeader().stringsOffset));
+    EXPECT_EQ(8U, sizeof(toml::internal::FrozenNode().payload));
+    EXPECT_EQ(8U, sizeof(toml::internal::FrozenKey().offset));
+}
@@ -0,0 +1,117 @@
+#include "toml/toml.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "test_helper.h"
+
+using namespace std;
+
+namespace {
+
+const char kDocument[] =
+    "name = \"app\"\n"
+    "[db.pool]\n"
+    "size = 10\n"
+    "[db.replica]\n"
+    "host = \"replica\"\n"
+    "[cache]\n"
+    "ttl = 60\n";
+
+} // namespace anonymous
+
+TEST(ChangeNotifierTest, notify)
+{
+    toml::Value before = parse(kDocument);
+    toml::Value after = before;
+    after.set("db.pool.size", 20);
+
+    vector<string> called;
+    toml::ChangeNotifier notifier;
+    notifier.watch("db.pool", [&](const toml::Value* b, const toml::Value* a) {
+        called.push_back("db.pool");
+        EXPECT_EQ(10, b->get<int>("size"));
+        EXPECT_EQ(20, a->get<int>("size"));
+    });
+    notifier.watch("db.pool.size", [&](const toml::Value* b, const toml::Value* a) {
+        called.push_back("db.pool.size");
+        EXPECT_EQ(10, b->as<int>());
+        EXPECT_EQ(20, a->as<int>());
+    });
+    notifier.watch("db", [&](const toml::Value*, const toml::Value*) { called.push_back("db"); });
+    notifier.watch("db.replica", [&](const toml::Value*, const toml::Value*) { called.push_back("db.replica"); });
+    notifier.watch("cache", [&](const toml::Value*, const toml::Value*) { called.push_back("cache"); });
+    notifier.watch("", [&](const toml::Value*, const toml::Value*) { called.push_back(""); });
+    EXPECT_EQ(6U, notifier.size());
+
+    EXPECT_EQ(4U, notifier.notify(before, after));
+    EXPECT_EQ((vector<string> { "", "db", "db.pool", "db.pool.size" }), called);
+
+    called.clear();
+    EXPECT_EQ(0U, notifier.notify(before, before));
+    EXPECT_EQ(0U, notifier.notify(before, parse(kDocument)));
+    EXPECT_TRUE(called.empty());
+}
+
+TEST(ChangeNotifierTest, addedAndRemoved)
+{
+    toml::Value before = parse(kDocument);
+    toml::Value after = parse("name = \"app\"\n[cache]\nttl = 60\n[new]\nx = 1\n");
+
+    vector<pair<bool, bool>> db, created, missing;
+    toml::ChangeNotifier notifier;
+    notifier.watch("db.replica.host", [&](const toml::Value* b, const toml::Value* a) { db.emplace_back(b != nullptr, a != nullptr); });
+    notifier.watch("new.x", [&](const toml::Value* b, const toml::Value* a) { created.emplace_back(b != nullptr, a != nullptr); });
+    notifier.watch("nothing.here", [&](const toml::Value* b, const toml::Value* a) { missing.emplace_back(b != nullptr, a != nullptr); });
+    // A scalar in the middle of the path.
+    notifier.watch("name.x", [&](const toml::Value* b, const toml::Value* a) { missing.emplace_back(b != nullptr, a != nullptr); });
+
+    EXPECT_EQ(2U, notifier.notify(before, after));
+    EXPECT_EQ((vector<pair<bool, bool>> { { true, false } }), db);
+    EXPECT_EQ((vector<pair<bool, bool>> { { false, true } }), created);
+    EXPECT_TRUE(missing.empty());
+}
+
+TEST(ChangeNotifierTest, typeChange)
+{
+    toml::Value before = parse("a = 1\n");
+    toml::Value after = parse("a = 1.0\n");
+
+    int count = 0;
+    toml::ChangeNotifier notifier;
+    notifier.watch("a", [&](const toml::Value*, const toml::Value*) { ++count; });
+    EXPECT_EQ(1U, notifier.notify(before, after));
+    EXPECT_EQ(1, count);
+}
+
+TEST(ChangeNotifierTest, unwatch)
+{
+    toml::Value before = parse(kDocument);
+    toml::Value after = before;
+    after.set("db.pool.size", 20);
+
+    int a = 0, b = 0;
+    toml::ChangeNotifier notifier;
+    toml::ChangeNotifier::SubscriptionId ida = notifier.watch("db.pool.size", [&](const toml::Value*, const toml::Value*) { ++a; });
+    toml::ChangeNotifier::SubscriptionId idb = notifier.watch("db.pool.size", [&](const toml::Value*, const toml::Value*) { ++b; });
+
+    EXPECT_TRUE(notifier.unwatch(ida));
+    EXPECT_FALSE(notifier.unwatch(ida));
+    EXPECT_EQ(1U, notifier.notify(before, after));
+    EXPECT_EQ(0, a);
+    EXPECT_EQ(1, b);
+
+    EXPECT_TRUE(notifier.unwatch(idb));
+    EXPECT_EQ(0U, notifier.size());
+    EXPECT_EQ(0U, notifier.notify(before, after));
+    EXPECT_EQ(1, b);
+}
+
+TEST(ChangeNotifierTest, invalidPath)
+{
+    toml::ChangeNotifier notifier;
+    EXPECT_THROW(notifier.watch("a..b", [](const toml::Value*, const toml::Value*) {}), std::runtime_error);
+    EXPECT_EQ(0U, notifier.size());
+}
@@ -0,0 +1,95 @@
+// Compares the reader throughput of ConfigHandle with a mutex guarding a shared_ptr,
+// while a writer publishes a new snapshot every millisecond.
+//   $ ./config_handle_bench [max threads] [milliseconds per run]
+#include "toml/toml.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+toml::Value makeConfig(int version)
+{
+    toml::Value v((toml::Table()));
+    v.set("version", version);
+    v.set("server.port", 8000);
+    return v;
+}
+
+class MutexHandle {
+public:
+    explicit MutexHandle(toml::Value v) : current_(make_shared<const toml::Value>(std::move(v))) {}
+
+    shared_ptr<const toml::Value> load() const
+    {
+        lock_guard<mutex> lock(mu_);
+        return current_;
+    }
+    void publish(toml::Value v)
+    {
+        shared_ptr<const toml::Value> next = make_shared<const toml::Value>(std::move(v));
+        lock_guard<mutex> lock(mu_);
+        current_.swap(next);
+    }
+
+private:
+    mutable mutex mu_;
+    shared_ptr<const toml::Value> current_;
+};
+
+// Returns the number of loads per second of all the readers.
+template<typename Handle>
+double run(Handle* handle, int numThreads, int millis)
+{
+    atomic<bool> done(false);
+    atomic<int64_t> loads(0);
+    vector<thread> readers;
+    for (int t = 0; t < numThreads; ++t) {
+        readers.emplace_back([&]() {
+            int64_t n = 0, sum = 0;
+            while (!done.load(memory_order_relaxed)) {
+                auto snapshot = handle->load();
+                sum += snapshot->findChild("version")->template as<int>();
+                ++n;
+            }
+            loads += n + (sum < 0 ? 1 : 0);
+        });
+    }
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; chrono::steady_clock::now() - start < chrono::milliseconds(millis); ++i) {
+        handle->publish(makeConfig(i));
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    done = true;
+    for (thread& t : readers)
+        t.join();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return loads.load() / seconds;
+}
+
+} // namespace anonymous
+
+int main(int argc, char* argv[])
+{
+    const int maxThreads = argc >= 2 ? stoi(argv[1]) : max(1U, thread::hardware_concurrency());
+    const int millis = argc >= 3 ? stoi(argv[2]) : 500;
+
+    cout << "threads  ConfigHandle (Mloads/s)  mutex + shared_ptr (Mloads/s)" << endl;
+    for (int n = 1; n <= maxThreads; n *= 2) {
+        toml::ConfigHandle handle(makeConfig(0));
+        MutexHandle mutexHandle(makeConfig(0));
+        double lockFree = run(&handle, n, millis);
+        double locked = run(&mutexHandle, n, millis);
+        cout << n << "\t " << lockFree / 1e6 << "\t\t\t  " << locked / 1e6 << endl;
+    }
+}
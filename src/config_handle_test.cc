@@ -0,0 +1,145 @@
+#include "toml/toml.h"
+
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+
+toml::Value makeConfig(int version)
+{
+    toml::Value v((toml::Table()));
+    v.set("version", version);
+    v.set("server.port", 8000 + version);
+    return v;
+}
+
+// Counts the live instances, to see that the snapshots are deleted.
+struct Counted {
+    static atomic<int> alive;
+
+    explicit Counted(int x) : x(x) { ++alive; }
+    Counted(const Counted& other) : x(other.x) { ++alive; }
+    Counted(Counted&& other) : x(other.x) { ++alive; }
+    ~Counted() { --alive; }
+
+    int x;
+};
+
+atomic<int> Counted::alive(0);
+
+} // namespace anonymous
+
+TEST(ConfigHandleTest, loadAndPublish)
+{
+    toml::ConfigHandle handle;
+    EXPECT_TRUE(handle.load().get() == nullptr);
+
+    handle.publish(makeConfig(1));
+    {
+        toml::ConfigHandle::Guard guard = handle.load();
+        ASSERT_TRUE(guard.get() != nullptr);
+        EXPECT_EQ(1, guard->get<int>("version"));
+
+        handle.publish(makeConfig(2));
+        // The old snapshot is alive while it's held.
+        EXPECT_EQ(1, guard->get<int>("version"));
+        EXPECT_EQ(8001, (*guard).get<int>("server.port"));
+        EXPECT_EQ(2, handle.load()->get<int>("version"));
+        EXPECT_EQ(1U, handle.retiredCount());
+    }
+
+    handle.publish(makeConfig(3));
+    EXPECT_EQ(0U, handle.retiredCount());
+    EXPECT_EQ(3, handle.load()->get<int>("version"));
+}
+
+TEST(ConfigHandleTest, guard)
+{
+    toml::ConfigHandle handle(makeConfig(1));
+
+    toml::ConfigHandle::Guard a = handle.load();
+    toml::ConfigHandle::Guard b = handle.load();
+    EXPECT_EQ(a.get(), b.get());
+
+    toml::ConfigHandle::Guard c(std::move(a));
+    EXPECT_TRUE(a.get() == nullptr);
+    EXPECT_EQ(b.get(), c.get());
+
+    handle.publish(makeConfig(2));
+    b = handle.load();
+    EXPECT_EQ(2, b->get<int>("version"));
+    EXPECT_EQ(1, c->get<int>("version"));
+}
+
+TEST(ConfigHandleTest, reclaim)
+{
+    ASSERT_EQ(0, Counted::alive.load());
+    {
+        toml::BasicConfigHandle<Counted> handle(Counted(0));
+        EXPECT_EQ(1, Counted::alive.load());
+
+        toml::BasicConfigHandle<Counted>::Guard held = handle.load();
+        for (int i = 1; i <= 10; ++i)
+            handle.publish(Counted(i));
+        // The current one, and the held one.
+        EXPECT_EQ(2, Counted::alive.load());
+        EXPECT_EQ(0, held->x);
+
+        held = toml::BasicConfigHandle<Counted>::Guard();
+        handle.publish(Counted(11));
+        EXPECT_EQ(1, Counted::alive.load());
+        EXPECT_EQ(11, handle.load()->x);
+
+        // Deleted by the destructor.
+        held = handle.load();
+        handle.publish(Counted(12));
+        held = toml::BasicConfigHandle<Counted>::Guard();
+    }
+    EXPECT_EQ(0, Counted::alive.load());
+}
+
+TEST(ConfigHandleTest, concurrentReaders)
+{
+    toml::ConfigHandle handle(makeConfig(0));
+    atomic<bool> done(false);
+    atomic<int> errors(0);
+
+    vector<thread> readers;
+    for (int t = 0; t < 8; ++t) {
+        readers.emplace_back([&]() {
+            int last = 0;
+            while (!done.load()) {
+                toml::ConfigHandle::Guard guard = handle.load();
+                int version = guard->get<int>("version");
+                // A snapshot is consistent, and versions never go back.
+                if (guard->get<int>("server.port") != 8000 + version || version < last)
+                    ++errors;
+                last = version;
+            }
+        });
+    }
+
+    for (int i = 1; i <= 2000; ++i)
+        handle.publish(makeConfig(i));
+    done = true;
+    for (thread& t : readers)
+        t.join();
+
+    EXPECT_EQ(0, errors.load());
+    EXPECT_EQ(2000, handle.load()->get<int>("version"));
+}
+
+TEST(ConfigHandleTest, frozenDocument)
+{
+    toml::BasicConfigHandle<toml::FrozenDocument> handle(toml::freeze(makeConfig(1)));
+    EXPECT_EQ(8001, handle.load()->get<int>("server.port"));
+
+    handle.publish(toml::freeze(makeConfig(2)));
+    EXPECT_EQ(8002, handle.load()->get<int>("server.port"));
+}
@@ -0,0 +1,123 @@
+#include "toml/toml.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "test_helper.h"
+
+using namespace std;
+
+namespace {
+
+vector<string> paths(const toml::Patch& patch)
+{
+    vector<string> result;
+    for (const auto& change : patch.changes)
+        result.push_back(change.pathString());
+    return result;
+}
+
+} // namespace anonymous
+
+TEST(DiffTest, same)
+{
+    toml::Value v = parse("a = 1\n[b]\nc = [1, 2]\n");
+    EXPECT_TRUE(toml::diff(v, v).empty());
+    EXPECT_TRUE(toml::diff(v, parse("a = 1\n[b]\nc = [1, 2]\n")).empty());
+}
+
+TEST(DiffTest, addRemoveChange)
+{
+    toml::Value from = parse(
+        "a = 1\n"
+        "b = \"x\"\n"
+        "[server]\n"
+        "host = \"localhost\"\n"
+        "ports = [80, 443]\n"
+        "[server.tls]\n"
+        "cert = \"a.pem\"\n");
+    toml::Value to = parse(
+        "a = 1\n"
+        "c = true\n"
+        "[server]\n"
+        "host = \"example.com\"\n"
+        "ports = [80, 443]\n"
+        "\"x.y\" = 1\n"
+        "[server.tls]\n"
+        "cert = \"a.pem\"\n");
+
+    toml::Patch patch = toml::diff(from, to);
+    ASSERT_EQ(4U, patch.size());
+    EXPECT_EQ((vector<string>{"b", "c", "server.host", "server.\"x.y\""}), paths(patch));
+
+    EXPECT_EQ(toml::Patch::Op::REMOVE, patch.changes[0].op);
+    EXPECT_FALSE(patch.changes[0].value.valid());
+    EXPECT_EQ(toml::Patch::Op::ADD, patch.changes[1].op);
+    EXPECT_TRUE(patch.changes[1].value.as<bool>());
+    EXPECT_EQ(toml::Patch::Op::CHANGE, patch.changes[2].op);
+    EXPECT_EQ((vector<string>{"server", "host"}), patch.changes[2].path);
+    EXPECT_EQ("example.com", patch.changes[2].value.as<string>());
+    EXPECT_EQ(toml::Patch::Op::ADD, patch.changes[3].op);
+
+    toml::Value applied = from;
+    toml::apply(applied, patch);
+    EXPECT_EQ(to, applied);
+    EXPECT_TRUE(toml::diff(applied, to).empty());
+}
+
+TEST(DiffTest, typeChange)
+{
+    toml::Value from = parse("a = 1\n[b]\nc = 1\n");
+    toml::Value to = parse("b = 2\n[a]\nc = 1\n");
+
+    toml::Patch patch = toml::diff(from, to);
+    ASSERT_EQ(2U, patch.size());
+    EXPECT_EQ(toml::Patch::Op::CHANGE, patch.changes[0].op);
+    EXPECT_TRUE(patch.changes[0].value.is<toml::Table>());
+    EXPECT_EQ(toml::Patch::Op::CHANGE, patch.changes[1].op);
+
+    toml::apply(from, patch);
+    EXPECT_EQ(to, from);
+
+    patch = toml::diff(toml::Value(1), toml::Value(2));
+    ASSERT_EQ(1U, patch.size());
+    EXPECT_TRUE(patch.changes[0].path.empty());
+    EXPECT_EQ("", patch.changes[0].pathString());
+}
+
+TEST(DiffTest, sharedSubtree)
+{
+    toml::Value from = parse("[a]\nb = 1\n[c]\nd = 2\n");
+    toml::Value to = from;
+    to.set("c.d", 3);
+
+    toml::Patch patch = toml::diff(from, to);
+    ASSERT_EQ(1U, patch.size());
+    EXPECT_EQ("c.d", patch.changes[0].pathString());
+    EXPECT_EQ(2, from.get<int>("c.d"));
+}
+
+TEST(DiffTest, apply)
+{
+    toml::Patch patch;
+    patch.changes.emplace_back(toml::Patch::Op::ADD, vector<string>{"a", "b", "c"}, toml::Value(1));
+    patch.changes.emplace_back(toml::Patch::Op::REMOVE, vector<string>{"x", "y"}, toml::Value());
+    patch.changes.emplace_back(toml::Patch::Op::REMOVE, vector<string>{"d"}, toml::Value());
+
+    toml::Value v = parse("d = 1\ne = 2\n");
+    toml::Value original = v;
+    toml::apply(v, patch);
+    EXPECT_EQ(1, v.get<int>("a.b.c"));
+    EXPECT_EQ(nullptr, v.find("d"));
+    EXPECT_EQ(nullptr, v.find("x"));
+    EXPECT_EQ(2, v.get<int>("e"));
+
+    // The original is not changed, since the nodes are copy-on-write.
+    EXPECT_EQ(1, original.get<int>("d"));
+
+    toml::Patch bad;
+    bad.changes.emplace_back(toml::Patch::Op::ADD, vector<string>{"e", "f"}, toml::Value(1));
+    EXPECT_THROW(toml::apply(v, bad), std::runtime_error);
+}
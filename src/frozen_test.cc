@@ -0,0 +1,171 @@
+#include "toml/toml.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "test_helper.h"
+
+using namespace std;
+
+TEST(FrozenTest, find)
+{
+    toml::FrozenDocument doc = toml::freeze(parse(kAppDocument));
+    ASSERT_FALSE(doc.empty());
+
+    EXPECT_EQ("app", doc.get<string>("name"));
+    EXPECT_EQ(0.25, doc.get<double>("ratio"));
+    EXPECT_FALSE(doc.get<bool>("debug"));
+    EXPECT_EQ(parse(kAppDocument).get<toml::Time>("started"), doc.get<toml::Time>("started"));
+    EXPECT_EQ("localhost", doc.get<string>("server.host"));
+    EXPECT_EQ(8080, doc.get<int>("server.port"));
+    EXPECT_EQ(8080, doc.get<int64_t>(TOML_PATH("server.port")));
+    EXPECT_TRUE(doc.get<bool>("server.tls.enabled"));
+    EXPECT_EQ(1, doc.get<int>("\"x.y\".z"));
+
+    toml::FrozenValue ports = doc.find("server.ports");
+    ASSERT_TRUE(ports.is<toml::Array>());
+    ASSERT_EQ(2U, ports.size());
+    EXPECT_EQ(80, ports.at(0).as<int>());
+    EXPECT_EQ(443, ports.at(1).as<int>());
+    EXPECT_FALSE(ports.at(2).valid());
+
+    toml::FrozenValue hosts = doc.find("hosts");
+    ASSERT_EQ(2U, hosts.size());
+    EXPECT_EQ("b", hosts.at(1).get<string>("name"));
+
+    EXPECT_FALSE(doc.find("nothing"));
+    EXPECT_FALSE(doc.find("server.nothing"));
+    EXPECT_FALSE(doc.find("name.nothing"));
+    EXPECT_FALSE(doc.find("server..host"));
+    EXPECT_FALSE(doc.find("server."));
+    EXPECT_FALSE(doc.find(""));
+    EXPECT_TRUE(doc.has("server.tls"));
+
+    EXPECT_THROW(doc.get<int>("nothing"), std::runtime_error);
+    EXPECT_THROW(doc.get<int>("name"), std::runtime_error);
+    EXPECT_THROW(doc.find("name").get<int>("x"), std::runtime_error);
+}
+
+TEST(FrozenTest, iterate)
+{
+    toml::FrozenDocument doc = toml::freeze(parse(kAppDocument));
+
+    vector<string> keys;
+    for (const auto& kv : doc.find("server"))
+        keys.push_back(kv.first);
+    EXPECT_EQ((vector<string> { "host", "port", "ports", "tls" }), keys);
+
+    EXPECT_TRUE(doc.find("name").begin() == doc.find("name").end());
+}
+
+TEST(FrozenTest, thaw)
+{
+    toml::Value v = parse(kAppDocument);
+    toml::FrozenDocument doc = toml::freeze(v);
+    EXPECT_EQ(v, doc.root().thaw());
+
+    toml::Value moved = v;
+    toml::FrozenDocument doc2 = toml::freeze(std::move(moved));
+    EXPECT_EQ(toml::Value::NULL_TYPE, moved.type());
+    EXPECT_EQ(v, doc2.root().thaw());
+}
+
+TEST(FrozenTest, largeTables)
+{
+    toml::Value v((toml::Table()));
+    for (int t = 0; t < 20; ++t) {
+        for (int k = 0; k < 1000; ++k)
+            v.set("table" + to_string(t) + ".key_" + to_string(k * 7919 % 1000), t * 1000 + k);
+    }
+
+    toml::FrozenDocument doc = toml::freeze(v);
+    for (int t = 0; t < 20; ++t) {
+        toml::FrozenValue table = doc.find("table" + to_string(t));
+        ASSERT_EQ(1000U, table.size());
+        for (int k = 0; k < 1000; ++k) {
+            const toml::Value* expected = v.find("table" + to_string(t) + ".key_" + to_string(k));
+            toml::FrozenValue x = table.findChild("key_" + to_string(k));
+            ASSERT_TRUE(x.valid());
+            EXPECT_EQ(expected->as<int64_t>(), x.as<int64_t>());
+        }
+        EXPECT_FALSE(table.findChild("key_1000").valid());
+        EXPECT_FALSE(table.findChild("").valid());
+    }
+    EXPECT_EQ(v, doc.root().thaw());
+
+    // The keys shared by the tables are stored once.
+    size_t keyBytes = 0;
+    for (int k = 0; k < 1000; ++k)
+        keyBytes += ("key_" + to_string(k)).size();
+    EXPECT_LT(doc.byteSize(), 20 * 1000 * (sizeof(toml::internal::FrozenKey) + sizeof(toml::internal::FrozenNode) + 12) + keyBytes + 4096);
+}
+
+TEST(FrozenTest, empty)
+{
+    toml::FrozenDocument doc;
+    EXPECT_TRUE(doc.empty());
+    EXPECT_FALSE(doc.root().valid());
+    EXPECT_FALSE(doc.find("a").valid());
+
+    toml::FrozenDocument emptyTable = toml::freeze(toml::Value(toml::Table()));
+    EXPECT_TRUE(emptyTable.root().is<toml::Table>());
+    EXPECT_EQ(0U, emptyTable.root().size());
+    EXPECT_FALSE(emptyTable.find("a").valid());
+}
+
+TEST(FrozenTest, packedArrays)
+{
+    toml::Value v = parse("xs = [1, 2, 3]\nys = [1.5, 2.5]\n[[t]]\na = 1\n[[t]]\na = 2\n");
+    toml::Value unpacked = v;
+    v.pack();
+
+    toml::FrozenDocument doc = toml::freeze(v);
+    EXPECT_EQ(3, doc.find("xs").at(2).as<int>());
+    EXPECT_EQ(2.5, doc.find("ys").at(1).as<double>());
+    EXPECT_EQ(2, doc.find("t").at(1).get<int>("a"));
+    EXPECT_EQ(unpacked, doc.root().thaw());
+}
+
+TEST(FrozenTest, timeUnit)
+{
+    toml::Value v = parse("t = 1979-05-27T07:32:00.999999Z\n");
+    toml::FrozenDocument doc = toml::freeze(v);
+    EXPECT_EQ(v.get<toml::Time>("t"), doc.get<toml::Time>("t"));
+
+    // A time is stored as microseconds, whatever the period of the clock is.
+    toml::FrozenDocument time = toml::freeze(toml::Value(v.get<toml::Time>("t")));
+    const toml::internal::FrozenHeader* header = reinterpret_cast<const toml::internal::FrozenHeader*>(time.data());
+    EXPECT_EQ(296638320999999ULL, header->root.payload);
+}
+
+TEST(FrozenTest, corruptedBytes)
+{
+    toml::Value v = parse(kAppDocument);
+    for (int i = 0; i < 20; ++i)
+        v.set("large.key" + to_string(i), i);
+    toml::FrozenDocument doc = toml::freeze(v);
+    const string bytes(doc.data(), doc.byteSize());
+    EXPECT_FALSE(toml::FrozenDocument::fromBytes(bytes.data(), bytes.size()).empty());
+
+    // Either the broken bytes are rejected, or every offset in them is within the bytes.
+    for (size_t i = sizeof(toml::internal::FrozenHeader) - sizeof(toml::internal::FrozenNode); i < bytes.size(); ++i) {
+        for (unsigned char c : { 0x00, 0x7f, 0xff }) {
+            string broken = bytes;
+            broken[i] = static_cast<char>(c);
+            toml::FrozenDocument d = toml::FrozenDocument::fromBytes(broken.data(), broken.size());
+            if (!d.empty())
+                d.root().thaw();
+        }
+    }
+
+    // An offset out of the bytes.
+    string broken = bytes;
+    toml::internal::FrozenHeader* header = reinterpret_cast<toml::internal::FrozenHeader*>(&broken[0]);
+    header->root.payload = broken.size() * 2;
+    EXPECT_TRUE(toml::FrozenDocument::fromBytes(broken.data(), broken.size()).empty());
+
+    // Truncated.
+    EXPECT_TRUE(toml::FrozenDocument::fromBytes(bytes.data(), bytes.size() - 8).empty());
+}
@@ -0,0 +1,137 @@
+#include "toml/toml.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "test_helper.h"
+
+using namespace std;
+
+namespace {
+
+const char kDocument[] =
+    "name = \"app\"\n"
+    "[server]\n"
+    "host = \"localhost\"\n"
+    "port = 8080\n"
+    "ratio = 0.5\n"
+    "[server.tls]\n"
+    "enabled = true\n"
+    "ciphers = [\"a\", \"b\"]\n"
+    "[\"x.y\"]\n"
+    "z = 1\n";
+
+} // namespace anonymous
+
+TEST(GetManyTest, resolve)
+{
+    toml::Value v = parse(kDocument);
+
+    string name, host;
+    int port = 0;
+    double ratio = 0;
+    bool enabled = false;
+    vector<string> ciphers;
+    int z = 0;
+    toml::Table tls;
+
+    vector<toml::Slot> slots {
+        { "server.tls.enabled", &enabled },
+        { "name", &name },
+        { "server.port", &port },
+        { toml::Path("server.host"), &host },
+        { "server.ratio", &ratio },
+        { "server.tls.ciphers", &ciphers },
+        { "\"x.y\".z", &z },
+        { "server.tls", &tls },
+    };
+    EXPECT_TRUE(v.getMany(&slots));
+    for (const toml::Slot& slot : slots)
+        EXPECT_TRUE(slot.ok()) << slot.path().toString() << ": " << slot.error();
+
+    EXPECT_EQ("app", name);
+    EXPECT_EQ("localhost", host);
+    EXPECT_EQ(8080, port);
+    EXPECT_EQ(0.5, ratio);
+    EXPECT_TRUE(enabled);
+    EXPECT_EQ((vector<string> { "a", "b" }), ciphers);
+    EXPECT_EQ(1, z);
+    EXPECT_EQ(2U, tls.size());
+}
+
+TEST(GetManyTest, errors)
+{
+    toml::Value v = parse(kDocument);
+
+    int port = 80, missing = 42, deep = 7;
+    string host = "default";
+    int small = 0;
+    bool invalid = false;
+
+    vector<toml::Slot> slots {
+        { "server.port", &port },
+        { "server.nothing", &missing },
+        { "server.host", &small },
+        { "name.deep", &deep },
+        { "server..host", &invalid },
+        { "server.host", &host },
+    };
+    EXPECT_FALSE(v.getMany(&slots));
+
+    EXPECT_TRUE(slots[0].ok());
+    EXPECT_EQ(8080, port);
+
+    EXPECT_FALSE(slots[1].ok());
+    EXPECT_NE(string::npos, slots[1].error().find("not found"));
+    EXPECT_EQ(42, missing);
+
+    EXPECT_FALSE(slots[2].ok());
+    EXPECT_NE(string::npos, slots[2].error().find("type error"));
+
+    EXPECT_FALSE(slots[3].ok());
+    EXPECT_EQ(7, deep);
+
+    EXPECT_FALSE(slots[4].ok());
+    EXPECT_EQ("invalid key", slots[4].error());
+
+    EXPECT_TRUE(slots[5].ok());
+    EXPECT_EQ("localhost", host);
+}
+
+TEST(GetManyTest, retry)
+{
+    toml::Value v = parse("x = \"1\"\n");
+
+    int x = 0;
+    vector<toml::Slot> slots { { "x", &x } };
+    EXPECT_FALSE(v.getMany(&slots));
+    EXPECT_FALSE(slots[0].ok());
+    EXPECT_EQ(0, x);
+
+    // Errors are cleared on the next call.
+    v.set("x", 100);
+    EXPECT_TRUE(v.getMany(&slots));
+    EXPECT_TRUE(slots[0].ok());
+    EXPECT_EQ(100, x);
+}
+
+TEST(GetManyTest, many)
+{
+    toml::Value v((toml::Table()));
+    for (int i = 0; i < 30; ++i) {
+        for (int j = 0; j < 10; ++j)
+            v.set("s" + to_string(i) + ".t.k" + to_string(j), i * 10 + j);
+    }
+
+    vector<int> outs(300, -1);
+    vector<toml::Slot> slots;
+    for (int j = 9; j >= 0; --j) {
+        for (int i = 0; i < 30; ++i)
+            slots.emplace_back("s" + to_string(i) + ".t.k" + to_string(j), &outs[i * 10 + j]);
+    }
+    EXPECT_TRUE(v.getMany(&slots));
+    for (int k = 0; k < 300; ++k)
+        EXPECT_EQ(k, outs[k]);
+}
@@ -0,0 +1,105 @@
+#define TOML_TABLE_POLICY InternedTablePolicy
+#include "toml/toml.h"
+
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+
+const toml::Key& firstKey(const toml::Value& v)
+{
+    return v.as<toml::Table>().begin()->first;
+}
+
+} // namespace anonymous
+
+TEST(KeyPoolTest, intern)
+{
+    toml::KeyPool pool;
+    toml::Key k1 = pool.intern("a_very_long_key_which_is_not_in_sso");
+    toml::Key k2 = pool.intern("a_very_long_key_which_is_not_in_sso");
+    toml::Key k3 = pool.intern("another");
+
+    EXPECT_EQ(&k1.str(), &k2.str());
+    EXPECT_NE(&k1.str(), &k3.str());
+    EXPECT_EQ(k1, k2);
+    EXPECT_NE(k1, k3);
+    EXPECT_EQ(2U, pool.size());
+
+    // Not interned.
+    toml::Key k4("another");
+    EXPECT_NE(&k3.str(), &k4.str());
+    EXPECT_EQ(k3, k4);
+}
+
+TEST(KeyPoolTest, scope)
+{
+    toml::KeyPool pool;
+    toml::Value v1;
+    toml::Value v2;
+    {
+        toml::KeyPool::Scope scope(&pool);
+        v1.set("a_very_long_key_which_is_not_in_sso", 1);
+        v2.set("a_very_long_key_which_is_not_in_sso", 2);
+    }
+
+    EXPECT_EQ(&firstKey(v1).str(), &firstKey(v2).str());
+    EXPECT_EQ(nullptr, toml::KeyPool::current());
+}
+
+TEST(KeyPoolTest, arrayOfTables)
+{
+    toml::KeyPool pool;
+    toml::ParseOptions options;
+    options.keyPool = &pool;
+
+    stringstream ss(
+        "[[records]]\n"
+        "identifier_of_the_record = 1\n"
+        "name_of_the_record = \"foo\"\n"
+        "[[records]]\n"
+        "identifier_of_the_record = 2\n"
+        "name_of_the_record = \"bar\"\n");
+    toml::ParseResult pr = toml::parse(ss, options);
+    ASSERT_TRUE(pr.valid()) << pr.errorReason;
+
+    const toml::Array& records = pr.value.get<toml::Array>("records");
+    ASSERT_EQ(2U, records.size());
+    EXPECT_EQ(&firstKey(records[0]).str(), &firstKey(records[1]).str());
+    EXPECT_EQ(2, records[1].get<int>("identifier_of_the_record"));
+    EXPECT_EQ("bar", records[1].get<string>("name_of_the_record"));
+
+    // "records", "identifier_of_the_record" and "name_of_the_record".
+    EXPECT_EQ(3U, pool.size());
+}
+
+TEST(KeyPoolTest, sharedAcrossDocuments)
+{
+    unique_ptr<toml::KeyPool> pool(new toml::KeyPool);
+    toml::ParseOptions options;
+    options.keyPool = pool.get();
+
+    vector<toml::Value> docs(8);
+    vector<thread> threads;
+    for (size_t i = 0; i < docs.size(); ++i) {
+        threads.emplace_back([&docs, &options, i]() {
+            stringstream ss("a_very_long_key_which_is_not_in_sso = " + to_string(i) + "\n");
+            docs[i] = toml::parse(ss, options).value;
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+
+    EXPECT_EQ(1U, pool->size());
+    for (size_t i = 1; i < docs.size(); ++i)
+        EXPECT_EQ(&firstKey(docs[0]).str(), &firstKey(docs[i]).str());
+
+    // Documents can outlive the pool.
+    pool.reset();
+    EXPECT_EQ(3, docs[3].get<int>("a_very_long_key_which_is_not_in_sso"));
+}
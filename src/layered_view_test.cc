@@ -0,0 +1,110 @@
+#include "toml/toml.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "test_helper.h"
+
+using namespace std;
+
+TEST(LayeredViewTest, find)
+{
+    toml::Value base = parse(
+        "name = \"base\"\n"
+        "timeout = 10\n"
+        "[server]\n"
+        "host = \"localhost\"\n"
+        "port = 80\n"
+        "[db]\n"
+        "url = \"db://base\"\n");
+    toml::Value overlay = parse(
+        "name = \"overlay\"\n"
+        "[server]\n"
+        "port = 8080\n");
+
+    toml::LayeredView view({ &base, &overlay });
+    EXPECT_EQ(2U, view.layerCount());
+
+    EXPECT_EQ("overlay", view.get<string>("name"));
+    EXPECT_EQ(10, view.get<int>("timeout"));
+    EXPECT_EQ("localhost", view.get<string>("server.host"));
+    EXPECT_EQ(8080, view.get<int>("server.port"));
+    EXPECT_EQ("db://base", view.get<string>("db.url"));
+    EXPECT_FALSE(view.has("server.unknown"));
+    EXPECT_FALSE(view.has("name.x"));
+    EXPECT_THROW(view.get<int>("unknown"), std::runtime_error);
+    EXPECT_THROW(view.get<int>("name"), std::runtime_error);
+
+    // The topmost table.
+    EXPECT_EQ(overlay.find("server"), view.find("server"));
+}
+
+TEST(LayeredViewTest, sameAsMerge)
+{
+    toml::Value base = parse(
+        "a = 1\n"
+        "[b]\n"
+        "c = 2\n"
+        "[d]\n"
+        "e = 3\n");
+    toml::Value overlay = parse(
+        "b = 4\n"
+        "d = { f = 5 }\n");
+    toml::Value top = parse(
+        "[b]\n"
+        "g = 6\n");
+
+    toml::LayeredView view;
+    view.push(&base);
+    view.push(&overlay);
+    view.push(&top);
+
+    // |b| in |overlay| hides the table in |base|.
+    EXPECT_FALSE(view.has("b.c"));
+    EXPECT_EQ(6, view.get<int>("b.g"));
+    EXPECT_EQ(1U, view.view("b").layerCount());
+    EXPECT_EQ(3, view.get<int>("d.e"));
+    EXPECT_EQ(5, view.get<int>("d.f"));
+
+    toml::Value merged = base;
+    ASSERT_TRUE(merged.merge(overlay));
+    ASSERT_TRUE(merged.merge(top));
+
+    vector<string> keys;
+    for (const auto& kv : view.view("d"))
+        keys.push_back(kv.first);
+    EXPECT_EQ((vector<string>{"e", "f"}), keys);
+
+    keys.clear();
+    for (const auto& kv : view) {
+        keys.push_back(kv.first);
+        if (!kv.second.is<toml::Table>()) {
+            EXPECT_EQ(*merged.find(kv.first), kv.second);
+        }
+    }
+    EXPECT_EQ((vector<string>{"a", "b", "d"}), keys);
+}
+
+TEST(LayeredViewTest, iterate)
+{
+    toml::Value l1 = parse("a = 1\nc = 3\ne = 5\n");
+    toml::Value l2 = parse("b = 20\nc = 30\n");
+    toml::Value l3 = parse("c = 300\nf = 600\n");
+
+    toml::LayeredView view({ &l1, &l2, &l3 });
+    vector<pair<string, int>> items;
+    for (const auto& kv : view)
+        items.push_back(make_pair(kv.first, kv.second.as<int>()));
+
+    vector<pair<string, int>> expected {
+        { "a", 1 }, { "b", 20 }, { "c", 300 }, { "e", 5 }, { "f", 600 },
+    };
+    EXPECT_EQ(expected, items);
+
+    toml::LayeredView empty;
+    EXPECT_TRUE(empty.begin() == empty.end());
+    EXPECT_TRUE(view.view("a").empty());
+    EXPECT_TRUE(view.view("x").empty());
+}
@@ -0,0 +1,336 @@
+#include "toml/toml.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "test_helper.h"
+
+using namespace std;
+
+namespace {
+
+toml::Value parsePacked(const string& s)
+{
+    istringstream ss(s);
+    toml::ParseOptions options;
+    options.packArrays = true;
+    toml::ParseResult pr = toml::parse(ss, options);
+    EXPECT_TRUE(pr.valid()) << pr.errorReason;
+    return pr.value;
+}
+
+} // namespace anonymous
+
+TEST(PackedArrayTest, packInts)
+{
+    toml::Value v((toml::Array()));
+    v.push(1);
+    v.push(2);
+    v.push(3);
+    EXPECT_FALSE(v.isPacked());
+
+    v.pack();
+    EXPECT_TRUE(v.isPacked());
+    EXPECT_EQ(3U, v.size());
+    EXPECT_TRUE(v.is<toml::Array>());
+    EXPECT_EQ(2, v.get<int>(1));
+
+    ASSERT_TRUE(v.is<toml::Span<const int64_t>>());
+    EXPECT_FALSE(v.is<toml::Span<const double>>());
+    toml::Span<const int64_t> span = v.as<toml::Span<const int64_t>>();
+    ASSERT_EQ(3U, span.size());
+    EXPECT_EQ(1, span[0]);
+    EXPECT_EQ(3, span[2]);
+
+    EXPECT_EQ((vector<int>{1, 2, 3}), v.as<vector<int>>());
+    EXPECT_EQ(3U, v.as<toml::Array>().size());
+}
+
+TEST(PackedArrayTest, packStringsAndBools)
+{
+    toml::Value strings((toml::Array()));
+    strings.push("foo");
+    strings.push("");
+    strings.push("barbaz");
+    strings.pack();
+    EXPECT_TRUE(strings.isPacked());
+    EXPECT_EQ((vector<string>{"foo", "", "barbaz"}), strings.as<vector<string>>());
+    EXPECT_EQ("", strings.get<string>(1));
+
+    toml::Value bools((toml::Array()));
+    bools.push(true);
+    bools.push(false);
+    bools.pack();
+    EXPECT_TRUE(bools.isPacked());
+    EXPECT_TRUE(bools.get<bool>(0));
+    EXPECT_FALSE(bools.get<bool>(1));
+}
+
+TEST(PackedArrayTest, notPackable)
+{
+    toml::Value empty((toml::Array()));
+    empty.pack();
+    EXPECT_FALSE(empty.isPacked());
+    EXPECT_TRUE(empty.is<toml::Span<const double>>());
+    EXPECT_TRUE(empty.as<toml::Span<const double>>().empty());
+
+    toml::Value mixed((toml::Array()));
+    mixed.push(1);
+    mixed.push(1.5);
+    mixed.pack();
+    EXPECT_FALSE(mixed.isPacked());
+    EXPECT_FALSE(mixed.is<toml::Span<const int64_t>>());
+    EXPECT_THROW(mixed.as<toml::Span<const int64_t>>(), std::runtime_error);
+}
+
+TEST(PackedArrayTest, packRecursively)
+{
+    toml::Value v;
+    v.set("a.b", toml::Array());
+    v.find("a.b")->push(1.0);
+    v.find("a.b")->push(2.5);
+    v.set("c", toml::Array());
+    v.find("c")->push(toml::Array());
+    v.find("c")->find(0)->push(1);
+
+    v.pack();
+    EXPECT_TRUE(v.find("a.b")->isPacked());
+    EXPECT_FALSE(v.find("c")->isPacked());
+    EXPECT_TRUE(v.find("c")->find(0)->isPacked());
+
+    toml::Span<const double> span = v.get<toml::Span<const double>>("a.b");
+    ASSERT_EQ(2U, span.size());
+    EXPECT_EQ(2.5, span[1]);
+}
+
+TEST(PackedArrayTest, unpackOnModification)
+{
+    toml::Value v((toml::Array()));
+    v.push(1);
+    v.push(2);
+    v.pack();
+
+    toml::Value copied = v;
+    v.push(3);
+    EXPECT_FALSE(v.isPacked());
+    EXPECT_EQ((vector<int>{1, 2, 3}), v.as<vector<int>>());
+
+    EXPECT_TRUE(copied.isPacked());
+    EXPECT_EQ((vector<int>{1, 2}), copied.as<vector<int>>());
+
+    *copied.find(0) = toml::Value(10);
+    EXPECT_FALSE(copied.isPacked());
+    EXPECT_EQ(10, copied.get<int>(0));
+}
+
+TEST(PackedArrayTest, equality)
+{
+    toml::Value v1((toml::Array()));
+    v1.push("x");
+    v1.push("y");
+    toml::Value v2 = v1;
+    v2.pack();
+
+    EXPECT_EQ(v1, v2);
+    EXPECT_EQ(v2, v1);
+
+    toml::Value v3 = v1;
+    v3.pack();
+    EXPECT_EQ(v2, v3);
+    v3.push("z");
+    EXPECT_NE(v2, v3);
+
+    // A packed array is compared element by element with an unpacked one.
+    toml::Value v4 = v1;
+    v4.pack();
+    v1.push("z");
+    EXPECT_NE(v1, v4);
+    EXPECT_NE(v4, v1);
+    toml::Value v5((toml::Array()));
+    v5.push("x");
+    v5.push("yy");
+    EXPECT_NE(v4, v5);
+    EXPECT_NE(v5, v4);
+
+    toml::Value ints((toml::Array()));
+    ints.push(1);
+    ints.push(2);
+    toml::Value doubles((toml::Array()));
+    doubles.push(1.0);
+    doubles.push(2.0);
+    toml::Value packedInts = ints;
+    packedInts.pack();
+    EXPECT_EQ(ints, packedInts);
+    EXPECT_NE(doubles, packedInts);
+}
+
+TEST(PackedArrayTest, getByIndex)
+{
+    toml::Value v((toml::Array()));
+    v.push(10);
+    v.push(20);
+    v.pack();
+    ASSERT_TRUE(v.isPacked());
+    EXPECT_EQ(20, v.get<int>(1));
+    EXPECT_EQ(20, v.get<int64_t>(1));
+    EXPECT_THROW(v.get<string>(1), std::runtime_error);
+    EXPECT_THROW(v.get<int>(2), std::runtime_error);
+
+    toml::Value strings((toml::Array()));
+    strings.push("a");
+    strings.push("bc");
+    strings.pack();
+    ASSERT_TRUE(strings.isPacked());
+    EXPECT_EQ("bc", strings.get<string>(1));
+    EXPECT_THROW(strings.get<int>(0), std::runtime_error);
+
+    toml::Value tables = parse("[[t]]\na = 1\n[[t]]\na = 2\n").get<toml::Array>("t");
+    toml::Value packedTables = tables;
+    packedTables.pack();
+    ASSERT_TRUE(packedTables.isColumnar());
+    EXPECT_EQ(tables, packedTables);
+    EXPECT_EQ(packedTables, tables);
+    EXPECT_EQ(2, packedTables.get<toml::Table>(1).at("a").as<int>());
+}
+
+TEST(PackedArrayTest, parse)
+{
+    toml::Value v = parsePacked(
+        "ints = [1, 2, 3]\n"
+        "doubles = [1.0, 2.0]\n"
+        "nested = [[1, 2], [\"a\"]]\n"
+        "[[tables]]\n"
+        "x = [true]\n");
+
+    EXPECT_TRUE(v.find("ints")->isPacked());
+    EXPECT_TRUE(v.find("doubles")->isPacked());
+    EXPECT_FALSE(v.find("nested")->isPacked());
+    EXPECT_TRUE(v.find("nested")->find(1)->isPacked());
+    EXPECT_TRUE(v.find("tables")->find(0)->find("x")->isPacked());
+
+    EXPECT_EQ(3U, v.get<toml::Span<const int64_t>>("ints").size());
+
+    istringstream ss("ints = [1, 2, 3]");
+    toml::ParseResult pr = toml::parse(ss);
+    ASSERT_TRUE(pr.valid());
+    EXPECT_FALSE(pr.value.find("ints")->isPacked());
+    EXPECT_EQ(*pr.value.find("ints"), *v.find("ints"));
+}
+
+TEST(PackedArrayTest, write)
+{
+    toml::Value v = parsePacked(
+        "a = [1, 2]\n"
+        "b = [\"x\", \"y\"]\n"
+        "[[c]]\n"
+        "d = 1\n");
+
+    ostringstream oss;
+    v.write(&oss);
+
+    istringstream ss(oss.str());
+    toml::ParseResult pr = toml::parse(ss);
+    ASSERT_TRUE(pr.valid()) << oss.str();
+    EXPECT_EQ(v, pr.value);
+}
+
+TEST(PackedArrayTest, columnar)
+{
+    toml::Value v = parsePacked(
+        "[[hosts]]\n"
+        "name = \"alpha\"\n"
+        "port = 80\n"
+        "latency = 1.5\n"
+        "[[hosts]]\n"
+        "name = \"beta\"\n"
+        "port = 8080\n"
+        "latency = 2.5\n"
+        "[[hosts]]\n"
+        "latency = 0.5\n"
+        "port = 443\n"
+        "name = \"gamma\"\n");
+
+    const toml::Value& hosts = *v.find("hosts");
+    ASSERT_TRUE(hosts.isColumnar());
+    EXPECT_TRUE(hosts.is<toml::Array>());
+    EXPECT_EQ(3U, hosts.size());
+
+    const toml::Value* ports = hosts.findColumn("port");
+    ASSERT_TRUE(ports != nullptr);
+    toml::Span<const int64_t> span = ports->as<toml::Span<const int64_t>>();
+    EXPECT_EQ((vector<int64_t>{80, 8080, 443}), vector<int64_t>(span.begin(), span.end()));
+    EXPECT_EQ((vector<double>{1.5, 2.5, 0.5}), hosts.findColumn("latency")->as<vector<double>>());
+    EXPECT_TRUE(hosts.findColumn("unknown") == nullptr);
+
+    toml::RecordView r = hosts.record(1);
+    EXPECT_EQ(1U, r.index());
+    EXPECT_EQ(3U, r.keys().size());
+    EXPECT_TRUE(r.has("name"));
+    EXPECT_FALSE(r.has("unknown"));
+    EXPECT_EQ("beta", r.get<string>("name"));
+    EXPECT_EQ(8080, r.get<int>("port"));
+    EXPECT_FALSE(r.find("unknown").valid());
+    EXPECT_THROW(r.get<int>("unknown"), std::runtime_error);
+    EXPECT_THROW(r.get<string>("port"), std::runtime_error);
+    EXPECT_EQ(2.5, r.toValue().get<double>("latency"));
+    EXPECT_THROW(hosts.record(3), std::runtime_error);
+    EXPECT_THROW(v.record(0), std::runtime_error);
+
+    // Still readable as an array of tables.
+    EXPECT_EQ("gamma", hosts.find(2)->get<string>("name"));
+    EXPECT_EQ(443, v.get<toml::Array>("hosts")[2].get<int>("port"));
+}
+
+TEST(PackedArrayTest, columnarNotUniform)
+{
+    toml::Value v = parsePacked(
+        "[[a]]\n"
+        "x = 1\n"
+        "[[a]]\n"
+        "y = 1\n"
+        "[[b]]\n"
+        "x = 1\n"
+        "[[b]]\n"
+        "x = 2\n"
+        "y = 3\n");
+
+    EXPECT_FALSE(v.find("a")->isPacked());
+    EXPECT_FALSE(v.find("b")->isPacked());
+    EXPECT_FALSE(v.find("a")->isColumnar());
+    EXPECT_TRUE(v.find("a")->findColumn("x") == nullptr);
+}
+
+TEST(PackedArrayTest, columnarModifyAndWrite)
+{
+    toml::Value v = parsePacked(
+        "[[events]]\n"
+        "id = 1\n"
+        "tags = [\"a\", \"b\"]\n"
+        "[events.detail]\n"
+        "ok = true\n"
+        "[[events]]\n"
+        "id = 2\n"
+        "tags = []\n"
+        "[events.detail]\n"
+        "ok = false\n");
+
+    ASSERT_TRUE(v.find("events")->isColumnar());
+    EXPECT_FALSE(v.find("events")->record(1).find("detail").get<bool>("ok"));
+
+    ostringstream oss;
+    v.write(&oss);
+    istringstream ss(oss.str());
+    toml::ParseResult pr = toml::parse(ss);
+    ASSERT_TRUE(pr.valid()) << oss.str();
+    EXPECT_FALSE(pr.value.find("events")->isPacked());
+    EXPECT_EQ(pr.value, v);
+
+    toml::Value copied = v;
+    v.find("events")->find(0)->set("id", 10);
+    EXPECT_FALSE(v.find("events")->isColumnar());
+    EXPECT_EQ(10, v.find("events")->find(0)->get<int>("id"));
+    EXPECT_TRUE(copied.find("events")->isColumnar());
+    EXPECT_EQ(1, copied.find("events")->record(0).get<int>("id"));
+}
@@ -0,0 +1,200 @@
+#include "toml/toml.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "test_helper.h"
+
+#include <dirent.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+class ParseCacheTest : public testing::Test {
+protected:
+    void SetUp() override
+    {
+        char pattern[] = "/tmp/toml_parse_cache_test_XXXXXX";
+        ASSERT_TRUE(mkdtemp(pattern) != nullptr);
+        dir_ = pattern;
+        ASSERT_EQ(0, system(("mkdir " + cacheDir()).c_str()));
+    }
+
+    void TearDown() override
+    {
+        EXPECT_EQ(0, system(("rm -rf " + dir_).c_str()));
+    }
+
+    string cacheDir() const { return dir_ + "/cache"; }
+    string path(const string& name) const { return dir_ + "/" + name; }
+
+    void write(const string& name, const string& content)
+    {
+        ofstream ofs(path(name));
+        ofs << content;
+    }
+
+    vector<string> cacheFiles() const
+    {
+        vector<string> files;
+        DIR* dir = opendir(cacheDir().c_str());
+        while (struct dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] != '.')
+                files.push_back(cacheDir() + "/" + entry->d_name);
+        }
+        closedir(dir);
+        return files;
+    }
+
+    toml::ParseOptions options() const
+    {
+        toml::ParseOptions options;
+        options.cacheDirectory = cacheDir();
+        return options;
+    }
+
+    string dir_;
+};
+
+} // namespace anonymous
+
+TEST_F(ParseCacheTest, hit)
+{
+    write("config.toml", kAppDocument);
+    toml::Value expected = toml::parseFile(path("config.toml")).value;
+
+    toml::ParseResult first = toml::parseFile(path("config.toml"), options());
+    ASSERT_TRUE(first.valid()) << first.errorReason;
+    EXPECT_EQ(expected, first.value);
+    vector<string> files = cacheFiles();
+    ASSERT_EQ(1U, files.size());
+
+    toml::ParseResult second = toml::parseFile(path("config.toml"), options());
+    ASSERT_TRUE(second.valid()) << second.errorReason;
+    EXPECT_EQ(expected, second.value);
+    EXPECT_EQ(files, cacheFiles());
+}
+
+TEST_F(ParseCacheTest, shareable)
+{
+    write("config.toml", kAppDocument);
+    toml::ParseResult miss = toml::parseFile(path("config.toml"), options());
+    toml::ParseResult hit = toml::parseFile(path("config.toml"), options());
+    ASSERT_TRUE(miss.valid());
+    ASSERT_TRUE(hit.valid());
+
+    // A copy shares the subtrees of a parsed document, whether it has been loaded from the cache or not.
+    for (const toml::Value* v : { &miss.value, &hit.value }) {
+        const toml::Value copy = *v;
+        EXPECT_EQ(v->find("server"), copy.find("server"));
+        EXPECT_EQ(v->find("server.ports"), copy.find("server.ports"));
+        EXPECT_EQ(v->find("hosts"), copy.find("hosts"));
+        EXPECT_EQ(v->hash(), copy.hash());
+    }
+}
+
+TEST_F(ParseCacheTest, loadedFromCache)
+{
+    write("config.toml", kAppDocument);
+    ASSERT_TRUE(toml::parseFile(path("config.toml"), options()).valid());
+    vector<string> files = cacheFiles();
+    ASSERT_EQ(1U, files.size());
+
+    // Replaces the cached document with another one, to see that it's used.
+    toml::Value other((toml::Table()));
+    other.set("cached", true);
+    toml::FrozenDocument frozen = toml::freeze(other);
+    string bytes;
+    {
+        ifstream ifs(files[0], ios::binary);
+        bytes.assign((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+    }
+    bytes.resize(sizeof(toml::internal::ParseCacheHeader) + strlen(kAppDocument));
+    bytes.append(frozen.data(), frozen.byteSize());
+    {
+        ofstream ofs(files[0], ios::binary | ios::trunc);
+        ofs << bytes;
+    }
+
+    toml::ParseResult pr = toml::parseFile(path("config.toml"), options());
+    ASSERT_TRUE(pr.valid());
+    EXPECT_TRUE(pr.value.get<bool>("cached"));
+
+    // The same hash and size, but another content, as a hash collision would have.
+    bytes[sizeof(toml::internal::ParseCacheHeader)] ^= 1;
+    {
+        ofstream ofs(files[0], ios::binary | ios::trunc);
+        ofs << bytes;
+    }
+    pr = toml::parseFile(path("config.toml"), options());
+    ASSERT_TRUE(pr.valid());
+    EXPECT_FALSE(pr.value.has("cached"));
+}
+
+TEST_F(ParseCacheTest, invalidation)
+{
+    write("config.toml", "x = 1\n");
+    EXPECT_EQ(1, toml::parseFile(path("config.toml"), options()).value.get<int>("x"));
+
+    write("config.toml", "x = 2\n");
+    EXPECT_EQ(2, toml::parseFile(path("config.toml"), options()).value.get<int>("x"));
+    EXPECT_EQ(2U, cacheFiles().size());
+
+    // A broken cache file is ignored, and written again.
+    for (const string& file : cacheFiles()) {
+        ofstream ofs(file, ios::binary | ios::trunc);
+        ofs << "broken";
+    }
+    EXPECT_EQ(2, toml::parseFile(path("config.toml"), options()).value.get<int>("x"));
+    EXPECT_EQ(2, toml::parseFile(path("config.toml"), options()).value.get<int>("x"));
+}
+
+TEST_F(ParseCacheTest, options)
+{
+    write("config.toml", "xs = [1, 2, 3]\n");
+
+    toml::ParseOptions packed = options();
+    packed.packArrays = true;
+    EXPECT_FALSE(toml::parseFile(path("config.toml"), options()).value.find("xs")->isPacked());
+    EXPECT_TRUE(toml::parseFile(path("config.toml"), packed).value.find("xs")->isPacked());
+    EXPECT_TRUE(toml::parseFile(path("config.toml"), packed).value.find("xs")->isPacked());
+    EXPECT_EQ(2U, cacheFiles().size());
+}
+
+TEST_F(ParseCacheTest, errors)
+{
+    write("config.toml", "x = \n");
+    toml::ParseResult pr = toml::parseFile(path("config.toml"), options());
+    EXPECT_FALSE(pr.valid());
+    EXPECT_FALSE(pr.errorReason.empty());
+    EXPECT_TRUE(cacheFiles().empty());
+
+    EXPECT_FALSE(toml::parseFile(path("nothing.toml"), options()).valid());
+
+    // A missing cache directory only disables the cache.
+    write("ok.toml", "x = 1\n");
+    toml::ParseOptions missing;
+    missing.cacheDirectory = path("nothing");
+    EXPECT_EQ(1, toml::parseFile(path("ok.toml"), missing).value.get<int>("x"));
+}
+
+TEST(FrozenDocumentTest, fromBytes)
+{
+    toml::Value v((toml::Table()));
+    v.set("a.b", 1);
+    toml::FrozenDocument doc = toml::freeze(v);
+
+    toml::FrozenDocument copy = toml::FrozenDocument::fromBytes(doc.data(), doc.byteSize());
+    ASSERT_FALSE(copy.empty());
+    EXPECT_EQ(1, copy.get<int>("a.b"));
+
+    EXPECT_TRUE(toml::FrozenDocument::fromBytes(doc.data(), doc.byteSize() - 1).empty());
+    EXPECT_TRUE(toml::FrozenDocument::fromBytes("broken", 6).empty());
+}
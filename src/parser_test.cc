@@ -1,7 +1,10 @@
 #include "toml/toml.h"
 
+#include <clocale>
+#include <locale>
 #include <sstream>
 #include <string>
+#include <vector>
 #include <gtest/gtest.h>
 
 using namespace std;
@@ -299,6 +302,87 @@ TEST(ParserTest, commentInArray)
     EXPECT_EQ(3, ar[3].as<int>());
 }
 
+TEST(ParserTest, parseLongNumberArray)
+{
+    stringstream input;
+    input << "x = [";
+    for (int i = 0; i < 10000; ++i)
+        input << (i ? ",\n  " : "") << (i % 2 ? -i : i);
+    input << "]\n"
+          << "y = [1.5, -2.0,3e2 , 1_000.5,\n 0.25]\n";
+
+    toml::Value v = parse(input.str());
+
+    const toml::Array& x = v.get<toml::Array>("x");
+    ASSERT_EQ(10000UL, x.size());
+    EXPECT_EQ(0, x[0].as<int>());
+    EXPECT_EQ(-9999, x[9999].as<int>());
+
+    EXPECT_EQ((vector<double>{1.5, -2.0, 300.0, 1000.5, 0.25}), v.get<vector<double>>("y"));
+}
+
+TEST(ParserTest, parseNumberArrayFallback)
+{
+    toml::Value v = parse(
+        "x = [1, 2, # comment\n"
+        "  3, +4, 1_000, 9223372036854775807, -9223372036854775808,]\n"
+        "y = [[1, 2], [3.5]]\n");
+
+    EXPECT_EQ((vector<int64_t>{1, 2, 3, 4, 1000, INT64_MAX, INT64_MIN}), v.get<vector<int64_t>>("x"));
+    EXPECT_EQ((vector<int>{1, 2}), v.find("y")->find(0)->as<vector<int>>());
+    EXPECT_EQ(3.5, v.find("y")->find(1)->get<double>(0));
+
+    const char* mismatches[] = {
+        "x = [1, 2.0]",
+        "x = [1.0, 2]",
+        "x = [1, 1979-05-27]",
+        "x = [1, \"a\"]",
+    };
+    for (const char* s : mismatches) {
+        stringstream ss(s);
+        toml::internal::Parser p(ss);
+        EXPECT_FALSE(p.parse().valid()) << s;
+    }
+}
+
+namespace {
+
+// A numpunct which uses ',' as the decimal point, as German does.
+class CommaNumpunct : public numpunct<char> {
+protected:
+    char do_decimal_point() const override { return ','; }
+};
+
+} // namespace anonymous
+
+TEST(ParserTest, parseDoubleInLocale)
+{
+    // Both the C locale, if any comma-decimal one is installed, and the C++ global locale.
+    string previous = setlocale(LC_ALL, nullptr);
+    const char* names[] = { "de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8", "German" };
+    for (const char* name : names) {
+        if (setlocale(LC_ALL, name))
+            break;
+    }
+    locale previousGlobal = locale::global(locale(locale::classic(), new CommaNumpunct));
+
+    toml::Value v = parse("x = 3.14\ny = [1.5, -2.25e1]\n");
+    double z = 0;
+    bool parsed = toml::internal::parseDouble("2.5", &z);
+
+    locale::global(previousGlobal);
+    setlocale(LC_ALL, previous.c_str());
+
+    EXPECT_EQ(3.14, v.get<double>("x"));
+    EXPECT_EQ((vector<double>{1.5, -22.5}), v.get<vector<double>>("y"));
+    EXPECT_TRUE(parsed);
+    EXPECT_EQ(2.5, z);
+
+    // The whole string must be a double.
+    EXPECT_FALSE(toml::internal::parseDouble("2.5x", &z));
+    EXPECT_FALSE(toml::internal::parseDouble("1e999", &z));
+}
+
 TEST(ParserTest, parseNumberKey)
 {
     toml::Value v = parse(
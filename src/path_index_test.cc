@@ -0,0 +1,200 @@
+#include "toml/toml.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "test_helper.h"
+
+using namespace std;
+
+namespace {
+
+vector<string> paths(pair<toml::PathIndex::const_iterator, toml::PathIndex::const_iterator> range)
+{
+    vector<string> result;
+    for (auto it = range.first; it != range.second; ++it)
+        result.push_back(it->first);
+    return result;
+}
+
+// Checks that |index| has the same entries as the one built from |v|.
+void expectBuilt(const toml::Value& v, const toml::PathIndex& index)
+{
+    toml::PathIndex rebuilt(v);
+    ASSERT_EQ(rebuilt.size(), index.size());
+    for (auto it = rebuilt.begin(), jt = index.begin(); it != rebuilt.end(); ++it, ++jt) {
+        EXPECT_EQ(it->first, jt->first);
+        EXPECT_EQ(it->second, jt->second) << it->first;
+        EXPECT_EQ(it->second, index.find(it->first)) << it->first;
+    }
+}
+
+const char kDocument[] =
+    "name = \"app\"\n"
+    "[features]\n"
+    "a = true\n"
+    "b = false\n"
+    "[features.c]\n"
+    "enabled = true\n"
+    "[features-x]\n"
+    "y = 1\n"
+    "[servers.\"web.1\"]\n"
+    "ports = [80, 443]\n";
+
+} // namespace anonymous
+
+TEST(PathIndexTest, find)
+{
+    toml::Value v = parse(kDocument);
+    toml::PathIndex index(v);
+
+    EXPECT_EQ(11U, index.size());
+    EXPECT_EQ(v.find("name"), index.find("name"));
+    EXPECT_EQ(v.find("features"), index.find("features"));
+    EXPECT_EQ(v.find("features.c.enabled"), index.find("features.c.enabled"));
+    EXPECT_EQ(v.find("servers.\"web.1\".ports"), index.find("servers.\"web.1\".ports"));
+    EXPECT_TRUE(index.has("features-x.y"));
+
+    EXPECT_TRUE(index.find("nothing") == nullptr);
+    EXPECT_TRUE(index.find("features.d") == nullptr);
+    // Arrays are leaves.
+    EXPECT_TRUE(index.find("servers.\"web.1\".ports.0") == nullptr);
+    // Not canonical.
+    EXPECT_TRUE(index.find("servers.web.1.ports") == nullptr);
+}
+
+TEST(PathIndexTest, scan)
+{
+    toml::Value v = parse(kDocument);
+    toml::PathIndex index(v);
+
+    EXPECT_EQ((vector<string> { "features.a", "features.b", "features.c", "features.c.enabled" }),
+              paths(index.scan("features")));
+    EXPECT_EQ((vector<string> { "features.c.enabled" }), paths(index.scan("features.c")));
+    EXPECT_TRUE(paths(index.scan("name")).empty());
+    EXPECT_TRUE(paths(index.scan("nothing")).empty());
+    EXPECT_EQ(index.size(), paths(index.scan("")).size());
+}
+
+TEST(PathIndexTest, empty)
+{
+    toml::PathIndex index;
+    EXPECT_TRUE(index.empty());
+    EXPECT_TRUE(index.find("a") == nullptr);
+
+    index.build(toml::Value(1));
+    EXPECT_TRUE(index.empty());
+}
+
+TEST(PathIndexTest, update)
+{
+    toml::Value v = parse(kDocument);
+    toml::PathIndex index(v);
+
+    v.find("features")->erase("b");
+    v.set("features.c.level", 3);
+    v.find("features")->setChild("d", 4);
+    index.update(v, "features");
+
+    EXPECT_EQ((vector<string> { "features.a", "features.c", "features.c.enabled", "features.c.level", "features.d" }),
+              paths(index.scan("features")));
+    EXPECT_EQ(4, index.find("features.d")->as<int>());
+    EXPECT_EQ(3, index.find("features.c.level")->as<int>());
+    EXPECT_TRUE(index.find("features.b") == nullptr);
+    EXPECT_EQ(v.find("features"), index.find("features"));
+    EXPECT_TRUE(index.has("features-x.y"));
+    EXPECT_TRUE(index.has("name"));
+
+    // Removed.
+    v.erase("features");
+    index.update(v, "features");
+    EXPECT_TRUE(index.find("features") == nullptr);
+    EXPECT_TRUE(paths(index.scan("features")).empty());
+    EXPECT_TRUE(index.has("features-x.y"));
+
+    // Added.
+    v.set("features.z", 1);
+    index.update(v, "features");
+    EXPECT_EQ((vector<string> { "features.z" }), paths(index.scan("features")));
+
+    expectBuilt(v, index);
+}
+
+TEST(PathIndexTest, updateNonCanonicalPath)
+{
+    toml::Value v = parse(kDocument);
+    toml::PathIndex index(v);
+
+    // A quoted or spaced path updates the same entries as the canonical one.
+    v.find("features")->erase("b");
+    v.set("features.c.level", 3);
+    index.update(v, "\"features\" . c");
+    index.update(v, "features . b");
+    EXPECT_EQ(3, index.find("features.c.level")->as<int>());
+    EXPECT_TRUE(index.find("features.b") == nullptr);
+
+    v.find("servers")->find("\"web.1\"")->setChild("host", "a");
+    index.update(v, "servers . \"web.1\"");
+    EXPECT_EQ("a", index.find("servers.\"web.1\".host")->as<string>());
+    expectBuilt(v, index);
+}
+
+TEST(PathIndexTest, updateCopiedOnWrite)
+{
+    toml::Value v = parse(kDocument);
+    toml::PathIndex index(v);
+
+    // The snapshot shares the tables, so editing "features.c" copies the root, "features" and
+    // "features.c", and the children of them move.
+    const toml::Value snapshot = v;
+    v.set("features.c.level", 3);
+    index.update(v, "features.c");
+    expectBuilt(v, index);
+    EXPECT_EQ(snapshot.find("features.c.enabled"), toml::PathIndex(snapshot).find("features.c.enabled"));
+
+    // A non-shareable table is deep-copied instead of shared, so its descendants move too.
+    v.find("servers")->setChild("db", 1);
+    index.update(v, "servers.db");
+    const toml::Value snapshot2 = v;
+    v.set("name", "other");
+    index.update(v, "name");
+    expectBuilt(v, index);
+    EXPECT_EQ("other", index.find("name")->as<string>());
+
+    // A new key in an existing table moves its siblings.
+    for (int i = 0; i < 20; ++i) {
+        v.set("features.n" + to_string(i), i);
+        index.update(v, "features.n" + to_string(i));
+    }
+    expectBuilt(v, index);
+}
+
+TEST(PathIndexTest, large)
+{
+    toml::Value v((toml::Table()));
+    for (int i = 0; i < 1000; ++i) {
+        for (int j = 0; j < 10; ++j)
+            v.set("t" + to_string(i) + ".k" + to_string(j), i * 10 + j);
+    }
+
+    toml::PathIndex index(v);
+    EXPECT_EQ(11000U, index.size());
+    for (int i = 0; i < 1000; ++i) {
+        for (int j = 0; j < 10; ++j) {
+            const toml::Value* x = index.find("t" + to_string(i) + ".k" + to_string(j));
+            ASSERT_TRUE(x != nullptr);
+            EXPECT_EQ(i * 10 + j, x->as<int>());
+        }
+    }
+    EXPECT_EQ(10U, paths(index.scan("t500")).size());
+
+    // Removing entries keeps the others reachable in the hash table.
+    for (int i = 0; i < 1000; i += 2) {
+        v.erase("t" + to_string(i));
+        index.update(v, "t" + to_string(i));
+    }
+    EXPECT_EQ(5500U, index.size());
+    expectBuilt(v, index);
+}
@@ -0,0 +1,72 @@
+#include "toml/toml.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "test_helper.h"
+
+using namespace std;
+
+TEST(PathTest, split)
+{
+    toml::Path path("server.tls.enabled");
+    EXPECT_TRUE(path.valid());
+    EXPECT_EQ((vector<string> { "server", "tls", "enabled" }), path.keys());
+    EXPECT_EQ("server.tls.enabled", path.toString());
+
+    toml::Path quoted("\"x.y\".z");
+    EXPECT_TRUE(quoted.valid());
+    EXPECT_EQ((vector<string> { "x.y", "z" }), quoted.keys());
+    EXPECT_EQ("\"x.y\".z", quoted.toString());
+
+    EXPECT_FALSE(toml::Path("a..b").valid());
+    EXPECT_FALSE(toml::Path("").valid());
+    EXPECT_FALSE(toml::Path().valid());
+
+    EXPECT_EQ(toml::Path("a.b"), toml::Path(vector<string> { "a", "b" }));
+}
+
+TEST(PathTest, find)
+{
+    toml::Value v = parse(kAppDocument);
+
+    EXPECT_EQ(v.find("server.tls.enabled"), v.find(toml::Path("server.tls.enabled")));
+    EXPECT_EQ(v.find("\"x.y\".z"), v.find(toml::Path("\"x.y\".z")));
+    EXPECT_TRUE(v.find(toml::Path("server.nothing")) == nullptr);
+    EXPECT_TRUE(v.find(toml::Path("name.nothing")) == nullptr);
+    EXPECT_TRUE(v.find(toml::Path("a..b")) == nullptr);
+}
+
+TEST(PathTest, staticPath)
+{
+    static_assert(toml::internal::isStaticKey("a", 1), "");
+    static_assert(toml::internal::isStaticKey("server.http-2.port_1", 20), "");
+    static_assert(!toml::internal::isStaticKey("", 0), "");
+    static_assert(!toml::internal::isStaticKey("a.", 2), "");
+    static_assert(!toml::internal::isStaticKey(".a", 2), "");
+    static_assert(!toml::internal::isStaticKey("a..b", 4), "");
+    static_assert(!toml::internal::isStaticKey("a b", 3), "");
+    static_assert(!toml::internal::isStaticKey("\"a\"", 3), "");
+
+    toml::Value v = parse(kAppDocument);
+
+    EXPECT_EQ((vector<string> { "server", "tls", "enabled" }), TOML_PATH("server.tls.enabled").keys());
+    EXPECT_EQ(toml::Path("server.tls.enabled"), TOML_PATH("server.tls.enabled"));
+    EXPECT_EQ(8080, v.get<int>(TOML_PATH("server.port")));
+    EXPECT_EQ("app", v.get<string>(TOML_PATH("name")));
+    EXPECT_TRUE(v.has(TOML_PATH("server.tls")));
+    EXPECT_FALSE(v.has(TOML_PATH("server.nothing")));
+    EXPECT_THROW(v.get<int>(TOML_PATH("server.nothing")), std::runtime_error);
+    EXPECT_THROW(v.get<int>(TOML_PATH("server.host")), std::runtime_error);
+
+    // The same path object is returned every time.
+    const toml::Path* first = nullptr;
+    for (int i = 0; i < 2; ++i) {
+        const toml::Path& path = TOML_PATH("server.port");
+        if (!first)
+            first = &path;
+        EXPECT_EQ(first, &path);
+    }
+}
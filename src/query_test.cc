@@ -0,0 +1,196 @@
+#include "toml/toml.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "test_helper.h"
+
+using namespace std;
+
+namespace {
+
+const char kDocument[] =
+    "[servers.alpha]\n"
+    "port = 80\n"
+    "[servers.beta]\n"
+    "port = 8080\n"
+    "[servers.gamma]\n"
+    "host = \"gamma\"\n"
+    "[[hosts]]\n"
+    "name = \"a\"\n"
+    "enabled = true\n"
+    "weight = 1\n"
+    "checks = [{ interval = 10 }, { interval = 20 }]\n"
+    "[[hosts]]\n"
+    "name = \"b\"\n"
+    "enabled = false\n"
+    "weight = 2.5\n"
+    "checks = [{ interval = 30 }]\n"
+    "[[hosts]]\n"
+    "name = \"c\"\n"
+    "enabled = true\n"
+    "weight = 3\n"
+    "tls = true\n"
+    "checks = []\n";
+
+vector<int64_t> ints(const vector<const toml::Value*>& results)
+{
+    vector<int64_t> xs;
+    for (const toml::Value* v : results)
+        xs.push_back(v->as<int64_t>());
+    return xs;
+}
+
+vector<string> strings(const vector<const toml::Value*>& results)
+{
+    vector<string> xs;
+    for (const toml::Value* v : results)
+        xs.push_back(v->as<string>());
+    return xs;
+}
+
+} // namespace anonymous
+
+TEST(QueryTest, keys)
+{
+    toml::Value v = parse(kDocument);
+    vector<const toml::Value*> results;
+
+    toml::Query("servers.alpha.port").evaluate(v, &results);
+    EXPECT_EQ((vector<int64_t> { 80 }), ints(results));
+
+    toml::Query("servers.delta.port").evaluate(v, &results);
+    EXPECT_TRUE(results.empty());
+
+    toml::Query("servers").evaluate(v, &results);
+    ASSERT_EQ(1U, results.size());
+    EXPECT_EQ(v.find("servers"), results[0]);
+}
+
+TEST(QueryTest, wildcards)
+{
+    toml::Value v = parse(kDocument);
+    vector<const toml::Value*> results;
+
+    toml::Query("servers.*.port").evaluate(v, &results);
+    EXPECT_EQ((vector<int64_t> { 80, 8080 }), ints(results));
+
+    toml::Query("**.interval").evaluate(v, &results);
+    EXPECT_EQ((vector<int64_t> { 10, 20, 30 }), ints(results));
+
+    toml::Query("**.name").evaluate(v, &results);
+    EXPECT_EQ((vector<string> { "a", "b", "c" }), strings(results));
+}
+
+TEST(QueryTest, indices)
+{
+    toml::Value v = parse(kDocument);
+    vector<const toml::Value*> results;
+
+    toml::Query("hosts[*].checks[0].interval").evaluate(v, &results);
+    EXPECT_EQ((vector<int64_t> { 10, 30 }), ints(results));
+
+    toml::Query("hosts[-1].name").evaluate(v, &results);
+    EXPECT_EQ((vector<string> { "c" }), strings(results));
+
+    toml::Query("hosts[3].name").evaluate(v, &results);
+    EXPECT_TRUE(results.empty());
+
+    toml::Query("hosts[1:].name").evaluate(v, &results);
+    EXPECT_EQ((vector<string> { "b", "c" }), strings(results));
+
+    toml::Query("hosts[:-1].name").evaluate(v, &results);
+    EXPECT_EQ((vector<string> { "a", "b" }), strings(results));
+
+    toml::Query("hosts[ 0 : 100 ].name").evaluate(v, &results);
+    EXPECT_EQ((vector<string> { "a", "b", "c" }), strings(results));
+}
+
+TEST(QueryTest, filters)
+{
+    toml::Value v = parse(kDocument);
+    vector<const toml::Value*> results;
+
+    toml::Query("hosts[?(enabled == true)].name").evaluate(v, &results);
+    EXPECT_EQ((vector<string> { "a", "c" }), strings(results));
+
+    toml::Query("hosts[?(name != \"a\")].name").evaluate(v, &results);
+    EXPECT_EQ((vector<string> { "b", "c" }), strings(results));
+
+    // int and double are compared as numbers.
+    toml::Query("hosts[?(weight >= 2.5)].name").evaluate(v, &results);
+    EXPECT_EQ((vector<string> { "b", "c" }), strings(results));
+
+    toml::Query("hosts[?(weight < 3)].name").evaluate(v, &results);
+    EXPECT_EQ((vector<string> { "a", "b" }), strings(results));
+
+    toml::Query("hosts[?(tls)].name").evaluate(v, &results);
+    EXPECT_EQ((vector<string> { "c" }), strings(results));
+
+    // Not ordered.
+    toml::Query("hosts[?(name < 1)].name").evaluate(v, &results);
+    EXPECT_TRUE(results.empty());
+}
+
+TEST(QueryTest, quotedKeys)
+{
+    toml::Value v = parse("[a]\n\"b.c\" = 1\n\"d\\\"e\" = 2\n");
+    vector<const toml::Value*> results;
+
+    toml::Query("a.\"b.c\"").evaluate(v, &results);
+    EXPECT_EQ((vector<int64_t> { 1 }), ints(results));
+
+    toml::Query("a.\"d\\\"e\"").evaluate(v, &results);
+    EXPECT_EQ((vector<int64_t> { 2 }), ints(results));
+}
+
+TEST(QueryTest, evaluateFirst)
+{
+    toml::Value v = parse(kDocument);
+
+    const toml::Value* x = toml::Query("**.interval").evaluateFirst(v);
+    ASSERT_TRUE(x != nullptr);
+    EXPECT_EQ(10, x->as<int>());
+
+    EXPECT_TRUE(toml::Query("**.nothing").evaluateFirst(v) == nullptr);
+}
+
+TEST(QueryTest, reuseResults)
+{
+    toml::Value v = parse(kDocument);
+    toml::Query query("**.interval");
+
+    vector<const toml::Value*> results;
+    query.evaluate(v, &results);
+    const toml::Value* const* data = results.data();
+    query.evaluate(v, &results);
+    EXPECT_EQ(data, results.data());
+    EXPECT_EQ(3U, results.size());
+}
+
+TEST(QueryTest, packedArrays)
+{
+    toml::Value v = parse("xs = [1, 2, 3]\n[[t]]\na = 1\n[[t]]\na = 2\n");
+    v.pack();
+    vector<const toml::Value*> results;
+
+    toml::Query("xs[1:]").evaluate(v, &results);
+    EXPECT_EQ((vector<int64_t> { 2, 3 }), ints(results));
+
+    toml::Query("t[?(a > 1)].a").evaluate(v, &results);
+    EXPECT_EQ((vector<int64_t> { 2 }), ints(results));
+}
+
+TEST(QueryTest, invalid)
+{
+    EXPECT_THROW(toml::Query(""), std::runtime_error);
+    EXPECT_THROW(toml::Query("a..b"), std::runtime_error);
+    EXPECT_THROW(toml::Query("a[1"), std::runtime_error);
+    EXPECT_THROW(toml::Query("a[x]"), std::runtime_error);
+    EXPECT_THROW(toml::Query("a[?(b == )]"), std::runtime_error);
+    EXPECT_THROW(toml::Query("a[?(b == 1]"), std::runtime_error);
+    EXPECT_THROW(toml::Query("\"a"), std::runtime_error);
+    EXPECT_THROW(toml::Query("a b"), std::runtime_error);
+}
@@ -0,0 +1,181 @@
+#include "toml/shm.h"
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "test_helper.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// Returns a name which is unique to this process and test.
+string sharedName(const char* test)
+{
+    return "/tinytoml-test-" + to_string(::getpid()) + "-" + test;
+}
+
+class SharedTest : public testing::Test {
+protected:
+    void SetUp() override
+    {
+        name_ = sharedName(testing::UnitTest::GetInstance()->current_test_info()->name());
+        toml::SharedPublisher::remove(name_);
+    }
+    void TearDown() override { toml::SharedPublisher::remove(name_); }
+
+    string name_;
+};
+
+} // namespace anonymous
+
+TEST_F(SharedTest, publishAndAttach)
+{
+    toml::SharedAttacher attacher(name_);
+    EXPECT_FALSE(attacher.refresh());
+    EXPECT_EQ(nullptr, attacher.load().get());
+
+    toml::SharedPublisher publisher(name_);
+    EXPECT_EQ(0U, publisher.version());
+    EXPECT_FALSE(attacher.refresh());
+
+    EXPECT_EQ(1U, publisher.publish(parse("[server]\nhost = \"a\"\nports = [80, 443]\n")));
+    EXPECT_TRUE(attacher.refresh());
+    EXPECT_FALSE(attacher.refresh());
+    EXPECT_EQ(1U, attacher.version());
+
+    toml::SharedAttacher::Guard first = attacher.load();
+    ASSERT_NE(nullptr, first.get());
+    EXPECT_EQ("a", first->view().get<string>("server.host"));
+    EXPECT_EQ(443, first->view().find("server.ports").at(1).as<int>());
+
+    EXPECT_EQ(2U, publisher.publish(parse("[server]\nhost = \"b\"\n")));
+    EXPECT_TRUE(attacher.refresh());
+    EXPECT_EQ(2U, attacher.version());
+    EXPECT_EQ("b", attacher.load()->view().get<string>("server.host"));
+    EXPECT_FALSE(attacher.load()->view().has("server.ports"));
+
+    // The previous document stays mapped while it's referred.
+    EXPECT_EQ("a", first->view().get<string>("server.host"));
+}
+
+TEST_F(SharedTest, skipsUnlinkedVersions)
+{
+    toml::SharedPublisher publisher(name_);
+    toml::SharedAttacher attacher(name_);
+    for (int i = 1; i <= 5; ++i)
+        publisher.publish(parse("n = " + to_string(i) + "\n"));
+
+    EXPECT_TRUE(attacher.refresh());
+    EXPECT_EQ(5U, attacher.version());
+    EXPECT_EQ(5, attacher.load()->view().get<int>("n"));
+}
+
+TEST_F(SharedTest, publisherRestart)
+{
+    {
+        toml::SharedPublisher publisher(name_);
+        publisher.publish(parse("n = 1\n"));
+    }
+
+    // The documents outlive the publisher, and a new publisher continues the versions.
+    toml::SharedAttacher attacher(name_);
+    EXPECT_TRUE(attacher.refresh());
+    EXPECT_EQ(1, attacher.load()->view().get<int>("n"));
+
+    toml::SharedPublisher publisher(name_);
+    EXPECT_EQ(1U, publisher.version());
+    EXPECT_EQ(2U, publisher.publish(parse("n = 2\n")));
+    EXPECT_TRUE(attacher.refresh());
+    EXPECT_EQ(2, attacher.load()->view().get<int>("n"));
+}
+
+TEST_F(SharedTest, remove)
+{
+    {
+        toml::SharedPublisher publisher(name_);
+        publisher.publish(parse("n = 1\n"));
+    }
+    toml::SharedAttacher mapped(name_);
+    EXPECT_TRUE(mapped.refresh());
+
+    toml::SharedPublisher::remove(name_);
+    toml::SharedAttacher attacher(name_);
+    EXPECT_FALSE(attacher.refresh());
+    EXPECT_EQ(1, mapped.load()->view().get<int>("n"));
+}
+
+TEST_F(SharedTest, processes)
+{
+    const int kChildren = 3;
+
+    toml::SharedPublisher publisher(name_);
+    publisher.publish(parse("n = 1\n"));
+
+    int ready[2], go[2];
+    ASSERT_EQ(0, ::pipe(ready));
+    ASSERT_EQ(0, ::pipe(go));
+
+    vector<pid_t> children;
+    for (int i = 0; i < kChildren; ++i) {
+        pid_t pid = ::fork();
+        ASSERT_LE(0, pid);
+        if (pid > 0) {
+            children.push_back(pid);
+            continue;
+        }
+
+        // The child exits with the number of the failed check.
+        toml::SharedAttacher attacher(name_);
+        if (!attacher.refresh())
+            ::_exit(1);
+        toml::SharedAttacher::Guard first = attacher.load();
+        if (first->view().get<int>("n") != 1)
+            ::_exit(2);
+
+        char c = 0;
+        if (::write(ready[1], &c, 1) != 1 || ::read(go[0], &c, 1) != 1)
+            ::_exit(3);
+
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+        while (attacher.version() != 2) {
+            if (chrono::steady_clock::now() > deadline)
+                ::_exit(4);
+            if (!attacher.refresh())
+                this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        if (attacher.load()->view().get<int>("n") != 2)
+            ::_exit(5);
+        if (first->view().get<int>("n") != 1)
+            ::_exit(6);
+        ::_exit(0);
+    }
+
+    for (int i = 0; i < kChildren; ++i) {
+        char c;
+        ASSERT_EQ(1, ::read(ready[0], &c, 1));
+    }
+    publisher.publish(parse("n = 2\n"));
+    for (int i = 0; i < kChildren; ++i) {
+        char c = 0;
+        ASSERT_EQ(1, ::write(go[1], &c, 1));
+    }
+
+    for (pid_t pid : children) {
+        int status = 0;
+        ASSERT_EQ(pid, ::waitpid(pid, &status, 0));
+        ASSERT_TRUE(WIFEXITED(status));
+        EXPECT_EQ(0, WEXITSTATUS(status));
+    }
+    ::close(ready[0]);
+    ::close(ready[1]);
+    ::close(go[0]);
+    ::close(go[1]);
+}
@@ -0,0 +1,94 @@
+// Compares table policies. This is built once for each policy. See CMakeLists.txt.
+//   $ ./table_bench_map; ./table_bench_flat; ./table_bench_hash; ./table_bench_ordered
+#include "toml/toml.h"
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define TOML_STRINGIFY_(x) #x
+#define TOML_STRINGIFY(x) TOML_STRINGIFY_(x)
+
+namespace {
+
+double elapsedMillis(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+} // namespace anonymous
+
+int main(int argc, char* argv[])
+{
+    const int numTables = argc >= 2 ? stoi(argv[1]) : 1000;
+    const int numKeys = argc >= 3 ? stoi(argv[2]) : 50;
+    const int repeat = 20;
+
+    vector<string> keys;
+    for (int i = 0; i < numKeys; ++i)
+        keys.push_back("key_" + to_string((i * 7919) % numKeys));
+
+    stringstream doc;
+    for (int t = 0; t < numTables; ++t) {
+        doc << "[table" << t << "]\n";
+        for (int i = 0; i < numKeys; ++i)
+            doc << keys[i] << " = " << i << "\n";
+    }
+    const string text = doc.str();
+
+    auto start = chrono::steady_clock::now();
+    toml::Value v;
+    for (int r = 0; r < repeat; ++r) {
+        istringstream ss(text);
+        v = toml::parse(ss).value;
+    }
+    double parseMillis = elapsedMillis(start) / repeat;
+
+    vector<string> tableNames;
+    for (int t = 0; t < numTables; ++t)
+        tableNames.push_back("table" + to_string(t));
+
+    start = chrono::steady_clock::now();
+    int64_t sum = 0;
+    for (int r = 0; r < repeat; ++r) {
+        for (const string& tableName : tableNames) {
+            const toml::Value* table = v.findChild(tableName);
+            for (const string& key : keys)
+                sum += table->findChild(key)->as<int64_t>();
+        }
+    }
+    double findMillis = elapsedMillis(start) / repeat;
+
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < repeat; ++r) {
+        for (const auto& table : v.as<toml::Table>()) {
+            for (const auto& kv : table.second.as<toml::Table>())
+                sum += kv.second.as<int64_t>();
+        }
+    }
+    double iterateMillis = elapsedMillis(start) / repeat;
+
+    toml::FrozenDocument frozen = toml::freeze(v);
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < repeat; ++r) {
+        for (const string& tableName : tableNames) {
+            toml::FrozenValue table = frozen.root().findChild(tableName);
+            for (const string& key : keys)
+                sum += table.findChild(key).as<int64_t>();
+        }
+    }
+    double frozenFindMillis = elapsedMillis(start) / repeat;
+
+    cout << TOML_STRINGIFY(TOML_TABLE_POLICY) << ": "
+         << numTables << " tables x " << numKeys << " keys" << endl
+         << "  parse:   " << parseMillis << " ms" << endl
+         << "  find:    " << findMillis << " ms" << endl
+         << "  iterate: " << iterateMillis << " ms" << endl
+         << "  frozen find: " << frozenFindMillis << " ms (" << frozen.byteSize() << " bytes, source "
+         << text.size() << " bytes)" << endl
+         << "  (checksum " << sum << ")" << endl;
+}
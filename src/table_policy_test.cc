@@ -0,0 +1,285 @@
+// This test is built once for each table policy. See CMakeLists.txt.
+#include "toml/toml.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "test_helper.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+TEST(TablePolicyTest, setFindErase)
+{
+    toml::Value v;
+    v.set("b", 2);
+    v.set("a", 1);
+    v.set("c.d", 3);
+
+    EXPECT_EQ(1, v.get<int>("a"));
+    EXPECT_EQ(2, v.get<int>("b"));
+    EXPECT_EQ(3, v.get<int>("c.d"));
+    EXPECT_EQ(nullptr, v.find("x"));
+
+    EXPECT_TRUE(v.erase("b"));
+    EXPECT_FALSE(v.erase("b"));
+    EXPECT_EQ(nullptr, v.find("b"));
+    EXPECT_EQ(2U, v.size());
+}
+
+TEST(TablePolicyTest, manyKeys)
+{
+    toml::Value v;
+    for (int i = 0; i < 1000; ++i)
+        v.set("key" + to_string((i * 7919) % 1000), i);
+    EXPECT_EQ(1000U, v.size());
+
+    for (int i = 0; i < 1000; ++i)
+        EXPECT_EQ(i, v.get<int>("key" + to_string((i * 7919) % 1000)));
+
+    for (int i = 0; i < 1000; i += 2)
+        EXPECT_TRUE(v.eraseChild("key" + to_string(i)));
+    EXPECT_EQ(500U, v.size());
+    for (int i = 0; i < 1000; ++i)
+        EXPECT_EQ(i % 2 == 1, v.has("key" + to_string(i))) << i;
+}
+
+TEST(TablePolicyTest, equality)
+{
+    toml::Value v1;
+    v1.set("a", 1);
+    v1.set("b", "foo");
+
+    toml::Value v2;
+    v2.set("b", "foo");
+    v2.set("a", 1);
+
+    EXPECT_EQ(v1, v2);
+
+    v2.set("a", 2);
+    EXPECT_NE(v1, v2);
+}
+
+TEST(TablePolicyTest, parseAndWrite)
+{
+    toml::Value v = parse(
+        "x = 1\n"
+        "a = [1, 2]\n"
+        "[table]\n"
+        "key = \"value\"\n"
+        "[[array]]\n"
+        "b = 1\n"
+        "[[array]]\n"
+        "b = 2\n");
+
+    EXPECT_EQ(1, v.get<int>("x"));
+    EXPECT_EQ("value", v.get<string>("table.key"));
+    EXPECT_EQ(2U, v.find("array")->size());
+
+    ostringstream os;
+    os << v;
+    EXPECT_EQ(v, parse(os.str()));
+}
+
+TEST(TablePolicyTest, iterationOrder)
+{
+    toml::Value v;
+    v.set("c", 1);
+    v.set("a", 2);
+    v.set("b", 3);
+
+    vector<string> keys;
+    for (const auto& kv : v.as<toml::Table>())
+        keys.push_back(kv.first);
+
+    if (toml::TablePolicy::sorted)
+        EXPECT_EQ((vector<string> { "a", "b", "c" }), keys);
+    else if (is_same<toml::TablePolicy, toml::OrderedTablePolicy>::value)
+        EXPECT_EQ((vector<string> { "c", "a", "b" }), keys);
+    else
+        EXPECT_EQ(3U, keys.size());
+}
+
+#if defined(__linux__)
+TEST(TablePolicyTest, parseCacheKeepsOrder)
+{
+    char pattern[] = "/tmp/toml_table_policy_test_XXXXXX";
+    ASSERT_TRUE(mkdtemp(pattern) != nullptr);
+    const string dir = pattern;
+    {
+        ofstream ofs(dir + "/config.toml");
+        ofs << "c = 1\na = 2\nb = 3\n";
+    }
+
+    toml::ParseOptions options;
+    options.cacheDirectory = dir;
+    toml::Value expected = toml::parseFile(dir + "/config.toml").value;
+    for (int i = 0; i < 2; ++i) {
+        // The second parse would be a cache hit.
+        toml::Value v = toml::parseFile(dir + "/config.toml", options).value;
+        vector<string> keys, expectedKeys;
+        for (const auto& kv : v.as<toml::Table>())
+            keys.push_back(kv.first);
+        for (const auto& kv : expected.as<toml::Table>())
+            expectedKeys.push_back(kv.first);
+        EXPECT_EQ(expectedKeys, keys);
+    }
+    EXPECT_EQ(0, system(("rm -rf " + dir).c_str()));
+}
+#endif
+
+TEST(TablePolicyTest, eraseAndFind)
+{
+    toml::Value v;
+    for (int i = 0; i < 100; ++i)
+        v.set("key" + to_string(i), i);
+    for (int i = 0; i < 100; i += 3)
+        EXPECT_TRUE(v.eraseChild("key" + to_string(i)));
+
+    for (int i = 0; i < 100; ++i) {
+        const toml::Value* x = v.findChild("key" + to_string(i));
+        if (i % 3 == 0) {
+            EXPECT_EQ(nullptr, x) << i;
+        } else {
+            ASSERT_NE(nullptr, x) << i;
+            EXPECT_EQ(i, x->as<int>());
+        }
+    }
+
+    // An erased key can be set again.
+    v.set("key0", -1);
+    EXPECT_EQ(-1, v.get<int>("key0"));
+    EXPECT_EQ(67U, v.size());
+
+    vector<string> keys;
+    for (const auto& kv : v.as<toml::Table>())
+        keys.push_back(kv.first);
+    if (is_same<toml::TablePolicy, toml::OrderedTablePolicy>::value) {
+        EXPECT_EQ("key1", keys.front());
+        EXPECT_EQ("key98", keys[keys.size() - 2]);
+        EXPECT_EQ("key0", keys.back());
+    }
+}
+
+TEST(TablePolicyTest, columnarEquality)
+{
+    toml::Value v1 = parse("[[t]]\na = 1\nb = \"x\"\n[[t]]\na = 2\nb = \"y\"\n");
+    toml::Value v2 = parse("[[t]]\nb = \"x\"\na = 1\n[[t]]\nb = \"y\"\na = 2\n");
+    v1.pack();
+    v2.pack();
+    ASSERT_TRUE(v1.find("t")->isColumnar());
+    ASSERT_TRUE(v2.find("t")->isColumnar());
+
+    // The keys may be in different orders in the columns.
+    EXPECT_EQ(v1, v2);
+    EXPECT_EQ(v1.hash(), v2.hash());
+    EXPECT_TRUE(toml::diff(v1, v2).changes.empty());
+
+    toml::Value v3 = parse("[[t]]\nb = \"x\"\na = 1\n[[t]]\nb = \"z\"\na = 2\n");
+    v3.pack();
+    EXPECT_NE(v1, v3);
+}
+
+// The types are in an inline namespace named after the policy.
+static_assert(is_same<toml::Value, toml::TOML_CONCAT(TOML_TABLE_POLICY, _)::Value>::value, "");
+
+TEST(TablePolicyTest, arena)
+{
+    stringstream ss("a = 1\n[b]\nc = 2\n");
+    toml::ParseResult pr = toml::parse(ss, make_shared<toml::Arena>());
+    ASSERT_TRUE(pr.valid()) << pr.errorReason;
+    EXPECT_EQ(2, pr.value.get<int>("b.c"));
+    EXPECT_NE(nullptr, pr.value.as<toml::Table>().get_allocator().arena());
+}
+
+TEST(TablePolicyTest, builder)
+{
+    vector<pair<string, toml::Value>> children;
+    for (int i = 0; i < 20; ++i)
+        children.emplace_back("key" + to_string(100 + i), toml::Value(i));
+
+    toml::Value v;
+    v.setChildren(children.begin(), children.end());
+    v.emplaceChild("key105", "overwritten");
+
+    EXPECT_EQ(20U, v.size());
+    EXPECT_EQ(3, v.get<int>("key103"));
+    EXPECT_EQ("overwritten", v.get<string>("key105"));
+}
+
+TEST(TablePolicyTest, emplaceChild)
+{
+    const string longString(64, 'x');
+    toml::Value v;
+    for (int i = 0; i < 20; ++i)
+        v.emplaceChild("key" + to_string(100 + i), i);
+
+    // The arguments are not consumed by a lookup which finds the key.
+    string s = longString;
+    toml::Value* replaced = v.emplaceChild("key105", std::move(s));
+    EXPECT_EQ(longString, replaced->as<string>());
+    toml::Value* added = v.emplaceChild("key099", longString);
+    EXPECT_EQ(longString, added->as<string>());
+
+    EXPECT_EQ(21U, v.size());
+    EXPECT_EQ(3, v.get<int>("key103"));
+    EXPECT_EQ(longString, v.get<string>("key105"));
+    EXPECT_EQ(longString, v.get<string>("key099"));
+}
+
+TEST(TablePolicyTest, diff)
+{
+    toml::Value from = parse("b = 1\nz = 2\na = 3\n[t]\nx = 1\n");
+    toml::Value to = parse("c = 1\nz = 2\na = 4\n[t]\ny = 1\n");
+
+    toml::Patch patch = toml::diff(from, to);
+    vector<string> paths;
+    for (const auto& change : patch.changes)
+        paths.push_back(change.pathString());
+    EXPECT_EQ((vector<string>{"a", "b", "c", "t.x", "t.y"}), paths);
+
+    toml::apply(from, patch);
+    EXPECT_EQ(to, from);
+}
+
+TEST(TablePolicyTest, merge)
+{
+    toml::Value v1 = parse("b = 1\nd = 2\n[t]\nx = 1\n");
+    toml::Value v2 = parse("a = 3\nd = 4\ne = 5\n[t]\ny = 2\n");
+
+    EXPECT_TRUE(v1.merge(v2));
+    EXPECT_EQ(parse("a = 3\nb = 1\nd = 4\ne = 5\n[t]\nx = 1\ny = 2\n"), v1);
+
+    toml::Value v3 = parse("c = 6\n[t]\nz = 3\n");
+    EXPECT_TRUE(v1.merge(std::move(v3)));
+    EXPECT_EQ(6, v1.get<int>("c"));
+    EXPECT_EQ(3, v1.get<int>("t.z"));
+    EXPECT_EQ(6U, v1.size());
+}
+
+TEST(TablePolicyTest, mergeFailure)
+{
+    // The conflicting array is found among interleaved keys, with any table policy.
+    toml::Value v1 = parse("b = 1\nd = [1]\nf = 2\n[t]\nx = 1\nz = [1]\n");
+    toml::Value v2 = parse("a = 3\nd = [2]\ne = 5\n[t]\ny = 2\nz = ['x']\n");
+    const toml::Value original = v1;
+
+    toml::MergeOptions options;
+    options.arrayPolicy = toml::ArrayMergePolicy::APPEND;
+    EXPECT_FALSE(v1.merge(v2, options));
+    EXPECT_EQ(original, v1);
+
+    v2.find("t")->set("z", toml::Array());
+    v2.find("t.z")->push(2);
+    EXPECT_TRUE(v1.merge(v2, options));
+    EXPECT_EQ(2U, v1.find("d")->size());
+    EXPECT_EQ(2U, v1.find("t.z")->size());
+}
@@ -0,0 +1,37 @@
+#ifndef TOML_TEST_HELPER_H
+#define TOML_TEST_HELPER_H
+
+// Helpers shared by the tests. Include me after toml.h and gtest.h.
+
+#include <sstream>
+#include <string>
+
+// Parses |s|, and expects that it's a valid document.
+inline toml::Value parse(const std::string& s)
+{
+    std::istringstream ss(s);
+    toml::ParseResult pr = toml::parse(ss);
+    EXPECT_TRUE(pr.valid()) << pr.errorReason;
+    return pr.value;
+}
+
+// A document which has a value of each type, nested tables, a quoted key and an array of tables.
+const char kAppDocument[] =
+    "name = \"app\"\n"
+    "ratio = 0.25\n"
+    "debug = false\n"
+    "started = 2014-03-01T12:34:56Z\n"
+    "[server]\n"
+    "host = \"localhost\"\n"
+    "port = 8080\n"
+    "ports = [80, 443]\n"
+    "[server.tls]\n"
+    "enabled = true\n"
+    "[\"x.y\"]\n"
+    "z = 1\n"
+    "[[hosts]]\n"
+    "name = \"a\"\n"
+    "[[hosts]]\n"
+    "name = \"b\"\n";
+
+#endif // TOML_TEST_HELPER_H
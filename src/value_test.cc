@@ -3,6 +3,7 @@
 #include <gtest/gtest.h>
 
 #include <iostream>
+#include <sstream>
 using namespace std;
 
 TEST(ValueTest, boolean)
@@ -496,3 +497,601 @@ TEST(ValueTest, operatorBox)
     EXPECT_EQ("foobar", v.findChild("foo.bar")->as<std::string>());
     EXPECT_EQ("bar", v["foo"].as<std::string>());
 }
+
+TEST(ValueTest, copyOnWrite)
+{
+    toml::Value v;
+    v.set("a.b", 1);
+    v.set("c.d", 2);
+    v.makeShareable();
+
+    toml::Value copied = v;
+    // The tables are shared.
+    EXPECT_EQ(&v.as<toml::Table>(), &copied.as<toml::Table>());
+
+    copied.set("a.b", 3);
+    EXPECT_EQ(1, v.get<int>("a.b"));
+    EXPECT_EQ(3, copied.get<int>("a.b"));
+
+    // Only the path to the modified value is cloned.
+    EXPECT_NE(&v.as<toml::Table>(), &copied.as<toml::Table>());
+    EXPECT_NE(&v.find("a")->as<toml::Table>(), &copied.find("a")->as<toml::Table>());
+    EXPECT_EQ(&static_cast<const toml::Value&>(v).find("c")->as<toml::Table>(),
+              &static_cast<const toml::Value&>(copied).find("c")->as<toml::Table>());
+
+    EXPECT_TRUE(copied.erase("c.d"));
+    EXPECT_EQ(2, v.get<int>("c.d"));
+    EXPECT_FALSE(copied.has("c.d"));
+}
+
+TEST(ValueTest, copyOnWriteArray)
+{
+    toml::Value v;
+    v.push(1);
+    v.push(2);
+    v.makeShareable();
+
+    toml::Value copied = v;
+    EXPECT_EQ(&v.as<toml::Array>(), &copied.as<toml::Array>());
+
+    copied.push(3);
+    *copied.find(0) = 10;
+    EXPECT_EQ(2U, v.size());
+    EXPECT_EQ(1, v.get<int>(0));
+    EXPECT_EQ(3U, copied.size());
+    EXPECT_EQ(10, copied.get<int>(0));
+}
+
+TEST(ValueTest, copyAfterGettingPointer)
+{
+    toml::Value v;
+    toml::Value* x = v.setChild("x", toml::Table());
+    x->setChild("y", 1);
+
+    // |x| still points into |v|, so the copy must not be affected by it.
+    toml::Value copied = v;
+    x->setChild("y", 2);
+    EXPECT_EQ(2, v.get<int>("x.y"));
+    EXPECT_EQ(1, copied.get<int>("x.y"));
+}
+
+TEST(ValueTest, parsedValueIsShareable)
+{
+    stringstream ss("[a]\nb = 1\n[c]\nd = [1, 2]\n");
+    toml::ParseResult pr = toml::parse(ss);
+    ASSERT_TRUE(pr.valid());
+
+    toml::Value copied = pr.value;
+    EXPECT_EQ(&pr.value.as<toml::Table>(), &copied.as<toml::Table>());
+}
+
+TEST(ValueTest, emplaceChild)
+{
+    toml::Value v;
+    toml::Value* array = v.emplaceChild("array", toml::Array());
+    array->emplaceBack(1);
+    array->emplaceBack(2);
+    v.emplaceChild("string", "foo");
+    v.emplaceChild("string", std::string("bar"));
+
+    EXPECT_EQ(2U, v.find("array")->size());
+    EXPECT_EQ(2, v.find("array")->get<int>(1));
+    EXPECT_EQ("bar", v.get<string>("string"));
+}
+
+TEST(ValueTest, reserve)
+{
+    toml::Value v;
+    v.reserve(100);
+    EXPECT_TRUE(v.is<toml::Array>());
+    EXPECT_LE(100U, v.as<toml::Array>().capacity());
+
+    toml::Value* first = v.emplaceBack(0);
+    for (int i = 1; i < 100; ++i)
+        v.emplaceBack(i);
+    // No reallocation happened.
+    EXPECT_EQ(first, v.find(0));
+
+    toml::Value t((toml::Table()));
+    EXPECT_THROW(t.reserve(1), std::runtime_error);
+}
+
+TEST(ValueTest, setChildren)
+{
+    vector<pair<string, toml::Value>> children;
+    for (int i = 0; i < 10; ++i)
+        children.emplace_back("key" + to_string(i), toml::Value(i));
+
+    toml::Value v;
+    v.setChild("key3", "will be overwritten");
+    v.setChildren(make_move_iterator(children.begin()), make_move_iterator(children.end()));
+
+    EXPECT_EQ(10U, v.size());
+    for (int i = 0; i < 10; ++i)
+        EXPECT_EQ(i, v.get<int>("key" + to_string(i)));
+}
+
+TEST(ValueTest, mergeRvalue)
+{
+    toml::Value v1;
+    v1.set("a.b", 1);
+    v1.set("c", 2);
+
+    toml::Value v2;
+    v2.set("a.d", 3);
+    v2.set("c", toml::Array());
+    v2.find("c")->push(4);
+
+    EXPECT_TRUE(v1.merge(std::move(v2)));
+    EXPECT_EQ(1, v1.get<int>("a.b"));
+    EXPECT_EQ(3, v1.get<int>("a.d"));
+    EXPECT_EQ(4, v1.find("c")->get<int>(0));
+}
+
+TEST(ValueTest, copyTo)
+{
+    toml::Value v((toml::Array()));
+    v.push(1);
+    v.push(2);
+    v.push(3);
+
+    vector<int32_t> ints;
+    v.copyTo<int32_t>(back_inserter(ints));
+    EXPECT_EQ((vector<int32_t>{1, 2, 3}), ints);
+
+    toml::Value d((toml::Array()));
+    d.push(0.5);
+    d.push(1.5);
+    float fs[2];
+    EXPECT_EQ(fs + 2, d.copyTo<float>(fs));
+    EXPECT_EQ(0.5f, fs[0]);
+    EXPECT_EQ(1.5f, fs[1]);
+
+    EXPECT_THROW(v.copyTo<double>(fs), std::runtime_error);
+    EXPECT_THROW(toml::Value(1).copyTo<int>(fs), std::runtime_error);
+}
+
+TEST(ValueTest, intoVector)
+{
+    toml::Value v((toml::Array()));
+    for (int i = 0; i < 100; ++i)
+        v.push(i);
+
+    vector<int> out;
+    out.reserve(200);
+    const int* data = out.data();
+    v.into(&out);
+    EXPECT_EQ(100U, out.size());
+    EXPECT_EQ(99, out[99]);
+    EXPECT_EQ(data, out.data());
+
+    // Packed arrays take the typed loop.
+    v.pack();
+    out.assign(5, -1);
+    v.into(&out);
+    EXPECT_EQ(100U, out.size());
+    EXPECT_EQ(99, out[99]);
+    EXPECT_EQ(data, out.data());
+    EXPECT_EQ(out, v.as<vector<int>>());
+}
+
+TEST(ValueTest, intoBuffer)
+{
+    toml::Value v((toml::Array()));
+    v.push(1.0);
+    v.push(2.0);
+
+    double buf[3] = { 0, 0, 0 };
+    EXPECT_EQ(2U, v.into(buf, 3));
+    EXPECT_EQ(1.0, buf[0]);
+    EXPECT_EQ(2.0, buf[1]);
+
+    double small[1] = { 0 };
+    EXPECT_THROW(v.into(small, 1), std::runtime_error);
+    EXPECT_EQ(0, small[0]);
+}
+
+TEST(ValueTest, intoNested)
+{
+    toml::Value v((toml::Array()));
+    v.push(toml::Array());
+    v.find(0)->push(1);
+    v.find(0)->push(2);
+    v.push(toml::Array());
+    v.find(1)->push(3);
+
+    vector<vector<int>> out(1);
+    out[0].reserve(10);
+    const int* data = out[0].data();
+    v.into(&out);
+    EXPECT_EQ((vector<vector<int>>{{1, 2}, {3}}), out);
+    EXPECT_EQ(data, out[0].data());
+
+    EXPECT_EQ(out, v.as<vector<vector<int>>>());
+}
+
+TEST(ValueTest, intoRangeCheck)
+{
+    toml::Value v((toml::Array()));
+    v.push(1);
+    v.push(300);
+
+    vector<int16_t> shorts;
+    v.into(&shorts);
+    EXPECT_EQ((vector<int16_t>{1, 300}), shorts);
+
+    vector<int8_t> bytes;
+    EXPECT_THROW(v.into(&bytes), std::runtime_error);
+    v.pack();
+    bytes.assign(1, 7);
+    EXPECT_THROW(v.into(&bytes), std::runtime_error);
+    EXPECT_EQ((vector<int8_t>{7}), bytes);
+
+    // A single value is truncated as before; only the bulk conversions check the range.
+    const int64_t big = (static_cast<int64_t>(1) << 32) + 5;
+    EXPECT_EQ(5, toml::Value(big).as<int>());
+    toml::Value bigs((toml::Array()));
+    bigs.push(big);
+    EXPECT_THROW(bigs.as<vector<int>>(), std::runtime_error);
+
+    toml::Value negative((toml::Array()));
+    negative.push(-1);
+    vector<uint32_t> unsigneds;
+    EXPECT_THROW(negative.into(&unsigneds), std::runtime_error);
+
+    toml::Value d((toml::Array()));
+    d.push(1e300);
+    vector<float> floats;
+    EXPECT_THROW(d.into(&floats), std::runtime_error);
+    EXPECT_THROW(d.find(0)->as<float>(), std::runtime_error);
+
+    // A type mismatch in the middle of an array is detected too.
+    toml::Array mixed;
+    mixed.push_back(toml::Value(1));
+    mixed.push_back(toml::Value("2"));
+    vector<int> ints;
+    EXPECT_THROW(toml::Value(mixed).into(&ints), std::runtime_error);
+}
+
+TEST(ValueTest, hash)
+{
+    toml::Value v1;
+    v1.set("a", 1);
+    v1.set("b.c", "foo");
+    v1.set("d", toml::Array());
+    v1.find("d")->push(0.0);
+    v1.find("d")->push(1.5);
+
+    toml::Value v2;
+    v2.set("d", toml::Array());
+    v2.find("d")->push(-0.0);
+    v2.find("d")->push(1.5);
+    v2.set("b.c", "foo");
+    v2.set("a", 1);
+
+    EXPECT_EQ(v1, v2);
+    EXPECT_EQ(v1.hash(), v2.hash());
+
+    // Packing doesn't change the hash.
+    toml::Value packed = v1;
+    packed.pack();
+    EXPECT_TRUE(packed.find("d")->isPacked());
+    EXPECT_EQ(v1.hash(), packed.hash());
+
+    toml::Value strings((toml::Array()));
+    strings.push("");
+    strings.push("foo");
+    strings.push("foobar");
+    toml::Value packedStrings = strings;
+    packedStrings.pack();
+    EXPECT_TRUE(packedStrings.isPacked());
+    EXPECT_EQ(strings.hash(), packedStrings.hash());
+
+    EXPECT_NE(toml::Value(1).hash(), toml::Value(1.0).hash());
+    EXPECT_NE(toml::Value(1).hash(), toml::Value(2).hash());
+    EXPECT_NE(toml::Value("1").hash(), toml::Value(1).hash());
+}
+
+TEST(ValueTest, hashIsUpdatedAfterModification)
+{
+    istringstream ss("[a]\nb = [1, 2]\n");
+    toml::ParseResult pr = toml::parse(ss);
+    ASSERT_TRUE(pr.valid());
+
+    toml::Value v = pr.value;
+    uint64_t h = v.hash();
+    EXPECT_EQ(h, pr.value.hash());
+
+    v.find("a.b")->push(3);
+    EXPECT_NE(h, v.hash());
+    EXPECT_NE(v, pr.value);
+    EXPECT_EQ(h, pr.value.hash());
+
+    // A leaked pointer can modify the value at any time, so the hash must follow it.
+    toml::Value* b = v.find("a.b");
+    uint64_t h2 = v.hash();
+    b->push(4);
+    EXPECT_NE(h2, v.hash());
+}
+
+TEST(ValueTest, hashOfColumnar)
+{
+    istringstream ss(
+        "[[x]]\n"
+        "a = 1\n"
+        "b = [\"p\", \"q\"]\n"
+        "[[x]]\n"
+        "a = 2\n"
+        "b = [\"r\"]\n");
+    toml::ParseOptions options;
+    options.packArrays = true;
+    toml::ParseResult pr = toml::parse(ss, options);
+    ASSERT_TRUE(pr.valid());
+    ASSERT_TRUE(pr.value.find("x")->isColumnar());
+
+    toml::Value plain = pr.value;
+    plain.find("x")->push(toml::Table());
+    plain.find("x")->find(2)->set("a", 3);
+    plain.find("x")->find(2)->set("b", toml::Array());
+    EXPECT_NE(plain.hash(), pr.value.hash());
+
+    // Getting a non-const pointer unpacks the array.
+    toml::Value unpacked = pr.value;
+    unpacked.find("x")->find(0);
+    EXPECT_FALSE(unpacked.find("x")->isPacked());
+    EXPECT_EQ(unpacked, pr.value);
+    EXPECT_EQ(unpacked.hash(), pr.value.hash());
+}
+
+TEST(ValueTest, deduplicate)
+{
+    istringstream ss(
+        "[a]\n"
+        "retry = { count = 3, backoff = [1, 2, 4] }\n"
+        "[b]\n"
+        "retry = { count = 3, backoff = [1, 2, 4] }\n"
+        "[c]\n"
+        "retry = { count = 4, backoff = [1, 2, 4] }\n");
+    toml::ParseResult pr = toml::parse(ss);
+    ASSERT_TRUE(pr.valid());
+
+    toml::Value v = pr.value;
+    const toml::Table* a = &v.get<toml::Table>("a.retry");
+    const toml::Table* b = &v.get<toml::Table>("b.retry");
+    EXPECT_NE(a, b);
+
+    toml::deduplicate(v);
+    EXPECT_EQ(pr.value, v);
+    EXPECT_EQ(&v.get<toml::Table>("a.retry"), &v.get<toml::Table>("b.retry"));
+    EXPECT_NE(&v.get<toml::Table>("a.retry"), &v.get<toml::Table>("c.retry"));
+    EXPECT_EQ(&v.get<toml::Array>("a.retry.backoff"), &v.get<toml::Array>("c.retry.backoff"));
+
+    // Shared subtrees are still copy-on-write.
+    v.find("a.retry")->set("count", 5);
+    EXPECT_EQ(5, v.get<int>("a.retry.count"));
+    EXPECT_EQ(3, v.get<int>("b.retry.count"));
+}
+
+TEST(ValueTest, mergeKeysWithDots)
+{
+    toml::Value v1;
+    v1.setChild("a.b", 1);
+    v1.set("a.b", 2);
+
+    toml::Value v2;
+    v2.setChild("a.b", 3);
+    v2.setChild("\"q\"", 4);
+
+    EXPECT_TRUE(v1.merge(v2));
+    EXPECT_EQ(3, v1.findChild("a.b")->as<int>());
+    EXPECT_EQ(2, v1.get<int>("a.b"));
+    EXPECT_EQ(4, v1.findChild("\"q\"")->as<int>());
+    EXPECT_EQ(3U, v1.size());
+}
+
+TEST(ValueTest, mergeMovesSubtrees)
+{
+    istringstream ss("[a]\nb = 1\n[c]\nd = [1, 2]\n");
+    toml::ParseResult pr = toml::parse(ss);
+    ASSERT_TRUE(pr.valid());
+    const toml::Table* c = &pr.value.get<toml::Table>("c");
+
+    toml::Value v;
+    v.set("a.x", 1);
+    EXPECT_TRUE(v.merge(std::move(pr.value)));
+    EXPECT_EQ(1, v.get<int>("a.b"));
+    EXPECT_EQ(1, v.get<int>("a.x"));
+    EXPECT_EQ(c, &v.get<toml::Table>("c"));
+}
+
+TEST(ValueTest, mergeArrays)
+{
+    toml::Value base;
+    base.set("a", toml::Array());
+    base.find("a")->push(1);
+    base.set("b", 1);
+
+    toml::Value overlay;
+    overlay.set("a", toml::Array());
+    overlay.find("a")->push(2);
+
+    toml::Value replaced = base;
+    EXPECT_TRUE(replaced.merge(overlay));
+    EXPECT_EQ((vector<int>{2}), replaced.get<vector<int>>("a"));
+
+    toml::MergeOptions options;
+    options.arrayPolicy = toml::ArrayMergePolicy::APPEND;
+    toml::Value appended = base;
+    EXPECT_TRUE(appended.merge(overlay, options));
+    EXPECT_EQ((vector<int>{1, 2}), appended.get<vector<int>>("a"));
+    EXPECT_EQ((vector<int>{1}), base.get<vector<int>>("a"));
+}
+
+TEST(ValueTest, mergeArraysByKey)
+{
+    istringstream ss1(
+        "[[hosts]]\n"
+        "name = \"a\"\n"
+        "port = 80\n"
+        "[[hosts]]\n"
+        "name = \"b\"\n"
+        "port = 81\n");
+    istringstream ss2(
+        "[[hosts]]\n"
+        "name = \"b\"\n"
+        "port = 8081\n"
+        "tls = true\n"
+        "[[hosts]]\n"
+        "name = \"c\"\n"
+        "port = 82\n"
+        "[[hosts]]\n"
+        "port = 83\n");
+    toml::Value v1 = toml::parse(ss1).value;
+    toml::Value v2 = toml::parse(ss2).value;
+
+    toml::MergeOptions options;
+    options.arrayPolicy = toml::ArrayMergePolicy::BY_KEY;
+    options.arrayKey = "name";
+    EXPECT_TRUE(v1.merge(v2, options));
+
+    const toml::Array& hosts = v1.get<toml::Array>("hosts");
+    ASSERT_EQ(4U, hosts.size());
+    EXPECT_EQ(80, hosts[0].get<int>("port"));
+    EXPECT_EQ(8081, hosts[1].get<int>("port"));
+    EXPECT_TRUE(hosts[1].get<bool>("tls"));
+    EXPECT_EQ("c", hosts[2].get<string>("name"));
+    EXPECT_EQ(83, hosts[3].get<int>("port"));
+}
+
+TEST(ValueTest, mergeFailureKeepsValue)
+{
+    toml::Value v1;
+    v1.set("a.b", 1);
+    v1.set("z", toml::Array());
+    v1.find("z")->push(1);
+
+    toml::Value v2;
+    v2.set("a.c", 2);
+    v2.set("z", toml::Array());
+    v2.find("z")->push("x");
+
+    toml::Value original = v1;
+    toml::MergeOptions options;
+    options.arrayPolicy = toml::ArrayMergePolicy::APPEND;
+    EXPECT_FALSE(v1.merge(v2, options));
+    EXPECT_EQ(original, v1);
+    EXPECT_FALSE(v1.has("a.c"));
+
+    EXPECT_FALSE(v1.merge(toml::Value(1)));
+    EXPECT_FALSE(toml::Value(1).merge(v1));
+}
+
+namespace {
+
+struct TypeNameVisitor {
+    string operator()(std::nullptr_t) const { return "null"; }
+    string operator()(bool) const { return "bool"; }
+    string operator()(int64_t x) const { return "int:" + to_string(x); }
+    string operator()(double) const { return "double"; }
+    string operator()(const string& s) const { return "string:" + s; }
+    string operator()(const toml::Time&) const { return "time"; }
+    string operator()(const toml::Array& a) const { return "array:" + to_string(a.size()); }
+    string operator()(const toml::Table& t) const { return "table:" + to_string(t.size()); }
+};
+
+struct CountingVisitor {
+    template<typename T> void operator()(const T&) { ++others; }
+    void operator()(int64_t x) { sum += x; }
+    void operator()(const string&) { ++strings; }
+
+    int64_t sum = 0;
+    int strings = 0;
+    int others = 0;
+};
+
+struct PackedCountingVisitor : public CountingVisitor {
+    using CountingVisitor::operator();
+    void operator()(const toml::Array&) { ++arrays; }
+    void operator()(const toml::PackedArrayView& view) { packedSize += view.array.size(); }
+    void operator()(bool b) { bools += b; }
+
+    int arrays = 0;
+    size_t packedSize = 0;
+    int bools = 0;
+};
+
+struct ArrayVisitor {
+    void operator()(std::nullptr_t) {}
+    void operator()(bool) {}
+    void operator()(int64_t x) { sum += x; }
+    void operator()(double) {}
+    void operator()(const string&) {}
+    void operator()(const toml::Time&) {}
+    void operator()(const toml::Array& a) { arraySize += a.size(); }
+    void operator()(const toml::Table&) {}
+
+    int64_t sum = 0;
+    size_t arraySize = 0;
+};
+
+} // namespace anonymous
+
+TEST(ValueTest, visit)
+{
+    EXPECT_EQ("null", toml::visit(TypeNameVisitor(), toml::Value()));
+    EXPECT_EQ("bool", toml::visit(TypeNameVisitor(), toml::Value(true)));
+    EXPECT_EQ("int:3", toml::visit(TypeNameVisitor(), toml::Value(3)));
+    EXPECT_EQ("double", toml::visit(TypeNameVisitor(), toml::Value(1.5)));
+    EXPECT_EQ("string:foo", toml::visit(TypeNameVisitor(), toml::Value("foo")));
+    EXPECT_EQ("time", toml::visit(TypeNameVisitor(), toml::Value(std::chrono::system_clock::now())));
+    EXPECT_EQ("array:0", toml::visit(TypeNameVisitor(), toml::Value(toml::Array())));
+    EXPECT_EQ("table:0", toml::visit(TypeNameVisitor(), toml::Value(toml::Table())));
+
+    toml::Value packed((toml::Array()));
+    packed.push(1);
+    packed.push(2);
+    packed.pack();
+    EXPECT_EQ("array:2", toml::visit(TypeNameVisitor(), packed));
+}
+
+TEST(ValueTest, visitRecursive)
+{
+    istringstream ss(
+        "a = 1\n"
+        "b = [2, 3]\n"
+        "c = \"x\"\n"
+        "[d]\n"
+        "e = 4\n"
+        "f = [\"y\", \"z\"]\n"
+        "g = true\n");
+    toml::ParseResult pr = toml::parse(ss);
+    ASSERT_TRUE(pr.valid());
+
+    CountingVisitor visitor;
+    toml::visitRecursive(visitor, pr.value);
+    EXPECT_EQ(10, visitor.sum);
+    EXPECT_EQ(3, visitor.strings);
+    // The root table, d, b, f and g.
+    EXPECT_EQ(5, visitor.others);
+
+    // The elements of packed arrays are read from the typed storage.
+    toml::Value packed = pr.value;
+    packed.set("h", toml::Array());
+    packed.find("h")->push(true);
+    packed.find("h")->push(true);
+    packed.pack();
+    PackedCountingVisitor packedVisitor;
+    toml::visitRecursive(packedVisitor, packed);
+    EXPECT_EQ(10, packedVisitor.sum);
+    EXPECT_EQ(3, packedVisitor.strings);
+    EXPECT_EQ(0, packedVisitor.arrays);
+    EXPECT_EQ(6U, packedVisitor.packedSize);
+    // g and the two in h.
+    EXPECT_EQ(3, packedVisitor.bools);
+
+    // A visitor which doesn't take PackedArrayView gets the array as Array.
+    ArrayVisitor arrayVisitor;
+    toml::visitRecursive(arrayVisitor, packed);
+    EXPECT_EQ(10, arrayVisitor.sum);
+    EXPECT_EQ(6U, arrayVisitor.arraySize);
+}
@@ -0,0 +1,277 @@
+#include "toml/watcher.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+using namespace std;
+
+namespace {
+
+class WatcherTest : public testing::Test {
+protected:
+    void SetUp() override
+    {
+        char pattern[] = "/tmp/toml_watcher_test_XXXXXX";
+        ASSERT_TRUE(mkdtemp(pattern) != nullptr);
+        dir_ = pattern;
+    }
+
+    void TearDown() override
+    {
+        string command = "rm -rf " + dir_;
+        EXPECT_EQ(0, system(command.c_str()));
+    }
+
+    string path(const string& name) const { return dir_ + "/" + name; }
+
+    void write(const string& name, const string& content)
+    {
+        ofstream ofs(path(name));
+        ofs << content;
+    }
+
+    // Writes to a temporary file, and renames it as editors do.
+    void replace(const string& name, const string& content)
+    {
+        write(".tmp", content);
+        ASSERT_EQ(0, rename(path(".tmp").c_str(), path(name).c_str()));
+    }
+
+    toml::Watcher::Callback callback()
+    {
+        return [this](const toml::WatchEvent& event) {
+            lock_guard<mutex> lock(mu_);
+            events_.push_back(event);
+            cv_.notify_all();
+        };
+    }
+
+    // Waits until |n| events have been received.
+    bool waitEvents(size_t n)
+    {
+        unique_lock<mutex> lock(mu_);
+        return cv_.wait_for(lock, chrono::seconds(5), [&]() { return events_.size() >= n; });
+    }
+
+    size_t eventCount()
+    {
+        lock_guard<mutex> lock(mu_);
+        return events_.size();
+    }
+
+    toml::WatchEvent event(size_t i)
+    {
+        lock_guard<mutex> lock(mu_);
+        return events_[i];
+    }
+
+    toml::WatchOptions options() const
+    {
+        toml::WatchOptions options;
+        options.debounce = chrono::milliseconds(50);
+        return options;
+    }
+
+    string dir_;
+    mutex mu_;
+    condition_variable cv_;
+    vector<toml::WatchEvent> events_;
+};
+
+} // namespace anonymous
+
+TEST_F(WatcherTest, file)
+{
+    write("config.toml", "port = 80\n");
+    toml::WatchOptions opts = options();
+    opts.diff = true;
+    toml::Watcher watcher(path("config.toml"), callback(), opts);
+    watcher.start();
+
+    ASSERT_TRUE(waitEvents(1));
+    EXPECT_TRUE(event(0).valid());
+    EXPECT_EQ(80, event(0).value.get<int>("port"));
+    ASSERT_EQ(1U, event(0).patch.changes.size());
+    EXPECT_EQ(toml::Patch::Op::ADD, event(0).patch.changes[0].op);
+
+    write("config.toml", "port = 8080\n");
+    ASSERT_TRUE(waitEvents(2));
+    EXPECT_EQ(8080, event(1).value.get<int>("port"));
+    ASSERT_EQ(1U, event(1).patch.changes.size());
+    EXPECT_EQ("port", event(1).patch.changes[0].pathString());
+    EXPECT_EQ(toml::Patch::Op::CHANGE, event(1).patch.changes[0].op);
+
+    // Saved by a rename.
+    replace("config.toml", "port = 443\n");
+    ASSERT_TRUE(waitEvents(3));
+    EXPECT_EQ(443, event(2).value.get<int>("port"));
+
+    // Other files are ignored.
+    write("other.toml", "x = 1\n");
+    this_thread::sleep_for(chrono::milliseconds(300));
+    EXPECT_EQ(3U, eventCount());
+    EXPECT_EQ(3U, watcher.parseCount());
+}
+
+TEST_F(WatcherTest, touchDoesNotReparse)
+{
+    write("config.toml", "port = 80\n");
+    toml::Watcher watcher(path("config.toml"), callback(), options());
+    watcher.start();
+    ASSERT_TRUE(waitEvents(1));
+
+    ASSERT_EQ(0, utime(path("config.toml").c_str(), nullptr));
+    write("config.toml", "port = 80\n");
+    this_thread::sleep_for(chrono::milliseconds(300));
+
+    EXPECT_EQ(1U, eventCount());
+    EXPECT_EQ(1U, watcher.parseCount());
+}
+
+TEST_F(WatcherTest, debounce)
+{
+    write("config.toml", "n = 0\n");
+    toml::WatchOptions opts = options();
+    opts.debounce = chrono::milliseconds(300);
+    toml::Watcher watcher(path("config.toml"), callback(), opts);
+    watcher.start();
+    ASSERT_TRUE(waitEvents(1));
+
+    for (int i = 1; i <= 10; ++i)
+        write("config.toml", "n = " + to_string(i) + "\n");
+    ASSERT_TRUE(waitEvents(2));
+    this_thread::sleep_for(chrono::milliseconds(500));
+
+    EXPECT_EQ(2U, eventCount());
+    EXPECT_EQ(10, event(1).value.get<int>("n"));
+}
+
+TEST_F(WatcherTest, maxDelay)
+{
+    write("config.toml", "n = 0\n");
+    toml::WatchOptions opts = options();
+    opts.debounce = chrono::milliseconds(200);
+    opts.maxDelay = chrono::milliseconds(300);
+    toml::Watcher watcher(path("config.toml"), callback(), opts);
+    watcher.start();
+    ASSERT_TRUE(waitEvents(1));
+
+    // Writes which never pause for the debounce still reload after |maxDelay|.
+    const auto start = chrono::steady_clock::now();
+    for (int i = 1; chrono::steady_clock::now() - start < chrono::milliseconds(1500); ++i) {
+        write("config.toml", "n = " + to_string(i) + "\n");
+        this_thread::sleep_for(chrono::milliseconds(20));
+    }
+    EXPECT_LE(2U, eventCount());
+}
+
+TEST_F(WatcherTest, stopFromCallback)
+{
+    write("config.toml", "port = 80\n");
+    toml::Watcher* self = nullptr;
+    int calls = 0;
+    toml::Watcher watcher(path("config.toml"), [&](const toml::WatchEvent& event) {
+        ++calls;
+        self->stop();
+        callback()(event);
+    }, options());
+    self = &watcher;
+    watcher.start();
+    ASSERT_TRUE(waitEvents(1));
+
+    // The thread has exited after the callback, so a change is not seen.
+    write("config.toml", "port = 8080\n");
+    this_thread::sleep_for(chrono::milliseconds(300));
+    EXPECT_EQ(1, calls);
+    watcher.stop();
+}
+
+TEST_F(WatcherTest, directory)
+{
+    write("10-base.toml", "[server]\nhost = \"localhost\"\nport = 80\n");
+    write("20-override.toml", "[server]\nport = 8080\n");
+    write("ignored.txt", "not toml");
+
+    toml::Watcher watcher(dir_, callback(), options());
+    watcher.start();
+
+    ASSERT_TRUE(waitEvents(1));
+    ASSERT_TRUE(event(0).valid()) << event(0).errorReason;
+    EXPECT_EQ("localhost", event(0).value.get<string>("server.host"));
+    EXPECT_EQ(8080, event(0).value.get<int>("server.port"));
+
+    write("30-more.toml", "[server]\nhost = \"example.com\"\n");
+    ASSERT_TRUE(waitEvents(2));
+    EXPECT_EQ("example.com", event(1).value.get<string>("server.host"));
+
+    ASSERT_EQ(0, unlink(path("20-override.toml").c_str()));
+    ASSERT_TRUE(waitEvents(3));
+    EXPECT_EQ(80, event(2).value.get<int>("server.port"));
+
+    write("ignored.txt", "still not toml");
+    this_thread::sleep_for(chrono::milliseconds(300));
+    EXPECT_EQ(3U, eventCount());
+}
+
+TEST_F(WatcherTest, symlinkSwap)
+{
+    // The layout of a Kubernetes ConfigMap volume: config.toml -> ..data/config.toml -> ..v1/config.toml
+    ASSERT_EQ(0, mkdir(path("..v1").c_str(), 0755));
+    write("..v1/config.toml", "port = 80\n");
+    ASSERT_EQ(0, symlink("..v1", path("..data").c_str()));
+    ASSERT_EQ(0, symlink("..data/config.toml", path("config.toml").c_str()));
+
+    toml::Watcher watcher(path("config.toml"), callback(), options());
+    watcher.start();
+    ASSERT_TRUE(waitEvents(1));
+    EXPECT_EQ(80, event(0).value.get<int>("port"));
+
+    // A new version is published by renaming a new link over "..data".
+    ASSERT_EQ(0, mkdir(path("..v2").c_str(), 0755));
+    write("..v2/config.toml", "port = 8080\n");
+    ASSERT_EQ(0, symlink("..v2", path("..data_tmp").c_str()));
+    ASSERT_EQ(0, rename(path("..data_tmp").c_str(), path("..data").c_str()));
+    ASSERT_TRUE(waitEvents(2));
+    EXPECT_EQ(8080, event(1).value.get<int>("port"));
+    ASSERT_EQ(0, system(("rm -rf " + path("..v1")).c_str()));
+
+    // The file the link refers to now is watched.
+    write("..v2/config.toml", "port = 443\n");
+    ASSERT_TRUE(waitEvents(3));
+    EXPECT_EQ(443, event(2).value.get<int>("port"));
+}
+
+TEST_F(WatcherTest, parseError)
+{
+    write("config.toml", "port = 80\n");
+    toml::Watcher watcher(path("config.toml"), callback(), options());
+    watcher.start();
+    ASSERT_TRUE(waitEvents(1));
+
+    write("config.toml", "port = \n");
+    ASSERT_TRUE(waitEvents(2));
+    EXPECT_FALSE(event(1).valid());
+    EXPECT_NE(string::npos, event(1).errorReason.find("config.toml"));
+
+    write("config.toml", "port = 81\n");
+    ASSERT_TRUE(waitEvents(3));
+    EXPECT_EQ(81, event(2).value.get<int>("port"));
+}
+
+TEST_F(WatcherTest, startFailure)
+{
+    toml::Watcher watcher(path("nothing.toml"), callback(), options());
+    EXPECT_THROW(watcher.start(), std::runtime_error);
+    watcher.stop();
+}